@@ -222,6 +222,54 @@ void bal_emit_movn(bal_assembler_t     *assembler,
                    uint16_t             imm,
                    uint8_t              shift);
 
+/// Emits a `B` (Branch) instruction to the address `offset` bytes away from
+/// the branch.
+///
+/// # Safety
+///
+/// * `offset` must be a multiple of 4 within +/-128 MiB.
+///
+/// # Errors
+///
+/// Modifies `assembler->status` to the following if an error occurs:
+///
+/// * [`BAL_ERROR_INSTRUCTION_OVERFLOW`] if `assembler->offset >= assembler->capacity`.
+/// * [`BAL_ERROR_INVALID_ARGUMENT`] if `offset` is out of range.
+void bal_emit_b(bal_assembler_t *assembler, int32_t offset);
+
+/// Emits a `BL` (Branch with Link) instruction. Like [`bal_emit_b`], but the
+/// address of the next instruction is written to X30.
+///
+/// # Errors
+///
+/// Same as [`bal_emit_b`].
+void bal_emit_bl(bal_assembler_t *assembler, int32_t offset);
+
+/// Emits a `BR` (Branch to Register) instruction.
+///
+/// # Errors
+///
+/// Modifies `assembler->status` to the following if an error occurs:
+///
+/// * [`BAL_ERROR_INSTRUCTION_OVERFLOW`] if `assembler->offset >= assembler->capacity`.
+/// * [`BAL_ERROR_INVALID_ARGUMENT`] if `rn` is out of range.
+void bal_emit_br(bal_assembler_t *assembler, bal_register_index_t rn);
+
+/// Emits a `BLR` (Branch with Link to Register) instruction.
+///
+/// # Errors
+///
+/// Same as [`bal_emit_br`].
+void bal_emit_blr(bal_assembler_t *assembler, bal_register_index_t rn);
+
+/// Emits a `RET` (Return from Subroutine) instruction that branches to `rn`,
+/// usually X30.
+///
+/// # Errors
+///
+/// Same as [`bal_emit_br`].
+void bal_emit_ret(bal_assembler_t *assembler, bal_register_index_t rn);
+
 #endif /* BALLISTIC_ASSEMBLER_H */
 
 /*** end of file ***/
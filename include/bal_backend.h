@@ -0,0 +1,315 @@
+/** @file bal_backend.h
+ *
+ * @brief Tier 1 code generation from the IR to host machine code.
+ */
+
+#ifndef BALLISTIC_BACKEND_H
+#define BALLISTIC_BACKEND_H
+
+#include "bal_attributes.h"
+#include "bal_code_buffer.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include "bal_fastmem.h"
+#include "bal_register_allocator.h"
+#include "bal_types.h"
+#include "bal_vcpu.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The signature of a compiled unit.
+///
+/// `vcpu` holds the guest registers and the return stack buffer. The unit
+/// returns the guest address of the next unit to run.
+typedef uint64_t (*bal_unit_function_t)(bal_vcpu_t *vcpu);
+
+/// The most entries an inline cache can have.
+#define BAL_INLINE_CACHE_MAX_ENTRIES 4U
+
+/// The guest target of an unfilled inline cache entry. Never a valid
+/// instruction address.
+#define BAL_LINK_TARGET_NONE UINT64_MAX
+
+/// The host register compiled x86-64 code keeps the fastmem base address in,
+/// `R14`. Must be pinned with [`bal_register_class_pin`] when
+/// `options->fastmem` is set.
+#define BAL_FASTMEM_BASE_REGISTER_X86_64 14U
+
+/// The kinds of patchable sites a unit can contain.
+typedef enum
+{
+    /// The 32-bit displacement of the `JMP` taken by a direct exit, or by a
+    /// conditional exit when the branch is taken.
+    BAL_LINK_KIND_JUMP,
+
+    /// The 64-bit host code pointer a call pushes onto the return stack
+    /// buffer next to its return address.
+    BAL_LINK_KIND_RETURN_ADDRESS,
+
+    /// The 32-bit displacement of the `JMP` taken by a conditional exit when
+    /// the branch is not taken.
+    BAL_LINK_KIND_NOT_TAKEN,
+
+    /// The 32-bit displacement of the `JMP` taken when an indirect exit hits
+    /// the first inline cache entry. Entry `i` has kind
+    /// `BAL_LINK_KIND_INLINE_CACHE + i`.
+    BAL_LINK_KIND_INLINE_CACHE,
+
+    BAL_LINK_KIND_COUNT = BAL_LINK_KIND_INLINE_CACHE + BAL_INLINE_CACHE_MAX_ENTRIES,
+} bal_link_kind_t;
+
+/// The most position dependent fields recorded for one unit.
+#define BAL_MAX_RELOCATIONS 256U
+
+/// The kinds of position dependent fields in a compiled unit. See
+/// [`bal_backend_load_x86_64`].
+typedef enum
+{
+    /// The 64-bit address of [`bal_tlb_load_slow`].
+    BAL_RELOCATION_LOAD_HELPER,
+
+    /// The 64-bit address of [`bal_tlb_store_slow`].
+    BAL_RELOCATION_STORE_HELPER,
+
+    /// The 64-bit address of [`bal_tlb_atomic_slow`].
+    BAL_RELOCATION_ATOMIC_HELPER,
+
+    /// The 64-bit address of [`bal_guest_state_condition_holds`].
+    BAL_RELOCATION_CONDITION_HELPER,
+
+    /// The 64-bit base address of `options->fastmem`.
+    BAL_RELOCATION_FASTMEM_BASE,
+
+    /// The 64-bit address `options->execution_counter`.
+    BAL_RELOCATION_EXECUTION_COUNTER,
+
+    /// The 32-bit `options->unit_id`.
+    BAL_RELOCATION_UNIT_ID,
+
+    /// The 32-bit displacement of a branch to `target`, relative to the end
+    /// of the field.
+    BAL_RELOCATION_BRANCH,
+
+    /// A fastmem access at `offset` whose slow path starts at `target`.
+    /// Nothing is patched, the site is registered with `options->fastmem`.
+    BAL_RELOCATION_FASTMEM_SITE,
+
+    BAL_RELOCATION_KIND_COUNT,
+} bal_relocation_kind_t;
+
+/// A position dependent field of a compiled unit. Positions are offsets
+/// from the start of the unit that continue into its cold code at the size
+/// of the unit.
+typedef struct
+{
+    /// A [`bal_relocation_kind_t`], stored with a fixed width.
+    uint32_t kind;
+
+    /// The position of the field.
+    uint32_t offset;
+
+    /// The position a branch or fastmem site refers to, or 0.
+    uint32_t target;
+} bal_relocation_t;
+
+/// Per unit code generation settings.
+typedef struct
+{
+    /// Written to [`bal_vcpu_t`]`.exit_unit` when an indirect exit misses
+    /// every inline cache entry.
+    uint32_t unit_id;
+
+    /// The number of inline cache entries emitted for `BR` and `BLR`, up to
+    /// [`BAL_INLINE_CACHE_MAX_ENTRIES`]. 0 disables inline caching.
+    uint32_t inline_cache_entries;
+
+    /// The execution counter decremented every time the body of the unit is
+    /// entered, or `NULL` for none. Must outlive the unit.
+    int32_t *execution_counter;
+
+    /// Receives the code of paths expected to be rare, such as inline cache
+    /// misses, or `NULL` to emit it after the unit. Must be in the same
+    /// reservation as the code buffer of the unit so every branch between
+    /// the two reaches.
+    bal_code_buffer_t *cold_code_buffer;
+
+    /// Accesses guest memory directly in this region instead of probing the
+    /// TLB, or `NULL` for none. Every access is registered as a site of the
+    /// region. Must outlive the unit.
+    bal_fastmem_t *fastmem;
+} bal_backend_options_t;
+
+/// Describes a unit emitted by the backend.
+typedef struct
+{
+    /// The executable address of the unit. Cast this to
+    /// [`bal_unit_function_t`] to run it.
+    const void *entry;
+
+    /// The offset of the unit in the code buffer.
+    size_t offset;
+
+    /// The size of the unit in bytes.
+    size_t size;
+
+    /// The offset from `entry` to the first instruction after the
+    /// prologue. Every unit shares the same frame layout, so control can be
+    /// transferred from the body of one unit to the body of another.
+    size_t body_offset;
+
+    /// The offset of the cold code of the unit in
+    /// `options->cold_code_buffer`.
+    size_t cold_offset;
+
+    /// The size of the cold code of the unit in bytes, or 0 if it has none.
+    size_t cold_size;
+
+    /// The offset from `entry` to each patchable site, indexed by
+    /// [`bal_link_kind_t`], or 0 if the unit has no site of that kind. See
+    /// [`bal_backend_link_x86_64`].
+    size_t link_offsets[BAL_LINK_KIND_COUNT];
+
+    /// Every position dependent field of the unit. Linkable sites are left
+    /// out, as they are position independent until linked.
+    bal_relocation_t relocations[BAL_MAX_RELOCATIONS];
+    uint32_t         relocation_count;
+
+    /// Whether `relocations` is complete. A unit with more than
+    /// [`BAL_MAX_RELOCATIONS`] of them can only run where it was compiled.
+    bool relocatable;
+} bal_compiled_unit_t;
+
+/// Compiles the IR in `engine` into x86-64 machine code appended to
+/// `code_buffer`.
+///
+/// Values are assigned locations by [`bal_register_allocate`] with
+/// `register_class`, then every IR instruction is expanded into a predefined
+/// machine code template. Dead side effect free instructions are not emitted.
+///
+/// The IR must end with the terminator emitted by [`bal_engine_translate`].
+/// The unit returns the target of the terminator. A direct exit leaves
+/// through a `JMP rel32` that initially falls into the epilogue and can be
+/// redirected into another unit with [`bal_backend_link_x86_64`]. A
+/// conditional exit has one such jump for each way the branch can go.
+///
+/// A call pushes its return address onto the return stack buffer of the
+/// vCPU together with a patchable host code pointer that starts out `NULL`.
+/// A return pops the top entry and, if it predicted the target and has a
+/// host code pointer, jumps straight to it instead of leaving the unit.
+///
+/// Any other indirect exit first compares its target against the entries of
+/// a polymorphic inline cache. Each entry holds a guest address, set with
+/// [`bal_backend_set_inline_cache_target_x86_64`], and a `JMP rel32` linked
+/// like a direct exit. A hit increments
+/// [`bal_vcpu_counters_t`]`.inline_cache_hits`. A miss stores
+/// `options->unit_id` in [`bal_vcpu_t`]`.exit_unit` and leaves the unit.
+///
+/// When `options->execution_counter` is set, the body starts by
+/// decrementing it. The entry that brings it to zero stores
+/// `options->unit_id` in [`bal_vcpu_t`]`.hot_unit` and leaves the unit
+/// before running any guest code, returning the guest address of the unit
+/// itself.
+///
+/// Guest memory accesses probe [`bal_vcpu_t`]`.tlb` inline and access host
+/// memory directly on a hit. A miss calls [`bal_tlb_load_slow`] or
+/// [`bal_tlb_store_slow`] and continues with the next instruction, unless the
+/// access faulted, in which case the unit is left with its own guest address
+/// as the target.
+///
+/// With `options->fastmem` set, the prologue loads its base address into
+/// [`BAL_FASTMEM_BASE_REGISTER_X86_64`] and accesses go to the base plus the
+/// guest address without probing the TLB. Addresses outside the region take
+/// the TLB miss path, and so does an access that faults, once the fault
+/// handler has redirected it. Once the site table of the region is full,
+/// accesses probe the TLB again.
+///
+/// Inline cache misses, return mispredictions, TLB misses and the execution
+/// counter trap are emitted out of line, into `options->cold_code_buffer` when it is
+/// set, so the expected path through the unit stays contiguous.
+///
+/// A `NULL` `options` emits no inline cache and no execution counter.
+///
+/// Host addresses and `options->unit_id` are emitted with a fixed width and
+/// recorded in `unit->relocations` together with every branch between the
+/// unit and its cold code, so [`bal_backend_load_x86_64`] can move the unit.
+///
+/// Returns [`BAL_SUCCESS`] on success and populates `unit`.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`, or
+/// `options->fastmem` is set and [`BAL_FASTMEM_BASE_REGISTER_X86_64`] is
+/// allocatable in `register_class`.
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine->status != BAL_SUCCESS`,
+/// the IR does not end with exactly one terminator, it names a guest
+/// register at or above [`BAL_GUEST_REGISTER_COUNT`], or a memory access
+/// size other than 1, 2, 4 or 8.
+///
+/// Returns [`BAL_ERROR_SPILL_SLOT_OVERFLOW`] if register allocation fails.
+///
+/// Returns [`BAL_ERROR_UNSUPPORTED_OPCODE`] if the IR contains an opcode
+/// without a template.
+///
+/// Returns [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if `code_buffer` or the cold
+/// code buffer is full.
+BAL_HOT bal_error_t
+bal_backend_compile_x86_64(bal_engine_t *BAL_RESTRICT               engine,
+                           const bal_register_class_t *BAL_RESTRICT register_class,
+                           bal_code_buffer_t *BAL_RESTRICT          code_buffer,
+                           const bal_backend_options_t             *options,
+                           bal_compiled_unit_t *BAL_RESTRICT        unit);
+
+/// Copies a unit compiled earlier, possibly by another process, into
+/// `code_buffer` and `options->cold_code_buffer`, then rewrites every field
+/// in `unit->relocations` for `options` and registers its fastmem sites.
+///
+/// On entry `unit` holds what [`bal_backend_compile_x86_64`] returned for
+/// the unit, with its unlinked code in the `unit->size` bytes at `code` and
+/// the `unit->cold_size` bytes at `cold_code`. `unit->entry` is ignored and
+/// `unit->offset` only matters modulo 8, which the copy keeps so its
+/// patchable sites stay aligned. On success `unit` describes the copy.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a required pointer is `NULL`,
+/// the unit is not relocatable, a relocation or link offset is out of range,
+/// or `options` lacks the fastmem region, execution counter or cold code
+/// buffer the unit was compiled with, or room for its fastmem sites.
+///
+/// Returns [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if `code_buffer` or the cold
+/// code buffer is full.
+bal_error_t bal_backend_load_x86_64(bal_code_buffer_t *BAL_RESTRICT   code_buffer,
+                                    const bal_backend_options_t      *options,
+                                    const uint8_t                    *code,
+                                    const uint8_t                    *cold_code,
+                                    bal_compiled_unit_t *BAL_RESTRICT unit);
+
+/// Points the site of `kind` at `target`, the executable address of another
+/// unit's body. `site_offset` is the offset in `code_buffer` of the site,
+/// `unit->offset + unit->link_offsets[kind]`.
+///
+/// Passing `NULL` unlinks the site. A direct exit returns to its caller
+/// again, a call pushes return stack entries that never predict, and an
+/// inline cache entry falls through to the next one.
+///
+/// Sites are naturally aligned and written with a single store, so a thread
+/// running the unit sees either the old or the new target.
+void bal_backend_link_x86_64(bal_code_buffer_t *code_buffer,
+                             bal_link_kind_t    kind,
+                             size_t             site_offset,
+                             const void        *target);
+
+/// Sets the guest address compared by the inline cache entry whose `JMP`
+/// displacement is at `site_offset`. The entry must be unlinked, so a thread
+/// running the unit never pairs the new address with the old host code.
+void bal_backend_set_inline_cache_target_x86_64(bal_code_buffer_t  *code_buffer,
+                                                size_t              site_offset,
+                                                bal_guest_address_t guest_address);
+
+#endif /* BALLISTIC_BACKEND_H */
+
+/*** end of file ***/
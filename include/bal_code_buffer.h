@@ -0,0 +1,136 @@
+/** @file bal_code_buffer.h
+ *
+ * @brief Manages a linear buffer that host machine code is emitted into.
+ */
+
+#ifndef BALLISTIC_CODE_BUFFER_H
+#define BALLISTIC_CODE_BUFFER_H
+
+#include "bal_attributes.h"
+#include "bal_code_memory.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// A byte addressed buffer that machine code is appended to. The buffer may
+/// be mapped twice, once writable for emission and once executable for
+/// running the code, so both addresses are tracked.
+typedef struct
+{
+    /// The writable view of the buffer.
+    uint8_t *buffer;
+
+    /// The executable view of `buffer`. This is the same address as `buffer`
+    /// when the memory is not dual mapped.
+    const uint8_t *executable_buffer;
+
+    /// The size of the buffer in bytes.
+    size_t capacity;
+
+    /// Commits more memory when `capacity` is reached. `NULL` if the buffer
+    /// has a fixed size.
+    bal_code_memory_t *code_memory;
+
+    /// The region of `code_memory` the buffer emits into.
+    bal_code_region_t region;
+
+    /// The current write offset in bytes.
+    size_t offset;
+
+    /// The offset emission stops at. Emitting past it fails like a full
+    /// buffer, without committing more memory. `SIZE_MAX` unless set by
+    /// [`bal_code_buffer_set_window`].
+    size_t limit;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+
+    /// The current error state of the code buffer.
+    ///
+    /// Once this is set to anything other than [`BAL_SUCCESS`], all subsequent
+    /// emit calls are ignored until the code buffer is reinitialized.
+    bal_error_t status;
+} bal_code_buffer_t;
+
+/// Initializes `code_buffer` to emit into the `size` bytes at `buffer`. The
+/// same memory must be executable at `executable_buffer`, which may equal
+/// `buffer`.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL` or `size`
+/// is zero.
+BAL_COLD bal_error_t bal_code_buffer_init(bal_code_buffer_t *code_buffer,
+                                          void              *buffer,
+                                          const void        *executable_buffer,
+                                          size_t             size,
+                                          bal_logger_t       logger);
+
+/// Initializes `code_buffer` to emit into `code_memory`, committing more of
+/// the reserved range whenever the committed part runs out.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the first pages can not be
+/// committed.
+BAL_COLD bal_error_t bal_code_buffer_init_code_memory(bal_code_buffer_t *code_buffer,
+                                                      bal_code_memory_t *code_memory,
+                                                      bal_logger_t       logger);
+
+/// Like [`bal_code_buffer_init_code_memory`] but emits into `region` of
+/// `code_memory`. Offsets in `code_buffer` are relative to the start of the
+/// region.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the first pages can not be
+/// committed.
+BAL_COLD bal_error_t bal_code_buffer_init_code_memory_region(bal_code_buffer_t *code_buffer,
+                                                             bal_code_memory_t *code_memory,
+                                                             bal_code_region_t  region,
+                                                             bal_logger_t       logger);
+
+/// Appends `size` bytes from `bytes` to `code_buffer`.
+///
+/// # Errors
+///
+/// Sets `code_buffer->status` to [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if the
+/// bytes do not fit, or to [`BAL_ERROR_ALLOCATION_FAILED`] if committing more
+/// code memory fails.
+BAL_HOT void bal_code_buffer_emit(bal_code_buffer_t *BAL_RESTRICT code_buffer,
+                                  const uint8_t *BAL_RESTRICT     bytes,
+                                  size_t                          size);
+
+/// Pads `code_buffer` with `fill` until `code_buffer->offset` is a multiple of
+/// `alignment`, which must be a power of two.
+///
+/// # Errors
+///
+/// Sets `code_buffer->status` to [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if the
+/// padding does not fit.
+void bal_code_buffer_align(bal_code_buffer_t *code_buffer, size_t alignment, uint8_t fill);
+
+/// Moves the write offset of `code_buffer` to `begin` and makes emission fail
+/// once it would pass `end`, so code can be appended to one part of the
+/// buffer while the rest stays untouched. Clears `code_buffer->status`.
+void bal_code_buffer_set_window(bal_code_buffer_t *code_buffer, size_t begin, size_t end);
+
+/// Returns the executable address of the byte at `offset` in `code_buffer`.
+static inline const void *
+bal_code_buffer_executable_address(const bal_code_buffer_t *code_buffer, size_t offset)
+{
+    return code_buffer->executable_buffer + offset;
+}
+
+#endif /* BALLISTIC_CODE_BUFFER_H */
+
+/*** end of file ***/
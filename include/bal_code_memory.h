@@ -0,0 +1,154 @@
+/** @file bal_code_memory.h
+ *
+ * @brief Reserves and commits executable memory for translated code.
+ *
+ * The same physical pages are mapped twice: once read/write for emitting
+ * code and once read/execute for running it. No page is ever writable and
+ * executable at the same time, and emitting code never changes page
+ * protections.
+ *
+ * The reserved range can be split into a hot region at the start and a cold
+ * region at the end. Code that rarely runs goes into the cold region, so the
+ * hot region stays dense in the instruction cache and TLB. Both regions are in
+ * the same reservation, so a 32-bit displacement always reaches from one to
+ * the other as long as the reservation is below 2 GiB.
+ */
+
+#ifndef BALLISTIC_CODE_MEMORY_H
+#define BALLISTIC_CODE_MEMORY_H
+
+#include "bal_attributes.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// The number of bytes committed at a time. Rounded up to the host page
+/// size.
+#define BAL_CODE_MEMORY_COMMIT_GRANULARITY (64U * 1024U)
+
+typedef enum
+{
+    /// Code on the expected path.
+    BAL_CODE_REGION_HOT,
+
+    /// Code on paths that are expected to be rare, such as fallbacks and
+    /// exits to the dispatcher.
+    BAL_CODE_REGION_COLD,
+} bal_code_region_t;
+
+typedef struct
+{
+    /// The read/write view of the reserved range.
+    uint8_t *writable_base;
+
+    /// The read/execute view of the reserved range. Code emitted at
+    /// `writable_base + n` runs at `executable_base + n`.
+    uint8_t *executable_base;
+
+    /// The size of the reserved range in bytes.
+    size_t reserved_size;
+
+    /// The number of bytes at the start of the hot region that are backed by
+    /// memory. Accessing anything beyond this faults.
+    size_t committed_size;
+
+    /// The offset of the cold region, which extends to `reserved_size`.
+    /// Equal to `reserved_size` when there is no cold region.
+    size_t cold_offset;
+
+    /// The number of bytes at the start of the cold region that are backed
+    /// by memory.
+    size_t cold_committed_size;
+
+    /// The host page size.
+    size_t page_size;
+
+    /// The platform handle of the shared memory object backing both views.
+    intptr_t handle;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_code_memory_t;
+
+/// Reserves `reserve_size` bytes of address space for code in `code_memory`.
+/// No memory is committed until [`bal_code_memory_commit`] is called.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `code_memory` is `NULL` or
+/// `reserve_size` is zero.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the host refuses to create or
+/// map the shared memory object.
+BAL_COLD bal_error_t bal_code_memory_init(bal_code_memory_t *code_memory,
+                                          size_t             reserve_size,
+                                          bal_logger_t       logger);
+
+/// Moves the last `cold_size` bytes of `code_memory`, rounded up to the host
+/// page size, into the cold region. Must be called before anything is
+/// committed.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `code_memory` is `NULL`, memory
+/// has already been committed, or the hot region would be empty.
+BAL_COLD bal_error_t bal_code_memory_split(bal_code_memory_t *code_memory, size_t cold_size);
+
+/// Ensures at least the first `size` bytes of `code_memory` are committed.
+/// Memory is committed in multiples of [`BAL_CODE_MEMORY_COMMIT_GRANULARITY`].
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if `size` exceeds the hot
+/// region.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the host fails to commit the
+/// pages.
+BAL_COLD bal_error_t bal_code_memory_commit(bal_code_memory_t *code_memory, size_t size);
+
+/// Like [`bal_code_memory_commit`] but for the first `size` bytes of
+/// `region`.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] if `size` exceeds `region`.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the host fails to commit the
+/// pages.
+BAL_COLD bal_error_t bal_code_memory_commit_region(bal_code_memory_t *code_memory,
+                                                   bal_code_region_t  region,
+                                                   size_t             size);
+
+/// Returns the offset of `region` in the reserved range.
+static inline size_t
+bal_code_memory_region_offset(const bal_code_memory_t *code_memory, bal_code_region_t region)
+{
+    return (BAL_CODE_REGION_COLD == region) ? code_memory->cold_offset : 0;
+}
+
+/// Returns the number of committed bytes at the start of `region`.
+static inline size_t
+bal_code_memory_region_committed(const bal_code_memory_t *code_memory, bal_code_region_t region)
+{
+    return (BAL_CODE_REGION_COLD == region) ? code_memory->cold_committed_size
+                                            : code_memory->committed_size;
+}
+
+/// Makes `size` bytes of code written through the writable view visible to
+/// instruction fetches at `executable_address`. This is a no-op on hosts with
+/// coherent instruction caches.
+void bal_code_memory_flush_instruction_cache(const void *executable_address, size_t size);
+
+/// Unmaps both views and releases all memory held by `code_memory`.
+BAL_COLD void bal_code_memory_destroy(bal_code_memory_t *code_memory);
+
+#endif /* BALLISTIC_CODE_MEMORY_H */
+
+/*** end of file ***/
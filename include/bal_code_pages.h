@@ -0,0 +1,87 @@
+/** @file bal_code_pages.h
+ *
+ * @brief Counts the translated units covering each guest page.
+ *
+ * A store to a page with translated code has to discard the units on it.
+ * The TLB never maps such a page for writes, so every store to it takes the
+ * slow path, which looks the page up here and reports the store before
+ * performing it.
+ *
+ * Pages are hashed into a fixed number of slots. Pages sharing a slot count
+ * as code pages as long as either of them is, which only costs the other
+ * page its inline stores.
+ */
+
+#ifndef BALLISTIC_CODE_PAGES_H
+#define BALLISTIC_CODE_PAGES_H
+
+#include "bal_attributes.h"
+#include "bal_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The log2 of the guest page size code is tracked at.
+#define BAL_CODE_PAGE_SHIFT 12U
+
+/// The number of slots pages are hashed into. Must be a power of two.
+#define BAL_CODE_PAGES_SLOTS 4096U
+
+typedef struct
+{
+    /// The number of units covering a page of each slot.
+    uint32_t counts[BAL_CODE_PAGES_SLOTS];
+
+    /// Incremented whenever a slot stops being zero. A TLB filled under an
+    /// older generation may map a new code page for writes.
+    uint64_t generation;
+} bal_code_pages_t;
+
+/// Marks every page as free of code.
+BAL_COLD void bal_code_pages_init(bal_code_pages_t *code_pages);
+
+/// Counts a unit covering the `size` bytes at `guest_address` on every page
+/// they overlap. Does nothing if `size` is 0.
+void bal_code_pages_add(bal_code_pages_t   *code_pages,
+                        bal_guest_address_t guest_address,
+                        size_t              size);
+
+/// Undoes [`bal_code_pages_add`] with the same range.
+void bal_code_pages_remove(bal_code_pages_t   *code_pages,
+                           bal_guest_address_t guest_address,
+                           size_t              size);
+
+/// Returns the slot of the page holding `guest_address`.
+static inline uint32_t
+bal_code_pages_slot(bal_guest_address_t guest_address)
+{
+    return (uint32_t)(guest_address >> BAL_CODE_PAGE_SHIFT) & (BAL_CODE_PAGES_SLOTS - 1U);
+}
+
+/// Returns `true` if any page overlapping the `size` bytes at
+/// `guest_address` may hold translated code.
+static inline bool
+bal_code_pages_contains(const bal_code_pages_t *code_pages,
+                        bal_guest_address_t     guest_address,
+                        size_t                  size)
+{
+    bal_guest_address_t first = guest_address >> BAL_CODE_PAGE_SHIFT;
+    bal_guest_address_t last  = (guest_address + size - 1U) >> BAL_CODE_PAGE_SHIFT;
+
+    for (bal_guest_address_t page = first;; ++page)
+    {
+        if (code_pages->counts[(uint32_t)page & (BAL_CODE_PAGES_SLOTS - 1U)] != 0)
+        {
+            return true;
+        }
+
+        if (page == last || page - first >= BAL_CODE_PAGES_SLOTS)
+        {
+            return false;
+        }
+    }
+}
+
+#endif /* BALLISTIC_CODE_PAGES_H */
+
+/*** end of file ***/
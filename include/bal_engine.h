@@ -6,6 +6,8 @@
 #include "bal_logging.h"
 #include "bal_memory.h"
 #include "bal_types.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /// A byte pattern written to memory during initialization, poisoning allocated
@@ -17,6 +19,18 @@
 /// 63               51 50        34 33        17 16        00
 /// |-----------------| |----------| |----------| |----------|
 ///        opc             src1         src2         src3
+///
+/// Each source bitfield holds the low 16 bits of its index and the is
+/// constant flag. A wide unit keeps bits 16 to 30 of every index in a
+/// parallel array, `source_extensions`:
+///
+/// 63    45 44        30 29        15 14        00
+/// |------| |----------| |----------| |----------|
+///   zero       src1         src2         src3
+///
+/// Decoded sources carry the is constant flag at bit 31 instead, so the
+/// passes see the same values in both forms. See `bal_ir_get` in
+/// `bal_ir.h`.
 
 /// Opcode bitfield least significant bit.
 #define BAL_OPCODE_SHIFT_POSITION 51U
@@ -40,6 +54,40 @@
 /// The bit position for the is constant flag in a bal_instruction_t.
 #define BAL_IS_CONSTANT_BIT_POSITION (1U << 16U)
 
+/// The bit position for the is constant flag in a decoded source.
+#define BAL_DECODED_CONSTANT_BIT (1U << 31U)
+
+/// The mask for the index of a decoded source.
+#define BAL_SOURCE_INDEX_MASK (BAL_DECODED_CONSTANT_BIT - 1U)
+
+/// The mask for the high index bits of one source in `source_extensions`.
+#define BAL_SOURCE_EXTENSION_MASK ((1U << 15U) - 1U)
+
+/// Source1 least significant bit in `source_extensions`.
+#define BAL_SOURCE1_EXTENSION_POSITION 30U
+
+/// Source2 least significant bit in `source_extensions`.
+#define BAL_SOURCE2_EXTENSION_POSITION 15U
+
+/// Marks an unused source. It is stored as an all ones bitfield with no
+/// extension. Constant pool index `0xFFFF` is never interned so this value
+/// can not be mistaken for a real operand.
+#define BAL_SOURCE_NONE 0xFFFFFFFFU
+
+/// The number of IR instructions or constants a unit keeps free for the last
+/// guest instruction, the register writebacks and the terminator.
+#define BAL_UNIT_INSTRUCTION_MARGIN 136U
+
+/// The number of IR instructions or constants after which
+/// [`bal_engine_translate`] ends a unit early. Source fields hold 16-bit
+/// indices, so a unit can never address more than 65536 of either. A wide
+/// unit ends [`BAL_UNIT_INSTRUCTION_MARGIN`] short of the engine capacity
+/// instead. See Rule 4.3 in the IR design document.
+#define BAL_UNIT_INSTRUCTION_LIMIT (65536U - BAL_UNIT_INSTRUCTION_MARGIN)
+
+/// The number of IR instructions [`bal_engine_init`] makes room for.
+#define BAL_ENGINE_DEFAULT_CAPACITY 65536U
+
 /// Represents the mapping of a Guest Register to an SSA variable.
 /// This is only used during Single Static Assignment construction
 /// to track variable definitions across basic blocks.
@@ -53,6 +101,68 @@ typedef struct
     uint32_t original_variable_index;
 } bal_source_variable_t;
 
+/// Describes how control leaves a compilation unit.
+typedef enum
+{
+    /// The unit ended without a branch. Execution continues at `target`.
+    BAL_UNIT_EXIT_FALLTHROUGH,
+
+    /// `B`. Execution continues at `target`.
+    BAL_UNIT_EXIT_BRANCH,
+
+    /// `BL`. `X30` holds `return_address` and execution continues at
+    /// `target`.
+    BAL_UNIT_EXIT_CALL,
+
+    /// `BR`. The target is read from `target_register`.
+    BAL_UNIT_EXIT_INDIRECT_BRANCH,
+
+    /// `BLR`. `X30` holds `return_address` and the target is read from
+    /// `target_register`.
+    BAL_UNIT_EXIT_INDIRECT_CALL,
+
+    /// `RET`. The target is read from `target_register`.
+    BAL_UNIT_EXIT_RETURN,
+
+    /// `B.cond`, `CBZ`, `CBNZ`, `TBZ` or `TBNZ`. Execution continues at
+    /// `target` if the branch is taken and at `return_address` otherwise.
+    BAL_UNIT_EXIT_CONDITIONAL,
+} bal_unit_exit_kind_t;
+
+/// Records where control goes after the last instruction of a compilation
+/// unit. Units with a direct exit can be linked to the unit at `target`.
+typedef struct
+{
+    /// The kind of branch that ended the unit.
+    bal_unit_exit_kind_t kind;
+
+    /// The guest register holding the target of an indirect exit.
+    uint32_t target_register;
+
+    /// The guest address a direct exit continues at.
+    bal_guest_address_t target;
+
+    /// The guest address of the instruction after the branch, where a
+    /// conditional exit continues if it is not taken.
+    bal_guest_address_t return_address;
+
+    /// The number of guest code bytes covered by the unit.
+    size_t guest_size;
+} bal_unit_exit_t;
+
+/// Returns `true` if an exit of `kind` always continues at the same guest
+/// address.
+static inline bool
+bal_unit_exit_is_direct(bal_unit_exit_kind_t kind)
+{
+    return kind <= BAL_UNIT_EXIT_CALL;
+}
+
+/// The number of scratch bytes reserved in the arena for every IR
+/// instruction. Passes and the register allocator carve their per-SSA arrays
+/// out of this region instead of allocating.
+#define BAL_SCRATCH_BYTES_PER_INSTRUCTION 16U
+
 /// Holds the Intermediate Representation buffers, SSA state, and other
 /// important metadata. The structure is divided into hot and cold data aligned
 /// to 64 bytes. Both hot and cold data lives on their own cache lines.
@@ -67,12 +177,22 @@ typedef struct
     /// compilation unit.
     bal_instruction_t *instructions;
 
-    /// Metadata tracking the bit-width (32 or 64 bit) for each variable.
+    /// The high source index bits of every instruction of a wide unit.
+    /// `NULL` if the engine was initialized without room for wide units.
+    uint64_t *source_extensions;
+
+    /// Metadata tracking the bit-width (32 or 64 bit) for each variable, or
+    /// 128 for vector operations, whose values stay in the guest vector
+    /// registers.
     bal_bit_width_t *ssa_bit_widths;
 
     /// Linear buffer of constants generated in the current compilation unit.
     bal_constant_t *constants;
 
+    /// Temporary memory owned by whichever pass is currently running. The
+    /// contents are undefined between passes.
+    void *scratch;
+
     /// The size of the `source_variables` array.
     size_t source_variables_size;
 
@@ -82,6 +202,9 @@ typedef struct
     /// The size of the `constants` array.
     size_t constants_size;
 
+    /// The size of the `scratch` region in bytes.
+    size_t scratch_size;
+
     /// The current number of instructions emitted.
     ///
     /// This tracks the current position in `instructions` and `ssa_bit_widths`
@@ -93,6 +216,19 @@ typedef struct
     /// This tracks the current position in the `constants` array.
     bal_constant_count_t constant_count;
 
+    /// The guest address of the first instruction passed to
+    /// [`bal_engine_translate`]. Branch targets are resolved against this.
+    bal_guest_address_t guest_address;
+
+    /// Selects the wide form for the current compilation unit, whose sources
+    /// index up to `instructions_size` instructions and constants. Cleared
+    /// by [`bal_engine_reset`]. Requires `source_extensions`.
+    bool is_wide;
+
+    /// How the current compilation unit ends. Written by
+    /// [`bal_engine_translate`].
+    bal_unit_exit_t unit_exit;
+
     /// The current error state of the Engine.
     ///
     /// If an operation fails, this field is set to a specific error code.
@@ -132,18 +268,55 @@ BAL_COLD bal_error_t bal_engine_init(bal_allocator_t *allocator,
                                      bal_engine_t    *engine,
                                      bal_logger_t     logger);
 
+/// Initializes a Ballistic engine like [`bal_engine_init`] with room for
+/// `capacity` IR instructions and constants. An engine with a capacity above
+/// [`BAL_ENGINE_DEFAULT_CAPACITY`] also allocates `source_extensions` and can
+/// translate wide units.
+///
+/// Returns [`BAL_SUCCESS`] if the engine is ready for use.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if the pointers are `NULL` or
+/// `capacity` is below [`BAL_ENGINE_DEFAULT_CAPACITY`] or above
+/// [`BAL_SOURCE_INDEX_MASK`].
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the allocator cannot fulfill the
+/// request.
+BAL_COLD bal_error_t bal_engine_init_with_capacity(bal_allocator_t *allocator,
+                                                   bal_engine_t    *engine,
+                                                   bal_logger_t     logger,
+                                                   size_t           capacity);
+
 /// Translates machine code starting at `arm_instruction_cursor` into the engine's
 /// internal IR. `interface` provides memory access handling (like instruction
 /// fetching).
 ///
+/// The first instruction is assumed to live at `engine->guest_address`.
+/// Translation stops after the first branch, or before the next guest
+/// instruction once the unit holds [`BAL_UNIT_INSTRUCTION_LIMIT`]
+/// instructions or constants, or [`BAL_UNIT_INSTRUCTION_MARGIN`] fewer
+/// than `engine->instructions_size` if `engine->is_wide` is set, or before
+/// a load or store that follows a vector operation or an atomic write, or
+/// before an instruction it can not translate, in which case the unit falls
+/// through to it. The IR always ends with a terminator: `OPCODE_JUMP`,
+/// `OPCODE_CALL` or `OPCODE_RETURN` whose `src1` is the target address.
+/// `OPCODE_CALL` carries the return address in `src2`. A conditional branch
+/// ends with `OPCODE_BRANCH_ZERO` or `OPCODE_BRANCH_NOT_ZERO` instead. How
+/// the unit ends is recorded in `engine->unit_exit`.
+///
 /// Returns [`BAL_SUCCESS`] on success.
 ///
 /// # Errors
 ///
 /// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine` is not initialized
-/// or `engine->status != BAL_SUCCESS`.
+/// or `engine->status != BAL_SUCCESS`, or if `engine->is_wide` is set on an
+/// engine without `source_extensions`.
 ///
 /// Returns [`BAL_ERROR_INSTRUCTION_OVERFLOW`] if the array `engine->constants` overflows.
+///
+/// Returns [`BAL_ERROR_UNKNOWN_INSTRUCTION`] if the first instruction can not
+/// be decoded or translated.
 BAL_HOT bal_error_t bal_engine_translate(bal_engine_t *BAL_RESTRICT           engine,
                                          bal_memory_interface_t *BAL_RESTRICT interface,
                                          const uint32_t *BAL_RESTRICT arm_instruction_cursor,
@@ -0,0 +1,118 @@
+/** @file bal_epoch.h
+ *
+ * @brief Tells when no thread can still be using something another thread
+ * retired, so it can be reused.
+ *
+ * Every thread running guest code holds a slot while it does. It publishes
+ * the global epoch in its slot whenever it holds no reference to anything
+ * that may be retired, such as between two units in the dispatcher, and
+ * goes offline while it can not take a new reference at all, such as while
+ * it holds or waits for the lock writers take.
+ *
+ * A writer tags what it retires with [`bal_epoch_current`] and then calls
+ * [`bal_epoch_advance`]. Once [`bal_epoch_safe`] is above the tag, every
+ * slot has moved past it and the memory can be reused.
+ *
+ * Readers only ever write their own slot, which has a cache line to itself,
+ * so they never wait for a writer or for each other.
+ */
+
+#ifndef BALLISTIC_EPOCH_H
+#define BALLISTIC_EPOCH_H
+
+#include "bal_attributes.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The epoch published by a slot that holds no references.
+#define BAL_EPOCH_OFFLINE 0U
+
+/// A thread's view of the epoch. Padded to a cache line so slots of
+/// different threads never share one.
+typedef struct
+{
+    /// The epoch the thread last published, or [`BAL_EPOCH_OFFLINE`].
+    uint64_t observed;
+
+    /// Nonzero while a thread holds the slot.
+    uint64_t claimed;
+
+    uint8_t padding[48];
+} bal_epoch_slot_t;
+
+typedef struct
+{
+    /// The current epoch. Starts at 1 and only grows.
+    uint64_t global;
+
+    /// One slot for every thread that may hold references at once.
+    bal_epoch_slot_t *slots;
+
+    /// The size of `slots`.
+    uint32_t slots_count;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_epoch_t;
+
+/// Initializes `epoch` with `slots_count` free slots, allocating them with
+/// `allocator`.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a pointer is `NULL` or
+/// `slots_count` is zero.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the allocator cannot fulfill the
+/// request.
+BAL_COLD bal_error_t bal_epoch_init(bal_allocator_t *allocator,
+                                    bal_epoch_t     *epoch,
+                                    uint32_t         slots_count,
+                                    bal_logger_t     logger);
+
+/// Takes a free slot for the calling thread, writes its index to `slot` and
+/// puts it online.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if every slot is held.
+bal_error_t bal_epoch_claim(bal_epoch_t *epoch, uint32_t *slot);
+
+/// Takes `slot` offline and frees it for another thread.
+void bal_epoch_release(bal_epoch_t *epoch, uint32_t slot);
+
+/// Publishes the current epoch in the online `slot`, declaring that its
+/// thread dropped every reference it took before.
+BAL_HOT void bal_epoch_quiesce(bal_epoch_t *epoch, uint32_t slot);
+
+/// Puts `slot` back online. Everything the thread reads afterwards is seen
+/// by a writer that checks the slot.
+void bal_epoch_online(bal_epoch_t *epoch, uint32_t slot);
+
+/// Takes `slot` offline, so writers stop waiting for its thread.
+void bal_epoch_offline(bal_epoch_t *epoch, uint32_t slot);
+
+/// Returns the tag of anything retired now.
+uint64_t bal_epoch_current(const bal_epoch_t *epoch);
+
+/// Moves to the next epoch, after retiring everything tagged with the
+/// current one.
+void bal_epoch_advance(bal_epoch_t *epoch);
+
+/// Returns the oldest epoch any online slot may still hold references from.
+/// Anything tagged below it can be reused.
+uint64_t bal_epoch_safe(const bal_epoch_t *epoch);
+
+/// Frees the slots of `epoch` using `allocator`.
+BAL_COLD void bal_epoch_destroy(bal_allocator_t *allocator, bal_epoch_t *epoch);
+
+#endif /* BALLISTIC_EPOCH_H */
+
+/*** end of file ***/
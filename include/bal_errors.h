@@ -22,6 +22,20 @@ typedef enum
     // IR Errors.
     //
     BAL_ERROR_INSTRUCTION_OVERFLOW = -100,
+    BAL_ERROR_SPILL_SLOT_OVERFLOW  = -101,
+
+    // Backend Errors.
+    //
+    BAL_ERROR_CODE_BUFFER_OVERFLOW = -200,
+    BAL_ERROR_UNSUPPORTED_OPCODE   = -201,
+    BAL_ERROR_UNSUPPORTED_HOST     = -202,
+
+    // Runtime Errors.
+    //
+    BAL_ERROR_TRANSLATION_CACHE_FULL = -300,
+    BAL_ERROR_GUEST_MEMORY_FAULT     = -301,
+    BAL_ERROR_FILE_IO                = -302,
+    BAL_ERROR_INVALID_FILE           = -303,
 } bal_error_t;
 
 /// Converts the enum into a readable string for error handling.
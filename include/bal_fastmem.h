@@ -0,0 +1,158 @@
+/** @file bal_fastmem.h
+ *
+ * @brief Maps the guest address space into one contiguous host region.
+ *
+ * With fastmem, guest address `n` lives at host address `base + n`, so
+ * compiled code accesses guest memory with one add and no TLB probe. The
+ * whole region is reserved up front without backing it, and the host maps
+ * guest RAM into it with [`bal_fastmem_map`]. Everything else, such as MMIO
+ * and unmapped pages, stays inaccessible.
+ *
+ * An access to an inaccessible page faults. The fault handler looks up the
+ * faulting instruction among the sites registered by the backend, patches it
+ * into a jump to the slow path of the access and resumes there. The slow
+ * path goes through the TLB and the memory interface like any TLB miss, so
+ * the interface must still resolve every guest address the host wants to be
+ * accessible, including the ones it maps here.
+ *
+ * Only supported on x86-64 Linux hosts. A region is used by one runtime and
+ * its vCPUs must all run on the thread that compiles for it, as sites are
+ * patched without synchronization.
+ */
+
+#ifndef BALLISTIC_FASTMEM_H
+#define BALLISTIC_FASTMEM_H
+
+#include "bal_attributes.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include "bal_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The fewest guest address bits a region can cover.
+#define BAL_FASTMEM_MIN_ADDRESS_BITS 16U
+
+/// The most guest address bits a region can cover.
+#define BAL_FASTMEM_MAX_ADDRESS_BITS 47U
+
+/// The inaccessible bytes reserved after the region, so an access starting
+/// in its last bytes faults instead of touching unrelated memory.
+#define BAL_FASTMEM_GUARD_SIZE (64U * 1024U)
+
+/// The most regions alive at once in a process.
+#define BAL_FASTMEM_MAX_REGIONS 8U
+
+/// A guest memory access in compiled code that may fault.
+typedef struct
+{
+    /// The executable address of the access instruction.
+    const uint8_t *access;
+
+    /// The writable address of the same instruction. There are at least 5
+    /// bytes before the next instruction, enough for a `JMP rel32`.
+    uint8_t *writable;
+
+    /// The executable address of the slow path of the access.
+    const uint8_t *slow_path;
+} bal_fastmem_site_t;
+
+typedef struct
+{
+    /// The host address of guest address 0.
+    uint8_t *base;
+
+    /// The number of bytes of guest address space, `1 << address_bits`.
+    size_t size;
+
+    /// The number of low guest address bits mapped. Compiled code sends
+    /// addresses with any higher bit set to the slow path.
+    uint32_t address_bits;
+
+    /// The registered sites, sorted by `access`.
+    bal_fastmem_site_t *sites;
+
+    /// The number of entries in `sites`.
+    uint32_t site_count;
+
+    /// The maximum number of entries in `sites`.
+    uint32_t site_capacity;
+
+    /// The number of sites patched into jumps to their slow path.
+    uint64_t patches;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_fastmem_t;
+
+/// Reserves `1 << address_bits` bytes of guest address space in `fastmem`
+/// with room for `site_capacity` sites, and installs the fault handler if no
+/// other region has. No guest memory is accessible until it is mapped.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `fastmem` or `allocator` is
+/// `NULL`, `site_capacity` is 0, `address_bits` is outside
+/// [[`BAL_FASTMEM_MIN_ADDRESS_BITS`], [`BAL_FASTMEM_MAX_ADDRESS_BITS`]] or
+/// [`BAL_FASTMEM_MAX_REGIONS`] regions are alive.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the address space or the site
+/// table could not be allocated, or the fault handler not installed.
+///
+/// Returns [`BAL_ERROR_UNSUPPORTED_HOST`] on hosts other than x86-64 Linux.
+BAL_COLD bal_error_t bal_fastmem_init(bal_allocator_t *allocator,
+                                      bal_fastmem_t   *fastmem,
+                                      uint32_t         address_bits,
+                                      uint32_t         site_capacity,
+                                      bal_logger_t     logger);
+
+/// Makes `size` bytes at `guest_address` readable, and writable if
+/// `writable` is set. The memory is zero filled the first time it is
+/// touched.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if the range is empty or extends
+/// past `fastmem->size`.
+///
+/// Returns [`BAL_ERROR_MEMORY_ALIGNMENT`] if `guest_address` or `size` is not
+/// a multiple of the host page size.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the host refused the change.
+BAL_COLD bal_error_t bal_fastmem_map(bal_fastmem_t      *fastmem,
+                                     bal_guest_address_t guest_address,
+                                     size_t              size,
+                                     bool                writable);
+
+/// Makes `size` bytes at `guest_address` inaccessible again and releases
+/// their memory. Accesses to them take the slow path from then on.
+///
+/// # Errors
+///
+/// Same as [`bal_fastmem_map`].
+BAL_COLD bal_error_t bal_fastmem_unmap(bal_fastmem_t      *fastmem,
+                                       bal_guest_address_t guest_address,
+                                       size_t              size);
+
+/// Registers an access emitted by the backend, so a fault on it resumes at
+/// `site->slow_path`. Returns `false` if the site table is full.
+bool bal_fastmem_add_site(bal_fastmem_t *fastmem, const bal_fastmem_site_t *site);
+
+/// Forgets every site whose access is in `[begin, end)`. Must be called
+/// before the code there is overwritten, so a fault in the new code is never
+/// taken for one of the old sites.
+void bal_fastmem_remove_sites(bal_fastmem_t *fastmem, const uint8_t *begin, const uint8_t *end);
+
+/// Releases the address space and the site table of `fastmem`, and removes
+/// the fault handler once no region is left.
+BAL_COLD void bal_fastmem_destroy(bal_allocator_t *allocator, bal_fastmem_t *fastmem);
+
+#endif /* BALLISTIC_FASTMEM_H */
+
+/*** end of file ***/
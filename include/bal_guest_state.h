@@ -0,0 +1,161 @@
+/** @file bal_guest_state.h
+ *
+ * @brief The architectural state of an emulated ARM64 CPU.
+ *
+ * Compiled units address the guest state through `OPCODE_GET_REGISTER` and
+ * `OPCODE_SET_REGISTER`, whose register index is the offset of a 64-bit field
+ * divided by 8. The general purpose registers, `SP`, `PC` and the flags are
+ * read by almost every unit, so they come first and fill the first five cache
+ * lines. The vector registers follow.
+ *
+ * NZCV is stored lazily. A flag setting instruction only records what it
+ * computed and its operands, which costs two or three stores, and the flags
+ * are derived from them by [`bal_guest_state_nzcv`] when something reads
+ * them.
+ */
+
+#ifndef BALLISTIC_GUEST_STATE_H
+#define BALLISTIC_GUEST_STATE_H
+
+#include "bal_attributes.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The register index of `SP`. Also the index `XZR` would have, so `XZR`
+/// must never reach `OPCODE_GET_REGISTER`.
+#define BAL_GUEST_REGISTER_SP 31U
+
+/// The register index of `PC`.
+#define BAL_GUEST_REGISTER_PC 32U
+
+/// The register index of [`bal_guest_flags_t`]`.operation`.
+#define BAL_GUEST_REGISTER_FLAGS_OPERATION 33U
+
+/// The register index of [`bal_guest_flags_t`]`.left`.
+#define BAL_GUEST_REGISTER_FLAGS_LEFT 34U
+
+/// The register index of [`bal_guest_flags_t`]`.right`.
+#define BAL_GUEST_REGISTER_FLAGS_RIGHT 35U
+
+/// The number of 64-bit fields addressable as guest registers.
+#define BAL_GUEST_REGISTER_COUNT 36U
+
+/// The number of guest vector registers.
+#define BAL_GUEST_VECTOR_REGISTER_COUNT 32U
+
+/// The NZCV bits in the layout of the `NZCV` system register.
+#define BAL_NZCV_N (1U << 31U)
+#define BAL_NZCV_Z (1U << 30U)
+#define BAL_NZCV_C (1U << 29U)
+#define BAL_NZCV_V (1U << 28U)
+
+/// The operation that last set the flags.
+typedef enum
+{
+    /// `left` holds NZCV itself, in the layout of the `NZCV` system register.
+    /// Used by instructions whose flags can not be derived from two operands,
+    /// such as `ADCS` and `CCMP`, and by writes to `NZCV`.
+    BAL_FLAGS_NONE,
+
+    /// `left + right` as `ADDS` and `CMN` compute it.
+    BAL_FLAGS_ADD_64,
+    BAL_FLAGS_ADD_32,
+
+    /// `left - right` as `SUBS` and `CMP` compute it.
+    BAL_FLAGS_SUB_64,
+    BAL_FLAGS_SUB_32,
+
+    /// `left` is the result of `ANDS`, `BICS` or `TST`. `C` and `V` are
+    /// cleared and `right` is unused.
+    BAL_FLAGS_LOGICAL_64,
+    BAL_FLAGS_LOGICAL_32,
+} bal_flags_operation_t;
+
+/// The lazily evaluated NZCV flags. Every field is 64 bits wide so compiled
+/// code can write it with `OPCODE_SET_REGISTER`.
+typedef struct
+{
+    /// A [`bal_flags_operation_t`].
+    uint64_t operation;
+
+    uint64_t left;
+    uint64_t right;
+} bal_guest_flags_t;
+
+/// A 128-bit vector register.
+BAL_ALIGNED(16) typedef struct
+{
+    uint64_t lanes[2];
+} bal_guest_vector_register_t;
+
+/// The guest CPU state. Zero initialization is a valid state with all flags
+/// clear.
+BAL_ALIGNED(64) typedef struct
+{
+    /// `X0` to `X30`.
+    uint64_t registers[31];
+
+    uint64_t          sp;
+    uint64_t          pc;
+    bal_guest_flags_t flags;
+
+    /// `V0` to `V31`.
+    bal_guest_vector_register_t vectors[BAL_GUEST_VECTOR_REGISTER_COUNT];
+} bal_guest_state_t;
+
+static_assert(BAL_GUEST_REGISTER_SP * 8U == offsetof(bal_guest_state_t, sp),
+              "SP must follow X30.");
+static_assert(BAL_GUEST_REGISTER_PC * 8U == offsetof(bal_guest_state_t, pc),
+              "PC must follow SP.");
+static_assert(BAL_GUEST_REGISTER_FLAGS_OPERATION * 8U
+                  == offsetof(bal_guest_state_t, flags) + offsetof(bal_guest_flags_t, operation),
+              "The flags must follow PC.");
+static_assert(BAL_GUEST_REGISTER_FLAGS_RIGHT * 8U
+                  == offsetof(bal_guest_state_t, flags) + offsetof(bal_guest_flags_t, right),
+              "The flags must be contiguous.");
+static_assert(0 == offsetof(bal_guest_state_t, vectors) % 16,
+              "Vector registers must be 16 byte aligned.");
+
+/// Returns the 64-bit field of `state` that `OPCODE_GET_REGISTER` reads for
+/// `index`, which must be less than [`BAL_GUEST_REGISTER_COUNT`].
+static inline uint64_t *
+bal_guest_state_register(bal_guest_state_t *state, uint32_t index)
+{
+    return &state->registers[0] + index;
+}
+
+/// Records that `operation` set the flags from `left` and `right`.
+static inline void
+bal_guest_state_set_flags(bal_guest_state_t    *state,
+                          bal_flags_operation_t operation,
+                          uint64_t              left,
+                          uint64_t              right)
+{
+    state->flags.operation = (uint64_t)operation;
+    state->flags.left      = left;
+    state->flags.right     = right;
+}
+
+/// Overwrites the flags with `nzcv`, in the layout of the `NZCV` system
+/// register.
+static inline void
+bal_guest_state_set_nzcv(bal_guest_state_t *state, uint32_t nzcv)
+{
+    bal_guest_state_set_flags(
+        state, BAL_FLAGS_NONE, nzcv & (BAL_NZCV_N | BAL_NZCV_Z | BAL_NZCV_C | BAL_NZCV_V), 0);
+}
+
+/// Computes NZCV from the operation recorded in `state`, in the layout of the
+/// `NZCV` system register. An unknown operation reads as all flags clear.
+BAL_HOT uint32_t bal_guest_state_nzcv(const bal_guest_state_t *state);
+
+/// Returns 1 if the A64 condition code `condition`, as encoded in the low 4
+/// bits of `B.cond`, holds for the flags of `state`, and 0 otherwise.
+/// Compiled code calls this for `OPCODE_CMP_COND`.
+BAL_HOT uint32_t bal_guest_state_condition_holds(const bal_guest_state_t *state,
+                                                 uint32_t                 condition);
+
+#endif /* BALLISTIC_GUEST_STATE_H */
+
+/*** end of file ***/
@@ -0,0 +1,230 @@
+/** @file bal_interpreter.h
+ *
+ * @brief Runs IR units directly, without generating machine code.
+ *
+ * The interpreter is Tier 0 of the runtime. A unit is decoded once into a
+ * compact form where every instruction holds a pointer to its handler and its
+ * operands index a single value array that starts with the constants. Running
+ * the unit then only calls one handler after another. Every unit carries a
+ * counter, and the runtime compiles the unit at Tier 1 when it runs out.
+ *
+ * Decoded units live in fixed size arenas. When an arena is full, every unit is
+ * discarded at once and decoding starts over, which suits code that mostly
+ * runs a handful of times.
+ */
+
+#ifndef BALLISTIC_INTERPRETER_H
+#define BALLISTIC_INTERPRETER_H
+
+#include "bal_attributes.h"
+#include "bal_code_pages.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include "bal_types.h"
+#include "bal_vcpu.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bal_interpreter_instruction;
+
+/// The state a running unit shares between its handlers.
+typedef struct
+{
+    /// The value array of the unit.
+    uint64_t *values;
+
+    /// The vCPU the unit runs on.
+    bal_vcpu_t *vcpu;
+
+    /// The guest address execution continues at. Written by the terminator,
+    /// and left at the address of the unit if an access faults.
+    bal_guest_address_t target;
+} bal_interpreter_frame_t;
+
+/// Executes `instruction` and returns the next one, or `NULL` after the
+/// terminator.
+typedef const struct bal_interpreter_instruction *(*bal_interpreter_handler_t)(
+    const struct bal_interpreter_instruction *instruction, bal_interpreter_frame_t *frame);
+
+/// A decoded IR instruction.
+typedef struct bal_interpreter_instruction
+{
+    bal_interpreter_handler_t handler;
+
+    /// The value slot written by the instruction, the guest register for
+    /// `OPCODE_SET_REGISTER`, the access size for `OPCODE_STORE`, or the
+    /// value slot of the address a conditional branch continues at when not
+    /// taken, or the opcode of a vector operation.
+    uint32_t destination;
+
+    /// The value slots read by the instruction, the guest register for
+    /// `OPCODE_GET_REGISTER`, the condition code for `OPCODE_CMP_COND`, the
+    /// access size in `operands[1]` for `OPCODE_LOAD`, or the vector
+    /// registers a vector operation reads.
+    uint32_t operands[2];
+
+    /// The operand modifier of an ALU instruction that has one, applied to
+    /// `operands[1]`, the two's complement offset in bytes that
+    /// `OPCODE_LOAD` and `OPCODE_STORE` add to their address, the vector
+    /// descriptor of a vector operation, the access size of an atomic
+    /// access, or the value slot of the value `OPCODE_ATOMIC_COMPARE_SWAP`
+    /// writes, whose size picks the handler instead.
+    uint32_t immediate;
+} bal_interpreter_instruction_t;
+
+/// A decoded unit.
+typedef struct
+{
+    /// The guest address of the first instruction of the unit.
+    bal_guest_address_t guest_address;
+
+    /// The number of guest code bytes covered by the unit, or 0 if the entry
+    /// is empty.
+    size_t guest_size;
+
+    /// The index of the first instruction of the unit in the instruction
+    /// arena.
+    uint32_t first_instruction;
+
+    /// The index of the first constant of the unit in the value arena.
+    uint32_t first_value;
+
+    /// The number of constants of the unit. They come first in its value
+    /// slots.
+    uint32_t constant_count;
+
+    /// The number of value slots the unit needs to run.
+    uint32_t value_count;
+
+    /// Decremented every time the unit runs. The runtime compiles the unit
+    /// when it reaches zero.
+    int32_t counter;
+} bal_interpreter_unit_t;
+
+typedef struct
+{
+    /// A direct mapped table of decoded units. A new unit replaces whichever
+    /// unit shares its slot.
+    bal_interpreter_unit_t *units;
+
+    /// The decoded instructions of every unit.
+    bal_interpreter_instruction_t *instructions;
+
+    /// The constants of every unit, copied to the start of its value slots
+    /// whenever it runs.
+    uint64_t *values;
+
+    /// The number of entries in `units` minus one.
+    uint32_t unit_mask;
+
+    /// The size of the `instructions` array.
+    uint32_t instruction_capacity;
+
+    /// The number of entries used in `instructions`.
+    uint32_t instruction_count;
+
+    /// The size of the `values` array, and the most value slots a unit can
+    /// need.
+    uint32_t value_capacity;
+
+    /// The number of entries used in `values`.
+    uint32_t value_count;
+
+    /// The number of times the arenas filled up and every unit was discarded.
+    uint64_t flushes;
+
+    /// Counts the guest code of every unit, so stores to it are reported.
+    /// `NULL` unless set by the owner after initialization.
+    bal_code_pages_t *code_pages;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_interpreter_t;
+
+/// Initializes `interpreter` with room for `unit_count` units, rounded up to
+/// a power of two, and `instruction_capacity` decoded instructions.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a pointer is `NULL` or a size is
+/// zero.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the allocator cannot fulfill the
+/// request.
+BAL_COLD bal_error_t bal_interpreter_init(bal_allocator_t   *allocator,
+                                          bal_interpreter_t *interpreter,
+                                          uint32_t           unit_count,
+                                          uint32_t           instruction_capacity,
+                                          bal_logger_t       logger);
+
+/// Returns the decoded unit at `guest_address`, or `NULL` if there is none.
+BAL_HOT bal_interpreter_unit_t *bal_interpreter_lookup(bal_interpreter_t  *interpreter,
+                                                       bal_guest_address_t guest_address);
+
+/// Decodes the IR in `engine` into a new unit that runs `counter` times
+/// before it reports itself hot. Side effect free instructions whose values
+/// are never read are dropped. Every unit is discarded first if the arenas
+/// are too full for it.
+///
+/// Returns [`BAL_SUCCESS`] on success and points `unit` at the new unit.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine->status != BAL_SUCCESS`
+/// or the IR does not end with exactly one terminator, it names a guest
+/// register at or above [`BAL_GUEST_REGISTER_COUNT`], or a memory access
+/// size other than 1, 2, 4 or 8.
+///
+/// Returns [`BAL_ERROR_UNSUPPORTED_OPCODE`] if the IR contains an opcode
+/// without a handler.
+///
+/// Returns [`BAL_ERROR_INSTRUCTION_OVERFLOW`] if the unit does not fit in an
+/// empty arena.
+BAL_HOT bal_error_t bal_interpreter_decode(bal_interpreter_t *BAL_RESTRICT       interpreter,
+                                           const bal_engine_t *BAL_RESTRICT      engine,
+                                           int32_t                               counter,
+                                           bal_interpreter_unit_t **BAL_RESTRICT unit);
+
+/// Returns `true` if the IR in `engine` can be decoded without discarding
+/// every unit first.
+bool bal_interpreter_fits(const bal_interpreter_t *interpreter, const bal_engine_t *engine);
+
+/// Runs `unit` on `vcpu` and returns the guest address execution continues
+/// at. Calls and returns keep the return stack buffer of `vcpu` balanced,
+/// but the entries pushed here never predict.
+///
+/// The unit keeps its values in `values`, which has room for
+/// `unit->value_count` of them, so threads with their own `values` can run
+/// the same unit at once. Only the instructions and constants of `unit` are
+/// read from `interpreter`.
+///
+/// Guest memory is accessed through [`bal_vcpu_t`]`.tlb`. An access that
+/// faults stops the unit and returns its own guest address, like compiled
+/// code does.
+BAL_HOT bal_guest_address_t bal_interpreter_run(const bal_interpreter_t      *interpreter,
+                                                const bal_interpreter_unit_t *unit,
+                                                bal_vcpu_t                   *vcpu,
+                                                uint64_t                     *values);
+
+/// Removes `unit` from `interpreter`. Its arena space is reclaimed by the
+/// next flush. Does nothing if `unit` is empty.
+void bal_interpreter_evict(bal_interpreter_t *interpreter, bal_interpreter_unit_t *unit);
+
+/// Removes every unit overlapping the `size` guest bytes at `guest_address`.
+BAL_COLD void bal_interpreter_invalidate(bal_interpreter_t  *interpreter,
+                                         bal_guest_address_t guest_address,
+                                         size_t              size);
+
+/// Frees all `interpreter` heap-allocated resources using `allocator`.
+BAL_COLD void bal_interpreter_destroy(bal_allocator_t *allocator, bal_interpreter_t *interpreter);
+
+#endif /* BALLISTIC_INTERPRETER_H */
+
+/*** end of file ***/
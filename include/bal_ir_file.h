@@ -0,0 +1,167 @@
+/** @file bal_ir_file.h
+ *
+ * @brief Saves the IR of a compilation unit to a file and maps it back, so
+ * passes and backends can be run offline on IR captured from real guests.
+ *
+ * A file holds exactly one unit. It is made of fixed width fields in host
+ * byte order, which is little-endian on every supported host, laid out at
+ * naturally aligned offsets:
+ *
+ * - A [`bal_ir_file_header_t`].
+ * - `instruction_count` [`bal_instruction_t`].
+ * - `instruction_count` source extensions if the unit is wide. See
+ *   [`BAL_IR_FILE_WIDE`].
+ * - `constant_count` [`bal_constant_t`].
+ * - `instruction_count` [`bal_bit_width_t`], padded to 8 bytes.
+ *
+ * The arrays can thus be read in place from a read-only mapping.
+ */
+
+#ifndef BALLISTIC_IR_FILE_H
+#define BALLISTIC_IR_FILE_H
+
+#include "bal_attributes.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifies an IR file.
+#define BAL_IR_FILE_MAGIC "BALIRBIN"
+
+/// Incremented whenever the file format or the meaning of an opcode
+/// changes.
+#define BAL_IR_FILE_VERSION 6U
+
+/// Set in [`bal_ir_file_header_t`]`.flags` if the unit uses the wide IR
+/// form, whose `source_extensions` follow the instructions.
+#define BAL_IR_FILE_WIDE 0x1U
+
+typedef struct
+{
+    /// [`BAL_IR_FILE_MAGIC`] without its terminator.
+    uint8_t magic[8];
+
+    /// [`BAL_IR_FILE_VERSION`].
+    uint32_t version;
+
+    /// [`bal_engine_t`]`.instruction_count`.
+    uint32_t instruction_count;
+
+    /// [`bal_engine_t`]`.constant_count`.
+    uint32_t constant_count;
+
+    /// [`bal_unit_exit_t`]`.kind`.
+    uint32_t exit_kind;
+
+    /// [`bal_unit_exit_t`]`.target_register`.
+    uint32_t exit_target_register;
+
+    /// [`BAL_IR_FILE_WIDE`] or 0. Also keeps the following fields aligned.
+    uint32_t flags;
+
+    /// [`bal_engine_t`]`.guest_address`.
+    uint64_t guest_address;
+
+    /// [`bal_unit_exit_t`]`.target`.
+    uint64_t exit_target;
+
+    /// [`bal_unit_exit_t`]`.return_address`.
+    uint64_t exit_return_address;
+
+    /// [`bal_unit_exit_t`]`.guest_size`.
+    uint64_t exit_guest_size;
+
+    /// The size of the whole file in bytes.
+    uint64_t file_size;
+} bal_ir_file_header_t;
+
+/// A unit read in place from a file by [`bal_ir_map`]. Every pointer points
+/// into the read-only mapping.
+typedef struct
+{
+    /// The mapping of the whole file.
+    const uint8_t *mapping;
+
+    /// The size of `mapping` in bytes.
+    size_t mapping_size;
+
+    /// The IR instructions of the unit.
+    const bal_instruction_t *instructions;
+
+    /// The high source index bits of every instruction of a wide unit,
+    /// `NULL` otherwise.
+    const uint64_t *source_extensions;
+
+    /// The constants of the unit.
+    const bal_constant_t *constants;
+
+    /// The bit width of every instruction.
+    const bal_bit_width_t *ssa_bit_widths;
+
+    /// The number of entries in `instructions` and `ssa_bit_widths`.
+    bal_instruction_count_t instruction_count;
+
+    /// The number of entries in `constants`.
+    bal_constant_count_t constant_count;
+
+    /// The guest address the unit was translated from.
+    bal_guest_address_t guest_address;
+
+    /// How the unit ends.
+    bal_unit_exit_t unit_exit;
+} bal_ir_mapping_t;
+
+/// Writes the IR of the current compilation unit of `engine` to a new file
+/// at `path`, replacing any file already there.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if
+/// `engine->status != BAL_SUCCESS`.
+///
+/// Returns [`BAL_ERROR_FILE_IO`] if the file can not be written.
+BAL_COLD bal_error_t bal_ir_write(const bal_engine_t *engine, const char *path);
+
+/// Maps the file at `path`, written by [`bal_ir_write`], and points
+/// `mapping` at the unit it holds. Nothing is copied.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_FILE_IO`] if the file is missing or can not be
+/// mapped.
+///
+/// Returns [`BAL_ERROR_INVALID_FILE`] if the file is truncated, malformed or
+/// was written by another version.
+BAL_COLD bal_error_t bal_ir_map(bal_ir_mapping_t *mapping, const char *path, bal_logger_t logger);
+
+/// Resets `engine` and copies the unit of `mapping` into it, so passes and
+/// backends, which rewrite the IR in place, can run on it.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_INSTRUCTION_OVERFLOW`] if the unit does not fit in the
+/// arrays of `engine`, or is wide and `engine` has no `source_extensions`.
+BAL_COLD bal_error_t bal_ir_load(bal_engine_t *engine, const bal_ir_mapping_t *mapping);
+
+/// Unmaps the file of `mapping`. Does nothing if `mapping` is `NULL` or was
+/// not mapped.
+BAL_COLD void bal_ir_unmap(bal_ir_mapping_t *mapping);
+
+#endif /* BALLISTIC_IR_FILE_H */
+
+/*** end of file ***/
@@ -51,6 +51,20 @@ typedef const uint8_t *(*bal_translate_function_t)(void               *context,
                                                    bal_guest_address_t guest_address,
                                                    size_t             *max_readable_size);
 
+/// Translates a Guest Virtual Address (GVA) to a writable Host Virtual
+/// Address (HVA) for guest stores.
+///
+/// Returns a pointer to the host memory backing `guest_address`, or `NULL` if
+/// the address is unmapped or not writable.
+///
+/// # Safety
+///
+/// The implementation must write the number of contiguous, writable bytes
+/// available at the returned pointer into `max_writable_size`.
+typedef uint8_t *(*bal_translate_write_function_t)(void               *context,
+                                                   bal_guest_address_t guest_address,
+                                                   size_t             *max_writable_size);
+
 /// The host application is responsible for providing an allocator capable of
 /// handling aligned memory requests.
 typedef struct
@@ -81,6 +95,10 @@ typedef struct
 
     /// The callback invoked to perform address translation.
     bal_translate_function_t translate;
+
+    /// The callback invoked to translate the target of a guest store, or
+    /// `NULL` if guest memory is read only.
+    bal_translate_write_function_t translate_write;
 } bal_memory_interface_t;
 
 /// Populates `out_allocator` with the default system implementation.
@@ -131,6 +149,135 @@ BAL_COLD bal_error_t bal_memory_init_flat(bal_allocator_t *BAL_RESTRICT        a
 /// Ballistic does not take ownership of the host memory region.
 BAL_COLD void bal_memory_destroy_flat(bal_allocator_t        *allocator,
                                       bal_memory_interface_t *interface);
+
+/// The number of low guest address bits a paged interface translates. Guest
+/// addresses at or above `1 << BAL_MEMORY_PAGED_ADDRESS_BITS` are never
+/// mapped.
+#define BAL_MEMORY_PAGED_ADDRESS_BITS 48U
+
+/// The access a page mapped by [`bal_memory_map_paged`] allows. The values
+/// are combined with a bitwise or.
+typedef enum
+{
+    /// The page is mapped but every access to it faults.
+    BAL_MEMORY_PERMISSION_NONE = 0,
+
+    /// Instructions can be fetched from the page and guest loads can read it.
+    BAL_MEMORY_PERMISSION_READ = 1,
+
+    /// Guest stores can write the page.
+    BAL_MEMORY_PERMISSION_WRITE = 2,
+} bal_memory_permission_t;
+
+/// Initializes a sparse translation interface of `page_size` pages, which
+/// starts out with nothing mapped.
+///
+/// Guest pages are mapped to host memory by [`bal_memory_map_paged`] through
+/// a radix tree of four levels, so the memory it takes grows with the mapped
+/// pages rather than with the highest guest address. `page_size` must be
+/// 4 KiB or 64 KiB. The context and every table are allocated with
+/// `allocator`, which must stay valid until [`bal_memory_destroy_paged`].
+///
+/// The translation callbacks report every following page whose host memory
+/// continues the same way, and that allows the access, in
+/// `max_readable_size` or `max_writable_size`.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL` or
+/// `page_size` is not supported.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if failed to allocate memory interface.
+BAL_COLD bal_error_t bal_memory_init_paged(bal_allocator_t *BAL_RESTRICT        allocator,
+                                           bal_memory_interface_t *BAL_RESTRICT interface,
+                                           size_t                               page_size,
+                                           bal_logger_t                         logger);
+
+/// Maps the `size` bytes of guest memory at `guest_address` to the host
+/// memory at `host`, allowing the accesses in `permissions`, a combination
+/// of [`bal_memory_permission_t`]. Pages already mapped in the range are
+/// replaced.
+///
+/// Returns [`BAL_SUCCESS`] on success. Nothing is mapped on failure.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a pointer is `NULL`, `size` is
+/// zero, the range ends above [`BAL_MEMORY_PAGED_ADDRESS_BITS`] or
+/// `permissions` has unknown bits.
+///
+/// Returns [`BAL_ERROR_MEMORY_ALIGNMENT`] if `guest_address` or `size` is not
+/// a multiple of the page size, or `host` is not aligned to a 16-byte
+/// boundary.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if a table could not be allocated.
+///
+/// # Safety
+///
+/// The caller retains ownership of `host`, which must stay valid until it is
+/// unmapped. Translations already cached, such as by a vCPU TLB, are not
+/// updated, and units compiled from the replaced pages are not discarded.
+/// The interface must not be changed while another thread translates
+/// through it.
+bal_error_t bal_memory_map_paged(bal_memory_interface_t *interface,
+                                 bal_guest_address_t     guest_address,
+                                 void                   *host,
+                                 size_t                  size,
+                                 uint32_t                permissions);
+
+/// Unmaps every page of the `size` bytes at `guest_address`, freeing the
+/// tables that become empty. Pages that are not mapped are skipped.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `interface` is `NULL` or the
+/// range ends above [`BAL_MEMORY_PAGED_ADDRESS_BITS`].
+///
+/// Returns [`BAL_ERROR_MEMORY_ALIGNMENT`] if `guest_address` or `size` is not
+/// a multiple of the page size.
+///
+/// # Safety
+///
+/// See [`bal_memory_map_paged`].
+bal_error_t bal_memory_unmap_paged(bal_memory_interface_t *interface,
+                                   bal_guest_address_t     guest_address,
+                                   size_t                  size);
+
+/// Changes the permissions of every page of the `size` bytes at
+/// `guest_address` to `permissions`.
+///
+/// Returns [`BAL_SUCCESS`] on success. Nothing is changed on failure.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `interface` is `NULL`, the range
+/// ends above [`BAL_MEMORY_PAGED_ADDRESS_BITS`] or `permissions` has unknown
+/// bits.
+///
+/// Returns [`BAL_ERROR_MEMORY_ALIGNMENT`] if `guest_address` or `size` is not
+/// a multiple of the page size.
+///
+/// Returns [`BAL_ERROR_GUEST_MEMORY_FAULT`] if a page in the range is not
+/// mapped.
+///
+/// # Safety
+///
+/// See [`bal_memory_map_paged`].
+bal_error_t bal_memory_protect_paged(bal_memory_interface_t *interface,
+                                     bal_guest_address_t     guest_address,
+                                     size_t                  size,
+                                     uint32_t                permissions);
+
+/// Frees the context and every table allocated within `interface` using the
+/// provided `allocator`, the one passed to [`bal_memory_init_paged`].
+///
+/// This does **not** free the host memory passed to [`bal_memory_map_paged`].
+BAL_COLD void bal_memory_destroy_paged(bal_allocator_t        *allocator,
+                                       bal_memory_interface_t *interface);
 #endif /* BALLISTIC_MEMORY_H */
 
 /*** end of file ***/
@@ -0,0 +1,100 @@
+/** @file bal_passes.h
+ *
+ * @brief Optimization passes that run over a translated compilation unit.
+ */
+
+#ifndef BALLISTIC_PASSES_H
+#define BALLISTIC_PASSES_H
+
+#include "bal_attributes.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include <stdbool.h>
+
+/// The maximum number of instructions, excluding `OPCODE_YIELD`, each arm of
+/// an `IF` diamond may hold for it to be flattened into
+/// `OPCODE_CONDITIONAL_SELECT`. A flattened inner diamond counts as both of
+/// its arms plus the select, so an arm fits a compare and an inner diamond
+/// whose arms hold one instruction each.
+#define BAL_IF_TO_SELECT_MAX_ARM_INSTRUCTIONS 4U
+
+/// The deepest `IF`/`LOOP` nesting the passes track. Scopes nested deeper than
+/// this are left untouched.
+#define BAL_PASS_MAX_SCOPE_DEPTH 64U
+
+/// Flattens small side-effect free `IF` diamonds in `engine` into
+/// `OPCODE_CONDITIONAL_SELECT`.
+///
+/// A diamond qualifies when both arms yield exactly one value, every
+/// instruction in both arms is side-effect free, and neither arm holds more
+/// than [`BAL_IF_TO_SELECT_MAX_ARM_INSTRUCTIONS`] instructions. The arm
+/// bodies are kept in place and executed speculatively. `OPCODE_IF`,
+/// `OPCODE_ELSE` and both `OPCODE_YIELD` instructions become `OPCODE_NOP`,
+/// and `OPCODE_MERGE` becomes the select so its users do not need to be
+/// remapped. Inner diamonds are flattened before their parents, so nested
+/// clamps collapse in a single pass.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine` is `NULL` or
+/// `engine->status != BAL_SUCCESS`.
+BAL_HOT bal_error_t bal_pass_if_to_select(bal_engine_t *engine);
+
+/// Replaces every `OPCODE_ADD`, `OPCODE_SUB`, `OPCODE_AND` and `OPCODE_XOR`
+/// in `engine` whose operands are all known at compile time with an
+/// `OPCODE_CONST` of the result, interned into the constant pool. The SSA
+/// index of the instruction is kept, so its users do not need to be
+/// remapped, and the definitions it read are left for the backend to drop
+/// once nothing reads them. Folding stops early when the constant pool is
+/// full.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine` is `NULL` or
+/// `engine->status != BAL_SUCCESS`.
+BAL_HOT bal_error_t bal_pass_constant_folding(bal_engine_t *engine);
+
+/// Replaces every `OPCODE_SET_REGISTER` of a lazy flag field in `engine` that
+/// is overwritten before anything reads it with `OPCODE_NOP`. The values only
+/// those writes used are then dropped by the backend like any other unused
+/// value. Guest memory accesses read every field, since a fault returns to
+/// the host.
+///
+/// The flags are live when the unit exits unless `flags_dead_on_exit` is set,
+/// which the caller may only do if the code the unit always continues at
+/// writes every flag field before reading one. The last write of each field
+/// then becomes `OPCODE_SET_REGISTER_ON_EXIT`, which the exit skips once it
+/// is linked to that code. Writes inside an `IF` scope are removed when dead
+/// but never hide earlier writes, and are never left to the exit.
+///
+/// Sets `*flags_live_on_entry` to whether the unit may read a flag field
+/// before writing it, or leave through an unlinked exit without writing
+/// it.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine` is `NULL` or
+/// `engine->status != BAL_SUCCESS`.
+BAL_HOT bal_error_t bal_pass_dead_flags(bal_engine_t *engine,
+                                        bool          flags_dead_on_exit,
+                                        bool         *flags_live_on_entry);
+
+/// Runs the Tier 2 optimization pipeline over `engine`, one pass after the
+/// other. Used when a hot unit is recompiled.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns the error of the first pass that fails.
+BAL_HOT bal_error_t bal_passes_run_tier2(bal_engine_t *engine);
+
+#endif /* BALLISTIC_PASSES_H */
+
+/*** end of file ***/
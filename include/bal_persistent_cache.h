@@ -0,0 +1,253 @@
+/** @file bal_persistent_cache.h
+ *
+ * @brief Keeps compiled units on disk so later runs can skip compiling
+ * them.
+ *
+ * A unit is stored with its unlinked host code, its relocations and the
+ * metadata the runtime needs to link it, keyed by its guest address and
+ * tier. Each entry also records a hash of the guest code it was translated
+ * from, so a unit whose guest code changed since is never reused.
+ *
+ * The file is little-endian and made of fixed width fields at naturally
+ * aligned offsets:
+ *
+ * - A [`bal_persistent_cache_header_t`].
+ * - `entry_count` [`bal_persistent_cache_entry_t`] sorted by guest address
+ *   and tier, without duplicates.
+ * - The data of every entry at its `data_offset`: the host code, the cold
+ *   code, then the relocations, padded to 8 bytes.
+ *
+ * The whole file is validated once when it is opened, after which it is
+ * read in place from a read-only mapping. A file written by another
+ * version, or with a different static context, is ignored.
+ */
+
+#ifndef BALLISTIC_PERSISTENT_CACHE_H
+#define BALLISTIC_PERSISTENT_CACHE_H
+
+#include "bal_attributes.h"
+#include "bal_backend.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include "bal_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifies a persistent cache file.
+#define BAL_PERSISTENT_CACHE_MAGIC "BALCACHE"
+
+/// Incremented whenever the file format or the code the backend emits
+/// changes.
+#define BAL_PERSISTENT_CACHE_VERSION 5U
+
+typedef struct
+{
+    /// [`BAL_PERSISTENT_CACHE_MAGIC`] without its terminator.
+    uint8_t magic[8];
+
+    /// [`BAL_PERSISTENT_CACHE_VERSION`].
+    uint32_t version;
+
+    /// The number of entries following the header.
+    uint32_t entry_count;
+
+    /// A hash of everything outside the guest code that shapes a unit, as
+    /// passed to [`bal_persistent_cache_open`].
+    uint64_t context;
+
+    /// The size of the whole file in bytes.
+    uint64_t file_size;
+} bal_persistent_cache_header_t;
+
+typedef struct
+{
+    /// The guest address of the unit.
+    uint64_t guest_address;
+
+    /// The hash of the guest code of the unit followed by the
+    /// `flags_assumption_size` bytes at `exit_target`. See
+    /// [`bal_persistent_cache_hash`].
+    uint64_t guest_hash;
+
+    /// [`bal_unit_exit_t`]`.target`.
+    uint64_t exit_target;
+
+    /// [`bal_unit_exit_t`]`.return_address`.
+    uint64_t exit_return_address;
+
+    /// [`bal_unit_exit_t`]`.guest_size`.
+    uint32_t guest_size;
+
+    /// The number of guest bytes at `exit_target` assumed to overwrite the
+    /// flags when the unit was compiled, or 0.
+    uint32_t flags_assumption_size;
+
+    /// [`bal_unit_exit_t`]`.kind`.
+    uint32_t exit_kind;
+
+    /// [`bal_unit_exit_t`]`.target_register`.
+    uint32_t exit_target_register;
+
+    /// The tier the unit was compiled at.
+    uint32_t tier;
+
+    /// Whether the unit may read a lazy flag field before writing it.
+    uint32_t flags_live_on_entry;
+
+    /// The size of the host code and of the cold code in bytes.
+    uint32_t code_size;
+    uint32_t cold_size;
+
+    /// [`bal_compiled_unit_t`]`.body_offset`.
+    uint32_t body_offset;
+
+    /// The offset the unit was compiled at, modulo 8.
+    uint32_t code_alignment;
+
+    /// The number of [`bal_relocation_t`] after the code.
+    uint32_t relocation_count;
+
+    /// [`bal_compiled_unit_t`]`.link_offsets`.
+    uint32_t link_offsets[BAL_LINK_KIND_COUNT];
+
+    /// Keeps `data_offset` aligned.
+    uint32_t reserved;
+
+    /// The offset in the file of the data of the entry.
+    uint64_t data_offset;
+} bal_persistent_cache_entry_t;
+
+typedef struct
+{
+    /// The read-only mapping of the file, or `NULL` if none was loaded.
+    const uint8_t *mapping;
+
+    /// The size of `mapping` in bytes.
+    size_t mapping_size;
+
+    /// The entries of the mapped file.
+    const bal_persistent_cache_entry_t *entries;
+
+    /// The number of entries in `entries`.
+    uint32_t entry_count;
+
+    /// The units recorded since the file was opened. `data_offset` is
+    /// relative to `record_data`.
+    bal_persistent_cache_entry_t *records;
+
+    /// The data of every record, laid out like in the file.
+    uint8_t *record_data;
+
+    /// The number of records and the size of `records` in entries.
+    uint32_t record_count;
+    uint32_t record_capacity;
+
+    /// The bytes used and allocated in `record_data`.
+    size_t record_data_size;
+    size_t record_data_capacity;
+
+    /// The static context the file must have been written with.
+    uint64_t context;
+
+    /// The path of the file. Owned by the caller.
+    const char *path;
+
+    /// Allocates the records.
+    bal_allocator_t allocator;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_persistent_cache_t;
+
+/// The first `hash` of a chain of [`bal_persistent_cache_hash`] calls.
+#define BAL_PERSISTENT_CACHE_HASH_SEED 0xCBF29CE484222325ULL
+
+/// Returns the FNV-1a hash of the `size` bytes at `bytes`, continuing from
+/// `hash`.
+uint64_t bal_persistent_cache_hash(uint64_t hash, const void *bytes, size_t size);
+
+/// Initializes `cache` to read and write the file at `path`, and maps it if
+/// it exists. A file that is missing, fails validation, or was written with
+/// another version or `context`, is ignored and replaced by the next
+/// [`bal_persistent_cache_save`].
+///
+/// Returns [`BAL_SUCCESS`] on success, including when the file was ignored.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+BAL_COLD bal_error_t bal_persistent_cache_open(const bal_allocator_t  *allocator,
+                                               bal_persistent_cache_t *cache,
+                                               const char             *path,
+                                               uint64_t                context,
+                                               bal_logger_t            logger);
+
+/// Returns the entry of the mapped file for the unit at `guest_address` and
+/// `tier`, or `NULL` if there is none. The caller checks its `guest_hash`.
+const bal_persistent_cache_entry_t *bal_persistent_cache_find(
+    const bal_persistent_cache_t *cache, bal_guest_address_t guest_address, uint32_t tier);
+
+/// Returns the data of `entry`, a result of [`bal_persistent_cache_find`]:
+/// its host code, followed by its cold code, then its relocations at the
+/// next multiple of 4 bytes.
+static inline const uint8_t *
+bal_persistent_cache_data(const bal_persistent_cache_t       *cache,
+                          const bal_persistent_cache_entry_t *entry)
+{
+    return cache->mapping + entry->data_offset;
+}
+
+/// Returns the relocations of `entry`, a result of
+/// [`bal_persistent_cache_find`].
+static inline const bal_relocation_t *
+bal_persistent_cache_relocations(const bal_persistent_cache_t       *cache,
+                                 const bal_persistent_cache_entry_t *entry)
+{
+    size_t code_size = ((size_t)entry->code_size + entry->cold_size + 3U) & ~(size_t)3U;
+    return (const bal_relocation_t *)(const void *)(bal_persistent_cache_data(cache, entry)
+                                                     + code_size);
+}
+
+/// Fills `unit` with the description of `entry`, a result of
+/// [`bal_persistent_cache_find`], that [`bal_backend_load_x86_64`] expects.
+void bal_persistent_cache_unit(const bal_persistent_cache_t       *cache,
+                               const bal_persistent_cache_entry_t *entry,
+                               bal_compiled_unit_t                *unit);
+
+/// Stores a copy of the unit described by `entry`, with the data laid out
+/// like [`bal_persistent_cache_data`] from `code`, `cold_code` and
+/// `relocations`. `entry->data_offset` is ignored. The unit is written to
+/// disk by the next [`bal_persistent_cache_save`], replacing any entry with
+/// the same guest address and tier.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the copy can not be allocated.
+bal_error_t bal_persistent_cache_record(bal_persistent_cache_t             *cache,
+                                        const bal_persistent_cache_entry_t *entry,
+                                        const uint8_t                      *code,
+                                        const uint8_t                      *cold_code,
+                                        const bal_relocation_t             *relocations);
+
+/// Writes every record and every entry of the mapped file not replaced by
+/// one to the file, then maps the new file in place of the old one and
+/// drops the records. The file is written next to its final path and
+/// renamed over it, so a crash never leaves it half written.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_FILE_IO`] if the file can not be written, in which
+/// case the records are kept.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if temporary memory can not be
+/// allocated.
+BAL_COLD bal_error_t bal_persistent_cache_save(bal_persistent_cache_t *cache);
+
+/// Unmaps the file and releases every record.
+BAL_COLD void bal_persistent_cache_close(bal_persistent_cache_t *cache);
+
+#endif /* BALLISTIC_PERSISTENT_CACHE_H */
+
+/*** end of file ***/
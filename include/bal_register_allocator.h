@@ -0,0 +1,132 @@
+/** @file bal_register_allocator.h
+ *
+ * @brief Linear scan register allocation over the structured SSA IR.
+ */
+
+#ifndef BALLISTIC_REGISTER_ALLOCATOR_H
+#define BALLISTIC_REGISTER_ALLOCATOR_H
+
+#include "bal_attributes.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include "bal_platform.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The maximum number of host registers in a register class.
+#define BAL_MAX_HOST_REGISTERS 32U
+
+/// The maximum number of 8-byte spill slots in a compilation unit's frame.
+#define BAL_MAX_SPILL_SLOTS 256U
+
+/// The size of one spill slot in bytes.
+#define BAL_SPILL_SLOT_SIZE 8U
+
+/// The location of an SSA variable that was never assigned one. This is the
+/// case for `TYPE_VOID` variables and values that are never used.
+#define BAL_LOCATION_NONE 0xFFFFU
+
+/// Set in a [`bal_value_location_t`] when the value lives in a spill slot. The
+/// remaining bits hold the slot index.
+#define BAL_LOCATION_SPILLED 0x8000U
+
+/// Where an SSA variable lives for its entire live range. Without
+/// [`BAL_LOCATION_SPILLED`] this is a host register number.
+typedef uint16_t bal_value_location_t;
+
+typedef enum
+{
+    /// 64-bit x86 hosts. Registers are numbered `RAX = 0` to `R15 = 15` like
+    /// the ModRM encoding.
+    BAL_HOST_ARCHITECTURE_X86_64,
+
+    /// 64-bit ARM hosts. Registers are numbered `X0 = 0` to `X30 = 30`.
+    BAL_HOST_ARCHITECTURE_ARM64,
+} bal_host_architecture_t;
+
+#if BAL_ARCHITECTURE_X86
+#define BAL_HOST_ARCHITECTURE_NATIVE BAL_HOST_ARCHITECTURE_X86_64
+#else
+#define BAL_HOST_ARCHITECTURE_NATIVE BAL_HOST_ARCHITECTURE_ARM64
+#endif
+
+/// Describes the general purpose registers of a host.
+typedef struct
+{
+    /// Registers the allocator may hand out, in order of preference.
+    uint8_t registers[BAL_MAX_HOST_REGISTERS];
+
+    /// The number of valid entries in `registers`.
+    uint8_t registers_count;
+
+    /// Holds the pointer to the guest state for the lifetime of the
+    /// translated code. Never allocated.
+    uint8_t guest_state_register;
+
+    /// Reserved for code generation templates, e.g. to reload spilled
+    /// operands. Never allocated.
+    uint8_t scratch_registers[2];
+
+    /// Bit `n` is set if register `n` must be preserved across calls.
+    uint32_t callee_saved_mask;
+} bal_register_class_t;
+
+/// The result of [`bal_register_allocate`].
+typedef struct
+{
+    /// The location of every SSA variable, indexed by SSA index. This points
+    /// into `engine->scratch`.
+    bal_value_location_t *locations;
+
+    /// The index of the last instruction that reads each SSA variable, or
+    /// `0xFFFFFFFF` if it is never read. This points into `engine->scratch`.
+    uint32_t *live_range_ends;
+
+    /// The number of spill slots the unit's frame must reserve.
+    uint32_t spill_slot_count;
+
+    /// Bit `n` is set if host register `n` was handed out.
+    uint32_t used_registers_mask;
+} bal_register_allocation_t;
+
+/// Populates `register_class` with the allocatable registers of
+/// `architecture`.
+///
+/// On x86-64, `R15` holds the guest state pointer, `RAX` and `RCX` are
+/// scratch registers and `RSP` is never touched. On ARM64, `X28` holds the
+/// guest state pointer, `X16` and `X17` are scratch registers, and `X18`,
+/// `X29`, `X30` and `SP` are never touched.
+BAL_COLD void bal_register_class_init(bal_register_class_t   *register_class,
+                                      bal_host_architecture_t architecture);
+
+/// Removes `host_register` from the allocatable registers in
+/// `register_class` so it can hold a value for the lifetime of the
+/// translated code, like a fastmem base address.
+BAL_COLD void bal_register_class_pin(bal_register_class_t *register_class, uint8_t host_register);
+
+/// Assigns a host register or spill slot to every SSA variable in `engine`.
+///
+/// Live ranges are computed in one backward sweep over `engine->instructions`.
+/// The allocation itself walks the instructions forward in SSA order and,
+/// when registers run out, spills the live range that ends furthest away.
+/// The value defined by `OPCODE_MERGE` is allocated at its first
+/// `OPCODE_YIELD`, so both arms write to the same location. All arrays live
+/// in `engine->scratch` and are valid until the next pass runs.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if any pointer is `NULL`.
+///
+/// Returns [`BAL_ERROR_ENGINE_STATE_INVALID`] if `engine->status != BAL_SUCCESS`.
+///
+/// Returns [`BAL_ERROR_SPILL_SLOT_OVERFLOW`] if more than
+/// [`BAL_MAX_SPILL_SLOTS`] values are spilled at the same time.
+BAL_HOT bal_error_t bal_register_allocate(bal_engine_t *BAL_RESTRICT               engine,
+                                          const bal_register_class_t *BAL_RESTRICT register_class,
+                                          bal_register_allocation_t *BAL_RESTRICT  allocation);
+
+#endif /* BALLISTIC_REGISTER_ALLOCATOR_H */
+
+/*** end of file ***/
@@ -0,0 +1,386 @@
+/** @file bal_runtime.h
+ *
+ * @brief Runs guest code by translating, compiling and chaining units.
+ *
+ * The dispatcher looks up the unit for the current guest address, compiling
+ * it on a miss, and calls it. A unit with a direct exit is linked to the unit
+ * at its target as soon as both exist, after which control flows from one to
+ * the other without returning to the dispatcher.
+ *
+ * Calls are linked the same way to the unit at their return address, so the
+ * return stack buffer of the vCPU lets a matching return jump straight back
+ * into compiled code.
+ *
+ * With execution counters enabled, every Tier 1 unit counts down from a
+ * threshold each time it is entered. A unit that reaches zero is queued, and
+ * the dispatcher replaces it with a Tier 2 unit compiled through the
+ * optimization pipeline before running anything else.
+ *
+ * Guest stores to a page holding translated code are caught, and every unit
+ * overlapping the stored bytes is discarded before the store happens, so
+ * self-modifying code runs its new instructions from the next unit on. With
+ * fastmem, such pages are write protected in the region while a compiled
+ * unit is on them, and a store to one discards every unit on the page.
+ *
+ * The code memory is split into segments that are filled in turn. When a
+ * unit does not fit in the rest of the current segment, or every translation
+ * entry is in use, the oldest segment is emptied by discarding its units and
+ * code is emitted into it again. Discarded units are translated again the
+ * next time they run.
+ *
+ * With a persistent cache, every compiled unit is also recorded with its
+ * relocations, and [`bal_runtime_save_cache`] writes the records to disk. A
+ * later runtime with the same configuration loads a unit from the file
+ * instead of compiling it, as long as the guest code it was translated
+ * from is unchanged.
+ *
+ * Up to `config.max_vcpus` threads may run guest code at once, each on its
+ * own vCPU, sharing every unit. The dispatcher looks units up and calls them
+ * without synchronization. Everything that changes the runtime, such as
+ * compiling, decoding, linking and discarding units, takes a lock that only
+ * a miss contends on. Interpreted units run outside of it, each vCPU with its
+ * own value slots. Discarded units stay in memory until every vCPU has been
+ * back in the dispatcher, which [`bal_epoch_t`] tracks, so neither their
+ * entries, their host code nor the interpreter arenas are reused while
+ * another vCPU may still be running them.
+ */
+
+#ifndef BALLISTIC_RUNTIME_H
+#define BALLISTIC_RUNTIME_H
+
+#include "bal_attributes.h"
+#include "bal_code_buffer.h"
+#include "bal_code_memory.h"
+#include "bal_code_pages.h"
+#include "bal_engine.h"
+#include "bal_epoch.h"
+#include "bal_errors.h"
+#include "bal_fastmem.h"
+#include "bal_interpreter.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include "bal_persistent_cache.h"
+#include "bal_register_allocator.h"
+#include "bal_translation_cache.h"
+#include "bal_types.h"
+#include "bal_vcpu.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The number of bits in the filter remembering evicted guest addresses.
+#define BAL_RUNTIME_EVICTED_FILTER_BITS 4096U
+
+/// Tunables for [`bal_runtime_init`].
+typedef struct
+{
+    /// The bytes of address space reserved for compiled code. Must not
+    /// exceed 2 GiB when `cold_code_size` is not zero.
+    size_t code_memory_size;
+
+    /// The bytes at the end of the code memory set aside for code on rare
+    /// paths, such as inline cache misses. 0 emits that code next to the
+    /// unit instead.
+    size_t cold_code_size;
+
+    /// The number of equal segments both code regions are split into. A
+    /// full code memory evicts one segment at a time, so 1 discards every
+    /// unit at once. Must not be zero.
+    uint32_t code_segments;
+
+    /// The maximum number of guest bytes translated into one unit. Must not
+    /// exceed [`BAL_TLB_PAGE_SIZE`].
+    size_t max_unit_size;
+
+    /// The maximum number of units alive at once. Discarded units count
+    /// until no vCPU can be running them anymore.
+    uint32_t max_translations;
+
+    /// The most threads that may be in [`bal_runtime_run`] at once, each with
+    /// its own vCPU. Must not be zero, and must be 1 with `fastmem`.
+    uint32_t max_vcpus;
+
+    /// Chains units with direct exits together and lets returns predicted by
+    /// the return stack buffer skip the dispatcher. When disabled, every unit
+    /// returns to the dispatcher.
+    bool enable_block_linking;
+
+    /// The number of inline cache entries in front of every `BR` and `BLR`,
+    /// up to [`BAL_INLINE_CACHE_MAX_ENTRIES`]. The entries are filled with
+    /// the targets the dispatcher sees. Requires `enable_block_linking`.
+    uint32_t inline_cache_entries;
+
+    /// Emits an execution counter into every Tier 1 unit and promotes hot
+    /// units to Tier 2.
+    bool enable_execution_counters;
+
+    /// The number of times a Tier 1 unit is entered before it is promoted.
+    /// Must not be zero.
+    uint32_t promotion_threshold;
+
+    /// Runs new units in the IR interpreter as Tier 0 and only compiles
+    /// them once they have run `interpreter_threshold` times. Units the
+    /// interpreter can not run are compiled right away.
+    bool enable_interpreter;
+
+    /// The number of times a unit is interpreted before it is compiled at
+    /// Tier 1. Must not be zero.
+    uint32_t interpreter_threshold;
+
+    /// The number of decoded IR instructions the interpreter holds before it
+    /// discards every unit.
+    uint32_t interpreter_capacity;
+
+    /// Has compiled code access guest memory directly in this region instead
+    /// of probing the TLB, or `NULL` to always probe it. Owned by the caller
+    /// and must outlive the runtime. Its base register is not available for
+    /// allocation. See [`bal_fastmem_t`].
+    bal_fastmem_t *fastmem;
+
+    /// The file compiled units are kept in across runs, or `NULL` for none.
+    /// The file is ignored if it was written with a different configuration.
+    /// Owned by the caller and must outlive the runtime. See
+    /// [`bal_persistent_cache_t`].
+    const char *persistent_cache_path;
+} bal_runtime_config_t;
+
+/// Counters describing what the runtime has done since initialization.
+typedef struct
+{
+    /// The number of units called by the dispatcher. Linked transfers are
+    /// not counted.
+    uint64_t dispatches;
+
+    /// The number of units compiled.
+    uint64_t translations;
+
+    /// The number of units loaded from the persistent cache instead of
+    /// compiled.
+    uint64_t cache_loads;
+
+    /// The number of sites patched to point to another unit.
+    uint64_t links;
+
+    /// The number of linked sites patched back to the dispatcher.
+    uint64_t unlinks;
+
+    /// The number of units discarded by [`bal_runtime_invalidate`].
+    uint64_t invalidations;
+
+    /// The number of inline cache entries filled or replaced after a miss.
+    /// Hits and misses are counted per vCPU in [`bal_vcpu_counters_t`].
+    uint64_t inline_cache_fills;
+
+    /// The number of hot units recompiled at Tier 2.
+    uint64_t promotions;
+
+    /// The number of units run by the interpreter.
+    uint64_t interpretations;
+
+    /// The number of guest stores that hit a page with translated code.
+    uint64_t code_writes;
+
+    /// The number of code segments holding units that were emptied to make
+    /// room for new units.
+    uint64_t evictions;
+
+    /// The number of units discarded by evictions.
+    uint64_t evicted_units;
+
+    /// The number of units compiled at a guest address whose unit was
+    /// evicted before. Hash collisions may overcount it slightly.
+    uint64_t retranslations;
+} bal_runtime_stats_t;
+
+typedef struct
+{
+    /// Translates guest code into IR.
+    bal_engine_t engine;
+
+    /// The host registers the backend allocates from.
+    bal_register_class_t register_class;
+
+    /// The dual mapped memory holding compiled units.
+    bal_code_memory_t code_memory;
+
+    /// Appends compiled units to the hot region of `code_memory`.
+    bal_code_buffer_t code_buffer;
+
+    /// Appends the rarely run parts of compiled units to the cold region of
+    /// `code_memory`. Unused if `config.cold_code_size` is 0.
+    bal_code_buffer_t cold_code_buffer;
+
+    /// Every live unit and the links between them.
+    bal_translation_cache_t cache;
+
+    /// The segment new units are emitted into.
+    uint32_t code_segment;
+
+    /// The epoch the current segment was emptied in. Nothing is emitted into
+    /// it until every vCPU has moved past it.
+    uint64_t segment_epoch;
+
+    /// The size in bytes of a segment of the hot region.
+    size_t hot_segment_size;
+
+    /// The size in bytes of a segment of the cold region, or 0 without one.
+    size_t cold_segment_size;
+
+    /// A bit for each hash of the guest address of an evicted unit, cleared
+    /// when a unit is compiled there again.
+    uint64_t evicted_filter[BAL_RUNTIME_EVICTED_FILTER_BITS / 64U];
+
+    /// The execution counter of every translation, indexed like
+    /// `cache.translations`. `NULL` unless execution counters are enabled.
+    int32_t *execution_counters;
+
+    /// The indices of hot translations waiting to be promoted.
+    uint32_t *promotion_queue;
+
+    /// The number of entries in `promotion_queue`.
+    uint32_t promotion_queue_count;
+
+    /// The units of the file at `config.persistent_cache_path` and the ones
+    /// compiled since it was loaded. Unused if there is no such path.
+    bal_persistent_cache_t persistent_cache;
+
+    /// Runs units before they are compiled. Unused unless
+    /// `config.enable_interpreter` is set.
+    bal_interpreter_t interpreter;
+
+    /// The value slots interpreted units run with, `interpreter.value_capacity`
+    /// of them for each of `config.max_vcpus`, so vCPUs interpret without the
+    /// lock. `NULL` unless `config.enable_interpreter` is set.
+    uint64_t *interpreter_values;
+
+    /// The pages holding the code of a compiled or interpreted unit. Every
+    /// vCPU TLB reports stores to them.
+    bal_code_pages_t code_pages;
+
+    /// Fetches guest code. Owned by the caller.
+    bal_memory_interface_t *interface;
+
+    /// The configuration passed to [`bal_runtime_init`].
+    bal_runtime_config_t config;
+
+    /// Event counters.
+    bal_runtime_stats_t stats;
+
+    /// Incremented whenever a unit is discarded. A vCPU whose return stack
+    /// buffer is from an older generation has it cleared before running.
+    uint64_t generation;
+
+    /// Tells when every vCPU has stopped running the units discarded before
+    /// some point. Has a slot for each of `config.max_vcpus`.
+    bal_epoch_t epoch;
+
+    /// The vCPU or other caller holding the lock that serializes changes to
+    /// the runtime, or 0 while it is free.
+    uint64_t lock_owner;
+
+    /// The number of threads waiting for vCPUs to leave discarded code.
+    /// Every site stays unlinked while it is not zero.
+    uint32_t waiters;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_runtime_t;
+
+/// Populates `config` with the default tunables.
+BAL_COLD void bal_runtime_config_init_default(bal_runtime_config_t *config);
+
+/// Initializes `runtime` to run guest code fetched through `interface`. A
+/// `NULL` `config` selects the defaults.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a required pointer is `NULL`,
+/// `code_segments` or `max_vcpus` is zero, execution counters are enabled
+/// with a zero `promotion_threshold`,
+/// `max_unit_size` exceeds [`BAL_TLB_PAGE_SIZE`], or `config.fastmem` is set
+/// but not initialized or shared by more than one vCPU.
+///
+/// Returns [`BAL_ERROR_UNSUPPORTED_HOST`] if there is no backend for the host
+/// architecture.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if memory can not be reserved.
+BAL_COLD bal_error_t bal_runtime_init(bal_allocator_t            *allocator,
+                                      bal_runtime_t              *runtime,
+                                      bal_memory_interface_t     *interface,
+                                      const bal_runtime_config_t *config,
+                                      bal_logger_t                logger);
+
+/// Runs guest code starting at `*guest_address` on `vcpu` until control
+/// reaches `halt_address`. The address execution stopped at is written back
+/// to `guest_address` and `vcpu->state.pc`.
+///
+/// `halt_address` is never translated, so any unit branching to it returns
+/// to the dispatcher.
+///
+/// Guest data is accessed through `vcpu->tlb`, which is bound to the memory
+/// interface and the code pages of `runtime`, and flushed if it was bound to
+/// another runtime.
+///
+/// With `config.enable_interpreter` set, units are interpreted until they
+/// have run `config.interpreter_threshold` times and only then compiled.
+///
+/// Other threads may run other vCPUs on `runtime` at the same time, up to
+/// `config.max_vcpus` in all. A store to code one of them compiled is only
+/// guaranteed to be seen by the others from their next unit on.
+///
+/// Returns [`BAL_SUCCESS`] once `halt_address` is reached.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `config.max_vcpus` threads are
+/// already running guest code on `runtime`.
+///
+/// Returns [`BAL_ERROR_GUEST_MEMORY_FAULT`] if guest code can not be fetched,
+/// or a guest data access faults. The latter stops at the start of the unit
+/// that faulted, which may have partially run, and leaves the data address
+/// in `vcpu->tlb.fault_address`.
+///
+/// Returns any error of [`bal_engine_translate`] or
+/// [`bal_backend_compile_x86_64`] if a unit fails to compile, such as
+/// [`BAL_ERROR_CODE_BUFFER_OVERFLOW`] for a unit larger than a code segment.
+BAL_HOT bal_error_t bal_runtime_run(bal_runtime_t *BAL_RESTRICT       runtime,
+                                    bal_vcpu_t *BAL_RESTRICT          vcpu,
+                                    bal_guest_address_t *BAL_RESTRICT guest_address,
+                                    bal_guest_address_t               halt_address);
+
+/// Discards every unit whose guest code overlaps `[guest_address,
+/// guest_address + size)`, and every unit that dropped its flags because the
+/// code it continues at in that range overwrote them. Sites linked to a
+/// discarded unit are unlinked first. The host code is not reclaimed.
+///
+/// With fastmem, the host must call this before writing guest code through
+/// the region, as pages with compiled code are write protected until the
+/// last unit on them is discarded.
+///
+/// May be called while vCPUs run, but not from a memory interface callback,
+/// as it takes the lock the runtime holds while it fetches guest code.
+BAL_COLD void bal_runtime_invalidate(bal_runtime_t      *runtime,
+                                     bal_guest_address_t guest_address,
+                                     size_t              size);
+
+/// Writes every unit compiled so far to `config.persistent_cache_path`,
+/// together with the units of the file that were not compiled again.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if `runtime` is `NULL` or has no
+/// persistent cache.
+///
+/// Returns any error of [`bal_persistent_cache_save`].
+BAL_COLD bal_error_t bal_runtime_save_cache(bal_runtime_t *runtime);
+
+/// Releases all memory held by `runtime`.
+BAL_COLD void bal_runtime_destroy(bal_allocator_t *allocator, bal_runtime_t *runtime);
+
+#endif /* BALLISTIC_RUNTIME_H */
+
+/*** end of file ***/
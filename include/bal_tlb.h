@@ -0,0 +1,253 @@
+/** @file bal_tlb.h
+ *
+ * @brief A per vCPU software TLB for guest data accesses.
+ *
+ * The TLB is direct mapped: a guest page can only live in the entry selected
+ * by the low bits of its page number. Compiled code probes the entry inline,
+ * so a hit costs a shift, a mask, a compare and the access itself, and only
+ * a miss calls into [`bal_tlb_load_slow`] or [`bal_tlb_store_slow`], which
+ * ask the [`bal_memory_interface_t`] and refill the entry.
+ *
+ * An entry holds a separate tag for reads and writes, which doubles as the
+ * permission check. A page that is only readable never gets a write tag, so
+ * every store to it misses and faults in the slow path.
+ *
+ * The host must flush the TLB of every vCPU whenever it changes a mapping
+ * the interface returned, as the TLB keeps using the old host address
+ * otherwise.
+ *
+ * A TLB watching a [`bal_code_pages_t`] never gets a write tag for a page
+ * with translated code, and reports every store to one before performing
+ * it, so the units on it can be discarded.
+ */
+
+#ifndef BALLISTIC_TLB_H
+#define BALLISTIC_TLB_H
+
+#include "bal_attributes.h"
+#include "bal_code_pages.h"
+#include "bal_memory.h"
+#include "bal_types.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// The log2 of the guest page size the TLB maps.
+#define BAL_TLB_PAGE_SHIFT 12U
+
+/// The guest page size the TLB maps.
+#define BAL_TLB_PAGE_SIZE (1ULL << BAL_TLB_PAGE_SHIFT)
+
+/// Clears the offset bits of a guest address.
+#define BAL_TLB_PAGE_MASK (~(BAL_TLB_PAGE_SIZE - 1U))
+
+/// The number of entries in a TLB. Must be a power of two.
+#define BAL_TLB_SIZE 256U
+
+/// The tag of an empty entry. Never equal to a page address, as those have
+/// the offset bits clear.
+#define BAL_TLB_INVALID_TAG UINT64_MAX
+
+/// One guest page. Compiled code computes the offset of an entry with a shift
+/// and a mask, which needs the size to be a power of two.
+typedef struct
+{
+    /// The guest page readable through `host_offset`, or
+    /// [`BAL_TLB_INVALID_TAG`].
+    bal_guest_address_t read_tag;
+
+    /// The guest page writable through `host_offset`, or
+    /// [`BAL_TLB_INVALID_TAG`].
+    bal_guest_address_t write_tag;
+
+    /// Added to a guest address in the page to get its host address.
+    uint64_t host_offset;
+
+    uint64_t reserved;
+} bal_tlb_entry_t;
+
+static_assert(32 == sizeof(bal_tlb_entry_t), "Compiled code assumes 32 byte TLB entries.");
+static_assert(BAL_CODE_PAGE_SHIFT == BAL_TLB_PAGE_SHIFT, "Code is tracked per TLB page.");
+
+struct bal_tlb_s;
+
+/// Called before a store of `size` bytes at `guest_address` to a page with
+/// translated code is performed. `tlb` is the TLB the store went through.
+typedef void (*bal_tlb_code_write_function_t)(void               *context,
+                                              struct bal_tlb_s   *tlb,
+                                              bal_guest_address_t guest_address,
+                                              uint64_t            size);
+
+/// Zero initialization is not a valid state, as it maps guest page 0 to host
+/// address 0. Use [`bal_tlb_init`].
+typedef struct bal_tlb_s
+{
+    bal_tlb_entry_t entries[BAL_TLB_SIZE];
+
+    /// Where misses are resolved.
+    bal_memory_interface_t *interface;
+
+    /// Non-zero once an access failed to translate. Compiled code leaves the
+    /// unit when it sees it set, and the runtime reports
+    /// [`BAL_ERROR_GUEST_MEMORY_FAULT`] and clears it.
+    uint64_t fault;
+
+    /// The guest address of the access that failed.
+    bal_guest_address_t fault_address;
+
+    /// The number of accesses resolved by the slow path.
+    uint64_t misses;
+
+    /// The pages with translated code, or `NULL` if stores are not checked.
+    const bal_code_pages_t *code_pages;
+
+    /// The generation of `code_pages` every write tag was filled under.
+    uint64_t code_generation;
+
+    /// Called with `code_write_context` before a store to a page in
+    /// `code_pages`.
+    bal_tlb_code_write_function_t code_write;
+    void                         *code_write_context;
+} bal_tlb_t;
+
+/// Binds `tlb` to `interface` and empties it.
+BAL_COLD void bal_tlb_init(bal_tlb_t *tlb, bal_memory_interface_t *interface);
+
+/// Has `tlb` call `code_write` with `context` before every store to a page
+/// in `code_pages`, and empties it. `NULL` `code_pages` stops checking
+/// stores.
+BAL_COLD void bal_tlb_watch_code(bal_tlb_t                    *tlb,
+                                 const bal_code_pages_t       *code_pages,
+                                 bal_tlb_code_write_function_t code_write,
+                                 void                         *context);
+
+/// Forgets every mapping in `tlb`. Must be called when the host changes a
+/// mapping of the memory interface.
+BAL_COLD void bal_tlb_flush(bal_tlb_t *tlb);
+
+/// Forgets the mappings of every page overlapping `size` bytes at
+/// `guest_address`.
+void bal_tlb_flush_range(bal_tlb_t *tlb, bal_guest_address_t guest_address, size_t size);
+
+/// Reads `size` bytes at `guest_address` through the memory interface,
+/// refilling the entry of the page on the way. `size` is 1, 2, 4 or 8 and the
+/// value is zero extended. Accesses that cross a page are split.
+///
+/// On failure, sets `tlb->fault` and returns 0. Called by compiled code on a
+/// miss.
+BAL_HOT uint64_t bal_tlb_load_slow(bal_tlb_t          *tlb,
+                                   bal_guest_address_t guest_address,
+                                   uint64_t            size);
+
+/// Writes the low `size` bytes of `value` at `guest_address` like
+/// [`bal_tlb_load_slow`] reads them.
+///
+/// A store to a page in `tlb->code_pages` is reported to `tlb->code_write`
+/// first.
+///
+/// On failure, sets `tlb->fault`. Bytes before the failing page may already
+/// be written.
+BAL_HOT void bal_tlb_store_slow(bal_tlb_t          *tlb,
+                                bal_guest_address_t guest_address,
+                                uint64_t            value,
+                                uint64_t            size);
+
+/// Returns the host address of `size` bytes at `guest_address` for an atomic
+/// read-modify-write, refilling the write entry of the page on the way. The
+/// address is only valid until the mappings of the interface change.
+///
+/// An atomic access can not be split, so one crossing a page or to memory
+/// the interface does not back for writes sets `tlb->fault` and returns
+/// `NULL`. An access to a page in `tlb->code_pages` is reported to
+/// `tlb->code_write` first. Called by compiled code on a miss.
+BAL_HOT uint8_t *bal_tlb_atomic_slow(bal_tlb_t          *tlb,
+                                     bal_guest_address_t guest_address,
+                                     uint64_t            size);
+
+/// Empties `tlb` if pages became code pages since it was last filled, as it
+/// may map them for writes. Must be called before running guest code after
+/// units were translated.
+static inline void
+bal_tlb_sync_code(bal_tlb_t *tlb)
+{
+    if (tlb->code_pages != NULL
+        && BAL_UNLIKELY(tlb->code_generation != tlb->code_pages->generation))
+    {
+        bal_tlb_flush(tlb);
+        tlb->code_generation = tlb->code_pages->generation;
+    }
+}
+
+/// Returns the entry `guest_address` maps to.
+static inline bal_tlb_entry_t *
+bal_tlb_entry(bal_tlb_t *tlb, bal_guest_address_t guest_address)
+{
+    return &tlb->entries[(guest_address >> BAL_TLB_PAGE_SHIFT) & (BAL_TLB_SIZE - 1U)];
+}
+
+/// Returns the host address of `size` bytes at `guest_address` if they are
+/// in one page with a mapping for the access, or `NULL` on a miss. This is
+/// the same probe compiled code does inline.
+static inline uint8_t *
+bal_tlb_probe(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size, bool write)
+{
+    const bal_tlb_entry_t *entry = bal_tlb_entry(tlb, guest_address);
+    bal_guest_address_t    tag   = write ? entry->write_tag : entry->read_tag;
+
+    // Testing the last byte also sends accesses crossing a page to the slow
+    // path.
+    //
+    if (BAL_LIKELY(((guest_address + size - 1U) & BAL_TLB_PAGE_MASK) == tag))
+    {
+        return (uint8_t *)(uintptr_t)(guest_address + entry->host_offset);
+    }
+
+    return NULL;
+}
+
+/// Reads `size` bytes at `guest_address`. See [`bal_tlb_load_slow`].
+static inline uint64_t
+bal_tlb_load(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size)
+{
+    const uint8_t *host = bal_tlb_probe(tlb, guest_address, size, false);
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        return bal_tlb_load_slow(tlb, guest_address, size);
+    }
+
+    uint64_t value = 0;
+    (void)memcpy(&value, host, (size_t)size);
+    return value;
+}
+
+/// Writes the low `size` bytes of `value` at `guest_address`. See
+/// [`bal_tlb_store_slow`].
+static inline void
+bal_tlb_store(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t value, uint64_t size)
+{
+    uint8_t *host = bal_tlb_probe(tlb, guest_address, size, true);
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        bal_tlb_store_slow(tlb, guest_address, value, size);
+        return;
+    }
+
+    (void)memcpy(host, &value, (size_t)size);
+}
+
+/// Returns the host address of `size` bytes at `guest_address` for an atomic
+/// access. See [`bal_tlb_atomic_slow`].
+static inline uint8_t *
+bal_tlb_atomic(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size)
+{
+    uint8_t *host = bal_tlb_probe(tlb, guest_address, size, true);
+    return BAL_LIKELY(host != NULL) ? host : bal_tlb_atomic_slow(tlb, guest_address, size);
+}
+
+#endif /* BALLISTIC_TLB_H */
+
+/*** end of file ***/
@@ -0,0 +1,276 @@
+/** @file bal_translation_cache.h
+ *
+ * @brief Maps guest addresses to translated units and tracks the links
+ * between them.
+ *
+ * Every translation has up to one link of each [`bal_link_kind_t`], such as
+ * its direct exit or the return address its call pushes. When a link is
+ * pointed at another translation, it is recorded in an intrusive list owned
+ * by the target, so all incoming links can be undone when the target is
+ * removed. Unlinked links wait in a second hash table keyed by their target
+ * address, so a new translation finds every link that can point to it.
+ *
+ * Links are named by a link id, the translation index times
+ * [`BAL_LINK_KIND_COUNT`] plus the kind.
+ *
+ * Every translation is also chained into a third table under each guest
+ * page its code and its flags assumption start or end on, so the units
+ * overlapping a small range are found without scanning every entry. Both
+ * ranges must be at most one [`BAL_CODE_PAGE_SHIFT`] page long.
+ *
+ * [`bal_translation_cache_lookup`] may run on any thread while one other
+ * thread changes the cache. Every other function must be serialized by the
+ * caller. An entry is published with a single store once it is complete,
+ * and a removed entry keeps its place in its hash chain until
+ * [`bal_translation_cache_reclaim`] is told no lookup can still be on it.
+ */
+
+#ifndef BALLISTIC_TRANSLATION_CACHE_H
+#define BALLISTIC_TRANSLATION_CACHE_H
+
+#include "bal_attributes.h"
+#include "bal_backend.h"
+#include "bal_code_pages.h"
+#include "bal_engine.h"
+#include "bal_errors.h"
+#include "bal_logging.h"
+#include "bal_memory.h"
+#include "bal_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Marks the absence of a translation index or link id.
+#define BAL_TRANSLATION_NONE 0xFFFFFFFFU
+
+/// The number of page chains a translation can be in: the first and last
+/// page of its code and of its flags assumption.
+#define BAL_TRANSLATION_PAGE_NODES 4U
+
+/// Returns the link id of the link of `kind` owned by translation `index`.
+static inline uint32_t
+bal_link_id(uint32_t index, bal_link_kind_t kind)
+{
+    return index * BAL_LINK_KIND_COUNT + (uint32_t)kind;
+}
+
+/// Returns the translation index owning `link_id`.
+static inline uint32_t
+bal_link_id_translation(uint32_t link_id)
+{
+    return link_id / BAL_LINK_KIND_COUNT;
+}
+
+/// Returns the kind of the link `link_id`.
+static inline bal_link_kind_t
+bal_link_id_kind(uint32_t link_id)
+{
+    return (bal_link_kind_t)(link_id % BAL_LINK_KIND_COUNT);
+}
+
+/// A patchable site of a translation that can point to another translation.
+typedef struct
+{
+    /// The offset in the code buffer of the patched field, or 0 if the
+    /// translation has no link of this kind.
+    size_t site;
+
+    /// The guest address of the translation the link wants to point to, or
+    /// [`BAL_LINK_TARGET_NONE`] for an unfilled inline cache entry.
+    bal_guest_address_t target;
+
+    /// The translation the link points to, or [`BAL_TRANSLATION_NONE`] while
+    /// it is unlinked.
+    uint32_t linked_to;
+
+    /// The next link id pointing to `linked_to`. While unlinked, the next
+    /// link id waiting in the same pending bucket.
+    uint32_t next;
+} bal_link_t;
+
+/// A compiled guest block.
+typedef struct
+{
+    /// The guest address of the first translated instruction.
+    bal_guest_address_t guest_address;
+
+    /// The executable address of the unit. Call this through
+    /// [`bal_unit_function_t`].
+    const void *entry;
+
+    /// The executable address of the first instruction after the prologue.
+    /// Linked exits of other units jump here.
+    const void *body;
+
+    /// The offset of the unit in the code buffer.
+    size_t code_offset;
+
+    /// The size of the unit in bytes.
+    size_t code_size;
+
+    /// The offset of the cold code of the unit in the cold code buffer.
+    size_t cold_offset;
+
+    /// The size of the cold code of the unit in bytes.
+    size_t cold_size;
+
+    /// How the unit ends.
+    bal_unit_exit_t exit;
+
+    /// 1 for a baseline unit, 2 for a unit recompiled with the optimization
+    /// pipeline after turning hot.
+    uint32_t tier;
+
+    /// Whether the unit may read a lazy flag field before writing it, or
+    /// return to the dispatcher without writing it.
+    bool flags_live_on_entry;
+
+    /// The number of guest bytes at `exit.target` that were assumed to
+    /// overwrite the flags when the unit was compiled, or 0. Invalidating any
+    /// of them invalidates the unit too.
+    size_t flags_assumption_size;
+
+    /// The patchable sites of the unit, indexed by [`bal_link_kind_t`].
+    bal_link_t links[BAL_LINK_KIND_COUNT];
+
+    /// The first link id pointing to this translation.
+    uint32_t first_incoming;
+
+    /// The inline cache entry replaced next once all of them are filled.
+    uint32_t inline_cache_victim;
+
+    /// The next translation in the same hash bucket, or the next free entry.
+    uint32_t next_in_bucket;
+
+    /// The next page node in the same page bucket for each page the
+    /// translation is chained under. A page node is the translation index
+    /// times [`BAL_TRANSLATION_PAGE_NODES`] plus the position of the page.
+    uint32_t next_in_page[BAL_TRANSLATION_PAGE_NODES];
+
+    /// The next removed translation waiting to be reclaimed.
+    uint32_t next_retired;
+
+    /// The epoch the translation was removed in, once it is.
+    uint64_t retired_epoch;
+} bal_translation_t;
+
+typedef struct
+{
+    /// Storage for every translation. Unused entries form a free list.
+    bal_translation_t *translations;
+
+    /// The heads of the hash chains, indexed by a hash of the guest address.
+    uint32_t *buckets;
+
+    /// The heads of the chains of unlinked link ids, indexed by a hash of the
+    /// link target. Has as many entries as `buckets`.
+    uint32_t *pending_buckets;
+
+    /// The heads of the chains of page nodes, indexed by a hash of the guest
+    /// page. Has as many entries as `buckets`.
+    uint32_t *page_buckets;
+
+    /// The size of `translations`.
+    uint32_t capacity;
+
+    /// The size of `buckets` minus one. The bucket count is a power of two.
+    uint32_t bucket_mask;
+
+    /// The number of translations in use.
+    uint32_t count;
+
+    /// The first unused entry in `translations`.
+    uint32_t free_head;
+
+    /// The oldest and newest removed entries not yet reclaimed, chained
+    /// through `next_retired` in the order they were removed.
+    uint32_t retired_head;
+    uint32_t retired_tail;
+
+    /// The logging context used to report details and errors.
+    bal_logger_t logger;
+} bal_translation_cache_t;
+
+/// Initializes `cache` to hold up to `capacity` translations, allocating its
+/// tables with `allocator`.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_INVALID_ARGUMENT`] if a pointer is `NULL` or
+/// `capacity` is zero or too large for every link id to fit in 32 bits.
+///
+/// Returns [`BAL_ERROR_ALLOCATION_FAILED`] if the allocator cannot fulfill the
+/// request.
+BAL_COLD bal_error_t bal_translation_cache_init(bal_allocator_t         *allocator,
+                                                bal_translation_cache_t *cache,
+                                                uint32_t                 capacity,
+                                                bal_logger_t             logger);
+
+/// Returns the index of the translation starting at `guest_address`, or
+/// [`BAL_TRANSLATION_NONE`] if there is none.
+///
+/// Safe to call while another thread changes `cache`. The entry at the index
+/// may have been removed since, which its `entry` being `NULL` tells.
+BAL_HOT uint32_t bal_translation_cache_lookup(const bal_translation_cache_t *cache,
+                                              bal_guest_address_t            guest_address);
+
+/// Copies `translation` into `cache` and writes its index to `index`. The
+/// link state of the copy is reset, and every link with a site and a target
+/// starts out pending.
+///
+/// Returns [`BAL_SUCCESS`] on success.
+///
+/// # Errors
+///
+/// Returns [`BAL_ERROR_TRANSLATION_CACHE_FULL`] if every entry is in use.
+BAL_COLD bal_error_t bal_translation_cache_insert(bal_translation_cache_t *BAL_RESTRICT cache,
+                                                  const bal_translation_t *BAL_RESTRICT translation,
+                                                  uint32_t *BAL_RESTRICT                index);
+
+/// Returns the id of a pending link targeting `guest_address`, or
+/// [`BAL_TRANSLATION_NONE`] if there is none.
+uint32_t bal_translation_cache_find_pending(const bal_translation_cache_t *cache,
+                                            bal_guest_address_t            guest_address);
+
+/// Records that the pending link `link_id` points to translation `to`.
+void bal_translation_cache_link(bal_translation_cache_t *cache, uint32_t link_id, uint32_t to);
+
+/// Records that the link `link_id` no longer points anywhere. The link
+/// becomes pending. Does nothing if it is not linked.
+void bal_translation_cache_unlink(bal_translation_cache_t *cache, uint32_t link_id);
+
+/// Changes the target of the unlinked link `link_id` to `guest_address`. The
+/// link is pending afterwards unless `guest_address` is
+/// [`BAL_LINK_TARGET_NONE`].
+void bal_translation_cache_retarget(bal_translation_cache_t *cache,
+                                    uint32_t                 link_id,
+                                    bal_guest_address_t      guest_address);
+
+/// Returns the index of a translation whose code or flags assumption
+/// overlaps `[guest_address, guest_address + size)`, or
+/// [`BAL_TRANSLATION_NONE`] if there is none.
+uint32_t bal_translation_cache_find_overlapping(const bal_translation_cache_t *cache,
+                                                bal_guest_address_t            guest_address,
+                                                size_t                         size);
+
+/// Removes the translation at `index` from the lookup tables. Every link into
+/// or out of it must have been undone first. Its `entry` becomes `NULL` right
+/// away, but the entry is only reused once it is reclaimed with an epoch
+/// above `epoch`.
+void bal_translation_cache_remove(bal_translation_cache_t *cache,
+                                  uint32_t                 index,
+                                  uint64_t                 epoch);
+
+/// Frees the entries of every translation removed in an epoch below
+/// `safe_epoch`, which no lookup can still be on.
+void bal_translation_cache_reclaim(bal_translation_cache_t *cache, uint64_t safe_epoch);
+
+/// Frees the tables of `cache` using `allocator`.
+BAL_COLD void bal_translation_cache_destroy(bal_allocator_t         *allocator,
+                                            bal_translation_cache_t *cache);
+
+#endif /* BALLISTIC_TRANSLATION_CACHE_H */
+
+/*** end of file ***/
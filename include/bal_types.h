@@ -11,8 +11,8 @@
 typedef uint64_t bal_guest_address_t;
 typedef uint64_t bal_instruction_t;
 typedef uint64_t bal_constant_t;
-typedef uint16_t bal_instruction_count_t;
-typedef uint16_t bal_constant_count_t;
+typedef uint32_t bal_instruction_count_t;
+typedef uint32_t bal_constant_count_t;
 typedef uint8_t  bal_bit_width_t;
 
 typedef enum
@@ -21,25 +21,154 @@ typedef enum
     OPCODE_GET_REGISTER,
     OPCODE_CONST,
     OPCODE_MOV,
+
+    /// Defines `src1 + src2`. `src3` is a raw operand modifier applied to
+    /// `src2` first, or [`BAL_SOURCE_NONE`]. See `bal_ir_modifier` in
+    /// `bal_ir.h`. The same holds for `OPCODE_SUB`, `OPCODE_AND`, `OPCODE_OR`
+    /// and `OPCODE_XOR`.
     OPCODE_ADD,
     OPCODE_SUB,
     OPCODE_MUL,
     OPCODE_DIV,
     OPCODE_AND,
     OPCODE_XOR,
+    OPCODE_OR,
     OPCODE_OR_NOT,
     OPCODE_SHIFT,
+
+    /// Reads guest memory at the address `src1` plus an offset and zero
+    /// extends it. `src2` is a raw access packing the size, 1, 2, 4 or 8,
+    /// with the signed offset. See `bal_ir_access` in `bal_ir.h`.
     OPCODE_LOAD,
+
+    /// Writes the low bytes of `src2` to guest memory at the address `src1`
+    /// plus an offset. `src3` is a raw access, like the `src2` of
+    /// `OPCODE_LOAD`.
     OPCODE_STORE,
     OPCODE_JUMP,
     OPCODE_CALL,
     OPCODE_RETURN,
+
+    /// Ends the unit at the target address `src2` if `src1` is zero, and at
+    /// `src3` otherwise. `OPCODE_BRANCH_NOT_ZERO` branches to `src2` if
+    /// `src1` is non-zero.
     OPCODE_BRANCH_ZERO,
     OPCODE_BRANCH_NOT_ZERO,
     OPCODE_TEST_BIT_ZERO,
     OPCODE_CMP,
+
+    /// Defines 1 if the A64 condition code `src1`, a raw operand, holds for
+    /// the NZCV flags in the guest state, and 0 otherwise. Like
+    /// `OPCODE_GET_REGISTER`, it reads what the unit last wrote back.
     OPCODE_CMP_COND,
     OPCODE_TRAP,
+
+    /// Kills a dead instruction in place. The SSA index it defines is
+    /// `TYPE_VOID`.
+    OPCODE_NOP,
+
+    /// Opens a structured `THEN` scope that runs if `src1` is non-zero.
+    OPCODE_IF,
+
+    /// Closes the `THEN` scope of the innermost `OPCODE_IF` and opens its
+    /// `ELSE` scope.
+    OPCODE_ELSE,
+
+    /// Closes the innermost `IF`/`LOOP` scope when no path reaches the merge
+    /// point.
+    OPCODE_END_BLOCK,
+
+    /// Pushes up to 3 values from the current scope to the parent scope.
+    /// Unused operands are set to [`BAL_SOURCE_NONE`].
+    OPCODE_YIELD,
+
+    /// Closes the innermost `IF` scope and defines the value yielded by the
+    /// branch that was taken.
+    OPCODE_MERGE,
+
+    /// Defines `src2` if `src1` is non-zero, otherwise defines `src3`.
+    OPCODE_CONDITIONAL_SELECT,
+
+    /// Writes `src2` back to guest register `src1`. Like
+    /// `OPCODE_GET_REGISTER`, `src1` is the raw register index.
+    OPCODE_SET_REGISTER,
+
+    /// Like `OPCODE_SET_REGISTER`, but the write is left to the terminator,
+    /// which only stores it when the unit returns to the dispatcher instead
+    /// of jumping to a linked successor.
+    OPCODE_SET_REGISTER_ON_EXIT,
+
+    /// Lane-wise operations on the guest vector registers. They define no
+    /// value: `src1` and `src2` are the raw indices of the `Vn` and `Vm`
+    /// registers they read and `src3` is a raw vector descriptor naming the
+    /// `Vd` register they write and the lane size. See `bal_ir_vector` in
+    /// `bal_ir.h`. A 64-bit operation clears the upper half of `Vd`.
+    OPCODE_VECTOR_ADD,
+    OPCODE_VECTOR_SUB,
+    OPCODE_VECTOR_MUL,
+    OPCODE_VECTOR_AND,
+
+    /// `Vn AND NOT Vm`.
+    OPCODE_VECTOR_BIC,
+    OPCODE_VECTOR_OR,
+
+    /// `Vn OR NOT Vm`.
+    OPCODE_VECTOR_OR_NOT,
+    OPCODE_VECTOR_XOR,
+
+    /// Sets every lane of `Vd` to all ones where the lane of `Vn` is equal
+    /// to, signed greater than, signed greater than or equal to, unsigned
+    /// higher than, or unsigned higher than or the same as the lane of `Vm`,
+    /// and clears it otherwise.
+    OPCODE_VECTOR_COMPARE_EQUAL,
+    OPCODE_VECTOR_COMPARE_GREATER,
+    OPCODE_VECTOR_COMPARE_GREATER_EQUAL,
+    OPCODE_VECTOR_COMPARE_HIGHER,
+    OPCODE_VECTOR_COMPARE_HIGHER_SAME,
+
+    /// Interleaves the lanes of the low or the high halves of `Vn` and `Vm`,
+    /// starting with `Vn`.
+    OPCODE_VECTOR_ZIP_LOW,
+    OPCODE_VECTOR_ZIP_HIGH,
+
+    /// Extracts the bytes of `Vm:Vn` starting at the byte index held in the
+    /// descriptor immediate.
+    OPCODE_VECTOR_EXTRACT,
+
+    /// Looks every byte of `Vm` up in the 16 byte table `Vn`. Indices out of
+    /// the table give 0.
+    OPCODE_VECTOR_TABLE,
+
+    /// Copies the lane of `Vn` whose index is the descriptor immediate to
+    /// every lane.
+    OPCODE_VECTOR_DUPLICATE,
+
+    /// Copies the low bits of `src2`, an SSA value, to every lane. `src1` is
+    /// unused.
+    OPCODE_VECTOR_DUPLICATE_SCALAR,
+
+    /// Atomic accesses to guest memory at the address `src1`. Unlike
+    /// `OPCODE_LOAD` and `OPCODE_STORE` they have no offset, and access as
+    /// many bytes as the bit width of the value they define.
+    ///
+    /// Reads guest memory like `OPCODE_LOAD` and arms the exclusive monitor
+    /// of the vCPU with the address and the value read.
+    OPCODE_LOAD_EXCLUSIVE,
+
+    /// Writes `src2` if the exclusive monitor is armed with the address and
+    /// memory still holds the value it was armed with, then closes the
+    /// monitor. Defines 0 if the write happened and 1 otherwise.
+    OPCODE_STORE_EXCLUSIVE,
+
+    /// Adds `src2` to memory and defines the value memory held before.
+    OPCODE_ATOMIC_ADD,
+
+    /// Writes `src2` to memory and defines the value memory held before.
+    OPCODE_ATOMIC_SWAP,
+
+    /// Writes `src3` if memory holds `src2`, and defines the value memory
+    /// held before.
+    OPCODE_ATOMIC_COMPARE_SWAP,
     OPCODE_EMUM_END = 0x7FF, // Force enum to 2 bytes.
 } bal_opcode_t;
 
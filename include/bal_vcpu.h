@@ -0,0 +1,131 @@
+/** @file bal_vcpu.h
+ *
+ * @brief The per virtual CPU state compiled units operate on.
+ *
+ * A compiled unit receives a pointer to a [`bal_vcpu_t`] and addresses every
+ * field relative to it, so the layout is part of the code generation ABI.
+ */
+
+#ifndef BALLISTIC_VCPU_H
+#define BALLISTIC_VCPU_H
+
+#include "bal_guest_state.h"
+#include "bal_tlb.h"
+#include "bal_types.h"
+#include <stdint.h>
+#include <string.h>
+
+/// The number of entries in a return stack buffer. Must be a power of two.
+#define BAL_RETURN_STACK_SIZE 16U
+
+/// The value of [`bal_vcpu_t`]`.exit_unit` when the last unit did not leave
+/// through an inline cache miss.
+#define BAL_VCPU_EXIT_UNIT_NONE 0xFFFFFFFFU
+
+/// The address of an open [`bal_exclusive_monitor_t`]. Only a byte sized
+/// store exclusive to the last byte of the address space can match it.
+#define BAL_EXCLUSIVE_MONITOR_OPEN UINT64_MAX
+
+/// A prediction of where a guest `RET` goes.
+typedef struct
+{
+    /// The guest address pushed by the `BL` or `BLR`.
+    bal_guest_address_t guest_address;
+
+    /// The body of the unit at `guest_address`, or `NULL` if it had not been
+    /// compiled when the call was made. A `NULL` entry never predicts.
+    const void *host_code;
+} bal_return_stack_entry_t;
+
+/// A circular stack of predicted return targets. Overflow silently discards
+/// the oldest entry and underflow wraps around, both of which only cost a
+/// misprediction.
+typedef struct
+{
+    /// The byte offset of the top entry in `entries`.
+    uint64_t top;
+
+    /// The runtime generation the entries were pushed in. Entries from an
+    /// older generation may point at discarded code and are cleared before
+    /// the next unit runs.
+    uint64_t generation;
+
+    bal_return_stack_entry_t entries[BAL_RETURN_STACK_SIZE];
+} bal_return_stack_t;
+
+/// Counters updated by compiled code and the dispatcher.
+typedef struct
+{
+    /// Indirect branches that found their target in an inline cache.
+    uint64_t inline_cache_hits;
+
+    /// Indirect branches that fell back to the dispatcher.
+    uint64_t inline_cache_misses;
+} bal_vcpu_counters_t;
+
+/// The exclusive monitor of the guest CPU, emulated without a global lock.
+/// A load exclusive records the address and the value it read, and a store
+/// exclusive only writes if memory still holds that value, with a host
+/// compare and swap. Unlike the real monitor it can not see a store that
+/// wrote the same value back, which the lock and counter loops exclusives are
+/// used for never tell apart.
+typedef struct
+{
+    /// The guest address the monitor is armed with, or
+    /// [`BAL_EXCLUSIVE_MONITOR_OPEN`].
+    bal_guest_address_t address;
+
+    /// The value read from `address`, zero extended.
+    uint64_t value;
+} bal_exclusive_monitor_t;
+
+/// Aligned like [`bal_guest_state_t`], so heap allocated vCPUs need an
+/// aligned allocation.
+typedef struct
+{
+    /// The architectural state of the guest CPU. Must stay at offset 0, where
+    /// `OPCODE_GET_REGISTER` expects it.
+    bal_guest_state_t state;
+
+    /// Predicts the targets of guest returns.
+    bal_return_stack_t return_stack;
+
+    /// The id of the unit whose inline cache missed on the way out, or
+    /// [`BAL_VCPU_EXIT_UNIT_NONE`]. Reset by the dispatcher before every
+    /// call so it can fill the cache with the target.
+    uint32_t exit_unit;
+
+    /// The id of the unit whose execution counter ran out on the way in, or
+    /// [`BAL_VCPU_EXIT_UNIT_NONE`]. Reset by the dispatcher before every call
+    /// so it can queue the unit for promotion.
+    uint32_t hot_unit;
+
+    bal_vcpu_counters_t counters;
+
+    /// Opened by [`bal_runtime_run`] along with binding `tlb`.
+    bal_exclusive_monitor_t monitor;
+
+    /// Translates the guest data accesses of compiled units. Bound to the
+    /// memory interface of the runtime on the first call to
+    /// [`bal_runtime_run`].
+    bal_tlb_t tlb;
+} bal_vcpu_t;
+
+/// Forgets every predicted return target of `vcpu`.
+static inline void
+bal_vcpu_clear_return_stack(bal_vcpu_t *vcpu)
+{
+    (void)memset(&vcpu->return_stack, 0, sizeof(vcpu->return_stack));
+}
+
+/// Opens the exclusive monitor of `vcpu`, so the next store exclusive fails.
+static inline void
+bal_vcpu_clear_exclusive_monitor(bal_vcpu_t *vcpu)
+{
+    vcpu->monitor.address = BAL_EXCLUSIVE_MONITOR_OPEN;
+    vcpu->monitor.value   = 0;
+}
+
+#endif /* BALLISTIC_VCPU_H */
+
+/*** end of file ***/
@@ -2,6 +2,8 @@
 #include <stdbool.h>
 
 static void emit_mov(bal_assembler_t *, const char *, uint32_t, uint16_t, uint8_t, uint32_t);
+static void emit_branch_immediate(bal_assembler_t *, const char *, int32_t, uint32_t);
+static void emit_branch_register(bal_assembler_t *, const char *, uint32_t, uint32_t);
 
 bal_error_t
 bal_assembler_init(bal_assembler_t *assembler, void *buffer, size_t size, bal_logger_t logger)
@@ -52,6 +54,36 @@ bal_emit_movn(bal_assembler_t *assembler, bal_register_index_t rd, uint16_t imm,
     emit_mov(assembler, "MOVN", rd, imm, shift, 0x0);
 }
 
+void
+bal_emit_b(bal_assembler_t *assembler, int32_t offset)
+{
+    emit_branch_immediate(assembler, "B", offset, 0x14000000);
+}
+
+void
+bal_emit_bl(bal_assembler_t *assembler, int32_t offset)
+{
+    emit_branch_immediate(assembler, "BL", offset, 0x94000000);
+}
+
+void
+bal_emit_br(bal_assembler_t *assembler, bal_register_index_t rn)
+{
+    emit_branch_register(assembler, "BR", rn, 0xD61F0000);
+}
+
+void
+bal_emit_blr(bal_assembler_t *assembler, bal_register_index_t rn)
+{
+    emit_branch_register(assembler, "BLR", rn, 0xD63F0000);
+}
+
+void
+bal_emit_ret(bal_assembler_t *assembler, bal_register_index_t rn)
+{
+    emit_branch_register(assembler, "RET", rn, 0xD65F0000);
+}
+
 static inline bool
 can_emit(bal_assembler_t *assembler)
 {
@@ -127,4 +159,70 @@ emit_mov(bal_assembler_t *assembler,
     assembler->buffer[assembler->offset++] = instruction;
 }
 
+static inline void
+emit_branch_immediate(bal_assembler_t *assembler,
+                      const char      *mnemonic,
+                      int32_t          offset,
+                      uint32_t         opcode)
+{
+    if (assembler->status != BAL_SUCCESS || false == can_emit(assembler))
+    {
+        return;
+    }
+
+    // imm26 holds a signed word offset.
+    //
+    const int32_t limit = 1 << 27;
+
+    if ((offset & 3) != 0 || offset < -limit || offset >= limit)
+    {
+        BAL_LOG_ERROR(&assembler->logger, "%d is not a valid branch offset.", offset);
+        assembler->status = BAL_ERROR_INVALID_ARGUMENT;
+        return;
+    }
+
+    uint32_t instruction = opcode | (((uint32_t)offset >> 2) & 0x03FFFFFFU);
+
+    BAL_LOG_TRACE(&assembler->logger,
+                  "[+0x%04zx] %08x %s #%d",
+                  assembler->offset * sizeof(uint32_t),
+                  instruction,
+                  mnemonic,
+                  offset);
+    (void)mnemonic;
+
+    assembler->buffer[assembler->offset++] = instruction;
+}
+
+static inline void
+emit_branch_register(bal_assembler_t *assembler,
+                     const char      *mnemonic,
+                     uint32_t         rn,
+                     uint32_t         opcode)
+{
+    if (assembler->status != BAL_SUCCESS || false == can_emit(assembler))
+    {
+        return;
+    }
+
+    if (rn > 30)
+    {
+        BAL_LOG_ERROR(&assembler->logger, "X%u out of range (0-30).", rn);
+        assembler->status = BAL_ERROR_INVALID_ARGUMENT;
+        return;
+    }
+
+    uint32_t instruction = opcode | (rn << 5);
+
+    BAL_LOG_TRACE(&assembler->logger,
+                  "[+0x%04zx] %08x %s X%u",
+                  assembler->offset * sizeof(uint32_t),
+                  instruction,
+                  mnemonic,
+                  rn);
+    (void)mnemonic;
+
+    assembler->buffer[assembler->offset++] = instruction;
+}
+
 /*** end of file ***/
@@ -0,0 +1,260 @@
+/** @file bal_atomic.h
+ *
+ * @brief Internal host atomics on guest memory, used by the interpreter for
+ * the atomic opcodes compiled code lowers to locked instructions, and the
+ * loads and stores the runtime shares between vCPU threads with.
+ *
+ * The read-modify-write functions take the host address of `size` bytes, 1,
+ * 2, 4 or 8, naturally aligned on hosts that need it, and return the value it
+ * held before, zero extended. They are sequentially consistent, which is at
+ * least as strong as any ordering the guest asks for.
+ *
+ * Loads acquire and stores release, so everything written before a store is
+ * seen by a thread that loads the stored value.
+ */
+
+#ifndef BALLISTIC_ATOMIC_H
+#define BALLISTIC_ATOMIC_H
+
+#include "bal_platform.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if BAL_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#if BAL_COMPILER_MSVC
+#include <intrin.h>
+
+#define BAL_ATOMIC_DISPATCH(size, operation, pointer, ...)                                  \
+    switch (size)                                                                           \
+    {                                                                                       \
+        case 1:                                                                             \
+            return (uint8_t)operation##8((volatile char *)(pointer), __VA_ARGS__);          \
+        case 2:                                                                             \
+            return (uint16_t)operation##16((volatile short *)(pointer), __VA_ARGS__);       \
+        case 4:                                                                             \
+            return (uint32_t)operation((volatile long *)(pointer), __VA_ARGS__);            \
+        default:                                                                            \
+            return (uint64_t)operation##64((volatile __int64 *)(pointer), __VA_ARGS__);     \
+    }
+#endif
+
+/// Writes `desired` to `host` if it holds `expected`. Only the low `size`
+/// bytes of both are used.
+static inline uint64_t
+bal_atomic_compare_swap(void *host, uint64_t expected, uint64_t desired, uint64_t size)
+{
+#if BAL_COMPILER_MSVC
+    // The MSVC intrinsics take the desired value first.
+    //
+    switch (size)
+    {
+        case 1:
+            return (uint8_t)_InterlockedCompareExchange8(
+                (volatile char *)host, (char)desired, (char)expected);
+        case 2:
+            return (uint16_t)_InterlockedCompareExchange16(
+                (volatile short *)host, (short)desired, (short)expected);
+        case 4:
+            return (uint32_t)_InterlockedCompareExchange(
+                (volatile long *)host, (long)desired, (long)expected);
+        default:
+            return (uint64_t)_InterlockedCompareExchange64(
+                (volatile __int64 *)host, (__int64)desired, (__int64)expected);
+    }
+#else
+    switch (size)
+    {
+        case 1: {
+            uint8_t value = (uint8_t)expected;
+            (void)__atomic_compare_exchange_n((uint8_t *)host,
+                                              &value,
+                                              (uint8_t)desired,
+                                              false,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST);
+            return value;
+        }
+        case 2: {
+            uint16_t value = (uint16_t)expected;
+            (void)__atomic_compare_exchange_n((uint16_t *)host,
+                                              &value,
+                                              (uint16_t)desired,
+                                              false,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST);
+            return value;
+        }
+        case 4: {
+            uint32_t value = (uint32_t)expected;
+            (void)__atomic_compare_exchange_n((uint32_t *)host,
+                                              &value,
+                                              (uint32_t)desired,
+                                              false,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST);
+            return value;
+        }
+        default: {
+            uint64_t value = expected;
+            (void)__atomic_compare_exchange_n((uint64_t *)host,
+                                              &value,
+                                              desired,
+                                              false,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST);
+            return value;
+        }
+    }
+#endif
+}
+
+/// Adds the low `size` bytes of `value` to `host`, wrapping around.
+static inline uint64_t
+bal_atomic_fetch_add(void *host, uint64_t value, uint64_t size)
+{
+#if BAL_COMPILER_MSVC
+    BAL_ATOMIC_DISPATCH(size, _InterlockedExchangeAdd, host, value)
+#else
+    switch (size)
+    {
+        case 1:
+            return __atomic_fetch_add((uint8_t *)host, (uint8_t)value, __ATOMIC_SEQ_CST);
+        case 2:
+            return __atomic_fetch_add((uint16_t *)host, (uint16_t)value, __ATOMIC_SEQ_CST);
+        case 4:
+            return __atomic_fetch_add((uint32_t *)host, (uint32_t)value, __ATOMIC_SEQ_CST);
+        default:
+            return __atomic_fetch_add((uint64_t *)host, value, __ATOMIC_SEQ_CST);
+    }
+#endif
+}
+
+/// Writes the low `size` bytes of `value` to `host`.
+static inline uint64_t
+bal_atomic_exchange(void *host, uint64_t value, uint64_t size)
+{
+#if BAL_COMPILER_MSVC
+    BAL_ATOMIC_DISPATCH(size, _InterlockedExchange, host, value)
+#else
+    switch (size)
+    {
+        case 1:
+            return __atomic_exchange_n((uint8_t *)host, (uint8_t)value, __ATOMIC_SEQ_CST);
+        case 2:
+            return __atomic_exchange_n((uint16_t *)host, (uint16_t)value, __ATOMIC_SEQ_CST);
+        case 4:
+            return __atomic_exchange_n((uint32_t *)host, (uint32_t)value, __ATOMIC_SEQ_CST);
+        default:
+            return __atomic_exchange_n((uint64_t *)host, value, __ATOMIC_SEQ_CST);
+    }
+#endif
+}
+
+/// Loads `*address` with acquire ordering.
+static inline uint32_t
+bal_atomic_load_32(const uint32_t *address)
+{
+#if BAL_COMPILER_MSVC
+    uint32_t value = *(const volatile uint32_t *)address;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// Stores `value` to `*address` with release ordering.
+static inline void
+bal_atomic_store_32(uint32_t *address, uint32_t value)
+{
+#if BAL_COMPILER_MSVC
+    _ReadWriteBarrier();
+    *(volatile uint32_t *)address = value;
+#else
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// Loads `*address` with acquire ordering.
+static inline uint64_t
+bal_atomic_load_64(const uint64_t *address)
+{
+#if BAL_COMPILER_MSVC
+    uint64_t value = *(const volatile uint64_t *)address;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// Stores `value` to `*address` with release ordering.
+static inline void
+bal_atomic_store_64(uint64_t *address, uint64_t value)
+{
+#if BAL_COMPILER_MSVC
+    _ReadWriteBarrier();
+    *(volatile uint64_t *)address = value;
+#else
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// Loads `*address` with acquire ordering.
+static inline const void *
+bal_atomic_load_pointer(const void *const *address)
+{
+#if BAL_COMPILER_MSVC
+    const void *value = *(const void *const volatile *)address;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// Stores `value` to `*address` with release ordering.
+static inline void
+bal_atomic_store_pointer(const void **address, const void *value)
+{
+#if BAL_COMPILER_MSVC
+    _ReadWriteBarrier();
+    *(const void *volatile *)address = value;
+#else
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// Orders every load and store before it against every one after it,
+/// including a store against a later load.
+static inline void
+bal_atomic_fence(void)
+{
+#if BAL_COMPILER_MSVC
+    _ReadWriteBarrier();
+    _mm_mfence();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/// Gives the rest of the time slice of the calling thread to another one,
+/// while it waits for a thread that may not be running.
+static inline void
+bal_atomic_yield(void)
+{
+#if BAL_PLATFORM_WINDOWS
+    (void)SwitchToThread();
+#else
+    (void)sched_yield();
+#endif
+}
+
+#endif /* BALLISTIC_ATOMIC_H */
+
+/*** end of file ***/
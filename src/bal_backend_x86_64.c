@@ -0,0 +1,3077 @@
+#include "bal_backend.h"
+#include "bal_assert.h"
+#include "bal_ir.h"
+#include "bal_logging.h"
+#include "bal_platform.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BAL_ARCHITECTURE_X86
+#if BAL_COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#define X86_RAX 0U
+#define X86_RCX 1U
+#define X86_RDX 2U
+#define X86_RSP 4U
+#define X86_RSI 6U
+#define X86_RDI 7U
+#define X86_R8  8U
+#define X86_R9  9U
+
+#define X86_XMM0 0U
+#define X86_XMM1 1U
+#define X86_XMM2 2U
+#define X86_XMM3 3U
+
+#define FASTMEM_BASE_REGISTER BAL_FASTMEM_BASE_REGISTER_X86_64
+
+/// The bytes a fastmem access spans at least, so the fault handler can
+/// overwrite it with a `JMP rel32`.
+#define FASTMEM_SITE_SIZE 5U
+
+#if BAL_PLATFORM_WINDOWS
+#define ARGUMENT_REGISTER   X86_RCX
+#define ARGUMENT_REGISTER_1 X86_RDX
+#define ARGUMENT_REGISTER_2 X86_R8
+#define ARGUMENT_REGISTER_3 X86_R9
+#define SHADOW_SPACE_SIZE   32
+#else
+#define ARGUMENT_REGISTER   X86_RDI
+#define ARGUMENT_REGISTER_1 X86_RSI
+#define ARGUMENT_REGISTER_2 X86_RDX
+#define ARGUMENT_REGISTER_3 X86_RCX
+#define SHADOW_SPACE_SIZE   0
+#endif
+
+/// The longest instruction the templates emit is `MOV r64, imm64`.
+#define MAX_INSTRUCTION_BYTES 16U
+
+#define RETURN_STACK_TOP     ((int32_t)offsetof(bal_vcpu_t, return_stack.top))
+#define RETURN_STACK_ENTRIES ((int32_t)offsetof(bal_vcpu_t, return_stack.entries))
+#define RETURN_STACK_MASK \
+    ((int32_t)(BAL_RETURN_STACK_SIZE * sizeof(bal_return_stack_entry_t) - 1U))
+#define RETURN_STACK_GUEST_ADDRESS \
+    (RETURN_STACK_ENTRIES + (int32_t)offsetof(bal_return_stack_entry_t, guest_address))
+#define RETURN_STACK_HOST_CODE \
+    (RETURN_STACK_ENTRIES + (int32_t)offsetof(bal_return_stack_entry_t, host_code))
+
+#define VCPU_EXIT_UNIT ((int32_t)offsetof(bal_vcpu_t, exit_unit))
+#define VCPU_HOT_UNIT  ((int32_t)offsetof(bal_vcpu_t, hot_unit))
+#define VCPU_INLINE_CACHE_HITS \
+    ((int32_t)offsetof(bal_vcpu_t, counters) \
+     + (int32_t)offsetof(bal_vcpu_counters_t, inline_cache_hits))
+
+#define VCPU_MONITOR_ADDRESS ((int32_t)offsetof(bal_vcpu_t, monitor.address))
+#define VCPU_MONITOR_VALUE   ((int32_t)offsetof(bal_vcpu_t, monitor.value))
+
+#define VCPU_TLB        ((int32_t)offsetof(bal_vcpu_t, tlb))
+#define TLB_FAULT       (VCPU_TLB + (int32_t)offsetof(bal_tlb_t, fault))
+#define TLB_ENTRIES     (VCPU_TLB + (int32_t)offsetof(bal_tlb_t, entries))
+#define TLB_READ_TAG    (TLB_ENTRIES + (int32_t)offsetof(bal_tlb_entry_t, read_tag))
+#define TLB_WRITE_TAG   (TLB_ENTRIES + (int32_t)offsetof(bal_tlb_entry_t, write_tag))
+#define TLB_HOST_OFFSET (TLB_ENTRIES + (int32_t)offsetof(bal_tlb_entry_t, host_offset))
+
+/// The log2 of `sizeof(bal_tlb_entry_t)`.
+#define TLB_ENTRY_SHIFT 5U
+
+/// Selects the byte offset of a TLB entry from a guest address shifted right
+/// by `BAL_TLB_PAGE_SHIFT - TLB_ENTRY_SHIFT`.
+#define TLB_INDEX_MASK ((int32_t)((BAL_TLB_SIZE - 1U) << TLB_ENTRY_SHIFT))
+
+/// The distance from the guest address of an inline cache entry to the
+/// displacement of its `JMP`. Fixed so only the latter has to be recorded.
+#define INLINE_CACHE_LINK_DISTANCE 24U
+
+/// The most guest memory accesses of a unit that get their TLB miss path out
+/// of line. Later accesses call into the TLB unconditionally.
+#define MAX_MEMORY_SLOW_PATHS 32U
+
+/// The most slow paths a unit can have: the execution counter trap, the miss
+/// path of its exit and the TLB miss paths.
+#define MAX_SLOW_PATHS (2U + MAX_MEMORY_SLOW_PATHS)
+
+/// The most `OPCODE_SET_REGISTER_ON_EXIT` writes the exit of a unit stores.
+/// The dead flags pass leaves at most one to the exit per lazy flag field.
+#define MAX_EXIT_WRITES 3U
+
+/// The most branches that can enter one slow path.
+#define MAX_SLOW_PATH_BRANCHES 2U
+
+/// The largest alignment patchable sites are padded to in the code buffer.
+#define SITE_ALIGNMENT 8U
+
+/// The primary opcodes of the `ALU r/m64, r64` forms.
+typedef enum
+{
+    ALU_ADD = 0x01,
+    ALU_OR  = 0x09,
+    ALU_AND = 0x21,
+    ALU_SUB = 0x29,
+    ALU_XOR = 0x31,
+    ALU_CMP = 0x39,
+} alu_opcode_t;
+
+/// The read-modify-write instructions atomic accesses lower to, with the
+/// `0F` escape of the two-byte opcodes. The byte forms are one less.
+typedef enum
+{
+    ATOMIC_XCHG    = 0x87,
+    ATOMIC_CMPXCHG = 0x0FB1,
+    ATOMIC_XADD    = 0x0FC1,
+} atomic_opcode_t;
+
+/// The `/digit` extensions of the `C1` shift group.
+typedef enum
+{
+    SHIFT_ROR = 1,
+    SHIFT_SHL = 4,
+    SHIFT_SHR = 5,
+    SHIFT_SAR = 7,
+} shift_opcode_t;
+
+/// The SSE instructions of the vector templates: the mandatory prefix in bits
+/// 16 to 23, the `0F 38` or `0F 3A` map in bits 8 to 15 if any, and the
+/// opcode in bits 0 to 7.
+typedef enum
+{
+    SSE_MOVDQA       = 0x66006F,
+    SSE_MOVDQU_LOAD  = 0xF3006F,
+    SSE_MOVDQU_STORE = 0xF3007F,
+    SSE_MOVQ         = 0xF3007E,
+    SSE_MOVQ_GPR     = 0x66006E,
+    SSE_PADDB        = 0x6600FC,
+    SSE_PADDW        = 0x6600FD,
+    SSE_PADDD        = 0x6600FE,
+    SSE_PADDQ        = 0x6600D4,
+    SSE_PADDUSB      = 0x6600DC,
+    SSE_PSUBB        = 0x6600F8,
+    SSE_PSUBW        = 0x6600F9,
+    SSE_PSUBD        = 0x6600FA,
+    SSE_PSUBQ        = 0x6600FB,
+    SSE_PMULLW       = 0x6600D5,
+    SSE_PMULLD       = 0x663840,
+    SSE_PAND         = 0x6600DB,
+    SSE_PANDN        = 0x6600DF,
+    SSE_POR          = 0x6600EB,
+    SSE_PXOR         = 0x6600EF,
+    SSE_PCMPEQB      = 0x660074,
+    SSE_PCMPEQW      = 0x660075,
+    SSE_PCMPEQD      = 0x660076,
+    SSE_PCMPEQQ      = 0x663829,
+    SSE_PCMPGTB      = 0x660064,
+    SSE_PCMPGTW      = 0x660065,
+    SSE_PCMPGTD      = 0x660066,
+    SSE_PCMPGTQ      = 0x663837,
+    SSE_PUNPCKLBW    = 0x660060,
+    SSE_PUNPCKLWD    = 0x660061,
+    SSE_PUNPCKLDQ    = 0x660062,
+    SSE_PUNPCKLQDQ   = 0x66006C,
+    SSE_PUNPCKHBW    = 0x660068,
+    SSE_PUNPCKHWD    = 0x660069,
+    SSE_PUNPCKHDQ    = 0x66006A,
+    SSE_PUNPCKHQDQ   = 0x66006D,
+    SSE_PSHUFB       = 0x663800,
+    SSE_PALIGNR      = 0x663A0F,
+    SSE_SHIFT_WORD   = 0x660071,
+    SSE_SHIFT_BYTES  = 0x660073,
+} sse_opcode_t;
+
+/// The `/digit` extensions of `SSE_SHIFT_WORD` and `SSE_SHIFT_BYTES`.
+typedef enum
+{
+    SSE_SHIFT_RIGHT       = 2,
+    SSE_SHIFT_RIGHT_BYTES = 3,
+    SSE_SHIFT_LEFT        = 6,
+} sse_shift_t;
+
+/// The `CPUID` leaf 1 `ECX` bits of SSSE3, SSE4.1 and SSE4.2, which the
+/// vector templates rely on.
+#define CPUID_VECTOR_EXTENSIONS ((1U << 9U) | (1U << 19U) | (1U << 20U))
+
+/// Marks `emitter_t.host_features` as not queried yet.
+#define HOST_FEATURES_UNKNOWN UINT32_MAX
+
+/// Code that leaves the unit on a path expected to be rare. Slow paths are
+/// emitted after the unit, into the cold code buffer if there is one, so the
+/// expected path stays contiguous.
+typedef enum
+{
+    /// The execution counter reached zero.
+    SLOW_PATH_HOT_UNIT,
+
+    /// An indirect exit missed every inline cache entry.
+    SLOW_PATH_INLINE_CACHE_MISS,
+
+    /// A return was not predicted by the return stack buffer.
+    SLOW_PATH_RETURN_MISS,
+
+    /// A guest memory access missed the TLB. The only kind that returns to
+    /// the unit, unless the access faults. An atomic read-modify-write
+    /// returns with its host address in `RAX`.
+    SLOW_PATH_MEMORY_ACCESS,
+} slow_path_kind_t;
+
+typedef struct
+{
+    slow_path_kind_t kind;
+
+    /// The offsets of the `rel32` displacements that branch to the slow
+    /// path.
+    size_t   branch_sites[MAX_SLOW_PATH_BRANCHES];
+    uint32_t branch_count;
+
+    /// The access of a `SLOW_PATH_MEMORY_ACCESS`, its SSA index, and the
+    /// offset in the unit execution continues at once it is done.
+    bal_ir_instruction_t instruction;
+    uint32_t             ssa_index;
+    size_t               resume_offset;
+
+    /// The offset of the fastmem access the slow path backs, and whether
+    /// there is one.
+    size_t site_offset;
+    bool   has_site;
+
+    /// The position of the slow path once it is emitted. See
+    /// [`bal_relocation_t`].
+    uint32_t position;
+
+    /// The executable address of the slow path once it is emitted.
+    const uint8_t *entry;
+} slow_path_t;
+
+typedef struct
+{
+    bal_code_buffer_t                       *code_buffer;
+    bal_code_buffer_t                       *cold_code_buffer;
+    const bal_register_class_t *BAL_RESTRICT register_class;
+    const bal_value_location_t *BAL_RESTRICT locations;
+    const bal_constant_t *BAL_RESTRICT       constants;
+    const bal_bit_width_t *BAL_RESTRICT      bit_widths;
+    size_t                                   unit_offset;
+    size_t                                   cold_offset;
+    size_t                                   hot_size;
+    size_t                                   link_offsets[BAL_LINK_KIND_COUNT];
+    bal_relocation_t                        *relocations;
+    uint32_t                                 relocation_count;
+    bool                                     relocatable;
+    uint32_t                                 used_registers_mask;
+    uint32_t                                 unit_id;
+    uint32_t                                 inline_cache_entries;
+    int32_t                                 *execution_counter;
+    bal_fastmem_t                           *fastmem;
+    uint32_t                                 fastmem_site_count;
+    bal_guest_address_t                      guest_address;
+    slow_path_t                              slow_paths[MAX_SLOW_PATHS];
+    uint32_t                                 slow_path_count;
+    bal_ir_instruction_t                     exit_writes[MAX_EXIT_WRITES];
+    uint32_t                                 exit_write_count;
+    bool                                     terminated;
+    uint32_t                                 host_features;
+    bal_error_t                              status;
+    bal_logger_t                            *logger;
+} emitter_t;
+
+static void emit_instruction(emitter_t *, uint32_t, bal_ir_instruction_t);
+static void emit_prologue(emitter_t *);
+static void emit_epilogue(emitter_t *);
+static void emit_execution_counter(emitter_t *);
+static void emit_slow_paths(emitter_t *);
+static uint32_t host_features(void);
+static void register_fastmem_sites(const emitter_t *);
+static size_t encode_immediate32(uint8_t *, uint32_t);
+static void resolve_position(const bal_code_buffer_t *,
+                             const bal_code_buffer_t *,
+                             const bal_compiled_unit_t *,
+                             uint32_t,
+                             uint8_t **,
+                             const uint8_t **);
+
+bal_error_t
+bal_backend_compile_x86_64(bal_engine_t *BAL_RESTRICT               engine,
+                           const bal_register_class_t *BAL_RESTRICT register_class,
+                           bal_code_buffer_t *BAL_RESTRICT          code_buffer,
+                           const bal_backend_options_t             *options,
+                           bal_compiled_unit_t *BAL_RESTRICT        unit)
+{
+    if (BAL_UNLIKELY(NULL == engine || NULL == register_class || NULL == code_buffer
+                     || NULL == unit))
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (BAL_UNLIKELY(engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    bal_register_allocation_t allocation;
+    bal_error_t               status = bal_register_allocate(engine, register_class, &allocation);
+
+    if (BAL_UNLIKELY(status != BAL_SUCCESS))
+    {
+        return status;
+    }
+
+    emitter_t emitter = { .code_buffer          = code_buffer,
+                          .cold_code_buffer     = NULL,
+                          .register_class       = register_class,
+                          .locations            = allocation.locations,
+                          .constants            = engine->constants,
+                          .bit_widths           = engine->ssa_bit_widths,
+                          .unit_offset          = code_buffer->offset,
+                          .cold_offset          = 0,
+                          .hot_size             = 0,
+                          .link_offsets         = { 0 },
+                          .relocations          = unit->relocations,
+                          .relocation_count     = 0,
+                          .relocatable          = true,
+                          .used_registers_mask  = allocation.used_registers_mask,
+                          .unit_id              = 0,
+                          .inline_cache_entries = 0,
+                          .execution_counter    = NULL,
+                          .fastmem              = NULL,
+                          .fastmem_site_count   = 0,
+                          .guest_address        = engine->guest_address,
+                          .slow_path_count      = 0,
+                          .terminated           = false,
+                          .host_features        = HOST_FEATURES_UNKNOWN,
+                          .status               = BAL_SUCCESS,
+                          .logger               = &engine->logger };
+
+    if (options != NULL)
+    {
+        uint32_t entries = options->inline_cache_entries;
+
+        emitter.unit_id              = options->unit_id;
+        emitter.execution_counter    = options->execution_counter;
+        emitter.cold_code_buffer     = options->cold_code_buffer;
+        emitter.fastmem              = options->fastmem;
+        emitter.inline_cache_entries = (entries < BAL_INLINE_CACHE_MAX_ENTRIES)
+                                           ? entries
+                                           : BAL_INLINE_CACHE_MAX_ENTRIES;
+    }
+
+    // The base address has to survive every unit.
+    //
+    for (uint32_t i = 0; emitter.fastmem != NULL && i < register_class->registers_count; ++i)
+    {
+        if (BAL_UNLIKELY(FASTMEM_BASE_REGISTER == register_class->registers[i]))
+        {
+            BAL_LOG_ERROR(&engine->logger, "The fastmem base register is allocatable.");
+            return BAL_ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    bal_code_buffer_t *cold_code_buffer = emitter.cold_code_buffer;
+
+    size_t unit_offset = code_buffer->offset;
+    size_t cold_offset = (cold_code_buffer != NULL) ? cold_code_buffer->offset : 0;
+    emitter.cold_offset = cold_offset;
+    emit_prologue(&emitter);
+    size_t body_offset = code_buffer->offset - unit_offset;
+
+    if (emitter.execution_counter != NULL)
+    {
+        emit_execution_counter(&emitter);
+    }
+
+    for (uint32_t i = 0; i < engine->instruction_count; ++i)
+    {
+        if (BAL_UNLIKELY(emitter.terminated))
+        {
+            BAL_LOG_ERROR(&engine->logger, "Instruction v%u follows the unit terminator.", i);
+            emitter.status = BAL_ERROR_ENGINE_STATE_INVALID;
+            break;
+        }
+
+        emit_instruction(&emitter, i, bal_ir_get(engine, i));
+
+        if (BAL_UNLIKELY(emitter.status != BAL_SUCCESS))
+        {
+            break;
+        }
+    }
+
+    if (BAL_SUCCESS == emitter.status && false == emitter.terminated)
+    {
+        BAL_LOG_ERROR(&engine->logger, "Unit does not end with a terminator.");
+        emitter.status = BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    if (BAL_SUCCESS == emitter.status)
+    {
+        emit_slow_paths(&emitter);
+    }
+
+    // Discard the partial unit so the code buffers can be reused.
+    //
+    if (BAL_UNLIKELY(emitter.status != BAL_SUCCESS))
+    {
+        if (BAL_SUCCESS == code_buffer->status)
+        {
+            code_buffer->offset = unit_offset;
+        }
+
+        if (cold_code_buffer != NULL && BAL_SUCCESS == cold_code_buffer->status)
+        {
+            cold_code_buffer->offset = cold_offset;
+        }
+
+        return emitter.status;
+    }
+
+    if (emitter.fastmem != NULL)
+    {
+        register_fastmem_sites(&emitter);
+    }
+
+    unit->entry       = bal_code_buffer_executable_address(code_buffer, unit_offset);
+    unit->offset      = unit_offset;
+    unit->size        = code_buffer->offset - unit_offset;
+    unit->body_offset = body_offset;
+    unit->cold_offset = cold_offset;
+    unit->cold_size   = (cold_code_buffer != NULL) ? cold_code_buffer->offset - cold_offset : 0;
+    (void)memcpy(unit->link_offsets, emitter.link_offsets, sizeof(unit->link_offsets));
+    unit->relocation_count = emitter.relocation_count;
+    unit->relocatable      = emitter.relocatable;
+
+    bal_code_memory_flush_instruction_cache(unit->entry, unit->size);
+
+    if (unit->cold_size != 0)
+    {
+        bal_code_memory_flush_instruction_cache(
+            bal_code_buffer_executable_address(cold_code_buffer, cold_offset), unit->cold_size);
+    }
+
+    BAL_LOG_INFO(&engine->logger,
+                 "Compiled unit at %p. Size: %zu bytes, Cold: %zu bytes, Spill slots: %u.",
+                 unit->entry,
+                 unit->size,
+                 unit->cold_size,
+                 allocation.spill_slot_count);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_backend_load_x86_64(bal_code_buffer_t *BAL_RESTRICT   code_buffer,
+                        const bal_backend_options_t      *options,
+                        const uint8_t                    *code,
+                        const uint8_t                    *cold_code,
+                        bal_compiled_unit_t *BAL_RESTRICT unit)
+{
+    if (BAL_UNLIKELY(NULL == code_buffer || NULL == options || NULL == code || NULL == unit))
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    bal_code_buffer_t *cold_code_buffer = options->cold_code_buffer;
+    bal_fastmem_t     *fastmem          = options->fastmem;
+    const size_t       total            = unit->size + unit->cold_size;
+    uint32_t           sites            = 0;
+    bool               valid            = unit->relocatable && unit->body_offset < unit->size
+                         && unit->relocation_count <= BAL_MAX_RELOCATIONS && total <= UINT32_MAX;
+
+    if (unit->cold_size != 0 && (NULL == cold_code_buffer || NULL == cold_code))
+    {
+        valid = false;
+    }
+
+    for (uint32_t i = 0; valid && i < BAL_LINK_KIND_COUNT; ++i)
+    {
+        valid = unit->link_offsets[i] < unit->size;
+    }
+
+    for (uint32_t i = 0; valid && i < unit->relocation_count; ++i)
+    {
+        const bal_relocation_t *relocation = &unit->relocations[i];
+        size_t                  width      = sizeof(uint32_t);
+
+        switch (relocation->kind)
+        {
+            case BAL_RELOCATION_FASTMEM_BASE:
+                valid = (fastmem != NULL);
+                width = sizeof(uint64_t);
+                break;
+
+            case BAL_RELOCATION_EXECUTION_COUNTER:
+                valid = (options->execution_counter != NULL);
+                width = sizeof(uint64_t);
+                break;
+
+            case BAL_RELOCATION_LOAD_HELPER:
+            case BAL_RELOCATION_STORE_HELPER:
+            case BAL_RELOCATION_ATOMIC_HELPER:
+            case BAL_RELOCATION_CONDITION_HELPER:
+                width = sizeof(uint64_t);
+                break;
+
+            case BAL_RELOCATION_FASTMEM_SITE:
+                valid = (fastmem != NULL && relocation->target < total);
+                width = FASTMEM_SITE_SIZE;
+                ++sites;
+                break;
+
+            case BAL_RELOCATION_BRANCH:
+                valid = (relocation->target < total);
+                break;
+
+            case BAL_RELOCATION_UNIT_ID:
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+
+        valid = valid && relocation->offset <= total && width <= total - relocation->offset;
+    }
+
+    if (valid && sites != 0)
+    {
+        valid = sites <= fastmem->site_capacity - fastmem->site_count;
+    }
+
+    if (BAL_UNLIKELY(false == valid))
+    {
+        BAL_LOG_ERROR(&code_buffer->logger, "Unit can not be loaded. Invalid relocations.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Patchable sites were aligned relative to the offset the unit was
+    // compiled at.
+    //
+    const uint8_t nop         = 0x90;
+    size_t        start       = code_buffer->offset;
+    size_t        cold_offset = (cold_code_buffer != NULL) ? cold_code_buffer->offset : 0;
+
+    while (((code_buffer->offset ^ unit->offset) & (SITE_ALIGNMENT - 1U)) != 0
+           && BAL_SUCCESS == code_buffer->status)
+    {
+        bal_code_buffer_emit(code_buffer, &nop, 1);
+    }
+
+    size_t unit_offset = code_buffer->offset;
+    bal_code_buffer_emit(code_buffer, code, unit->size);
+
+    if (unit->cold_size != 0)
+    {
+        bal_code_buffer_emit(cold_code_buffer, cold_code, unit->cold_size);
+    }
+
+    bal_error_t status = code_buffer->status;
+
+    if (BAL_SUCCESS == status && cold_code_buffer != NULL)
+    {
+        status = cold_code_buffer->status;
+    }
+
+    if (BAL_UNLIKELY(status != BAL_SUCCESS))
+    {
+        if (BAL_SUCCESS == code_buffer->status)
+        {
+            code_buffer->offset = start;
+        }
+
+        if (cold_code_buffer != NULL && BAL_SUCCESS == cold_code_buffer->status)
+        {
+            cold_code_buffer->offset = cold_offset;
+        }
+
+        return status;
+    }
+
+    unit->entry       = bal_code_buffer_executable_address(code_buffer, unit_offset);
+    unit->offset      = unit_offset;
+    unit->cold_offset = cold_offset;
+
+    for (uint32_t i = 0; i < unit->relocation_count; ++i)
+    {
+        const bal_relocation_t *relocation = &unit->relocations[i];
+        uint8_t                *writable   = NULL;
+        const uint8_t          *executable = NULL;
+        uint64_t                address    = 0;
+
+        resolve_position(
+            code_buffer, cold_code_buffer, unit, relocation->offset, &writable, &executable);
+
+        switch (relocation->kind)
+        {
+            case BAL_RELOCATION_LOAD_HELPER:
+                address = (uint64_t)(uintptr_t)bal_tlb_load_slow;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_STORE_HELPER:
+                address = (uint64_t)(uintptr_t)bal_tlb_store_slow;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_ATOMIC_HELPER:
+                address = (uint64_t)(uintptr_t)bal_tlb_atomic_slow;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_CONDITION_HELPER:
+                address = (uint64_t)(uintptr_t)bal_guest_state_condition_holds;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_FASTMEM_BASE:
+                address = (uint64_t)(uintptr_t)fastmem->base;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_EXECUTION_COUNTER:
+                address = (uint64_t)(uintptr_t)options->execution_counter;
+                (void)memcpy(writable, &address, sizeof(address));
+                break;
+
+            case BAL_RELOCATION_UNIT_ID:
+                (void)encode_immediate32(writable, options->unit_id);
+                break;
+
+            case BAL_RELOCATION_BRANCH: {
+                uint8_t       *target_writable = NULL;
+                const uint8_t *target          = NULL;
+                resolve_position(code_buffer,
+                                 cold_code_buffer,
+                                 unit,
+                                 relocation->target,
+                                 &target_writable,
+                                 &target);
+
+                ptrdiff_t distance = target - (executable + sizeof(uint32_t));
+                BAL_ASSERT(distance >= INT32_MIN && distance <= INT32_MAX);
+                (void)encode_immediate32(writable, (uint32_t)(int32_t)distance);
+                break;
+            }
+
+            case BAL_RELOCATION_FASTMEM_SITE: {
+                bal_fastmem_site_t site = { .access = executable, .writable = writable };
+                uint8_t           *slow_path_writable = NULL;
+                resolve_position(code_buffer,
+                                 cold_code_buffer,
+                                 unit,
+                                 relocation->target,
+                                 &slow_path_writable,
+                                 &site.slow_path);
+                (void)bal_fastmem_add_site(fastmem, &site);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    bal_code_memory_flush_instruction_cache(unit->entry, unit->size);
+
+    if (unit->cold_size != 0)
+    {
+        bal_code_memory_flush_instruction_cache(
+            bal_code_buffer_executable_address(cold_code_buffer, cold_offset), unit->cold_size);
+    }
+
+    BAL_LOG_INFO(&code_buffer->logger,
+                 "Loaded unit at %p. Size: %zu bytes, Cold: %zu bytes, Relocations: %u.",
+                 unit->entry,
+                 unit->size,
+                 unit->cold_size,
+                 unit->relocation_count);
+
+    return BAL_SUCCESS;
+}
+
+void
+bal_backend_link_x86_64(bal_code_buffer_t *code_buffer,
+                        bal_link_kind_t    kind,
+                        size_t             site_offset,
+                        const void        *target)
+{
+    const uint8_t *site = (const uint8_t *)bal_code_buffer_executable_address(code_buffer,
+                                                                               site_offset);
+
+    if (BAL_LINK_KIND_RETURN_ADDRESS == kind)
+    {
+        volatile uint64_t *writable
+            = (volatile uint64_t *)(void *)(code_buffer->buffer + site_offset);
+        *writable = (uint64_t)(uintptr_t)target;
+
+        bal_code_memory_flush_instruction_cache(site, sizeof(uint64_t));
+        return;
+    }
+
+    // The displacement is relative to the end of the JMP, and 0 falls into
+    // the epilogue that follows it.
+    //
+    const uint8_t *next         = site + sizeof(uint32_t);
+    int32_t        displacement = 0;
+
+    if (target != NULL)
+    {
+        ptrdiff_t distance = (const uint8_t *)target - next;
+        BAL_ASSERT(distance >= INT32_MIN && distance <= INT32_MAX);
+        displacement = (int32_t)distance;
+    }
+
+    volatile uint32_t *writable = (volatile uint32_t *)(void *)(code_buffer->buffer + site_offset);
+    *writable                   = (uint32_t)displacement;
+
+    bal_code_memory_flush_instruction_cache(site, sizeof(uint32_t));
+}
+
+void
+bal_backend_set_inline_cache_target_x86_64(bal_code_buffer_t  *code_buffer,
+                                           size_t              site_offset,
+                                           bal_guest_address_t guest_address)
+{
+    size_t             offset = site_offset - INLINE_CACHE_LINK_DISTANCE;
+    volatile uint64_t *writable = (volatile uint64_t *)(void *)(code_buffer->buffer + offset);
+    *writable                   = guest_address;
+
+    bal_code_memory_flush_instruction_cache(
+        bal_code_buffer_executable_address(code_buffer, offset), sizeof(uint64_t));
+}
+
+/// Returns a REX prefix with the high bits of `reg` and `base`.
+static inline uint8_t
+rex(bool wide, uint32_t reg, uint32_t base)
+{
+    return (uint8_t)(0x40U | (wide ? 0x08U : 0U) | (((reg >> 3) & 1U) << 2) | ((base >> 3) & 1U));
+}
+
+/// Encodes a `[base + displacement]` ModRM operand into `bytes` and returns
+/// the number of bytes written.
+static size_t
+encode_memory_operand(uint8_t *bytes, uint32_t reg, uint32_t base, int32_t displacement)
+{
+    size_t   size = 0;
+    uint32_t mod  = 2;
+
+    // RBP and R13 without a displacement encode RIP relative addressing.
+    //
+    if (0 == displacement && (base & 7U) != 5U)
+    {
+        mod = 0;
+    }
+    else if (displacement >= INT8_MIN && displacement <= INT8_MAX)
+    {
+        mod = 1;
+    }
+
+    bytes[size++] = (uint8_t)((mod << 6) | ((reg & 7U) << 3) | (base & 7U));
+
+    // RSP and R12 as a base need a SIB byte.
+    //
+    if (X86_RSP == (base & 7U))
+    {
+        bytes[size++] = 0x24;
+    }
+
+    if (1 == mod)
+    {
+        bytes[size++] = (uint8_t)displacement;
+    }
+    else if (2 == mod)
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            bytes[size++] = (uint8_t)((uint32_t)displacement >> (i * 8U));
+        }
+    }
+
+    return size;
+}
+
+static size_t
+encode_immediate32(uint8_t *bytes, uint32_t immediate)
+{
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        bytes[i] = (uint8_t)(immediate >> (i * 8U));
+    }
+
+    return 4;
+}
+
+// MOV r64, [base + displacement]
+//
+static void
+emit_load(emitter_t *emitter, uint32_t destination, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, destination, base);
+    bytes[size++] = 0x8B;
+    size += encode_memory_operand(bytes + size, destination, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOV [base + displacement], r64
+//
+static void
+emit_store(emitter_t *emitter, uint32_t base, int32_t displacement, uint32_t source)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, source, base);
+    bytes[size++] = 0x89;
+    size += encode_memory_operand(bytes + size, source, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// CMP r64, [base + displacement]
+//
+static void
+emit_compare_memory(emitter_t *emitter, uint32_t left, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, left, base);
+    bytes[size++] = 0x3B;
+    size += encode_memory_operand(bytes + size, left, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// INC qword [base + displacement]
+//
+static void
+emit_increment_memory(emitter_t *emitter, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, 0, base);
+    bytes[size++] = 0xFF;
+    size += encode_memory_operand(bytes + size, 0, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOV dword [base + displacement], imm32
+//
+static void
+emit_store_immediate32(emitter_t *emitter, uint32_t base, int32_t displacement, uint32_t value)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+
+    if (base >= 8)
+    {
+        bytes[size++] = rex(false, 0, base);
+    }
+
+    bytes[size++] = 0xC7;
+    size += encode_memory_operand(bytes + size, 0, base, displacement);
+    size += encode_immediate32(bytes + size, value);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// ADD r64, [base + displacement]
+//
+static void
+emit_add_memory(emitter_t *emitter, uint32_t destination, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, destination, base);
+    bytes[size++] = 0x03;
+    size += encode_memory_operand(bytes + size, destination, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// LEA r64, [base + displacement]
+//
+static void
+emit_load_address(emitter_t *emitter, uint32_t destination, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, destination, base);
+    bytes[size++] = 0x8D;
+    size += encode_memory_operand(bytes + size, destination, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOVZX r32, byte/word [base], MOV r32, [base] or MOV r64, [base]. Every
+// form zero extends to 64 bits.
+//
+static void
+emit_sized_load(emitter_t *emitter, uint32_t destination, uint32_t base, uint32_t access_size)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+
+    if (8 == access_size || destination >= 8 || base >= 8)
+    {
+        bytes[size++] = rex(8 == access_size, destination, base);
+    }
+
+    if (access_size < 4)
+    {
+        bytes[size++] = 0x0F;
+        bytes[size++] = (1 == access_size) ? 0xB6 : 0xB7;
+    }
+    else
+    {
+        bytes[size++] = 0x8B;
+    }
+
+    size += encode_memory_operand(bytes + size, destination, base, 0);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOV byte/word/dword/qword [base], r
+//
+static void
+emit_sized_store(emitter_t *emitter, uint32_t base, uint32_t source, uint32_t access_size)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+
+    if (2 == access_size)
+    {
+        bytes[size++] = 0x66;
+    }
+
+    // The byte form needs a REX prefix to address SIL and DIL rather than DH
+    // and BH.
+    //
+    if (1 == access_size || 8 == access_size || source >= 8 || base >= 8)
+    {
+        bytes[size++] = rex(8 == access_size, source, base);
+    }
+
+    bytes[size++] = (1 == access_size) ? 0x88 : 0x89;
+    size += encode_memory_operand(bytes + size, source, base, 0);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// LOCK CMPXCHG, LOCK XADD or XCHG [base], r of `access_size` bytes. XCHG
+// with a memory operand is locked without the prefix.
+//
+static void
+emit_atomic_instruction(emitter_t      *emitter,
+                        atomic_opcode_t opcode,
+                        uint32_t        base,
+                        uint32_t        source,
+                        uint32_t        access_size)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+
+    if (opcode != ATOMIC_XCHG)
+    {
+        bytes[size++] = 0xF0;
+    }
+
+    if (2 == access_size)
+    {
+        bytes[size++] = 0x66;
+    }
+
+    if (1 == access_size || 8 == access_size || source >= 8 || base >= 8)
+    {
+        bytes[size++] = rex(8 == access_size, source, base);
+    }
+
+    if (opcode > 0xFF)
+    {
+        bytes[size++] = 0x0F;
+    }
+
+    bytes[size++] = (uint8_t)((uint32_t)opcode - ((1 == access_size) ? 1U : 0U));
+    size += encode_memory_operand(bytes + size, source, base, 0);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// TEST r64, r64
+//
+static void
+emit_test(emitter_t *emitter, uint32_t host_register)
+{
+    const uint32_t low     = host_register & 7U;
+    const uint8_t  bytes[] = { rex(true, host_register, host_register),
+                               0x85,
+                               (uint8_t)(0xC0U | (low << 3) | low) };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+// Jcc rel8 with a placeholder displacement. Returns the offset of the
+// displacement for `patch_branch8`.
+//
+static size_t
+emit_branch8(emitter_t *emitter, uint8_t opcode)
+{
+    const uint8_t bytes[] = { opcode, 0x00 };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+    return emitter->code_buffer->offset - 1;
+}
+
+/// Points the rel8 displacement at `site_offset` to the current offset.
+static void
+patch_branch8(emitter_t *emitter, size_t site_offset)
+{
+    bal_code_buffer_t *code_buffer = emitter->code_buffer;
+
+    if (code_buffer->status != BAL_SUCCESS)
+    {
+        return;
+    }
+
+    size_t distance = code_buffer->offset - (site_offset + 1);
+    BAL_ASSERT(distance <= INT8_MAX);
+    code_buffer->buffer[site_offset] = (uint8_t)distance;
+}
+
+/// Returns the index of a new slow path of `kind`.
+static uint32_t
+add_slow_path(emitter_t *emitter, slow_path_kind_t kind)
+{
+    BAL_ASSERT(emitter->slow_path_count < MAX_SLOW_PATHS);
+
+    slow_path_t *slow_path  = &emitter->slow_paths[emitter->slow_path_count];
+    slow_path->kind         = kind;
+    slow_path->branch_count = 0;
+    slow_path->has_site     = false;
+    return emitter->slow_path_count++;
+}
+
+// Jcc rel32, or JMP rel32 if `opcode` is 0xEB, to the slow path at `index`.
+// `opcode` is the rel8 form. The displacement is filled in by
+// `emit_slow_paths`.
+//
+static void
+emit_slow_path_branch(emitter_t *emitter, uint32_t index, uint8_t opcode)
+{
+    slow_path_t *slow_path = &emitter->slow_paths[index];
+    uint8_t      bytes[6];
+    size_t       size = 0;
+
+    if (0xEB == opcode)
+    {
+        bytes[size++] = 0xE9;
+    }
+    else
+    {
+        bytes[size++] = 0x0F;
+        bytes[size++] = (uint8_t)(opcode + 0x10U);
+    }
+
+    size += encode_immediate32(bytes + size, 0);
+
+    BAL_ASSERT(slow_path->branch_count < MAX_SLOW_PATH_BRANCHES);
+    slow_path->branch_sites[slow_path->branch_count++] = emitter->code_buffer->offset + size - 4;
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// ALU r/m64, r64
+//
+static void
+emit_alu_register(emitter_t *emitter, alu_opcode_t opcode, uint32_t destination, uint32_t source)
+{
+    const uint8_t bytes[] = { rex(true, source, destination),
+                              (uint8_t)opcode,
+                              (uint8_t)(0xC0U | ((source & 7U) << 3) | (destination & 7U)) };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+// ALU r/m64, imm8/imm32
+//
+static void
+emit_alu_immediate(emitter_t *emitter, alu_opcode_t opcode, uint32_t destination, int32_t immediate)
+{
+    // The `/digit` extension of the immediate form is the primary opcode of
+    // the register form divided by 8.
+    //
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = rex(true, 0, destination);
+
+    if (immediate >= INT8_MIN && immediate <= INT8_MAX)
+    {
+        bytes[size++] = 0x83;
+        bytes[size++] = (uint8_t)(0xC0U | (((uint32_t)opcode >> 3) << 3) | (destination & 7U));
+        bytes[size++] = (uint8_t)immediate;
+    }
+    else
+    {
+        bytes[size++] = 0x81;
+        bytes[size++] = (uint8_t)(0xC0U | (((uint32_t)opcode >> 3) << 3) | (destination & 7U));
+        size += encode_immediate32(bytes + size, (uint32_t)immediate);
+    }
+
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// SHL/SHR/SAR/ROR r64 or r32, imm8
+//
+static void
+emit_shift(
+    emitter_t *emitter, shift_opcode_t opcode, uint32_t destination, uint8_t count, bool wide)
+{
+    const uint8_t bytes[] = { rex(wide, 0, destination),
+                              0xC1,
+                              (uint8_t)(0xC0U | ((uint32_t)opcode << 3) | (destination & 7U)),
+                              count };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+// MOV r32, r32, which zero extends `register_index` from 32 bits.
+//
+static void
+emit_zero_extend32(emitter_t *emitter, uint32_t register_index)
+{
+    const uint8_t modrm   = (uint8_t)(0xC0U | ((register_index & 7U) << 3) | (register_index & 7U));
+    const uint8_t bytes[] = { rex(false, register_index, register_index), 0x89, modrm };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+// MOVZX r32, r/m8 or r/m16, MOVSX r64, r/m8 or r/m16 and MOVSXD r64, r/m32,
+// in place.
+//
+static void
+emit_extend(emitter_t *emitter, bal_ir_extend_t extend, uint32_t register_index)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size  = 0;
+    uint8_t modrm = (uint8_t)(0xC0U | ((register_index & 7U) << 3) | (register_index & 7U));
+
+    switch (extend)
+    {
+        case BAL_IR_EXTEND_UXTW:
+            emit_zero_extend32(emitter, register_index);
+            return;
+
+        case BAL_IR_EXTEND_SXTW:
+            bytes[size++] = rex(true, register_index, register_index);
+            bytes[size++] = 0x63;
+            break;
+
+        case BAL_IR_EXTEND_UXTB:
+        case BAL_IR_EXTEND_UXTH:
+        case BAL_IR_EXTEND_SXTB:
+        case BAL_IR_EXTEND_SXTH: {
+            // The REX prefix selects SPL, BPL, SIL and DIL over AH to BH.
+            //
+            const bool is_signed = (BAL_IR_EXTEND_SXTB == extend || BAL_IR_EXTEND_SXTH == extend);
+            const bool is_byte   = (BAL_IR_EXTEND_UXTB == extend || BAL_IR_EXTEND_SXTB == extend);
+            bytes[size++]        = rex(is_signed, register_index, register_index);
+            bytes[size++]        = 0x0F;
+            bytes[size++]        = (uint8_t)((is_signed ? 0xBEU : 0xB6U) + (is_byte ? 0U : 1U));
+            break;
+        }
+
+        default:
+            return;
+    }
+
+    bytes[size++] = modrm;
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// NOT r64
+//
+static void
+emit_not(emitter_t *emitter, uint32_t register_index)
+{
+    const uint8_t bytes[]
+        = { rex(true, 0, register_index), 0xF7, (uint8_t)(0xD0U | (register_index & 7U)) };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+// MOV r64, r64
+//
+static void
+emit_move(emitter_t *emitter, uint32_t destination, uint32_t source)
+{
+    if (destination == source)
+    {
+        return;
+    }
+
+    const uint8_t bytes[] = { rex(true, source, destination),
+                              0x89,
+                              (uint8_t)(0xC0U | ((source & 7U) << 3) | (destination & 7U)) };
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+/// Loads `value` into `destination` with the shortest encoding.
+static void
+emit_move_immediate(emitter_t *emitter, uint32_t destination, uint64_t value)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+
+    if (0 == value)
+    {
+        // XOR r32, r32
+        //
+        if (destination >= 8)
+        {
+            bytes[size++] = rex(false, destination, destination);
+        }
+
+        bytes[size++] = 0x31;
+        bytes[size++] = (uint8_t)(0xC0U | ((destination & 7U) << 3) | (destination & 7U));
+    }
+    else if (value <= UINT32_MAX)
+    {
+        // MOV r32, imm32 zero extends to 64 bits.
+        //
+        if (destination >= 8)
+        {
+            bytes[size++] = rex(false, 0, destination);
+        }
+
+        bytes[size++] = (uint8_t)(0xB8U | (destination & 7U));
+        size += encode_immediate32(bytes + size, (uint32_t)value);
+    }
+    else if ((int64_t)value >= INT32_MIN && (int64_t)value <= INT32_MAX)
+    {
+        // MOV r/m64, imm32 sign extends to 64 bits.
+        //
+        bytes[size++] = rex(true, 0, destination);
+        bytes[size++] = 0xC7;
+        bytes[size++] = (uint8_t)(0xC0U | (destination & 7U));
+        size += encode_immediate32(bytes + size, (uint32_t)value);
+    }
+    else
+    {
+        bytes[size++] = rex(true, 0, destination);
+        bytes[size++] = (uint8_t)(0xB8U | (destination & 7U));
+
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            bytes[size++] = (uint8_t)(value >> (i * 8U));
+        }
+    }
+
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+/// Returns the position of the next byte emitted. See [`bal_relocation_t`].
+static uint32_t
+current_position(const emitter_t *emitter)
+{
+    const bal_code_buffer_t *code_buffer = emitter->code_buffer;
+
+    if (code_buffer == emitter->cold_code_buffer)
+    {
+        return (uint32_t)(emitter->hot_size + code_buffer->offset - emitter->cold_offset);
+    }
+
+    return (uint32_t)(code_buffer->offset - emitter->unit_offset);
+}
+
+/// Records the position dependent field at `offset`. A unit with too many
+/// of them is still emitted, but marked as not relocatable.
+static void
+add_relocation(emitter_t *emitter, bal_relocation_kind_t kind, uint32_t offset, uint32_t target)
+{
+    if (BAL_UNLIKELY(BAL_MAX_RELOCATIONS == emitter->relocation_count))
+    {
+        emitter->relocatable = false;
+        return;
+    }
+
+    bal_relocation_t *relocation = &emitter->relocations[emitter->relocation_count++];
+    relocation->kind             = (uint32_t)kind;
+    relocation->offset           = offset;
+    relocation->target           = target;
+}
+
+// MOV r64, imm64 with a host address, always in the long form so the
+// address can be relocated.
+//
+static void
+emit_move_address(emitter_t            *emitter,
+                  uint32_t              destination,
+                  uint64_t              address,
+                  bal_relocation_kind_t kind)
+{
+    uint8_t bytes[10] = { rex(true, 0, destination), (uint8_t)(0xB8U | (destination & 7U)) };
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        bytes[2 + i] = (uint8_t)(address >> (i * 8U));
+    }
+
+    add_relocation(emitter, kind, current_position(emitter) + 2U, 0);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, sizeof(bytes));
+}
+
+static void
+emit_push_pop(emitter_t *emitter, uint8_t opcode, uint32_t host_register)
+{
+    uint8_t bytes[2];
+    size_t  size = 0;
+
+    if (host_register >= 8)
+    {
+        bytes[size++] = rex(false, 0, host_register);
+    }
+
+    bytes[size++] = (uint8_t)(opcode | (host_register & 7U));
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOV RAX, imm64; CALL RAX
+//
+static void
+emit_call(emitter_t *emitter, uint64_t function, bal_relocation_kind_t kind)
+{
+    const uint8_t call_rax[] = { 0xFF, 0xD0 };
+    emit_move_address(emitter, X86_RAX, function, kind);
+    bal_code_buffer_emit(emitter->code_buffer, call_rax, sizeof(call_rax));
+}
+
+/// Returns the number of bytes reserved below the saved registers. This holds
+/// every spill slot and keeps `RSP` 16-byte aligned in the body.
+static int32_t
+frame_size(const bal_register_class_t *register_class)
+{
+    uint32_t pushed = 0;
+    uint32_t size   = BAL_MAX_SPILL_SLOTS * BAL_SPILL_SLOT_SIZE;
+
+    for (uint32_t mask = register_class->callee_saved_mask; mask != 0; mask &= mask - 1)
+    {
+        ++pushed;
+    }
+
+    // The return address and the pushed registers.
+    //
+    if (0 == ((1U + pushed) & 1U))
+    {
+        return (int32_t)size;
+    }
+
+    return (int32_t)(size + 8U);
+}
+
+static void
+emit_prologue(emitter_t *emitter)
+{
+    const bal_register_class_t *register_class = emitter->register_class;
+
+    for (uint32_t i = 0; i < BAL_MAX_HOST_REGISTERS; ++i)
+    {
+        if (register_class->callee_saved_mask & (1U << i))
+        {
+            emit_push_pop(emitter, 0x50, i);
+        }
+    }
+
+    // SUB RSP, imm32
+    //
+    uint8_t bytes[MAX_INSTRUCTION_BYTES] = { rex(true, 0, X86_RSP), 0x81, 0xEC };
+    size_t  size = 3 + encode_immediate32(bytes + 3, (uint32_t)frame_size(register_class));
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+
+    emit_move(emitter, register_class->guest_state_register, ARGUMENT_REGISTER);
+
+    if (emitter->fastmem != NULL)
+    {
+        emit_move_address(emitter,
+                          FASTMEM_BASE_REGISTER,
+                          (uint64_t)(uintptr_t)emitter->fastmem->base,
+                          BAL_RELOCATION_FASTMEM_BASE);
+    }
+}
+
+static void
+emit_epilogue(emitter_t *emitter)
+{
+    const bal_register_class_t *register_class = emitter->register_class;
+
+    // ADD RSP, imm32
+    //
+    uint8_t bytes[MAX_INSTRUCTION_BYTES] = { rex(true, 0, X86_RSP), 0x81, 0xC4 };
+    size_t  size = 3 + encode_immediate32(bytes + 3, (uint32_t)frame_size(register_class));
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+
+    for (uint32_t i = BAL_MAX_HOST_REGISTERS; i-- > 0;)
+    {
+        if (register_class->callee_saved_mask & (1U << i))
+        {
+            emit_push_pop(emitter, 0x58, i);
+        }
+    }
+
+    const uint8_t ret = 0xC3;
+    bal_code_buffer_emit(emitter->code_buffer, &ret, 1);
+}
+
+static inline bool
+is_spilled(bal_value_location_t location)
+{
+    return (location & BAL_LOCATION_SPILLED) != 0;
+}
+
+static inline int32_t
+spill_slot_displacement(bal_value_location_t location)
+{
+    return (int32_t)((location & ~BAL_LOCATION_SPILLED) * BAL_SPILL_SLOT_SIZE);
+}
+
+static inline int32_t
+guest_register_displacement(uint32_t guest_register)
+{
+    return (int32_t)(offsetof(bal_vcpu_t, state) + guest_register * sizeof(uint64_t));
+}
+
+/// Moves the value of `source` into `destination`.
+static void
+emit_load_operand(emitter_t *emitter, uint32_t destination, uint32_t source)
+{
+    if (bal_ir_is_constant(source))
+    {
+        emit_move_immediate(
+            emitter, destination, emitter->constants[source & ~BAL_DECODED_CONSTANT_BIT]);
+        return;
+    }
+
+    bal_value_location_t location = emitter->locations[source];
+
+    if (is_spilled(location))
+    {
+        emit_load(emitter, destination, X86_RSP, spill_slot_displacement(location));
+        return;
+    }
+
+    emit_move(emitter, destination, location);
+}
+
+/// Returns the register holding `source`, loading it into `scratch` first if
+/// it lives anywhere else.
+static uint32_t
+emit_materialize_operand(emitter_t *emitter, uint32_t source, uint32_t scratch)
+{
+    if (bal_ir_is_variable(source) && !is_spilled(emitter->locations[source]))
+    {
+        return emitter->locations[source];
+    }
+
+    emit_load_operand(emitter, scratch, source);
+    return scratch;
+}
+
+/// Returns the register the value `ssa_index` is computed in. Spilled values
+/// are computed in the first scratch register and stored afterwards.
+static uint32_t
+result_register(const emitter_t *emitter, uint32_t ssa_index)
+{
+    bal_value_location_t location = emitter->locations[ssa_index];
+    return is_spilled(location) ? emitter->register_class->scratch_registers[0] : location;
+}
+
+static void
+emit_store_result(emitter_t *emitter, uint32_t ssa_index, uint32_t host_register)
+{
+    bal_value_location_t location = emitter->locations[ssa_index];
+
+    if (is_spilled(location))
+    {
+        emit_store(emitter, X86_RSP, spill_slot_displacement(location), host_register);
+    }
+}
+
+static void
+emit_binary(emitter_t           *emitter,
+            alu_opcode_t         opcode,
+            uint32_t             ssa_index,
+            bal_ir_instruction_t instruction)
+{
+    uint32_t source1  = bal_ir_source1(instruction);
+    uint32_t source2  = bal_ir_source2(instruction);
+    uint32_t modifier = bal_ir_modifier_of(instruction);
+    uint32_t result   = result_register(emitter, ssa_index);
+    bool     is_32    = (modifier & BAL_IR_MODIFIER_32) != 0;
+
+    if (BAL_UNLIKELY(false == bal_ir_modifier_is_valid(modifier)))
+    {
+        emitter->status = BAL_ERROR_ENGINE_STATE_INVALID;
+        return;
+    }
+
+    // The allocator never assigns the result the location of a live operand,
+    // so `result` can be overwritten before `source2` is read.
+    //
+    emit_load_operand(emitter, result, source1);
+
+    if (bal_ir_is_constant(source2))
+    {
+        uint64_t constant = emitter->constants[source2 & ~BAL_DECODED_CONSTANT_BIT];
+        int64_t  value    = (int64_t)bal_ir_apply_modifier(constant, modifier);
+
+        // Only the low half of the operand of a 32-bit operation matters.
+        //
+        if (is_32)
+        {
+            value = (int64_t)(int32_t)(uint32_t)value;
+        }
+
+        if (value >= INT32_MIN && value <= INT32_MAX)
+        {
+            emit_alu_immediate(emitter, opcode, result, (int32_t)value);
+
+            if (is_32)
+            {
+                emit_zero_extend32(emitter, result);
+            }
+
+            emit_store_result(emitter, ssa_index, result);
+            return;
+        }
+    }
+
+    uint32_t operand;
+
+    if (0 == (modifier & ~BAL_IR_MODIFIER_32))
+    {
+        operand = emit_materialize_operand(
+            emitter, source2, emitter->register_class->scratch_registers[1]);
+    }
+    else
+    {
+        // A 32-bit shift reads only the low half of its operand, which is
+        // what truncating it first would leave.
+        //
+        uint32_t amount = modifier & BAL_IR_MODIFIER_AMOUNT_MASK;
+        operand         = emitter->register_class->scratch_registers[1];
+        emit_load_operand(emitter, operand, source2);
+        emit_extend(emitter, bal_ir_modifier_extend(modifier), operand);
+
+        if (amount != 0)
+        {
+            static const shift_opcode_t shifts[]
+                = { SHIFT_SHL, SHIFT_SHR, SHIFT_SAR, SHIFT_ROR };
+            emit_shift(emitter, shifts[bal_ir_modifier_shift(modifier)], operand, (uint8_t)amount,
+                       false == is_32);
+        }
+
+        if ((modifier & BAL_IR_MODIFIER_INVERT) != 0)
+        {
+            emit_not(emitter, operand);
+        }
+    }
+
+    emit_alu_register(emitter, opcode, result, operand);
+
+    if (is_32)
+    {
+        emit_zero_extend32(emitter, result);
+    }
+
+    emit_store_result(emitter, ssa_index, result);
+}
+
+static inline int32_t
+vector_register_displacement(uint32_t vector_register)
+{
+    return (int32_t)(offsetof(bal_vcpu_t, state) + offsetof(bal_guest_state_t, vectors)
+                     + vector_register * sizeof(bal_guest_vector_register_t));
+}
+
+/// Encodes the prefixes and the opcode of the SSE instruction `opcode` whose
+/// ModRM names `reg` and `rm` into `bytes` and returns the number of bytes
+/// written. The REX prefix is only emitted when needed.
+static size_t
+encode_sse(uint8_t *bytes, sse_opcode_t opcode, bool wide, uint32_t reg, uint32_t rm)
+{
+    size_t   size = 0;
+    uint32_t map  = ((uint32_t)opcode >> 8) & 0xFFU;
+
+    bytes[size++] = (uint8_t)((uint32_t)opcode >> 16);
+
+    if (wide || reg >= 8 || rm >= 8)
+    {
+        bytes[size++] = rex(wide, reg, rm);
+    }
+
+    bytes[size++] = 0x0F;
+
+    if (map != 0)
+    {
+        bytes[size++] = (uint8_t)map;
+    }
+
+    bytes[size++] = (uint8_t)opcode;
+    return size;
+}
+
+// <SSE> xmm, xmm
+//
+static void
+emit_sse(emitter_t *emitter, sse_opcode_t opcode, uint32_t destination, uint32_t source)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size  = encode_sse(bytes, opcode, false, destination, source);
+    bytes[size++] = (uint8_t)(0xC0U | ((destination & 7U) << 3) | (source & 7U));
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// <SSE> xmm, xmm, imm8, or a shift group with `reg` as its `/digit`
+//
+static void
+emit_sse_immediate(
+    emitter_t *emitter, sse_opcode_t opcode, uint32_t reg, uint32_t rm, uint8_t immediate)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size  = encode_sse(bytes, opcode, false, reg, rm);
+    bytes[size++] = (uint8_t)(0xC0U | ((reg & 7U) << 3) | (rm & 7U));
+    bytes[size++] = immediate;
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOVDQU xmm, [base + displacement] or MOVDQU [base + displacement], xmm
+//
+static void
+emit_sse_memory(
+    emitter_t *emitter, sse_opcode_t opcode, uint32_t reg, uint32_t base, int32_t displacement)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = encode_sse(bytes, opcode, false, reg, base);
+    size += encode_memory_operand(bytes + size, reg, base, displacement);
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+// MOVQ xmm, r64
+//
+static void
+emit_move_to_vector(emitter_t *emitter, uint32_t destination, uint32_t source)
+{
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size  = encode_sse(bytes, SSE_MOVQ_GPR, true, destination, source);
+    bytes[size++] = (uint8_t)(0xC0U | ((destination & 7U) << 3) | (source & 7U));
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+}
+
+/// Loads the 128-bit constant `high:low` into `destination`, clobbering the
+/// first scratch register and `XMM3`.
+static void
+emit_vector_constant(emitter_t *emitter, uint32_t destination, uint64_t low, uint64_t high)
+{
+    const uint32_t scratch = emitter->register_class->scratch_registers[0];
+
+    emit_move_immediate(emitter, scratch, low);
+    emit_move_to_vector(emitter, destination, scratch);
+
+    if (high == low)
+    {
+        emit_sse(emitter, SSE_PUNPCKLQDQ, destination, destination);
+        return;
+    }
+
+    emit_move_immediate(emitter, scratch, high);
+    emit_move_to_vector(emitter, X86_XMM3, scratch);
+    emit_sse(emitter, SSE_PUNPCKLQDQ, destination, X86_XMM3);
+}
+
+/// Multiplies the lanes of `XMM0` by the lanes of `XMM1` into `XMM0`. SSE has
+/// no byte multiply, so the even bytes are multiplied as words and masked to
+/// their low byte, and the odd bytes are shifted down, multiplied as words
+/// and shifted back up.
+static void
+emit_vector_multiply(emitter_t *emitter, uint32_t size)
+{
+    if (size != 0)
+    {
+        emit_sse(emitter, (1U == size) ? SSE_PMULLW : SSE_PMULLD, X86_XMM0, X86_XMM1);
+        return;
+    }
+
+    emit_sse(emitter, SSE_MOVDQA, X86_XMM2, X86_XMM0);
+    emit_sse(emitter, SSE_PMULLW, X86_XMM2, X86_XMM1);
+    emit_sse_immediate(emitter, SSE_SHIFT_WORD, SSE_SHIFT_LEFT, X86_XMM2, 8);
+    emit_sse_immediate(emitter, SSE_SHIFT_WORD, SSE_SHIFT_RIGHT, X86_XMM2, 8);
+    emit_sse_immediate(emitter, SSE_SHIFT_WORD, SSE_SHIFT_RIGHT, X86_XMM0, 8);
+    emit_sse_immediate(emitter, SSE_SHIFT_WORD, SSE_SHIFT_RIGHT, X86_XMM1, 8);
+    emit_sse(emitter, SSE_PMULLW, X86_XMM0, X86_XMM1);
+    emit_sse_immediate(emitter, SSE_SHIFT_WORD, SSE_SHIFT_LEFT, X86_XMM0, 8);
+    emit_sse(emitter, SSE_POR, X86_XMM0, X86_XMM2);
+}
+
+/// Compares the lanes of `XMM0` with the lanes of `XMM1` and returns the
+/// register holding the lane masks.
+static uint32_t
+emit_vector_compare(emitter_t *emitter, bal_opcode_t opcode, uint32_t size)
+{
+    static const sse_opcode_t equal[4]
+        = { SSE_PCMPEQB, SSE_PCMPEQW, SSE_PCMPEQD, SSE_PCMPEQQ };
+    static const sse_opcode_t greater[4]
+        = { SSE_PCMPGTB, SSE_PCMPGTW, SSE_PCMPGTD, SSE_PCMPGTQ };
+    static const uint64_t sign_bits[4] = {
+        0x8080808080808080ULL,
+        0x8000800080008000ULL,
+        0x8000000080000000ULL,
+        0x8000000000000000ULL,
+    };
+
+    const bool is_unsigned
+        = (OPCODE_VECTOR_COMPARE_HIGHER == opcode || OPCODE_VECTOR_COMPARE_HIGHER_SAME == opcode);
+    const bool is_inclusive = (OPCODE_VECTOR_COMPARE_GREATER_EQUAL == opcode
+                               || OPCODE_VECTOR_COMPARE_HIGHER_SAME == opcode);
+
+    if (OPCODE_VECTOR_COMPARE_EQUAL == opcode)
+    {
+        emit_sse(emitter, equal[size], X86_XMM0, X86_XMM1);
+        return X86_XMM0;
+    }
+
+    // PCMPGT is signed. Flipping the sign bit of both operands makes it
+    // unsigned.
+    //
+    if (is_unsigned)
+    {
+        emit_vector_constant(emitter, X86_XMM2, sign_bits[size], sign_bits[size]);
+        emit_sse(emitter, SSE_PXOR, X86_XMM0, X86_XMM2);
+        emit_sse(emitter, SSE_PXOR, X86_XMM1, X86_XMM2);
+    }
+
+    if (false == is_inclusive)
+    {
+        emit_sse(emitter, greater[size], X86_XMM0, X86_XMM1);
+        return X86_XMM0;
+    }
+
+    // Vn >= Vm is NOT (Vm > Vn).
+    //
+    emit_sse(emitter, greater[size], X86_XMM1, X86_XMM0);
+    emit_sse(emitter, SSE_PCMPEQD, X86_XMM0, X86_XMM0);
+    emit_sse(emitter, SSE_PXOR, X86_XMM0, X86_XMM1);
+    return X86_XMM0;
+}
+
+/// Returns the `CPUID` leaf 1 `ECX` feature bits of the host, or 0 if it is
+/// not x86.
+static uint32_t
+host_features(void)
+{
+#if BAL_ARCHITECTURE_X86 && BAL_COMPILER_MSVC
+    int registers[4];
+    __cpuid(registers, 1);
+    return (uint32_t)registers[2];
+#elif BAL_ARCHITECTURE_X86
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    return (0 != __get_cpuid(1, &eax, &ebx, &ecx, &edx)) ? (uint32_t)ecx : 0U;
+#else
+    return 0;
+#endif
+}
+
+/// Emits a vector operation. Guest vector registers are never allocated:
+/// the operands are loaded into `XMM0` and `XMM1`, combined, and the result
+/// is stored back, with `XMM2` and `XMM3` holding constants. None of them
+/// is preserved across calls by either host ABI, so the templates are free
+/// to clobber them.
+static void
+emit_vector(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    static const sse_opcode_t add[4] = { SSE_PADDB, SSE_PADDW, SSE_PADDD, SSE_PADDQ };
+    static const sse_opcode_t sub[4] = { SSE_PSUBB, SSE_PSUBW, SSE_PSUBD, SSE_PSUBQ };
+    static const sse_opcode_t unpack_low[4]
+        = { SSE_PUNPCKLBW, SSE_PUNPCKLWD, SSE_PUNPCKLDQ, SSE_PUNPCKLQDQ };
+    static const sse_opcode_t unpack_high[4]
+        = { SSE_PUNPCKHBW, SSE_PUNPCKHWD, SSE_PUNPCKHDQ, SSE_PUNPCKHQDQ };
+
+    const bal_opcode_t opcode      = bal_ir_opcode(instruction);
+    const uint32_t     descriptor  = bal_ir_source3(instruction);
+    const uint32_t     size        = bal_ir_vector_size(descriptor);
+    const uint32_t     immediate   = bal_ir_vector_immediate(descriptor);
+    const bool         is_128      = bal_ir_vector_is_128(descriptor);
+    const uint32_t     guest_state = emitter->register_class->guest_state_register;
+    uint32_t           result      = X86_XMM0;
+
+    if (BAL_UNLIKELY(false == bal_ir_vector_is_valid(instruction)))
+    {
+        BAL_LOG_ERROR(emitter->logger, "Invalid vector operation (v%u).", ssa_index);
+        emitter->status = BAL_ERROR_ENGINE_STATE_INVALID;
+        return;
+    }
+
+    if (HOST_FEATURES_UNKNOWN == emitter->host_features)
+    {
+        emitter->host_features = host_features();
+    }
+
+    if (BAL_UNLIKELY((emitter->host_features & CPUID_VECTOR_EXTENSIONS)
+                     != CPUID_VECTOR_EXTENSIONS))
+    {
+        BAL_LOG_ERROR(emitter->logger,
+                      "The host lacks SSE4.2 for vector opcode %u (v%u).",
+                      opcode,
+                      ssa_index);
+        emitter->status = BAL_ERROR_UNSUPPORTED_OPCODE;
+        return;
+    }
+
+    if (OPCODE_VECTOR_DUPLICATE_SCALAR == opcode)
+    {
+        uint32_t scalar = emit_materialize_operand(
+            emitter, bal_ir_source2(instruction), emitter->register_class->scratch_registers[0]);
+        emit_move_to_vector(emitter, X86_XMM0, scalar);
+    }
+    else
+    {
+        emit_sse_memory(emitter,
+                        SSE_MOVDQU_LOAD,
+                        X86_XMM0,
+                        guest_state,
+                        vector_register_displacement(bal_ir_source1(instruction)));
+    }
+
+    if (opcode != OPCODE_VECTOR_DUPLICATE && opcode != OPCODE_VECTOR_DUPLICATE_SCALAR)
+    {
+        emit_sse_memory(emitter,
+                        SSE_MOVDQU_LOAD,
+                        X86_XMM1,
+                        guest_state,
+                        vector_register_displacement(bal_ir_source2(instruction)));
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_VECTOR_ADD:
+            emit_sse(emitter, add[size], X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_SUB:
+            emit_sse(emitter, sub[size], X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_MUL:
+            emit_vector_multiply(emitter, size);
+            break;
+
+        case OPCODE_VECTOR_AND:
+            emit_sse(emitter, SSE_PAND, X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_BIC:
+            emit_sse(emitter, SSE_PANDN, X86_XMM1, X86_XMM0);
+            result = X86_XMM1;
+            break;
+
+        case OPCODE_VECTOR_OR:
+            emit_sse(emitter, SSE_POR, X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_OR_NOT:
+            emit_sse(emitter, SSE_PCMPEQD, X86_XMM2, X86_XMM2);
+            emit_sse(emitter, SSE_PXOR, X86_XMM1, X86_XMM2);
+            emit_sse(emitter, SSE_POR, X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_XOR:
+            emit_sse(emitter, SSE_PXOR, X86_XMM0, X86_XMM1);
+            break;
+
+        case OPCODE_VECTOR_COMPARE_EQUAL:
+        case OPCODE_VECTOR_COMPARE_GREATER:
+        case OPCODE_VECTOR_COMPARE_GREATER_EQUAL:
+        case OPCODE_VECTOR_COMPARE_HIGHER:
+        case OPCODE_VECTOR_COMPARE_HIGHER_SAME:
+            result = emit_vector_compare(emitter, opcode, size);
+            break;
+
+        case OPCODE_VECTOR_ZIP_LOW:
+            emit_sse(emitter, unpack_low[size], X86_XMM0, X86_XMM1);
+            break;
+
+        // The high halves of 64-bit operands interleave into the upper half
+        // of the low interleave.
+        //
+        case OPCODE_VECTOR_ZIP_HIGH:
+            if (is_128)
+            {
+                emit_sse(emitter, unpack_high[size], X86_XMM0, X86_XMM1);
+                break;
+            }
+
+            emit_sse(emitter, unpack_low[size], X86_XMM0, X86_XMM1);
+            emit_sse_immediate(emitter, SSE_SHIFT_BYTES, SSE_SHIFT_RIGHT_BYTES, X86_XMM0, 8);
+            break;
+
+        // PALIGNR shifts `Vm:Vn` right. A 64-bit EXT shifts the low halves
+        // joined into one register instead.
+        //
+        case OPCODE_VECTOR_EXTRACT:
+            if (is_128)
+            {
+                emit_sse_immediate(emitter, SSE_PALIGNR, X86_XMM1, X86_XMM0, (uint8_t)immediate);
+                result = X86_XMM1;
+                break;
+            }
+
+            emit_sse(emitter, SSE_PUNPCKLQDQ, X86_XMM0, X86_XMM1);
+            emit_sse_immediate(
+                emitter, SSE_SHIFT_BYTES, SSE_SHIFT_RIGHT_BYTES, X86_XMM0, (uint8_t)immediate);
+            break;
+
+        // PSHUFB zeroes the bytes whose index has the top bit set, and only
+        // reads the low 4 bits of the others. Adding 0x70 with unsigned
+        // saturation sets the top bit of every index past the table.
+        //
+        case OPCODE_VECTOR_TABLE:
+            emit_vector_constant(emitter, X86_XMM2, 0x7070707070707070ULL, 0x7070707070707070ULL);
+            emit_sse(emitter, SSE_PADDUSB, X86_XMM1, X86_XMM2);
+            emit_sse(emitter, SSE_PSHUFB, X86_XMM0, X86_XMM1);
+            break;
+
+        // Both broadcast a lane with PSHUFB. The scalar sits in lane 0.
+        //
+        case OPCODE_VECTOR_DUPLICATE:
+        case OPCODE_VECTOR_DUPLICATE_SCALAR: {
+            const uint32_t lane_bytes = 1U << size;
+            const uint32_t first      = (OPCODE_VECTOR_DUPLICATE == opcode) ? immediate : 0U;
+            uint64_t       mask[2]    = { 0, 0 };
+
+            for (uint32_t i = 0; i < 16U; ++i)
+            {
+                uint64_t index = first * lane_bytes + (i % lane_bytes);
+                mask[i / 8U] |= index << ((i % 8U) * 8U);
+            }
+
+            emit_vector_constant(emitter, X86_XMM2, mask[0], mask[1]);
+            emit_sse(emitter, SSE_PSHUFB, X86_XMM0, X86_XMM2);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    // MOVQ clears the upper half.
+    //
+    if (false == is_128)
+    {
+        emit_sse(emitter, SSE_MOVQ, result, result);
+    }
+
+    emit_sse_memory(emitter,
+                    SSE_MOVDQU_STORE,
+                    result,
+                    guest_state,
+                    vector_register_displacement(bal_ir_vector_register(descriptor)));
+}
+
+/// Pads with `NOP`s until `offset + bias` is a multiple of `alignment`.
+static void
+emit_site_padding(emitter_t *emitter, size_t bias, size_t alignment)
+{
+    const uint8_t nop = 0x90;
+
+    while (((emitter->code_buffer->offset + bias) & (alignment - 1U)) != 0
+           && BAL_SUCCESS == emitter->code_buffer->status)
+    {
+        bal_code_buffer_emit(emitter->code_buffer, &nop, 1);
+    }
+}
+
+/// Moves the top of the return stack buffer by `delta` bytes, leaving the
+/// new top offset in `scratch`.
+static void
+emit_return_stack_move(emitter_t *emitter, uint32_t scratch, int32_t delta)
+{
+    const uint32_t guest_state = emitter->register_class->guest_state_register;
+
+    emit_load(emitter, scratch, guest_state, RETURN_STACK_TOP);
+    emit_alu_immediate(emitter, ALU_ADD, scratch, delta);
+    emit_alu_immediate(emitter, ALU_AND, scratch, RETURN_STACK_MASK);
+    emit_store(emitter, guest_state, RETURN_STACK_TOP, scratch);
+}
+
+/// Pushes `return_address` and a patchable host code pointer onto the
+/// return stack buffer.
+static void
+emit_return_stack_push(emitter_t *emitter, bal_guest_address_t return_address)
+{
+    emit_return_stack_move(emitter, X86_RCX, (int32_t)sizeof(bal_return_stack_entry_t));
+    emit_alu_register(emitter, ALU_ADD, X86_RCX, emitter->register_class->guest_state_register);
+
+    emit_move_immediate(emitter, X86_RAX, return_address);
+    emit_store(emitter, X86_RCX, RETURN_STACK_GUEST_ADDRESS, X86_RAX);
+
+    // MOV RAX, imm64 with the immediate 8-byte aligned. Always the long form
+    // so the unlinked value 0 can be patched.
+    //
+    emit_site_padding(emitter, 2, sizeof(uint64_t));
+
+    const uint8_t move[] = { rex(true, 0, X86_RAX), 0xB8, 0, 0, 0, 0, 0, 0, 0, 0 };
+    emitter->link_offsets[BAL_LINK_KIND_RETURN_ADDRESS]
+        = emitter->code_buffer->offset + 2 - emitter->unit_offset;
+    bal_code_buffer_emit(emitter->code_buffer, move, sizeof(move));
+
+    emit_store(emitter, X86_RCX, RETURN_STACK_HOST_CODE, X86_RAX);
+}
+
+/// Pops the return stack buffer and jumps to the predicted host code if it
+/// matches the target in `RAX`. Otherwise branches to a slow path that pops
+/// and leaves the unit with `RAX` intact.
+static void
+emit_return_stack_pop(emitter_t *emitter)
+{
+    uint32_t miss = add_slow_path(emitter, SLOW_PATH_RETURN_MISS);
+
+    emit_load(emitter, X86_RCX, emitter->register_class->guest_state_register, RETURN_STACK_TOP);
+    emit_alu_register(emitter, ALU_ADD, X86_RCX, emitter->register_class->guest_state_register);
+    emit_compare_memory(emitter, X86_RAX, X86_RCX, RETURN_STACK_GUEST_ADDRESS);
+    emit_slow_path_branch(emitter, miss, 0x75);
+
+    emit_load(emitter, X86_RCX, X86_RCX, RETURN_STACK_HOST_CODE);
+    emit_test(emitter, X86_RCX);
+    emit_slow_path_branch(emitter, miss, 0x74);
+
+    // JMP RCX
+    //
+    const uint8_t jump_rcx[] = { 0xFF, 0xE1 };
+    emit_return_stack_move(emitter, X86_RAX, -(int32_t)sizeof(bal_return_stack_entry_t));
+    bal_code_buffer_emit(emitter->code_buffer, jump_rcx, sizeof(jump_rcx));
+}
+
+/// Emits a `JMP rel32` to the next instruction as the site of `kind`, with
+/// its displacement aligned so it can be patched atomically.
+static void
+emit_link_site(emitter_t *emitter, bal_link_kind_t kind)
+{
+    const uint8_t jump[] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+
+    emit_site_padding(emitter, 1, sizeof(uint32_t));
+    emitter->link_offsets[kind] = emitter->code_buffer->offset + 1 - emitter->unit_offset;
+    bal_code_buffer_emit(emitter->code_buffer, jump, sizeof(jump));
+}
+
+/// Decrements the execution counter and branches to a slow path that leaves
+/// the unit when it reaches zero, reporting it as hot. Runs before any guest
+/// code so the dispatcher can restart the unit at its own address.
+static void
+emit_execution_counter(emitter_t *emitter)
+{
+    emit_move_address(emitter,
+                      X86_RCX,
+                      (uint64_t)(uintptr_t)emitter->execution_counter,
+                      BAL_RELOCATION_EXECUTION_COUNTER);
+
+    // SUB dword [RCX], 1
+    //
+    uint8_t bytes[MAX_INSTRUCTION_BYTES];
+    size_t  size = 0;
+    bytes[size++] = 0x83;
+    size += encode_memory_operand(bytes + size, 5, X86_RCX, 0);
+    bytes[size++] = 0x01;
+    bal_code_buffer_emit(emitter->code_buffer, bytes, size);
+
+    emit_slow_path_branch(emitter, add_slow_path(emitter, SLOW_PATH_HOT_UNIT), 0x74);
+}
+
+/// Compares the target in `RAX` against every inline cache entry and jumps
+/// to the host code of the first match. A miss, or a hit on an unlinked
+/// entry, ends in a slow path that records the unit id and leaves the unit
+/// with `RAX` intact.
+static void
+emit_inline_cache(emitter_t *emitter)
+{
+    const uint32_t guest_state = emitter->register_class->guest_state_register;
+    const uint8_t  nop         = 0x90;
+
+    for (uint32_t i = 0; i < emitter->inline_cache_entries; ++i)
+    {
+        // MOV RCX, imm64 with the immediate 8-byte aligned.
+        //
+        emit_site_padding(emitter, 2, sizeof(uint64_t));
+
+        size_t        guest_site = emitter->code_buffer->offset + 2;
+        const uint8_t move[]     = {
+            rex(true, 0, X86_RCX), 0xB9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        };
+        bal_code_buffer_emit(emitter->code_buffer, move, sizeof(move));
+
+        emit_alu_register(emitter, ALU_CMP, X86_RAX, X86_RCX);
+        size_t mismatch = emit_branch8(emitter, 0x75);
+        emit_increment_memory(emitter, guest_state, VCPU_INLINE_CACHE_HITS);
+
+        while (emitter->code_buffer->offset + 1 < guest_site + INLINE_CACHE_LINK_DISTANCE
+               && BAL_SUCCESS == emitter->code_buffer->status)
+        {
+            bal_code_buffer_emit(emitter->code_buffer, &nop, 1);
+        }
+
+        // JMP rel32 to the next entry.
+        //
+        const uint8_t jump[] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+        BAL_ASSERT(emitter->code_buffer->status != BAL_SUCCESS
+                   || emitter->code_buffer->offset + 1 == guest_site + INLINE_CACHE_LINK_DISTANCE);
+        emitter->link_offsets[BAL_LINK_KIND_INLINE_CACHE + i]
+            = emitter->code_buffer->offset + 1 - emitter->unit_offset;
+        bal_code_buffer_emit(emitter->code_buffer, jump, sizeof(jump));
+
+        patch_branch8(emitter, mismatch);
+    }
+
+    emit_slow_path_branch(emitter, add_slow_path(emitter, SLOW_PATH_INLINE_CACHE_MISS), 0xEB);
+}
+
+// JMP rel32 from the slow path buffer back to `offset` in `hot_buffer`.
+//
+static void
+emit_resume_jump(emitter_t *emitter, bal_code_buffer_t *hot_buffer, size_t offset)
+{
+    bal_code_buffer_t *code_buffer = emitter->code_buffer;
+    const uint8_t     *target
+        = (const uint8_t *)bal_code_buffer_executable_address(hot_buffer, offset);
+    const uint8_t *next = (const uint8_t *)bal_code_buffer_executable_address(
+                              code_buffer, code_buffer->offset)
+                          + 5;
+    ptrdiff_t distance = target - next;
+
+    BAL_ASSERT(distance >= INT32_MIN && distance <= INT32_MAX);
+
+    add_relocation(emitter,
+                   BAL_RELOCATION_BRANCH,
+                   current_position(emitter) + 1U,
+                   (uint32_t)(offset - emitter->unit_offset));
+
+    uint8_t bytes[5] = { 0xE9 };
+    (void)encode_immediate32(bytes + 1, (uint32_t)(int32_t)distance);
+    bal_code_buffer_emit(code_buffer, bytes, sizeof(bytes));
+}
+
+/// Returns the register the value loaded by `ssa_index` ends up in. A load
+/// nobody reads still runs for its fault, into the first scratch register.
+static uint32_t
+load_result_register(const emitter_t *emitter, uint32_t ssa_index)
+{
+    if (BAL_LOCATION_NONE == emitter->locations[ssa_index])
+    {
+        return emitter->register_class->scratch_registers[0];
+    }
+
+    return result_register(emitter, ssa_index);
+}
+
+static void
+emit_load_result(emitter_t *emitter, uint32_t ssa_index, uint32_t host_register)
+{
+    if (emitter->locations[ssa_index] != BAL_LOCATION_NONE)
+    {
+        emit_store_result(emitter, ssa_index, host_register);
+    }
+}
+
+/// Loads the guest address of the access of `instruction`, its address
+/// operand plus its offset, into `destination`.
+static void
+emit_guest_address(emitter_t *emitter, uint32_t destination, bal_ir_instruction_t instruction)
+{
+    int64_t offset = bal_ir_access_offset(instruction);
+
+    emit_load_operand(emitter, destination, bal_ir_source1(instruction));
+
+    if (offset != 0)
+    {
+        emit_alu_immediate(emitter, ALU_ADD, destination, (int32_t)offset);
+    }
+}
+
+/// Returns the size in bytes of the access `instruction`, which defines
+/// `ssa_index`. Atomic accesses take it from their bit width.
+static uint32_t
+access_size(const emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    if (bal_ir_is_atomic(bal_ir_opcode(instruction)))
+    {
+        return emitter->bit_widths[ssa_index] / 8U;
+    }
+
+    return bal_ir_access_size(instruction);
+}
+
+/// Returns `true` if `opcode` is an atomic read-modify-write, which is
+/// performed on a host address the TLB maps for writes.
+static inline bool
+is_atomic_write(bal_opcode_t opcode)
+{
+    return bal_ir_is_atomic(opcode) && opcode != OPCODE_LOAD_EXCLUSIVE;
+}
+
+/// Pushes every allocated register a helper call may clobber and reserves
+/// the shadow space, keeping `RSP` 16-byte aligned. Returns the bytes
+/// reserved below the pushed registers for `emit_restore_registers`.
+static int32_t
+emit_save_registers(emitter_t *emitter)
+{
+    uint32_t saved  = emitter->used_registers_mask & ~emitter->register_class->callee_saved_mask;
+    uint32_t pushed = 0;
+
+    for (uint32_t i = 0; i < BAL_MAX_HOST_REGISTERS; ++i)
+    {
+        if (saved & (1U << i))
+        {
+            emit_push_pop(emitter, 0x50, i);
+            ++pushed;
+        }
+    }
+
+    int32_t padding = (int32_t)((pushed & 1U) * 8U) + SHADOW_SPACE_SIZE;
+
+    if (padding != 0)
+    {
+        emit_alu_immediate(emitter, ALU_SUB, X86_RSP, padding);
+    }
+
+    return padding;
+}
+
+/// Undoes `emit_save_registers`, which returned `padding`.
+static void
+emit_restore_registers(emitter_t *emitter, int32_t padding)
+{
+    uint32_t saved = emitter->used_registers_mask & ~emitter->register_class->callee_saved_mask;
+
+    if (padding != 0)
+    {
+        emit_alu_immediate(emitter, ALU_ADD, X86_RSP, padding);
+    }
+
+    for (uint32_t i = BAL_MAX_HOST_REGISTERS; i-- > 0;)
+    {
+        if (saved & (1U << i))
+        {
+            emit_push_pop(emitter, 0x58, i);
+        }
+    }
+}
+
+/// Performs the access `instruction`, which defines `ssa_index`, by calling
+/// into the TLB, leaving a loaded value, or the host address of an atomic
+/// read-modify-write, in `RAX` and the zero flag clear if the access
+/// faulted. Every allocated register the callee may clobber is saved around
+/// the call.
+static void
+emit_memory_access_call(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    const bal_register_class_t *register_class = emitter->register_class;
+    const uint32_t              guest_state    = register_class->guest_state_register;
+    const bal_opcode_t          opcode         = bal_ir_opcode(instruction);
+    const bool                  write          = (OPCODE_STORE == opcode);
+
+    // Operands may live in spill slots, which move once registers are pushed.
+    //
+    emit_guest_address(emitter, X86_RAX, instruction);
+
+    if (write)
+    {
+        emit_load_operand(emitter, X86_RCX, bal_ir_source2(instruction));
+    }
+
+    int32_t padding = emit_save_registers(emitter);
+
+    // The argument registers are written in an order that never overwrites
+    // RAX or RCX before they are read.
+    //
+    uint64_t              function = (uint64_t)(uintptr_t)bal_tlb_load_slow;
+    bal_relocation_kind_t kind     = BAL_RELOCATION_LOAD_HELPER;
+    uint64_t              size     = access_size(emitter, ssa_index, instruction);
+    emit_move(emitter, ARGUMENT_REGISTER_1, X86_RAX);
+
+    if (is_atomic_write(opcode))
+    {
+        function = (uint64_t)(uintptr_t)bal_tlb_atomic_slow;
+        kind     = BAL_RELOCATION_ATOMIC_HELPER;
+    }
+
+    if (write)
+    {
+        function = (uint64_t)(uintptr_t)bal_tlb_store_slow;
+        kind     = BAL_RELOCATION_STORE_HELPER;
+        emit_move(emitter, ARGUMENT_REGISTER_2, X86_RCX);
+        emit_move_immediate(emitter, ARGUMENT_REGISTER_3, size);
+    }
+    else
+    {
+        emit_move_immediate(emitter, ARGUMENT_REGISTER_2, size);
+    }
+
+    emit_load_address(emitter, ARGUMENT_REGISTER, guest_state, VCPU_TLB);
+    emit_call(emitter, function, kind);
+    emit_restore_registers(emitter, padding);
+
+    emit_load(emitter, X86_RCX, guest_state, TLB_FAULT);
+    emit_test(emitter, X86_RCX);
+}
+
+/// Returns whether the next access can go through fastmem, which needs room
+/// for its site in the table of the region.
+static bool
+can_use_fastmem(const emitter_t *emitter)
+{
+    const bal_fastmem_t *fastmem = emitter->fastmem;
+
+    return fastmem != NULL
+           && emitter->fastmem_site_count < fastmem->site_capacity - fastmem->site_count;
+}
+
+/// Leaves the host address of the access of `instruction` in `RAX`, which
+/// is the fastmem base plus the guest address. Addresses outside the region branch to the
+/// slow path `miss`.
+static void
+emit_fastmem_address(emitter_t *emitter, uint32_t miss, bal_ir_instruction_t instruction)
+{
+    const uint32_t address_bits = emitter->fastmem->address_bits;
+    const uint32_t address      = bal_ir_source1(instruction);
+
+    emit_guest_address(emitter, X86_RAX, instruction);
+
+    if (false == bal_ir_is_constant(address)
+        || ((emitter->constants[address & ~BAL_DECODED_CONSTANT_BIT]
+             + (uint64_t)bal_ir_access_offset(instruction))
+            >> address_bits)
+               != 0)
+    {
+        emit_move(emitter, X86_RCX, X86_RAX);
+        emit_shift(emitter, SHIFT_SHR, X86_RCX, (uint8_t)address_bits, true);
+        emit_slow_path_branch(emitter, miss, 0x75);
+    }
+
+    emit_alu_register(emitter, ALU_ADD, X86_RAX, FASTMEM_BASE_REGISTER);
+}
+
+/// Leaves the host address of the `size` byte access of `instruction` in
+/// `RAX` if the TLB maps it, and branches to the slow path `miss` otherwise.
+static void
+emit_tlb_address(emitter_t *emitter, uint32_t miss, bal_ir_instruction_t instruction, uint32_t size)
+{
+    const uint32_t     guest_state = emitter->register_class->guest_state_register;
+    const bal_opcode_t opcode      = bal_ir_opcode(instruction);
+    const bool         write       = (OPCODE_STORE == opcode || is_atomic_write(opcode));
+
+    // RCX = the entry of the page minus `TLB_ENTRIES`, RAX = the page of the
+    // last byte.
+    //
+    emit_guest_address(emitter, X86_RAX, instruction);
+    emit_move(emitter, X86_RCX, X86_RAX);
+    emit_shift(emitter, SHIFT_SHR, X86_RCX, (uint8_t)(BAL_TLB_PAGE_SHIFT - TLB_ENTRY_SHIFT), true);
+    emit_alu_immediate(emitter, ALU_AND, X86_RCX, TLB_INDEX_MASK);
+    emit_alu_register(emitter, ALU_ADD, X86_RCX, guest_state);
+
+    if (size > 1)
+    {
+        emit_alu_immediate(emitter, ALU_ADD, X86_RAX, (int32_t)size - 1);
+    }
+
+    emit_alu_immediate(emitter, ALU_AND, X86_RAX, -(int32_t)BAL_TLB_PAGE_SIZE);
+    emit_compare_memory(emitter, X86_RAX, X86_RCX, write ? TLB_WRITE_TAG : TLB_READ_TAG);
+    emit_slow_path_branch(emitter, miss, 0x75);
+
+    emit_guest_address(emitter, X86_RAX, instruction);
+    emit_add_memory(emitter, X86_RAX, X86_RCX, TLB_HOST_OFFSET);
+}
+
+/// Performs the access of `instruction` inline, through fastmem if the unit
+/// uses it and by probing the TLB otherwise. A miss branches to a slow path
+/// that calls into the TLB and returns to the end of the access. Once the
+/// slow paths run out, the access always calls into the TLB.
+static void
+emit_memory_access(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    const uint32_t size  = access_size(emitter, ssa_index, instruction);
+    const bool     write = (OPCODE_STORE == bal_ir_opcode(instruction));
+
+    if (BAL_UNLIKELY(size != 1 && size != 2 && size != 4 && size != 8))
+    {
+        BAL_LOG_ERROR(emitter->logger, "Invalid access size %u (v%u).", size, ssa_index);
+        emitter->status = BAL_ERROR_ENGINE_STATE_INVALID;
+        return;
+    }
+
+    if (BAL_UNLIKELY(MAX_SLOW_PATHS == emitter->slow_path_count))
+    {
+        emit_memory_access_call(emitter, ssa_index, instruction);
+        size_t handled = emit_branch8(emitter, 0x74);
+        emit_move_immediate(emitter, X86_RAX, emitter->guest_address);
+        emit_epilogue(emitter);
+        patch_branch8(emitter, handled);
+
+        if (false == write)
+        {
+            uint32_t result = load_result_register(emitter, ssa_index);
+            emit_move(emitter, result, X86_RAX);
+            emit_load_result(emitter, ssa_index, result);
+        }
+
+        return;
+    }
+
+    uint32_t miss     = add_slow_path(emitter, SLOW_PATH_MEMORY_ACCESS);
+    bool     has_site = can_use_fastmem(emitter);
+
+    if (has_site)
+    {
+        emit_fastmem_address(emitter, miss, instruction);
+    }
+    else
+    {
+        emit_tlb_address(emitter, miss, instruction, size);
+    }
+
+    uint32_t result = X86_RAX;
+    uint32_t value  = X86_RCX;
+
+    if (write)
+    {
+        value = emit_materialize_operand(emitter, bal_ir_source2(instruction), X86_RCX);
+    }
+
+    size_t site_offset = emitter->code_buffer->offset;
+
+    if (write)
+    {
+        emit_sized_store(emitter, X86_RAX, value, size);
+    }
+    else
+    {
+        result = load_result_register(emitter, ssa_index);
+        emit_sized_load(emitter, result, X86_RAX, size);
+    }
+
+    if (has_site)
+    {
+        const uint8_t nop = 0x90;
+
+        while (emitter->code_buffer->offset - site_offset < FASTMEM_SITE_SIZE
+               && BAL_SUCCESS == emitter->code_buffer->status)
+        {
+            bal_code_buffer_emit(emitter->code_buffer, &nop, 1);
+        }
+
+        emitter->fastmem_site_count++;
+    }
+
+    slow_path_t *slow_path   = &emitter->slow_paths[miss];
+    slow_path->instruction   = instruction;
+    slow_path->ssa_index     = ssa_index;
+    slow_path->resume_offset = emitter->code_buffer->offset;
+    slow_path->site_offset   = site_offset;
+    slow_path->has_site      = has_site;
+
+    if (false == write)
+    {
+        emit_load_result(emitter, ssa_index, result);
+    }
+}
+
+/// Loads like `OPCODE_LOAD` and arms the exclusive monitor with the address
+/// and the value. The address is recorded first, as the value may be loaded
+/// into the register that held it.
+static void
+emit_load_exclusive(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    const uint32_t guest_state = emitter->register_class->guest_state_register;
+
+    emit_guest_address(emitter, X86_RAX, instruction);
+    emit_store(emitter, guest_state, VCPU_MONITOR_ADDRESS, X86_RAX);
+    emit_memory_access(emitter, ssa_index, instruction);
+    emit_store(emitter, guest_state, VCPU_MONITOR_VALUE, load_result_register(emitter, ssa_index));
+}
+
+/// Leaves the host address of the atomic read-modify-write `instruction`
+/// in `RAX`. A TLB miss calls into [`bal_tlb_atomic_slow`] and returns
+/// here, and once the slow paths run out the call is made unconditionally.
+/// Fastmem is never used, as its fault handler resumes after the access.
+static void
+emit_atomic_address(emitter_t           *emitter,
+                    uint32_t             ssa_index,
+                    bal_ir_instruction_t instruction,
+                    uint32_t             size)
+{
+    if (BAL_UNLIKELY(MAX_SLOW_PATHS == emitter->slow_path_count))
+    {
+        emit_memory_access_call(emitter, ssa_index, instruction);
+        size_t handled = emit_branch8(emitter, 0x74);
+        emit_move_immediate(emitter, X86_RAX, emitter->guest_address);
+        emit_epilogue(emitter);
+        patch_branch8(emitter, handled);
+        return;
+    }
+
+    uint32_t miss = add_slow_path(emitter, SLOW_PATH_MEMORY_ACCESS);
+    emit_tlb_address(emitter, miss, instruction, size);
+
+    slow_path_t *slow_path   = &emitter->slow_paths[miss];
+    slow_path->instruction   = instruction;
+    slow_path->ssa_index     = ssa_index;
+    slow_path->resume_offset = emitter->code_buffer->offset;
+}
+
+/// Writes the operand `source` to the `size` bytes at `[RCX]` if they hold
+/// `RAX`, leaving the value they held in `RAX` and the zero flag set if the
+/// write happened. Both scratch registers are taken, so a `source` outside
+/// of a register is loaded into `RDX`, which is saved around it.
+static void
+emit_compare_swap(emitter_t *emitter, uint32_t source, uint32_t size)
+{
+    if (bal_ir_is_variable(source) && false == is_spilled(emitter->locations[source]))
+    {
+        emit_atomic_instruction(
+            emitter, ATOMIC_CMPXCHG, X86_RCX, emitter->locations[source], size);
+        return;
+    }
+
+    emit_push_pop(emitter, 0x50, X86_RDX);
+
+    // Spill slots moved down by the pushed register.
+    //
+    if (bal_ir_is_constant(source))
+    {
+        emit_load_operand(emitter, X86_RDX, source);
+    }
+    else
+    {
+        emit_load(emitter,
+                  X86_RDX,
+                  X86_RSP,
+                  spill_slot_displacement(emitter->locations[source]) + (int32_t)sizeof(uint64_t));
+    }
+
+    emit_atomic_instruction(emitter, ATOMIC_CMPXCHG, X86_RCX, X86_RDX, size);
+    emit_push_pop(emitter, 0x58, X86_RDX);
+}
+
+/// Performs the atomic read-modify-write `instruction` with a locked host
+/// instruction on the host address the TLB maps its guest address to.
+static void
+emit_atomic(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    const bal_opcode_t opcode      = bal_ir_opcode(instruction);
+    const uint32_t     size        = access_size(emitter, ssa_index, instruction);
+    const uint32_t     guest_state = emitter->register_class->guest_state_register;
+    const uint32_t     result      = load_result_register(emitter, ssa_index);
+    bal_ir_extend_t    extend      = BAL_IR_EXTEND_NONE;
+
+    if (BAL_UNLIKELY(size != 1 && size != 2 && size != 4 && size != 8))
+    {
+        BAL_LOG_ERROR(emitter->logger, "Invalid access size %u (v%u).", size, ssa_index);
+        emitter->status = BAL_ERROR_ENGINE_STATE_INVALID;
+        return;
+    }
+
+    emit_atomic_address(emitter, ssa_index, instruction, size);
+
+    switch (opcode)
+    {
+        case OPCODE_ATOMIC_ADD:
+        case OPCODE_ATOMIC_SWAP:
+            emit_load_operand(emitter, X86_RCX, bal_ir_source2(instruction));
+            emit_atomic_instruction(emitter,
+                                    (OPCODE_ATOMIC_ADD == opcode) ? ATOMIC_XADD : ATOMIC_XCHG,
+                                    X86_RAX,
+                                    X86_RCX,
+                                    size);
+            emit_move(emitter, result, X86_RCX);
+            break;
+
+        case OPCODE_ATOMIC_COMPARE_SWAP:
+            emit_move(emitter, X86_RCX, X86_RAX);
+            emit_load_operand(emitter, X86_RAX, bal_ir_source2(instruction));
+            emit_compare_swap(emitter, bal_ir_source3(instruction), size);
+            emit_move(emitter, result, X86_RAX);
+            break;
+
+        default: {
+            // The monitor is closed either way, and the status stays 1 unless
+            // the guest address matches and memory still holds the value the
+            // monitor was armed with. Neither MOV touches the flags.
+            //
+            const uint8_t set_not_equal_al[] = { 0x0F, 0x95, 0xC0 };
+
+            emit_move(emitter, X86_RCX, X86_RAX);
+            emit_guest_address(emitter, X86_RAX, instruction);
+            emit_compare_memory(emitter, X86_RAX, guest_state, VCPU_MONITOR_ADDRESS);
+            emit_move_immediate(emitter, X86_RAX, BAL_EXCLUSIVE_MONITOR_OPEN);
+            emit_store(emitter, guest_state, VCPU_MONITOR_ADDRESS, X86_RAX);
+            emit_move_immediate(emitter, X86_RAX, 1);
+            size_t failed = emit_branch8(emitter, 0x75);
+            emit_load(emitter, X86_RAX, guest_state, VCPU_MONITOR_VALUE);
+            emit_compare_swap(emitter, bal_ir_source2(instruction), size);
+            bal_code_buffer_emit(emitter->code_buffer, set_not_equal_al, sizeof(set_not_equal_al));
+            patch_branch8(emitter, failed);
+            emit_move(emitter, result, X86_RAX);
+            extend = BAL_IR_EXTEND_UXTB;
+            break;
+        }
+    }
+
+    // The narrow forms leave the upper bits of the register alone.
+    //
+    if (OPCODE_STORE_EXCLUSIVE != opcode && size < 8)
+    {
+        extend = (1 == size)   ? BAL_IR_EXTEND_UXTB
+                 : (2 == size) ? BAL_IR_EXTEND_UXTH
+                               : BAL_IR_EXTEND_UXTW;
+    }
+
+    emit_extend(emitter, extend, result);
+    emit_load_result(emitter, ssa_index, result);
+}
+
+/// Emits every slow path recorded while compiling the unit and points their
+/// branches at them.
+static void
+emit_slow_paths(emitter_t *emitter)
+{
+    bal_code_buffer_t *hot_buffer  = emitter->code_buffer;
+    bal_code_buffer_t *slow_buffer = hot_buffer;
+
+    if (emitter->cold_code_buffer != NULL)
+    {
+        slow_buffer = emitter->cold_code_buffer;
+    }
+
+    const uint32_t guest_state = emitter->register_class->guest_state_register;
+    emitter->hot_size          = hot_buffer->offset - emitter->unit_offset;
+    emitter->code_buffer       = slow_buffer;
+
+    for (uint32_t i = 0; i < emitter->slow_path_count; ++i)
+    {
+        if (hot_buffer->status != BAL_SUCCESS || slow_buffer->status != BAL_SUCCESS)
+        {
+            break;
+        }
+
+        slow_path_t   *slow_path = &emitter->slow_paths[i];
+        const uint8_t *entry
+            = (const uint8_t *)bal_code_buffer_executable_address(slow_buffer, slow_buffer->offset);
+
+        slow_path->entry    = entry;
+        slow_path->position = current_position(emitter);
+
+        // Both buffers live in the same reservation, so the distance always
+        // fits in 32 bits.
+        //
+        for (uint32_t j = 0; j < slow_path->branch_count; ++j)
+        {
+            size_t         site = slow_path->branch_sites[j];
+            const uint8_t *next
+                = (const uint8_t *)bal_code_buffer_executable_address(hot_buffer, site) + 4;
+            ptrdiff_t distance = entry - next;
+
+            BAL_ASSERT(distance >= INT32_MIN && distance <= INT32_MAX);
+            (void)encode_immediate32(hot_buffer->buffer + site, (uint32_t)(int32_t)distance);
+            add_relocation(emitter,
+                           BAL_RELOCATION_BRANCH,
+                           (uint32_t)(site - emitter->unit_offset),
+                           slow_path->position);
+        }
+
+        if (slow_path->has_site)
+        {
+            add_relocation(emitter,
+                           BAL_RELOCATION_FASTMEM_SITE,
+                           (uint32_t)(slow_path->site_offset - emitter->unit_offset),
+                           slow_path->position);
+        }
+
+        switch (slow_path->kind)
+        {
+            case SLOW_PATH_HOT_UNIT:
+                emit_store_immediate32(emitter, guest_state, VCPU_HOT_UNIT, emitter->unit_id);
+                add_relocation(emitter, BAL_RELOCATION_UNIT_ID, current_position(emitter) - 4U, 0);
+                emit_move_immediate(emitter, X86_RAX, emitter->guest_address);
+                break;
+
+            case SLOW_PATH_INLINE_CACHE_MISS:
+                emit_store_immediate32(emitter, guest_state, VCPU_EXIT_UNIT, emitter->unit_id);
+                add_relocation(emitter, BAL_RELOCATION_UNIT_ID, current_position(emitter) - 4U, 0);
+                break;
+
+            case SLOW_PATH_RETURN_MISS:
+                emit_return_stack_move(
+                    emitter, X86_RCX, -(int32_t)sizeof(bal_return_stack_entry_t));
+                break;
+
+            case SLOW_PATH_MEMORY_ACCESS: {
+                const bal_opcode_t opcode = bal_ir_opcode(slow_path->instruction);
+                emit_memory_access_call(emitter, slow_path->ssa_index, slow_path->instruction);
+                size_t fault = emit_branch8(emitter, 0x75);
+
+                if (OPCODE_LOAD == opcode || OPCODE_LOAD_EXCLUSIVE == opcode)
+                {
+                    emit_move(
+                        emitter, load_result_register(emitter, slow_path->ssa_index), X86_RAX);
+                }
+
+                emit_resume_jump(emitter, hot_buffer, slow_path->resume_offset);
+
+                // A fault leaves the unit with its own address as the
+                // target, for the dispatcher to report.
+                //
+                patch_branch8(emitter, fault);
+                emit_move_immediate(emitter, X86_RAX, emitter->guest_address);
+                break;
+            }
+        }
+
+        emit_epilogue(emitter);
+    }
+
+    emitter->code_buffer = hot_buffer;
+
+    if (hot_buffer->status != BAL_SUCCESS)
+    {
+        emitter->status = hot_buffer->status;
+    }
+    else if (slow_buffer->status != BAL_SUCCESS)
+    {
+        emitter->status = slow_buffer->status;
+    }
+}
+
+/// Stores `src2` of the `OPCODE_SET_REGISTER` or
+/// `OPCODE_SET_REGISTER_ON_EXIT` `instruction` to its guest register, through
+/// `scratch` if it is not in a register.
+static void
+emit_set_register(emitter_t *emitter, bal_ir_instruction_t instruction, uint32_t scratch)
+{
+    uint32_t value = emit_materialize_operand(emitter, bal_ir_source2(instruction), scratch);
+    emit_store(emitter,
+               emitter->register_class->guest_state_register,
+               guest_register_displacement(bal_ir_source1(instruction)),
+               value);
+}
+
+/// Stores the writes the unit left to its exit, through `RCX` so the target
+/// in `RAX` survives.
+static void
+emit_exit_writes(emitter_t *emitter)
+{
+    for (uint32_t i = 0; i < emitter->exit_write_count; ++i)
+    {
+        emit_set_register(emitter, emitter->exit_writes[i], X86_RCX);
+    }
+}
+
+/// Registers the fastmem access of every memory slow path with the region,
+/// so a fault on it resumes in the slow path. Room was checked while the
+/// accesses were emitted.
+static void
+register_fastmem_sites(const emitter_t *emitter)
+{
+    bal_code_buffer_t *code_buffer = emitter->code_buffer;
+
+    for (uint32_t i = 0; i < emitter->slow_path_count; ++i)
+    {
+        const slow_path_t *slow_path = &emitter->slow_paths[i];
+
+        if (SLOW_PATH_MEMORY_ACCESS != slow_path->kind || false == slow_path->has_site)
+        {
+            continue;
+        }
+
+        bal_fastmem_site_t site = {
+            .access = (const uint8_t *)bal_code_buffer_executable_address(
+                code_buffer, slow_path->site_offset),
+            .writable  = code_buffer->buffer + slow_path->site_offset,
+            .slow_path = slow_path->entry,
+        };
+
+        (void)bal_fastmem_add_site(emitter->fastmem, &site);
+    }
+}
+
+/// Finds `position` of the unit described by `unit`, see
+/// [`bal_relocation_t`], and returns its writable address in `writable` and
+/// its executable address in `executable`.
+static void
+resolve_position(const bal_code_buffer_t   *code_buffer,
+                 const bal_code_buffer_t   *cold_code_buffer,
+                 const bal_compiled_unit_t *unit,
+                 uint32_t                   position,
+                 uint8_t                  **writable,
+                 const uint8_t            **executable)
+{
+    if (position < unit->size)
+    {
+        *writable   = code_buffer->buffer + unit->offset + position;
+        *executable = (const uint8_t *)bal_code_buffer_executable_address(
+            code_buffer, unit->offset + position);
+        return;
+    }
+
+    size_t offset = unit->cold_offset + (position - unit->size);
+    *writable     = cold_code_buffer->buffer + offset;
+    *executable   = (const uint8_t *)bal_code_buffer_executable_address(cold_code_buffer, offset);
+}
+
+/// Leaves the unit with the target of `instruction` in `RAX`. Direct exits
+/// go through a `JMP rel32` whose displacement is aligned so it can be
+/// patched atomically. The writes left to the exit follow the `JMP`, so they
+/// are skipped once it is linked. Returns go through the return stack buffer
+/// and other indirect exits through the inline cache, both of which leave the
+/// unit from a slow path.
+static void
+emit_exit(emitter_t *emitter, bal_ir_instruction_t instruction)
+{
+    const bal_opcode_t opcode        = bal_ir_opcode(instruction);
+    uint32_t           target        = bal_ir_source1(instruction);
+    const bool         has_link_site = (OPCODE_RETURN != opcode && bal_ir_is_constant(target));
+
+    if (false == has_link_site)
+    {
+        emit_exit_writes(emitter);
+    }
+
+    // The push clobbers both scratch registers, so it has to come before the
+    // target is loaded.
+    //
+    if (OPCODE_CALL == opcode)
+    {
+        uint32_t return_address = bal_ir_source2(instruction);
+        emit_return_stack_push(
+            emitter, emitter->constants[return_address & ~BAL_DECODED_CONSTANT_BIT]);
+    }
+
+    emit_load_operand(emitter, X86_RAX, target);
+    emitter->terminated = true;
+
+    if (OPCODE_RETURN == opcode)
+    {
+        emit_return_stack_pop(emitter);
+        return;
+    }
+
+    if (bal_ir_is_variable(target) && emitter->inline_cache_entries != 0)
+    {
+        emit_inline_cache(emitter);
+        return;
+    }
+
+    if (has_link_site)
+    {
+        emit_link_site(emitter, BAL_LINK_KIND_JUMP);
+        emit_exit_writes(emitter);
+    }
+
+    emit_epilogue(emitter);
+}
+
+/// Leaves the unit for `src2` if the branch `instruction` is taken and for
+/// `src3` otherwise, with the target in `RAX`. Both paths are direct exits
+/// with their own link site. The writes left to the exit are stored before
+/// either is taken.
+static void
+emit_conditional_exit(emitter_t *emitter, bal_ir_instruction_t instruction)
+{
+    emit_exit_writes(emitter);
+
+    const bool not_zero  = (OPCODE_BRANCH_NOT_ZERO == bal_ir_opcode(instruction));
+    uint32_t   condition = emit_materialize_operand(emitter, bal_ir_source1(instruction), X86_RCX);
+
+    emit_test(emitter, condition);
+
+    // JNZ or JZ rel8 over the path that is not taken.
+    //
+    size_t taken = emit_branch8(emitter, not_zero ? 0x75 : 0x74);
+
+    emit_load_operand(emitter, X86_RAX, bal_ir_source3(instruction));
+    emit_link_site(emitter, BAL_LINK_KIND_NOT_TAKEN);
+    emit_epilogue(emitter);
+
+    patch_branch8(emitter, taken);
+    emit_load_operand(emitter, X86_RAX, bal_ir_source2(instruction));
+    emit_link_site(emitter, BAL_LINK_KIND_JUMP);
+    emit_epilogue(emitter);
+
+    emitter->terminated = true;
+}
+
+/// Calls [`bal_guest_state_condition_holds`] for the condition code of the
+/// `OPCODE_CMP_COND` `instruction`, which defines `ssa_index`.
+static void
+emit_compare_condition(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    int32_t padding = emit_save_registers(emitter);
+
+    emit_move_immediate(emitter, ARGUMENT_REGISTER_1, bal_ir_source1(instruction) & 0xFU);
+    emit_move(emitter, ARGUMENT_REGISTER, emitter->register_class->guest_state_register);
+    emit_call(emitter,
+              (uint64_t)(uintptr_t)bal_guest_state_condition_holds,
+              BAL_RELOCATION_CONDITION_HELPER);
+    emit_restore_registers(emitter, padding);
+
+    // Only the low half of a 32-bit return value is defined.
+    //
+    uint32_t result = result_register(emitter, ssa_index);
+    emit_move(emitter, result, X86_RAX);
+    emit_zero_extend32(emitter, result);
+    emit_store_result(emitter, ssa_index, result);
+}
+
+static void
+emit_instruction(emitter_t *emitter, uint32_t ssa_index, bal_ir_instruction_t instruction)
+{
+    const bal_opcode_t opcode = bal_ir_opcode(instruction);
+
+    // Nothing reads the value and computing it can not be observed.
+    //
+    if (BAL_LOCATION_NONE == emitter->locations[ssa_index]
+        && (bal_ir_is_side_effect_free(opcode) || OPCODE_GET_REGISTER == opcode))
+    {
+        return;
+    }
+
+    BAL_LOG_TRACE(emitter->logger,
+                  "  [+0x%04zx] v%u: opcode %u",
+                  emitter->code_buffer->offset,
+                  ssa_index,
+                  opcode);
+
+    const uint32_t guest_state = emitter->register_class->guest_state_register;
+
+    if (BAL_UNLIKELY((OPCODE_GET_REGISTER == opcode || OPCODE_SET_REGISTER == opcode
+                      || OPCODE_SET_REGISTER_ON_EXIT == opcode)
+                     && bal_ir_source1(instruction) >= BAL_GUEST_REGISTER_COUNT))
+    {
+        BAL_LOG_ERROR(emitter->logger,
+                      "Guest register %u out of range (v%u).",
+                      bal_ir_source1(instruction),
+                      ssa_index);
+        emitter->status = BAL_ERROR_ENGINE_STATE_INVALID;
+        return;
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_GET_REGISTER: {
+            uint32_t result = result_register(emitter, ssa_index);
+            emit_load(emitter,
+                      result,
+                      guest_state,
+                      guest_register_displacement(bal_ir_source1(instruction)));
+            emit_store_result(emitter, ssa_index, result);
+            break;
+        }
+
+        case OPCODE_SET_REGISTER:
+            emit_set_register(emitter, instruction, emitter->register_class->scratch_registers[0]);
+            break;
+
+        // Written by the exit, unless it has no room left for it.
+        //
+        case OPCODE_SET_REGISTER_ON_EXIT:
+            if (emitter->exit_write_count < MAX_EXIT_WRITES)
+            {
+                emitter->exit_writes[emitter->exit_write_count++] = instruction;
+                break;
+            }
+
+            emit_set_register(emitter, instruction, emitter->register_class->scratch_registers[0]);
+            break;
+
+        case OPCODE_CONST:
+        case OPCODE_MOV: {
+            uint32_t result = result_register(emitter, ssa_index);
+            emit_load_operand(emitter, result, bal_ir_source1(instruction));
+            emit_store_result(emitter, ssa_index, result);
+            break;
+        }
+
+        case OPCODE_ADD:
+            emit_binary(emitter, ALU_ADD, ssa_index, instruction);
+            break;
+
+        case OPCODE_SUB:
+            emit_binary(emitter, ALU_SUB, ssa_index, instruction);
+            break;
+
+        case OPCODE_AND:
+            emit_binary(emitter, ALU_AND, ssa_index, instruction);
+            break;
+
+        case OPCODE_OR:
+            emit_binary(emitter, ALU_OR, ssa_index, instruction);
+            break;
+
+        case OPCODE_XOR:
+            emit_binary(emitter, ALU_XOR, ssa_index, instruction);
+            break;
+
+        case OPCODE_LOAD:
+        case OPCODE_STORE:
+            emit_memory_access(emitter, ssa_index, instruction);
+            break;
+
+        case OPCODE_LOAD_EXCLUSIVE:
+            emit_load_exclusive(emitter, ssa_index, instruction);
+            break;
+
+        case OPCODE_STORE_EXCLUSIVE:
+        case OPCODE_ATOMIC_ADD:
+        case OPCODE_ATOMIC_SWAP:
+        case OPCODE_ATOMIC_COMPARE_SWAP:
+            emit_atomic(emitter, ssa_index, instruction);
+            break;
+
+        case OPCODE_JUMP:
+        case OPCODE_CALL:
+        case OPCODE_RETURN:
+            emit_exit(emitter, instruction);
+            break;
+
+        case OPCODE_BRANCH_ZERO:
+        case OPCODE_BRANCH_NOT_ZERO:
+            emit_conditional_exit(emitter, instruction);
+            break;
+
+        case OPCODE_CMP_COND:
+            emit_compare_condition(emitter, ssa_index, instruction);
+            break;
+
+        case OPCODE_VECTOR_ADD:
+        case OPCODE_VECTOR_SUB:
+        case OPCODE_VECTOR_MUL:
+        case OPCODE_VECTOR_AND:
+        case OPCODE_VECTOR_BIC:
+        case OPCODE_VECTOR_OR:
+        case OPCODE_VECTOR_OR_NOT:
+        case OPCODE_VECTOR_XOR:
+        case OPCODE_VECTOR_COMPARE_EQUAL:
+        case OPCODE_VECTOR_COMPARE_GREATER:
+        case OPCODE_VECTOR_COMPARE_GREATER_EQUAL:
+        case OPCODE_VECTOR_COMPARE_HIGHER:
+        case OPCODE_VECTOR_COMPARE_HIGHER_SAME:
+        case OPCODE_VECTOR_ZIP_LOW:
+        case OPCODE_VECTOR_ZIP_HIGH:
+        case OPCODE_VECTOR_EXTRACT:
+        case OPCODE_VECTOR_TABLE:
+        case OPCODE_VECTOR_DUPLICATE:
+        case OPCODE_VECTOR_DUPLICATE_SCALAR:
+            emit_vector(emitter, ssa_index, instruction);
+            break;
+
+        case OPCODE_NOP:
+            break;
+
+        default:
+            BAL_LOG_ERROR(
+                emitter->logger, "No x86-64 template for opcode %u (v%u).", opcode, ssa_index);
+            emitter->status = BAL_ERROR_UNSUPPORTED_OPCODE;
+            return;
+    }
+
+    if (BAL_UNLIKELY(emitter->code_buffer->status != BAL_SUCCESS))
+    {
+        emitter->status = emitter->code_buffer->status;
+    }
+}
+
+/*** end of file ***/
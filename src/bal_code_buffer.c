@@ -0,0 +1,172 @@
+#include "bal_code_buffer.h"
+#include <stdbool.h>
+#include <string.h>
+
+static bool reserve_bytes(bal_code_buffer_t *, size_t);
+
+bal_error_t
+bal_code_buffer_init(bal_code_buffer_t *code_buffer,
+                     void              *buffer,
+                     const void        *executable_buffer,
+                     size_t             size,
+                     bal_logger_t       logger)
+{
+    if (NULL == code_buffer || NULL == buffer || NULL == executable_buffer || 0 == size)
+    {
+        BAL_LOG_ERROR(&logger,
+                      "Code buffer init failed. Invalid arguments (Buffer: %p, Size: %zu).",
+                      buffer,
+                      size);
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    code_buffer->buffer            = (uint8_t *)buffer;
+    code_buffer->executable_buffer = (const uint8_t *)executable_buffer;
+    code_buffer->capacity          = size;
+    code_buffer->code_memory       = NULL;
+    code_buffer->region            = BAL_CODE_REGION_HOT;
+    code_buffer->offset            = 0;
+    code_buffer->limit             = SIZE_MAX;
+    code_buffer->logger            = logger;
+    code_buffer->status            = BAL_SUCCESS;
+
+    BAL_LOG_INFO(&logger,
+                 "Code buffer initialized. RW: %p, RX: %p, Capacity: %zu bytes.",
+                 buffer,
+                 executable_buffer,
+                 size);
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_code_buffer_init_code_memory(bal_code_buffer_t *code_buffer,
+                                 bal_code_memory_t *code_memory,
+                                 bal_logger_t       logger)
+{
+    return bal_code_buffer_init_code_memory_region(
+        code_buffer, code_memory, BAL_CODE_REGION_HOT, logger);
+}
+
+bal_error_t
+bal_code_buffer_init_code_memory_region(bal_code_buffer_t *code_buffer,
+                                        bal_code_memory_t *code_memory,
+                                        bal_code_region_t  region,
+                                        bal_logger_t       logger)
+{
+    if (NULL == code_buffer || NULL == code_memory)
+    {
+        BAL_LOG_ERROR(&logger, "Code buffer init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    bal_error_t error = bal_code_memory_commit_region(code_memory, region, 1);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    size_t base = bal_code_memory_region_offset(code_memory, region);
+
+    code_buffer->buffer            = code_memory->writable_base + base;
+    code_buffer->executable_buffer = code_memory->executable_base + base;
+    code_buffer->capacity          = bal_code_memory_region_committed(code_memory, region);
+    code_buffer->code_memory       = code_memory;
+    code_buffer->region            = region;
+    code_buffer->offset            = 0;
+    code_buffer->limit             = SIZE_MAX;
+    code_buffer->logger            = logger;
+    code_buffer->status            = BAL_SUCCESS;
+
+    return BAL_SUCCESS;
+}
+
+void
+bal_code_buffer_emit(bal_code_buffer_t *BAL_RESTRICT code_buffer,
+                     const uint8_t *BAL_RESTRICT     bytes,
+                     size_t                          size)
+{
+    if (code_buffer->status != BAL_SUCCESS)
+    {
+        return;
+    }
+
+    if (BAL_UNLIKELY(false == reserve_bytes(code_buffer, size)))
+    {
+        return;
+    }
+
+    (void)memcpy(code_buffer->buffer + code_buffer->offset, bytes, size);
+    code_buffer->offset += size;
+}
+
+void
+bal_code_buffer_align(bal_code_buffer_t *code_buffer, size_t alignment, uint8_t fill)
+{
+    if (code_buffer->status != BAL_SUCCESS)
+    {
+        return;
+    }
+
+    size_t padding = (alignment - (code_buffer->offset & (alignment - 1))) & (alignment - 1);
+
+    if (BAL_UNLIKELY(false == reserve_bytes(code_buffer, padding)))
+    {
+        return;
+    }
+
+    (void)memset(code_buffer->buffer + code_buffer->offset, fill, padding);
+    code_buffer->offset += padding;
+}
+
+void
+bal_code_buffer_set_window(bal_code_buffer_t *code_buffer, size_t begin, size_t end)
+{
+    code_buffer->offset = begin;
+    code_buffer->limit  = end;
+    code_buffer->status = BAL_SUCCESS;
+}
+
+/// Makes room for `size` more bytes, committing code memory if needed.
+static bool
+reserve_bytes(bal_code_buffer_t *code_buffer, size_t size)
+{
+    // The owner of the window handles running out of it, so this is not
+    // logged as an error.
+    //
+    if (BAL_UNLIKELY(size > code_buffer->limit - code_buffer->offset))
+    {
+        BAL_LOG_DEBUG(
+            &code_buffer->logger, "Code buffer window full at offset %zu.", code_buffer->offset);
+        code_buffer->status = BAL_ERROR_CODE_BUFFER_OVERFLOW;
+        return false;
+    }
+
+    if (BAL_LIKELY(size <= code_buffer->capacity - code_buffer->offset))
+    {
+        return true;
+    }
+
+    if (code_buffer->code_memory != NULL)
+    {
+        bal_error_t error = bal_code_memory_commit_region(
+            code_buffer->code_memory, code_buffer->region, code_buffer->offset + size);
+
+        if (BAL_SUCCESS == error)
+        {
+            code_buffer->capacity
+                = bal_code_memory_region_committed(code_buffer->code_memory, code_buffer->region);
+            return true;
+        }
+
+        code_buffer->status = error;
+        return false;
+    }
+
+    BAL_LOG_ERROR(
+        &code_buffer->logger, "Code buffer overflow. Capacity %zu reached.", code_buffer->capacity);
+    code_buffer->status = BAL_ERROR_CODE_BUFFER_OVERFLOW;
+    return false;
+}
+
+/*** end of file ***/
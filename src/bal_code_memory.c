@@ -0,0 +1,370 @@
+// memfd_create() is a GNU extension.
+//
+#define _GNU_SOURCE
+
+#include "bal_code_memory.h"
+#include "bal_platform.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static size_t host_page_size(void);
+static bool   map_views(bal_code_memory_t *);
+static bool   commit_range(bal_code_memory_t *, size_t, size_t);
+static void   unmap_views(bal_code_memory_t *);
+
+/// Helper macro to align `x` UP to `alignment`, which must be a power of two.
+#define ALIGN_UP(x, alignment) (((x) + ((alignment) - 1)) & ~((alignment) - 1))
+
+bal_error_t
+bal_code_memory_init(bal_code_memory_t *code_memory, size_t reserve_size, bal_logger_t logger)
+{
+    if (NULL == code_memory || 0 == reserve_size)
+    {
+        BAL_LOG_ERROR(&logger, "Code memory init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    code_memory->page_size       = host_page_size();
+    code_memory->reserved_size   = ALIGN_UP(reserve_size, code_memory->page_size);
+    code_memory->committed_size  = 0;
+    code_memory->writable_base   = NULL;
+    code_memory->executable_base = NULL;
+    code_memory->handle          = -1;
+    code_memory->logger          = logger;
+
+    code_memory->cold_offset         = code_memory->reserved_size;
+    code_memory->cold_committed_size = 0;
+
+    if (false == map_views(code_memory))
+    {
+        BAL_LOG_ERROR(&logger,
+                      "Failed to reserve %zu bytes of code memory.",
+                      code_memory->reserved_size);
+        unmap_views(code_memory);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    BAL_LOG_INFO(&logger,
+                 "Reserved %zu KB of code memory. RW: %p, RX: %p.",
+                 code_memory->reserved_size / 1024,
+                 (void *)code_memory->writable_base,
+                 (void *)code_memory->executable_base);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_code_memory_split(bal_code_memory_t *code_memory, size_t cold_size)
+{
+    if (NULL == code_memory || code_memory->committed_size != 0
+        || code_memory->cold_committed_size != 0)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t aligned_size = ALIGN_UP(cold_size, code_memory->page_size);
+
+    if (aligned_size >= code_memory->reserved_size)
+    {
+        BAL_LOG_ERROR(&code_memory->logger,
+                      "A %zu byte cold region leaves no hot region.",
+                      aligned_size);
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    code_memory->cold_offset = code_memory->reserved_size - aligned_size;
+
+    BAL_LOG_INFO(&code_memory->logger,
+                 "Split code memory. Hot: %zu KB, Cold: %zu KB.",
+                 code_memory->cold_offset / 1024,
+                 aligned_size / 1024);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_code_memory_commit(bal_code_memory_t *code_memory, size_t size)
+{
+    return bal_code_memory_commit_region(code_memory, BAL_CODE_REGION_HOT, size);
+}
+
+bal_error_t
+bal_code_memory_commit_region(bal_code_memory_t *code_memory,
+                              bal_code_region_t  region,
+                              size_t             size)
+{
+    if (BAL_UNLIKELY(NULL == code_memory))
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    bool    cold      = (BAL_CODE_REGION_COLD == region);
+    size_t  base      = cold ? code_memory->cold_offset : 0;
+    size_t  limit     = cold ? code_memory->reserved_size - base : code_memory->cold_offset;
+    size_t *committed = cold ? &code_memory->cold_committed_size : &code_memory->committed_size;
+
+    if (size <= *committed)
+    {
+        return BAL_SUCCESS;
+    }
+
+    if (BAL_UNLIKELY(size > limit))
+    {
+        BAL_LOG_ERROR(&code_memory->logger,
+                      "Code memory exhausted. %zu of %zu bytes requested.",
+                      size,
+                      limit);
+        return BAL_ERROR_CODE_BUFFER_OVERFLOW;
+    }
+
+    size_t granularity    = ALIGN_UP(BAL_CODE_MEMORY_COMMIT_GRANULARITY, code_memory->page_size);
+    size_t committed_size = ALIGN_UP(size, granularity);
+
+    if (committed_size > limit)
+    {
+        committed_size = limit;
+    }
+
+    size_t offset = base + *committed;
+
+    if (BAL_UNLIKELY(false == commit_range(code_memory, offset, base + committed_size - offset)))
+    {
+        BAL_LOG_ERROR(&code_memory->logger,
+                      "Failed to commit code memory [0x%zx, 0x%zx).",
+                      offset,
+                      base + committed_size);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    *committed = committed_size;
+
+    BAL_LOG_DEBUG(&code_memory->logger,
+                  "Committed %zu KB of %s code memory.",
+                  committed_size / 1024,
+                  cold ? "cold" : "hot");
+    return BAL_SUCCESS;
+}
+
+void
+bal_code_memory_destroy(bal_code_memory_t *code_memory)
+{
+    if (NULL == code_memory)
+    {
+        return;
+    }
+
+    unmap_views(code_memory);
+    code_memory->committed_size = 0;
+    code_memory->reserved_size  = 0;
+}
+
+#if BAL_PLATFORM_POSIX
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t
+host_page_size(void)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    return (page_size > 0) ? (size_t)page_size : 4096U;
+}
+
+/// Returns a file descriptor for an anonymous shared memory object that is
+/// not visible in the file system.
+static int
+create_shared_memory(void)
+{
+#if defined(__linux__)
+    return memfd_create("ballistic-code", MFD_CLOEXEC);
+#else
+    // Apple Silicon only allows JIT code in MAP_JIT mappings, which can not be
+    // shared, so the executable view is only usable on Intel Macs.
+    //
+    static unsigned int counter = 0;
+    char                name[64];
+    (void)snprintf(name, sizeof(name), "/ballistic-%ld-%u", (long)getpid(), counter++);
+
+    int file_descriptor = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (file_descriptor >= 0)
+    {
+        (void)shm_unlink(name);
+    }
+
+    return file_descriptor;
+#endif
+}
+
+static bool
+map_views(bal_code_memory_t *code_memory)
+{
+    int file_descriptor = create_shared_memory();
+
+    if (file_descriptor < 0)
+    {
+        return false;
+    }
+
+    code_memory->handle = file_descriptor;
+
+    // The object is sparse, so sizing it for the whole reservation up front
+    // does not consume memory until pages are touched.
+    //
+    if (ftruncate(file_descriptor, (off_t)code_memory->reserved_size) != 0)
+    {
+        return false;
+    }
+
+    void *writable = mmap(
+        NULL, code_memory->reserved_size, PROT_NONE, MAP_SHARED, file_descriptor, 0);
+
+    if (MAP_FAILED == writable)
+    {
+        return false;
+    }
+
+    code_memory->writable_base = (uint8_t *)writable;
+
+    void *executable = mmap(
+        NULL, code_memory->reserved_size, PROT_NONE, MAP_SHARED, file_descriptor, 0);
+
+    if (MAP_FAILED == executable)
+    {
+        return false;
+    }
+
+    code_memory->executable_base = (uint8_t *)executable;
+    return true;
+}
+
+static bool
+commit_range(bal_code_memory_t *code_memory, size_t offset, size_t size)
+{
+    uint8_t *writable   = code_memory->writable_base + offset;
+    uint8_t *executable = code_memory->executable_base + offset;
+
+    return 0 == mprotect(writable, size, PROT_READ | PROT_WRITE)
+           && 0 == mprotect(executable, size, PROT_READ | PROT_EXEC);
+}
+
+static void
+unmap_views(bal_code_memory_t *code_memory)
+{
+    if (code_memory->writable_base != NULL)
+    {
+        (void)munmap(code_memory->writable_base, code_memory->reserved_size);
+        code_memory->writable_base = NULL;
+    }
+
+    if (code_memory->executable_base != NULL)
+    {
+        (void)munmap(code_memory->executable_base, code_memory->reserved_size);
+        code_memory->executable_base = NULL;
+    }
+
+    if (code_memory->handle >= 0)
+    {
+        (void)close((int)code_memory->handle);
+        code_memory->handle = -1;
+    }
+}
+
+void
+bal_code_memory_flush_instruction_cache(const void *executable_address, size_t size)
+{
+#if BAL_ARCHITECTURE_ARM
+    char *begin = (char *)(uintptr_t)executable_address;
+    __builtin___clear_cache(begin, begin + size);
+#else
+    // x86 keeps instruction fetches coherent with stores.
+    //
+    (void)executable_address;
+    (void)size;
+#endif
+}
+
+#endif /* BAL_PLATFORM_POSIX */
+
+#if BAL_PLATFORM_WINDOWS
+
+#include <windows.h>
+
+static size_t
+host_page_size(void)
+{
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (size_t)system_info.dwPageSize;
+}
+
+static bool
+map_views(bal_code_memory_t *code_memory)
+{
+    uint64_t size    = (uint64_t)code_memory->reserved_size;
+    HANDLE   section = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                        NULL,
+                                        PAGE_EXECUTE_READWRITE | SEC_RESERVE,
+                                        (DWORD)(size >> 32),
+                                        (DWORD)size,
+                                        NULL);
+
+    if (NULL == section)
+    {
+        return false;
+    }
+
+    code_memory->handle = (intptr_t)section;
+
+    code_memory->writable_base
+        = (uint8_t *)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, code_memory->reserved_size);
+    code_memory->executable_base = (uint8_t *)MapViewOfFile(
+        section, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, code_memory->reserved_size);
+
+    return code_memory->writable_base != NULL && code_memory->executable_base != NULL;
+}
+
+static bool
+commit_range(bal_code_memory_t *code_memory, size_t offset, size_t size)
+{
+    uint8_t *writable   = code_memory->writable_base + offset;
+    uint8_t *executable = code_memory->executable_base + offset;
+
+    return VirtualAlloc(writable, size, MEM_COMMIT, PAGE_READWRITE) != NULL
+           && VirtualAlloc(executable, size, MEM_COMMIT, PAGE_EXECUTE_READ) != NULL;
+}
+
+static void
+unmap_views(bal_code_memory_t *code_memory)
+{
+    if (code_memory->writable_base != NULL)
+    {
+        (void)UnmapViewOfFile(code_memory->writable_base);
+        code_memory->writable_base = NULL;
+    }
+
+    if (code_memory->executable_base != NULL)
+    {
+        (void)UnmapViewOfFile(code_memory->executable_base);
+        code_memory->executable_base = NULL;
+    }
+
+    if (code_memory->handle != -1)
+    {
+        (void)CloseHandle((HANDLE)code_memory->handle);
+        code_memory->handle = -1;
+    }
+}
+
+void
+bal_code_memory_flush_instruction_cache(const void *executable_address, size_t size)
+{
+    (void)FlushInstructionCache(GetCurrentProcess(), executable_address, size);
+}
+
+#endif /* BAL_PLATFORM_WINDOWS */
+
+/*** end of file ***/
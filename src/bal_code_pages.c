@@ -0,0 +1,60 @@
+#include "bal_code_pages.h"
+#include <string.h>
+
+void
+bal_code_pages_init(bal_code_pages_t *code_pages)
+{
+    (void)memset(code_pages->counts, 0, sizeof(code_pages->counts));
+    code_pages->generation = 0;
+}
+
+void
+bal_code_pages_add(bal_code_pages_t *code_pages, bal_guest_address_t guest_address, size_t size)
+{
+    if (0 == size)
+    {
+        return;
+    }
+
+    bal_guest_address_t first = guest_address >> BAL_CODE_PAGE_SHIFT;
+    bal_guest_address_t last  = (guest_address + size - 1U) >> BAL_CODE_PAGE_SHIFT;
+
+    for (bal_guest_address_t page = first;; ++page)
+    {
+        uint32_t *count = &code_pages->counts[(uint32_t)page & (BAL_CODE_PAGES_SLOTS - 1U)];
+
+        if (0 == (*count)++)
+        {
+            code_pages->generation++;
+        }
+
+        if (page == last)
+        {
+            break;
+        }
+    }
+}
+
+void
+bal_code_pages_remove(bal_code_pages_t *code_pages, bal_guest_address_t guest_address, size_t size)
+{
+    if (0 == size)
+    {
+        return;
+    }
+
+    bal_guest_address_t first = guest_address >> BAL_CODE_PAGE_SHIFT;
+    bal_guest_address_t last  = (guest_address + size - 1U) >> BAL_CODE_PAGE_SHIFT;
+
+    for (bal_guest_address_t page = first;; ++page)
+    {
+        code_pages->counts[(uint32_t)page & (BAL_CODE_PAGES_SLOTS - 1U)]--;
+
+        if (page == last)
+        {
+            break;
+        }
+    }
+}
+
+/*** end of file ***/
@@ -13,7 +13,7 @@ bal_decode_arm64(const uint32_t instruction)
     for (size_t i = 0; i < bucket->count; ++i)
     {
         const bal_decoder_instruction_metadata_t *metadata
-            = g_decoder_hash_candidates[bucket->index];
+            = g_decoder_hash_candidates[bucket->index + i];
 
         if ((instruction & metadata->mask) == metadata->expected)
         {
@@ -1,16 +1,20 @@
 #include "bal_engine.h"
 #include "bal_decoder.h"
+#include "bal_guest_state.h"
+#include "bal_ir.h"
 #include "bal_logging.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
-#define MAX_INSTRUCTIONS 65536
-
 // Not sure what exact value to put here.
 //
 #define MAX_GUEST_REGISTERS 128
 
+/// The register field value that names `SP` or `XZR` depending on the
+/// instruction.
+#define REGISTER_SP_OR_ZR 31U
+
 /// Helper macro to align `x` UP to the nearest memory alignment.
 #define BAL_ALIGN_UP(x, memory_alignment) \
     (((x) + ((memory_alignment) - 1)) & ~((memory_alignment) - 1))
@@ -18,12 +22,22 @@
 typedef struct
 {
     bal_instruction_t      *ir_instruction_cursor;
+    uint64_t               *source_extensions;
     bal_bit_width_t        *bit_width_cursor;
     bal_source_variable_t  *source_variables;
     bal_constant_t         *constants;
     size_t                  constants_size;
     bal_constant_count_t    constant_count;
     bal_instruction_count_t instruction_count;
+    bool                    cannot_restart;
+
+    /// What a conditional exit tests: `OPCODE_BRANCH_ZERO` or
+    /// `OPCODE_BRANCH_NOT_ZERO` of the SSA value `branch_condition`, or of
+    /// whether the raw condition code `branch_condition` holds for the flags
+    /// if `branch_on_flags` is set.
+    bal_opcode_t            branch_opcode;
+    uint32_t                branch_condition;
+    bool                    branch_on_flags;
     bal_error_t             status;
     bal_logger_t           *logger;
 } bal_translation_context_t;
@@ -34,32 +48,102 @@ static inline void translate_const(bal_translation_context_t *,
                                    const bal_decoder_instruction_metadata_t *,
                                    uint32_t *,
                                    const bal_decoder_operand_t *);
+static bool        translate_data_processing(bal_translation_context_t *, uint32_t);
+static bool        decode_bit_mask(uint32_t, uint32_t, uint32_t, bool, uint64_t *);
+static bool        translate_memory_access(bal_translation_context_t *,
+                                           uint32_t,
+                                           bal_guest_address_t);
+static uint32_t    access_base(bal_translation_context_t *, uint32_t, int64_t *, uint32_t);
+static void        emit_load(bal_translation_context_t *,
+                             uint32_t,
+                             uint32_t,
+                             int64_t,
+                             uint32_t,
+                             bal_ir_extend_t,
+                             bool);
+static void        emit_store(bal_translation_context_t *, uint32_t, uint32_t, int64_t, uint32_t);
+static void        emit_base_writeback(bal_translation_context_t *, uint32_t, uint32_t, int64_t);
+static bool        translate_vector(bal_translation_context_t *, uint32_t);
+static bool        translate_atomic(bal_translation_context_t *, uint32_t);
+static void        emit_data_processing(bal_translation_context_t *,
+                                        bal_opcode_t,
+                                        bal_flags_operation_t,
+                                        uint32_t,
+                                        uint32_t,
+                                        uint32_t,
+                                        uint32_t,
+                                        bool);
+static void        emit_register_writebacks(bal_translation_context_t *,
+                                            const bal_instruction_t *,
+                                            const bal_instruction_t *);
+static bool        classify_branch(const bal_decoder_instruction_metadata_t *,
+                                   bal_unit_exit_kind_t *);
+static uint32_t    translate_branch(bal_translation_context_t *,
+                                    bal_unit_exit_t *,
+                                    const uint32_t *,
+                                    bal_guest_address_t);
+static bool        translate_conditional_branch(bal_translation_context_t *,
+                                                bal_unit_exit_t *,
+                                                uint32_t,
+                                                bal_guest_address_t);
+static uint32_t    emit_ir(bal_translation_context_t *,
+                           bal_opcode_t,
+                           uint32_t,
+                           uint32_t,
+                           uint32_t,
+                           bal_bit_width_t);
+static void        emit_terminator(bal_translation_context_t *,
+                                   const bal_unit_exit_t *,
+                                   uint32_t,
+                                   const bal_instruction_t *);
 BAL_COLD bal_error_t
 bal_engine_init(bal_allocator_t *allocator, bal_engine_t *engine, bal_logger_t logger)
 {
-    if (NULL == allocator || NULL == engine)
+    return bal_engine_init_with_capacity(allocator, engine, logger, BAL_ENGINE_DEFAULT_CAPACITY);
+}
+
+BAL_COLD bal_error_t
+bal_engine_init_with_capacity(bal_allocator_t *allocator,
+                              bal_engine_t    *engine,
+                              bal_logger_t     logger,
+                              size_t           capacity)
+{
+    if (NULL == allocator || NULL == engine || capacity < BAL_ENGINE_DEFAULT_CAPACITY
+        || capacity > BAL_SOURCE_INDEX_MASK)
     {
         return BAL_ERROR_INVALID_ARGUMENT;
     }
 
-    size_t source_variables_size = MAX_GUEST_REGISTERS * sizeof(bal_source_variable_t);
-    size_t ssa_bit_widths_size   = MAX_INSTRUCTIONS * sizeof(bal_bit_width_t);
-    size_t instructions_size     = MAX_INSTRUCTIONS * sizeof(bal_instruction_t);
-    size_t constants_size        = MAX_INSTRUCTIONS * sizeof(bal_instruction_t);
+    // Only an engine that can hold more than the narrow form addresses needs
+    // the high source index bits.
+    //
+    size_t extensions_count = (capacity > BAL_ENGINE_DEFAULT_CAPACITY) ? capacity : 0;
+
+    size_t source_variables_size  = MAX_GUEST_REGISTERS * sizeof(bal_source_variable_t);
+    size_t ssa_bit_widths_size    = capacity * sizeof(bal_bit_width_t);
+    size_t instructions_size      = capacity * sizeof(bal_instruction_t);
+    size_t source_extensions_size = extensions_count * sizeof(uint64_t);
+    size_t constants_size         = capacity * sizeof(bal_constant_t);
+    size_t scratch_size           = capacity * BAL_SCRATCH_BYTES_PER_INSTRUCTION;
 
     // Calculate amount of memory needed for all arrays in engine.
     //
     size_t memory_alignment    = 64U;
     size_t offset_instructions = BAL_ALIGN_UP(source_variables_size, memory_alignment);
 
-    size_t offset_ssa_bit_widths
+    size_t offset_source_extensions
         = BAL_ALIGN_UP((offset_instructions + instructions_size), memory_alignment);
 
+    size_t offset_ssa_bit_widths
+        = BAL_ALIGN_UP((offset_source_extensions + source_extensions_size), memory_alignment);
+
     size_t offset_constants
         = BAL_ALIGN_UP((offset_ssa_bit_widths + ssa_bit_widths_size), memory_alignment);
 
+    size_t offset_scratch = BAL_ALIGN_UP((offset_constants + constants_size), memory_alignment);
+
     size_t total_size_with_padding
-        = BAL_ALIGN_UP((offset_constants + constants_size), memory_alignment);
+        = BAL_ALIGN_UP((offset_scratch + scratch_size), memory_alignment);
 
     uint8_t *data = (uint8_t *)allocator->allocate(
         allocator->handle, memory_alignment, total_size_with_padding);
@@ -71,12 +155,18 @@ bal_engine_init(bal_allocator_t *allocator, bal_engine_t *engine, bal_logger_t l
                   "  [0x%08zx] instructions     (%zu bytes)",
                   offset_instructions,
                   instructions_size);
+    BAL_LOG_DEBUG(&logger,
+                  "  [0x%08zx] source_extensions (%zu bytes)",
+                  offset_source_extensions,
+                  source_extensions_size);
     BAL_LOG_DEBUG(&logger,
                   "  [0x%08zx] ssa_bit_widths   (%zu bytes)",
                   offset_ssa_bit_widths,
                   ssa_bit_widths_size);
     BAL_LOG_DEBUG(
         &logger, "  [0x%08zx] constants        (%zu bytes)", offset_constants, constants_size);
+    BAL_LOG_DEBUG(
+        &logger, "  [0x%08zx] scratch          (%zu bytes)", offset_scratch, scratch_size);
 
     if (NULL == data)
     {
@@ -87,13 +177,19 @@ bal_engine_init(bal_allocator_t *allocator, bal_engine_t *engine, bal_logger_t l
 
     engine->source_variables      = (bal_source_variable_t *)data;
     engine->instructions          = (bal_instruction_t *)(data + offset_instructions);
+    engine->source_extensions
+        = (extensions_count > 0) ? (uint64_t *)(void *)(data + offset_source_extensions) : NULL;
     engine->ssa_bit_widths        = (bal_bit_width_t *)(data + offset_ssa_bit_widths);
     engine->constants             = (bal_constant_t *)(data + offset_constants);
+    engine->scratch               = (void *)(data + offset_scratch);
     engine->source_variables_size = source_variables_size / sizeof(bal_source_variable_t);
     engine->instructions_size     = instructions_size / sizeof(bal_instruction_t);
     engine->constants_size        = constants_size / sizeof(bal_constant_t);
+    engine->scratch_size          = scratch_size;
     engine->constant_count        = 0;
     engine->instruction_count     = 0;
+    engine->guest_address         = 0;
+    engine->is_wide               = false;
     engine->status                = BAL_SUCCESS;
     engine->arena_base            = (void *)data;
     engine->arena_size            = total_size_with_padding;
@@ -106,6 +202,13 @@ bal_engine_init(bal_allocator_t *allocator, bal_engine_t *engine, bal_logger_t l
 
     (void)memset(engine->source_variables, POISON_UNINITIALIZED_MEMORY, source_variables_size);
     (void)memset(engine->instructions, POISON_UNINITIALIZED_MEMORY, instructions_size);
+
+    if (engine->source_extensions != NULL)
+    {
+        (void)memset(
+            engine->source_extensions, POISON_UNINITIALIZED_MEMORY, source_extensions_size);
+    }
+
     (void)memset(engine->ssa_bit_widths, POISON_UNINITIALIZED_MEMORY, ssa_bit_widths_size);
     (void)memset(engine->constants, POISON_UNINITIALIZED_MEMORY, constants_size);
 
@@ -120,7 +223,8 @@ bal_engine_translate(bal_engine_t *BAL_RESTRICT           engine,
 {
     (void)interface;
 
-    if (BAL_UNLIKELY(NULL == engine || NULL == arm_instruction_cursor))
+    if (BAL_UNLIKELY(NULL == engine || NULL == arm_instruction_cursor
+                     || (engine->is_wide && NULL == engine->source_extensions)))
     {
         return BAL_ERROR_ENGINE_STATE_INVALID;
     }
@@ -132,12 +236,17 @@ bal_engine_translate(bal_engine_t *BAL_RESTRICT           engine,
 
     bal_translation_context_t context
         = { .ir_instruction_cursor = engine->instructions + engine->instruction_count,
+            .source_extensions     = engine->is_wide ? engine->source_extensions : NULL,
             .bit_width_cursor      = engine->ssa_bit_widths + engine->instruction_count,
             .source_variables      = engine->source_variables,
             .constants             = engine->constants,
             .constants_size        = engine->constants_size,
             .constant_count        = engine->constant_count,
             .instruction_count     = engine->instruction_count,
+            .cannot_restart        = false,
+            .branch_opcode         = OPCODE_BRANCH_NOT_ZERO,
+            .branch_condition      = BAL_SOURCE_NONE,
+            .branch_on_flags       = false,
             .status                = engine->status,
             .logger                = &engine->logger };
 
@@ -146,30 +255,95 @@ bal_engine_translate(bal_engine_t *BAL_RESTRICT           engine,
     const uint32_t *arm_start = arm_instruction_cursor;
     const uint32_t *arm_end   = arm_instruction_cursor + (arm_size_bytes / sizeof(uint32_t));
     uint32_t        arm_registers[BAL_OPERANDS_SIZE] = { 0 };
+    bal_unit_exit_t unit_exit   = { .kind = BAL_UNIT_EXIT_FALLTHROUGH };
+    uint32_t        exit_target = BAL_SOURCE_NONE;
+    const size_t    unit_limit  = engine->is_wide
+                                      ? engine->instructions_size - BAL_UNIT_INSTRUCTION_MARGIN
+                                      : BAL_UNIT_INSTRUCTION_LIMIT;
 
     while ((context.ir_instruction_cursor < ir_instruction_end)
            && (arm_instruction_cursor < arm_end))
     {
-        if (BAL_UNLIKELY(context.instruction_count >= (MAX_INSTRUCTIONS - 128)))
+        size_t relative_offset = (size_t)((uintptr_t)arm_instruction_cursor - (uintptr_t)arm_start);
+
+        // Rule 4.3: end the unit here and let the runtime translate the rest
+        // as the next one, which the fallthrough exit links to.
+        //
+        if (BAL_UNLIKELY(context.instruction_count >= unit_limit
+                         || context.constant_count >= unit_limit))
         {
             BAL_LOG_WARN(context.logger,
-                         "Critical buffer pressure. Inst:  %u/%d",
+                         "IR limit reached. Ending unit early at +0x%zx. Inst: %u, Const: %u",
+                         relative_offset,
                          context.instruction_count,
-                         MAX_INSTRUCTIONS);
+                         context.constant_count);
+            break;
+        }
+
+        // Vector operations write the guest vector registers as they go,
+        // and atomic writes can not be undone, while a faulting access
+        // restarts the unit from its first instruction. End the unit before
+        // the first load or store that follows one so it is never replayed.
+        //
+        if (context.cannot_restart && (*arm_instruction_cursor & 0x0A000000U) == 0x08000000U)
+        {
+            break;
+        }
+
+        // The decoder does not know the exclusives.
+        //
+        if (translate_atomic(&context, *arm_instruction_cursor))
+        {
+            if (BAL_UNLIKELY(context.status != BAL_SUCCESS))
+            {
+                BAL_LOG_ERROR(context.logger, "  Status failure: %d", context.status);
+                break;
+            }
+
+            context.ir_instruction_cursor = engine->instructions + context.instruction_count;
+            context.bit_width_cursor      = engine->ssa_bit_widths + context.instruction_count;
+            ++arm_instruction_cursor;
+            continue;
+        }
+
+        // The decoder does not tell conditional branches apart, and does not
+        // decode their operands.
+        //
+        if (translate_conditional_branch(&context,
+                                         &unit_exit,
+                                         *arm_instruction_cursor,
+                                         engine->guest_address + relative_offset))
+        {
+            exit_target = intern_constant(&context, unit_exit.target);
+            ++arm_instruction_cursor;
+            break;
+        }
+
+        // `NOP` and the other hints have no effect here.
+        //
+        if ((*arm_instruction_cursor & 0xFFFFF01FU) == 0xD503201FU)
+        {
+            ++arm_instruction_cursor;
+            continue;
         }
 
         const bal_decoder_instruction_metadata_t *metadata
             = bal_decode_arm64(*arm_instruction_cursor);
-
-        size_t relative_offset = (size_t)((uintptr_t)arm_instruction_cursor - (uintptr_t)arm_start);
         if (BAL_UNLIKELY(NULL == metadata))
         {
-
             BAL_LOG_ERROR(context.logger,
                           "Decode failed for opcode 0x%08x at offset +0x%zx",
-                          arm_instruction_cursor,
+                          *arm_instruction_cursor,
                           relative_offset);
-            context.status = BAL_ERROR_UNKNOWN_INSTRUCTION;
+
+            // The unit falls through to it, so only the unit that starts
+            // with it fails.
+            //
+            if (arm_instruction_cursor == arm_start)
+            {
+                context.status = BAL_ERROR_UNKNOWN_INSTRUCTION;
+            }
+
             break;
         }
 
@@ -190,29 +364,102 @@ bal_engine_translate(bal_engine_t *BAL_RESTRICT           engine,
 
         operands_cursor = metadata->operands;
 
+        bool translated = true;
+
+        if (classify_branch(metadata, &unit_exit.kind))
+        {
+            bal_guest_address_t address = engine->guest_address + relative_offset;
+            exit_target = translate_branch(&context, &unit_exit, arm_registers, address);
+            ++arm_instruction_cursor;
+            break;
+        }
+
         switch (metadata->ir_opcode)
         {
             case OPCODE_CONST:
                 translate_const(&context, metadata, arm_registers, operands_cursor);
                 break;
+
+            // Integer data processing, memory accesses and vector operations
+            // share their mnemonics, and `BIC`, `ORN`, `EON`, `BICS`, `LDUR`,
+            // `STUR` and most vector operations decode as traps, so the
+            // encoding decides.
+            //
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_AND:
+            case OPCODE_XOR:
+            case OPCODE_MOV:
+            case OPCODE_LOAD:
+            case OPCODE_STORE:
+            case OPCODE_TRAP:
+                if (false == translate_data_processing(&context, *arm_instruction_cursor)
+                    && false
+                           == translate_memory_access(&context,
+                                                      *arm_instruction_cursor,
+                                                      engine->guest_address + relative_offset)
+                    && false == translate_vector(&context, *arm_instruction_cursor))
+                {
+                    translated = false;
+                }
+                break;
             default:
-                BAL_LOG_DEBUG(context.logger,
-                              "  SKIPPED: Opcode %s not implemented in IR layer.",
-                              metadata->name);
+                translated = false;
                 break;
         }
 
+        // Skipping the instruction would run the rest of the unit without
+        // it. The unit falls through to it instead, so only the unit that
+        // starts with it fails.
+        //
+        if (false == translated)
+        {
+            BAL_LOG_WARN(context.logger,
+                         "Opcode %s at +0x%zx has no translation. Ending unit.",
+                         metadata->name,
+                         relative_offset);
+
+            if (arm_instruction_cursor == arm_start)
+            {
+                context.status = BAL_ERROR_UNKNOWN_INSTRUCTION;
+            }
+
+            break;
+        }
+
         if (BAL_UNLIKELY(context.status != BAL_SUCCESS))
         {
             BAL_LOG_ERROR(context.logger, "  Status failure: %d", context.status);
             break;
         }
 
-        ++context.ir_instruction_cursor;
-        ++context.bit_width_cursor;
+        // Translators emit a variable number of instructions, so resync the
+        // cursors with the instruction count instead of advancing them.
+        //
+        context.ir_instruction_cursor = engine->instructions + context.instruction_count;
+        context.bit_width_cursor      = engine->ssa_bit_widths + context.instruction_count;
         ++arm_instruction_cursor;
     }
 
+    if (BAL_SUCCESS == context.status)
+    {
+        unit_exit.guest_size
+            = (size_t)((uintptr_t)arm_instruction_cursor - (uintptr_t)arm_start);
+
+        if (BAL_UNIT_EXIT_FALLTHROUGH == unit_exit.kind)
+        {
+            unit_exit.target         = engine->guest_address + unit_exit.guest_size;
+            unit_exit.return_address = unit_exit.target;
+            exit_target              = intern_constant(&context, unit_exit.target);
+        }
+
+        emit_register_writebacks(&context, engine->instructions, ir_instruction_end);
+        emit_terminator(&context, &unit_exit, exit_target, ir_instruction_end);
+    }
+
+    engine->unit_exit = unit_exit;
+
     engine->instruction_count = context.instruction_count;
     engine->constant_count    = context.constant_count;
     engine->status            = context.status;
@@ -234,12 +481,18 @@ bal_engine_reset(bal_engine_t *engine)
     }
 
     engine->instruction_count = 0;
+    engine->constant_count    = 0;
+    engine->guest_address     = 0;
+    engine->is_wide           = false;
     engine->status            = BAL_SUCCESS;
 
-    (void)memset(
-        engine->source_variables, POISON_UNINITIALIZED_MEMORY, engine->source_variables_size);
+    (void)memset(engine->source_variables,
+                 POISON_UNINITIALIZED_MEMORY,
+                 engine->source_variables_size * sizeof(bal_source_variable_t));
 
-    (void)memset(engine->constants, POISON_UNINITIALIZED_MEMORY, engine->constants_size);
+    (void)memset(engine->constants,
+                 POISON_UNINITIALIZED_MEMORY,
+                 engine->constants_size * sizeof(bal_constant_t));
 
     return engine->status;
 }
@@ -250,10 +503,12 @@ bal_engine_destroy(bal_allocator_t *allocator, bal_engine_t *engine)
     // No argument error handling. Segfault if user passes NULL.
 
     allocator->free(allocator->handle, engine->arena_base, engine->arena_size);
-    engine->arena_base       = NULL;
-    engine->source_variables = NULL;
-    engine->instructions     = NULL;
-    engine->ssa_bit_widths   = NULL;
+    engine->arena_base        = NULL;
+    engine->source_variables  = NULL;
+    engine->instructions      = NULL;
+    engine->source_extensions = NULL;
+    engine->ssa_bit_widths    = NULL;
+    engine->scratch           = NULL;
 }
 
 BAL_HOT static uint32_t
@@ -279,7 +534,18 @@ intern_constant(bal_translation_context_t *BAL_RESTRICT context, bal_constant_t
 
     uint32_t index = context->constant_count;
 
-    if (BAL_UNLIKELY(index >= context->constants_size))
+    // Pool index 0xFFFF is reserved for BAL_SOURCE_NONE. A wide unit skips
+    // it, a narrow one ends there.
+    //
+    if (BAL_UNLIKELY(BAL_SOURCE_MASK == index && context->source_extensions != NULL
+                     && index < context->constants_size))
+    {
+        context->constants[index] = 0;
+        index                     = ++context->constant_count;
+    }
+
+    if (BAL_UNLIKELY(index >= context->constants_size
+                     || (index >= BAL_SOURCE_MASK && NULL == context->source_extensions)))
     {
         BAL_LOG_ERROR(context->logger, "Constant pool overflow.");
         context->status = BAL_ERROR_INSTRUCTION_OVERFLOW;
@@ -289,7 +555,20 @@ intern_constant(bal_translation_context_t *BAL_RESTRICT context, bal_constant_t
     context->constants[index] = constant;
     context->constant_count++;
     BAL_LOG_TRACE(context->logger, "  0X%08X -> Pool Index %u", constant, index);
-    return index | BAL_IS_CONSTANT_BIT_POSITION;
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+/// Writes `instruction` at the IR cursor, along with its high source index
+/// bits in a wide unit.
+BAL_HOT static inline void
+write_ir(bal_translation_context_t *BAL_RESTRICT context, bal_ir_instruction_t instruction)
+{
+    *context->ir_instruction_cursor = instruction.word;
+
+    if (context->source_extensions != NULL)
+    {
+        context->source_extensions[context->instruction_count] = instruction.extension;
+    }
 }
 
 BAL_HOT static inline uint32_t
@@ -304,11 +583,7 @@ get_or_create_ssa_index(bal_translation_context_t *context, uint64_t register_in
         return ssa_index;
     }
 
-    bal_instruction_t instruction
-        = ((bal_instruction_t)OPCODE_GET_REGISTER << BAL_OPCODE_SHIFT_POSITION)
-          | ((bal_instruction_t)register_index << BAL_SOURCE1_SHIFT_POSITION);
-
-    *context->ir_instruction_cursor                             = instruction;
+    write_ir(context, bal_ir_encode(OPCODE_GET_REGISTER, (uint32_t)register_index, 0, 0));
     ssa_index                                                   = context->instruction_count;
     context->source_variables[register_index].current_ssa_index = ssa_index;
 
@@ -372,12 +647,12 @@ translate_const(bal_translation_context_t *BAL_RESTRICT                context,
         {
             BAL_LOG_TRACE(context->logger, "  MOVK Source is ZR. Interning 0.");
             old_ssa_with_flag = intern_constant(context, 0);
-            old_ssa           = old_ssa_with_flag & ~BAL_IS_CONSTANT_BIT_POSITION;
+            old_ssa           = old_ssa_with_flag & ~BAL_DECODED_CONSTANT_BIT;
         }
         else
         {
             old_ssa_with_flag = get_or_create_ssa_index(context, rd);
-            old_ssa           = old_ssa_with_flag & ~BAL_IS_CONSTANT_BIT_POSITION;
+            old_ssa           = old_ssa_with_flag & ~BAL_DECODED_CONSTANT_BIT;
             BAL_LOG_TRACE(context->logger, "  MOVK Source: Reg X%lu -> SSA v%lu", rd, old_ssa);
         }
 
@@ -389,16 +664,14 @@ translate_const(bal_translation_context_t *BAL_RESTRICT                context,
             return;
         }
 
-        *context->ir_instruction_cursor
-            = ((bal_instruction_t)OPCODE_AND << BAL_OPCODE_SHIFT_POSITION)
-              | ((bal_instruction_t)old_ssa_with_flag << BAL_SOURCE1_SHIFT_POSITION)
-              | ((bal_instruction_t)mask_index << BAL_SOURCE2_SHIFT_POSITION);
+        write_ir(context,
+                 bal_ir_encode(OPCODE_AND, (uint32_t)old_ssa_with_flag, (uint32_t)mask_index, 0));
 
         BAL_LOG_DEBUG(context->logger,
                       "  EMIT: v%lu = AND v%lu, c%lu (Mask: 0x%llX)",
                       context->instruction_count,
                       old_ssa,
-                      mask_index & ~BAL_IS_CONSTANT_BIT_POSITION,
+                      mask_index & ~BAL_DECODED_CONSTANT_BIT,
                       clear_mask);
 
         uint64_t cleared_ssa = context->instruction_count;
@@ -419,16 +692,14 @@ translate_const(bal_translation_context_t *BAL_RESTRICT                context,
         // Source 1 is the result of the AND instruction.
         //
         uint64_t masked_ssa = context->instruction_count - 1;
-        *context->ir_instruction_cursor
-            = ((bal_instruction_t)OPCODE_ADD << BAL_OPCODE_SHIFT_POSITION)
-              | ((bal_instruction_t)masked_ssa << BAL_SOURCE1_SHIFT_POSITION)
-              | ((bal_instruction_t)value_index << BAL_SOURCE2_SHIFT_POSITION);
+        write_ir(context,
+                 bal_ir_encode(OPCODE_ADD, (uint32_t)masked_ssa, (uint32_t)value_index, 0));
 
         BAL_LOG_DEBUG(context->logger,
                       "  EMIT: v%lu = ADD v%lu, c%lu (Val: 0x%llX)",
                       context->instruction_count,
                       cleared_ssa,
-                      value_index & ~BAL_IS_CONSTANT_BIT_POSITION,
+                      value_index & ~BAL_DECODED_CONSTANT_BIT,
                       value);
     }
     else
@@ -440,14 +711,12 @@ translate_const(bal_translation_context_t *BAL_RESTRICT                context,
             return;
         }
 
-        *context->ir_instruction_cursor
-            = ((bal_instruction_t)OPCODE_CONST << BAL_OPCODE_SHIFT_POSITION)
-              | ((bal_instruction_t)constant_index << BAL_SOURCE1_SHIFT_POSITION);
+        write_ir(context, bal_ir_encode(OPCODE_CONST, (uint32_t)constant_index, 0, 0));
 
         BAL_LOG_DEBUG(context->logger,
                       "  EMIT: v%lu = CONST %lu (0x%llX)",
                       context->instruction_count,
-                      constant_index & ~BAL_IS_CONSTANT_BIT_POSITION,
+                      constant_index & ~BAL_DECODED_CONSTANT_BIT,
                       value);
     }
 
@@ -466,3 +735,1102 @@ translate_const(bal_translation_context_t *BAL_RESTRICT                context,
 
     context->instruction_count++;
 }
+
+/// Reads the register field `index` of an operand that names `SP` for 31 if
+/// `is_sp` is set, and `XZR` otherwise.
+static uint32_t
+read_register(bal_translation_context_t *BAL_RESTRICT context, uint32_t index, bool is_sp)
+{
+    if (REGISTER_SP_OR_ZR == index && false == is_sp)
+    {
+        return intern_constant(context, 0);
+    }
+
+    return get_or_create_ssa_index(context, index);
+}
+
+/// Appends an instruction defining a `bit_width` value and returns its SSA
+/// index.
+static uint32_t
+emit_ir(bal_translation_context_t *BAL_RESTRICT context,
+        bal_opcode_t                            opcode,
+        uint32_t                                source1,
+        uint32_t                                source2,
+        uint32_t                                source3,
+        bal_bit_width_t                         bit_width)
+{
+    uint32_t ssa_index = context->instruction_count;
+
+    write_ir(context, bal_ir_encode(opcode, source1, source2, source3));
+    *context->bit_width_cursor = bit_width;
+
+    BAL_LOG_DEBUG(context->logger,
+                  "  EMIT: v%u = opcode %u 0x%x, 0x%x, 0x%x",
+                  ssa_index,
+                  opcode,
+                  source1,
+                  source2,
+                  source3);
+
+    context->instruction_count++;
+    context->ir_instruction_cursor++;
+    context->bit_width_cursor++;
+    return ssa_index;
+}
+
+/// Translates the ADD, SUB, AND, ORR, EOR and BIC families, with their flag
+/// setting and inverted forms, in their immediate, shifted register and
+/// extended register encodings. Returns `false` if `instruction` is none of
+/// them or is unallocated.
+static bool
+translate_data_processing(bal_translation_context_t *BAL_RESTRICT context, uint32_t instruction)
+{
+    const bool     is_64 = (instruction >> 31) != 0;
+    const uint32_t rd    = instruction & 0x1FU;
+    const uint32_t rn    = (instruction >> 5) & 0x1FU;
+    const uint32_t rm    = (instruction >> 16) & 0x1FU;
+    const uint32_t width = is_64 ? 0 : BAL_IR_MODIFIER_32;
+
+    // ADD, ADDS, SUB and SUBS are selected by bits 30 and 29 in every
+    // encoding, and so are AND, ORR, EOR and ANDS.
+    //
+    const bool            is_sub     = ((instruction >> 30) & 1U) != 0;
+    const bool            sets_flags = ((instruction >> 29) & 1U) != 0;
+    const bal_opcode_t    arithmetic = is_sub ? OPCODE_SUB : OPCODE_ADD;
+    const bal_opcode_t    logical[4] = { OPCODE_AND, OPCODE_OR, OPCODE_XOR, OPCODE_AND };
+    const uint32_t        opc        = (instruction >> 29) & 3U;
+    bal_flags_operation_t flags      = BAL_FLAGS_NONE;
+
+    if (sets_flags)
+    {
+        flags = is_sub ? (is_64 ? BAL_FLAGS_SUB_64 : BAL_FLAGS_SUB_32)
+                       : (is_64 ? BAL_FLAGS_ADD_64 : BAL_FLAGS_ADD_32);
+    }
+
+    const bal_flags_operation_t logical_flags
+        = (3U == opc) ? (is_64 ? BAL_FLAGS_LOGICAL_64 : BAL_FLAGS_LOGICAL_32) : BAL_FLAGS_NONE;
+
+    // Add/subtract (immediate): imm12, optionally shifted left by 12.
+    //
+    if ((instruction & 0x1F800000U) == 0x11000000U)
+    {
+        uint64_t immediate = (instruction >> 10) & 0xFFFU;
+        immediate <<= ((instruction >> 22) & 1U) != 0 ? 12U : 0U;
+
+        uint32_t left  = read_register(context, rn, true);
+        uint32_t right = intern_constant(context, immediate);
+        emit_data_processing(context, arithmetic, flags, rd, left, right, width, !sets_flags);
+        return true;
+    }
+
+    // Add/subtract (shifted register). ROR is unallocated.
+    //
+    if ((instruction & 0x1F200000U) == 0x0B000000U)
+    {
+        uint32_t shift  = (instruction >> 22) & 3U;
+        uint32_t amount = (instruction >> 10) & 0x3FU;
+
+        if (BAL_IR_SHIFT_ROR == shift || (false == is_64 && amount >= 32))
+        {
+            return false;
+        }
+
+        uint32_t left     = read_register(context, rn, false);
+        uint32_t right    = read_register(context, rm, false);
+        uint32_t modifier = bal_ir_modifier(
+            (bal_ir_shift_t)shift, amount, BAL_IR_EXTEND_NONE, false, false == is_64);
+        emit_data_processing(context, arithmetic, flags, rd, left, right, modifier, false);
+        return true;
+    }
+
+    // Add/subtract (extended register). UXTX and SXTX leave the operand
+    // as is.
+    //
+    if ((instruction & 0x1FE00000U) == 0x0B200000U)
+    {
+        static const bal_ir_extend_t extends[8] = {
+            BAL_IR_EXTEND_UXTB, BAL_IR_EXTEND_UXTH, BAL_IR_EXTEND_UXTW, BAL_IR_EXTEND_NONE,
+            BAL_IR_EXTEND_SXTB, BAL_IR_EXTEND_SXTH, BAL_IR_EXTEND_SXTW, BAL_IR_EXTEND_NONE,
+        };
+
+        uint32_t option = (instruction >> 13) & 7U;
+        uint32_t amount = (instruction >> 10) & 7U;
+
+        if (amount > 4)
+        {
+            return false;
+        }
+
+        uint32_t left     = read_register(context, rn, true);
+        uint32_t right    = read_register(context, rm, false);
+        uint32_t modifier = bal_ir_modifier(
+            BAL_IR_SHIFT_LSL, amount, extends[option], false, false == is_64);
+        emit_data_processing(context, arithmetic, flags, rd, left, right, modifier, !sets_flags);
+        return true;
+    }
+
+    // Logical (immediate). Only ANDS writes XZR instead of SP.
+    //
+    if ((instruction & 0x1F800000U) == 0x12000000U)
+    {
+        uint64_t mask = 0;
+
+        if (false
+            == decode_bit_mask((instruction >> 22) & 1U,
+                               (instruction >> 10) & 0x3FU,
+                               (instruction >> 16) & 0x3FU,
+                               is_64,
+                               &mask))
+        {
+            return false;
+        }
+
+        uint32_t left  = read_register(context, rn, false);
+        uint32_t right = intern_constant(context, mask);
+        emit_data_processing(
+            context, logical[opc], logical_flags, rd, left, right, width, 3U != opc);
+        return true;
+    }
+
+    // Logical (shifted register). N inverts the operand for BIC, ORN, EON
+    // and BICS.
+    //
+    if ((instruction & 0x1F000000U) == 0x0A000000U)
+    {
+        uint32_t shift  = (instruction >> 22) & 3U;
+        uint32_t amount = (instruction >> 10) & 0x3FU;
+        bool     invert = ((instruction >> 21) & 1U) != 0;
+
+        if (false == is_64 && amount >= 32)
+        {
+            return false;
+        }
+
+        uint32_t left     = read_register(context, rn, false);
+        uint32_t right    = read_register(context, rm, false);
+        uint32_t modifier = bal_ir_modifier(
+            (bal_ir_shift_t)shift, amount, BAL_IR_EXTEND_NONE, invert, false == is_64);
+        emit_data_processing(
+            context, logical[opc], logical_flags, rd, left, right, modifier, false);
+        return true;
+    }
+
+    return false;
+}
+
+/// Decodes the N, imms and immr fields of a logical immediate into `mask`.
+/// Returns `false` for the reserved encodings.
+static bool
+decode_bit_mask(uint32_t n, uint32_t imms, uint32_t immr, bool is_64, uint64_t *mask)
+{
+    // The element size is the highest set bit of N:NOT(imms).
+    //
+    uint32_t combined = (n << 6) | (~imms & 0x3FU);
+    uint32_t length   = 0;
+
+    if ((false == is_64 && n != 0) || 0 == combined)
+    {
+        return false;
+    }
+
+    while ((combined >> (length + 1U)) != 0)
+    {
+        ++length;
+    }
+
+    uint32_t size   = 1U << length;
+    uint32_t levels = size - 1U;
+    uint32_t ones   = (imms & levels) + 1U;
+    uint32_t rotate = immr & levels;
+
+    if (length < 1 || ones == size)
+    {
+        return false;
+    }
+
+    uint64_t size_mask = (64U == size) ? ~0ULL : ((1ULL << size) - 1U);
+    uint64_t element   = (1ULL << ones) - 1U;
+
+    if (rotate != 0)
+    {
+        element = ((element >> rotate) | (element << (size - rotate))) & size_mask;
+    }
+
+    for (uint32_t i = size; i < 64U; i *= 2U)
+    {
+        element |= element << i;
+    }
+
+    *mask = is_64 ? element : (element & 0xFFFFFFFFULL);
+    return true;
+}
+
+/// Emits `rd = left opcode modifier(right)` and records the flags of
+/// `flags` unless it is `BAL_FLAGS_NONE`. `rd` names `SP` for 31 if
+/// `rd_is_sp` is set.
+static void
+emit_data_processing(bal_translation_context_t *BAL_RESTRICT context,
+                     bal_opcode_t                            opcode,
+                     bal_flags_operation_t                   flags,
+                     uint32_t                                rd,
+                     uint32_t                                left,
+                     uint32_t                                right,
+                     uint32_t                                modifier,
+                     bool                                    rd_is_sp)
+{
+    if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+    {
+        return;
+    }
+
+    const bool            is_arithmetic = (OPCODE_ADD == opcode || OPCODE_SUB == opcode);
+    const bal_bit_width_t bit_width     = (modifier & BAL_IR_MODIFIER_32) != 0 ? 32U : 64U;
+
+    // The lazy flags of ADDS and SUBS keep the operand as it was added, so
+    // a shifted or extended one is computed on its own, as `ORR` from `XZR`.
+    //
+    if (flags != BAL_FLAGS_NONE && is_arithmetic && (modifier & ~BAL_IR_MODIFIER_32) != 0)
+    {
+        uint32_t zero = intern_constant(context, 0);
+        right         = emit_ir(context, OPCODE_OR, zero, right, modifier, bit_width);
+        modifier &= BAL_IR_MODIFIER_32;
+    }
+
+    uint32_t result = emit_ir(context, opcode, left, right, modifier, bit_width);
+
+    if (flags != BAL_FLAGS_NONE)
+    {
+        uint32_t operation = intern_constant(context, (bal_constant_t)flags);
+        (void)emit_ir(context,
+                      OPCODE_SET_REGISTER,
+                      BAL_GUEST_REGISTER_FLAGS_OPERATION,
+                      operation,
+                      BAL_SOURCE_NONE,
+                      0);
+
+        if (is_arithmetic)
+        {
+            (void)emit_ir(context,
+                          OPCODE_SET_REGISTER,
+                          BAL_GUEST_REGISTER_FLAGS_LEFT,
+                          left,
+                          BAL_SOURCE_NONE,
+                          0);
+            (void)emit_ir(context,
+                          OPCODE_SET_REGISTER,
+                          BAL_GUEST_REGISTER_FLAGS_RIGHT,
+                          right,
+                          BAL_SOURCE_NONE,
+                          0);
+        }
+        else
+        {
+            (void)emit_ir(context,
+                          OPCODE_SET_REGISTER,
+                          BAL_GUEST_REGISTER_FLAGS_LEFT,
+                          result,
+                          BAL_SOURCE_NONE,
+                          0);
+        }
+    }
+
+    if (rd != REGISTER_SP_OR_ZR || rd_is_sp)
+    {
+        context->source_variables[rd].current_ssa_index = result;
+    }
+}
+
+/// Translates LDR, STR and their byte, halfword and sign extending forms in
+/// their unsigned offset, unscaled, pre-index, post-index, register offset
+/// and literal encodings, and LDP, STP and LDPSW. `address` is the guest
+/// address of `instruction`. Returns `false` if `instruction` is none of
+/// them, is a prefetch, or is unallocated.
+static bool
+translate_memory_access(bal_translation_context_t *BAL_RESTRICT context,
+                        uint32_t                                instruction,
+                        bal_guest_address_t                     address)
+{
+    const uint32_t rt = instruction & 0x1FU;
+    const uint32_t rn = (instruction >> 5) & 0x1FU;
+
+    // Load/store pair. Both halves address the base directly, so a pair
+    // costs two accesses and, with writeback, one ADD.
+    //
+    if ((instruction & 0x3E000000U) == 0x28000000U)
+    {
+        const uint32_t opc     = instruction >> 30;
+        const uint32_t mode    = (instruction >> 23) & 3U;
+        const bool     is_load = ((instruction >> 22) & 1U) != 0;
+        const uint32_t rt2     = (instruction >> 10) & 0x1FU;
+
+        // opc 01 is LDPSW when loading outside the non-temporal mode, and
+        // STGP, a tagging store, otherwise.
+        //
+        if (3U == opc || (1U == opc && (false == is_load || 0U == mode)))
+        {
+            return false;
+        }
+
+        const uint32_t        size   = (2U == opc) ? 8U : 4U;
+        const bal_ir_extend_t extend = (1U == opc) ? BAL_IR_EXTEND_SXTW : BAL_IR_EXTEND_NONE;
+        const int64_t         offset
+            = ((int64_t)((uint64_t)((instruction >> 15) & 0x7FU) << 57) >> 57) * (int64_t)size;
+        const int64_t access_offset = (1U == mode) ? 0 : offset;
+        const uint32_t base         = read_register(context, rn, true);
+
+        if (is_load)
+        {
+            emit_load(context, rt, base, access_offset, size, extend, false);
+            emit_load(context, rt2, base, access_offset + (int64_t)size, size, extend, false);
+        }
+        else
+        {
+            emit_store(context, read_register(context, rt, false), base, access_offset, size);
+            emit_store(context,
+                       read_register(context, rt2, false),
+                       base,
+                       access_offset + (int64_t)size,
+                       size);
+        }
+
+        if (1U == mode || 3U == mode)
+        {
+            emit_base_writeback(context, rn, base, offset);
+        }
+
+        return true;
+    }
+
+    // Load register (literal): a PC relative LDR or LDRSW.
+    //
+    if ((instruction & 0x3F000000U) == 0x18000000U)
+    {
+        const uint32_t opc = instruction >> 30;
+
+        if (3U == opc)
+        {
+            return false;
+        }
+
+        // imm19 is a signed word offset from the load.
+        //
+        const int64_t  offset  = (int64_t)((uint64_t)((instruction >> 5) & 0x7FFFFU) << 45) >> 43;
+        const uint32_t literal = intern_constant(context, address + (uint64_t)offset);
+
+        emit_load(context,
+                  rt,
+                  literal,
+                  0,
+                  (1U == opc) ? 8U : 4U,
+                  (2U == opc) ? BAL_IR_EXTEND_SXTW : BAL_IR_EXTEND_NONE,
+                  false);
+        return true;
+    }
+
+    // Every single register form below shares size, V and opc. opc 00
+    // stores, 01 loads, 10 sign extends to 64 bits and 11 to 32 bits.
+    //
+    const uint32_t size        = 1U << (instruction >> 30);
+    const uint32_t opc         = (instruction >> 22) & 3U;
+    const bool     is_unsigned = (instruction & 0x3F000000U) == 0x39000000U;
+    const bool     is_indexed  = (instruction & 0x3F200000U) == 0x38000000U;
+    const bool     is_register = (instruction & 0x3F200C00U) == 0x38200800U;
+
+    if ((false == is_unsigned && false == is_indexed && false == is_register)
+        || (8U == size && opc >= 2U) || (4U == size && 3U == opc))
+    {
+        return false;
+    }
+
+    static const bal_ir_extend_t sign_extends[] = {
+        BAL_IR_EXTEND_SXTB, BAL_IR_EXTEND_SXTH, BAL_IR_EXTEND_SXTW, BAL_IR_EXTEND_NONE
+    };
+
+    const bal_ir_extend_t extend
+        = (opc >= 2U) ? sign_extends[instruction >> 30] : BAL_IR_EXTEND_NONE;
+    const bool is_32   = (3U == opc);
+    uint32_t   base    = read_register(context, rn, true);
+    int64_t    offset  = 0;
+    int64_t    advance = 0;
+
+    if (is_unsigned)
+    {
+        offset = (int64_t)((instruction >> 10) & 0xFFFU) * (int64_t)size;
+    }
+    else if (is_indexed)
+    {
+        // Bits 11:10 select unscaled, post-index, unprivileged or pre-index.
+        // Unprivileged accesses behave like unscaled ones at EL0.
+        //
+        const uint32_t mode  = (instruction >> 10) & 3U;
+        const int64_t  imm9  = (int64_t)((uint64_t)((instruction >> 12) & 0x1FFU) << 55) >> 55;
+        offset               = (1U == mode) ? 0 : imm9;
+        advance              = (1U == mode || 3U == mode) ? imm9 : 0;
+    }
+    else
+    {
+        // The option field names the extension of Rm; S scales it by the
+        // access size.
+        //
+        static const bal_ir_extend_t index_extends[] = {
+            BAL_IR_EXTEND_NONE, BAL_IR_EXTEND_NONE, BAL_IR_EXTEND_UXTW, BAL_IR_EXTEND_NONE,
+            BAL_IR_EXTEND_NONE, BAL_IR_EXTEND_NONE, BAL_IR_EXTEND_SXTW, BAL_IR_EXTEND_NONE,
+        };
+
+        const uint32_t option = (instruction >> 13) & 7U;
+        const uint32_t amount = ((instruction >> 12) & 1U) != 0 ? (instruction >> 30) : 0U;
+
+        if (0 == (option & 2U))
+        {
+            return false;
+        }
+
+        uint32_t index    = read_register(context, (instruction >> 16) & 0x1FU, false);
+        uint32_t modifier = bal_ir_modifier(
+            BAL_IR_SHIFT_LSL, amount, index_extends[option], false, false);
+        base = emit_ir(context, OPCODE_ADD, base, index, modifier, 64);
+    }
+
+    if (0U == opc)
+    {
+        emit_store(context, read_register(context, rt, false), base, offset, size);
+    }
+    else
+    {
+        emit_load(context, rt, base, offset, size, extend, is_32);
+    }
+
+    if (advance != 0)
+    {
+        emit_base_writeback(context, rn, base, advance);
+    }
+
+    return true;
+}
+
+/// Returns the address operand of an access of `size` bytes at `base` plus
+/// `offset`. That is `base` if the access can fold `offset`, and otherwise
+/// their sum, in which case `offset` is cleared.
+static uint32_t
+access_base(bal_translation_context_t *BAL_RESTRICT context,
+            uint32_t                                base,
+            int64_t                                *offset,
+            uint32_t                                size)
+{
+    if (bal_ir_access_fits(size, *offset))
+    {
+        return base;
+    }
+
+    uint32_t displacement = intern_constant(context, (bal_constant_t)*offset);
+    *offset               = 0;
+    return emit_ir(context, OPCODE_ADD, base, displacement, BAL_SOURCE_NONE, 64);
+}
+
+/// Loads `size` bytes at `base` plus `offset` into `rt`, which names `XZR`
+/// for 31. `extend` sign extends the value to 64 bits, or to 32 bits if
+/// `is_32` is set.
+static void
+emit_load(bal_translation_context_t *BAL_RESTRICT context,
+          uint32_t                                rt,
+          uint32_t                                base,
+          int64_t                                 offset,
+          uint32_t                                size,
+          bal_ir_extend_t                         extend,
+          bool                                    is_32)
+{
+    if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+    {
+        return;
+    }
+
+    base = access_base(context, base, &offset, size);
+
+    uint32_t        access    = bal_ir_access(size, offset);
+    bal_bit_width_t bit_width = (bal_bit_width_t)(size * 8U);
+    uint32_t        value = emit_ir(context, OPCODE_LOAD, base, access, BAL_SOURCE_NONE, bit_width);
+
+    if (extend != BAL_IR_EXTEND_NONE)
+    {
+        uint32_t zero     = intern_constant(context, 0);
+        uint32_t modifier = bal_ir_modifier(BAL_IR_SHIFT_LSL, 0, extend, false, is_32);
+        value             = emit_ir(context, OPCODE_OR, zero, value, modifier, is_32 ? 32U : 64U);
+    }
+
+    if (rt != REGISTER_SP_OR_ZR)
+    {
+        context->source_variables[rt].current_ssa_index = value;
+    }
+}
+
+/// Stores the low `size` bytes of `value` at `base` plus `offset`.
+static void
+emit_store(bal_translation_context_t *BAL_RESTRICT context,
+           uint32_t                                value,
+           uint32_t                                base,
+           int64_t                                 offset,
+           uint32_t                                size)
+{
+    if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+    {
+        return;
+    }
+
+    base = access_base(context, base, &offset, size);
+    (void)emit_ir(context, OPCODE_STORE, base, value, bal_ir_access(size, offset), 0);
+}
+
+/// Writes `base` plus `offset` back to the base register `rn`, which names
+/// `SP` for 31.
+static void
+emit_base_writeback(bal_translation_context_t *BAL_RESTRICT context,
+                    uint32_t                                rn,
+                    uint32_t                                base,
+                    int64_t                                 offset)
+{
+    if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+    {
+        return;
+    }
+
+    uint32_t displacement = intern_constant(context, (bal_constant_t)offset);
+    context->source_variables[rn].current_ssa_index
+        = emit_ir(context, OPCODE_ADD, base, displacement, BAL_SOURCE_NONE, 64);
+}
+
+/// Translates the vector forms of ADD, SUB, MUL, AND, BIC, ORR, ORN, EOR,
+/// CMEQ, CMGT, CMGE, CMHI, CMHS, ZIP1, ZIP2, EXT, TBL with one table register
+/// and DUP. Returns `false` if `instruction` is none of them or is reserved.
+static bool
+translate_vector(bal_translation_context_t *BAL_RESTRICT context, uint32_t instruction)
+{
+    const uint32_t rd        = instruction & 0x1FU;
+    const uint32_t rn        = (instruction >> 5) & 0x1FU;
+    const uint32_t rm        = (instruction >> 16) & 0x1FU;
+    const bool     is_128    = ((instruction >> 30) & 1U) != 0;
+    bal_opcode_t   opcode    = OPCODE_TRAP;
+    uint32_t       size      = (instruction >> 22) & 3U;
+    uint32_t       source1   = rn;
+    uint32_t       source2   = rm;
+    uint32_t       immediate = 0;
+
+    // Three registers of the same type. U selects the unsigned compares
+    // and EOR, and size selects the other logical operations.
+    //
+    if ((instruction & 0x9F200400U) == 0x0E200400U)
+    {
+        static const bal_opcode_t logical[4] = {
+            OPCODE_VECTOR_AND,
+            OPCODE_VECTOR_BIC,
+            OPCODE_VECTOR_OR,
+            OPCODE_VECTOR_OR_NOT,
+        };
+
+        const bool is_unsigned = ((instruction >> 29) & 1U) != 0;
+
+        switch ((instruction >> 11) & 0x1FU)
+        {
+            case 0x10:
+                opcode = is_unsigned ? OPCODE_VECTOR_SUB : OPCODE_VECTOR_ADD;
+                break;
+            case 0x13:
+                opcode = is_unsigned ? OPCODE_TRAP : OPCODE_VECTOR_MUL;
+                break;
+            case 0x03:
+                if (false == is_unsigned || 0 == size)
+                {
+                    opcode = is_unsigned ? OPCODE_VECTOR_XOR : logical[size];
+                }
+
+                size = 0;
+                break;
+            case 0x11:
+                opcode = is_unsigned ? OPCODE_VECTOR_COMPARE_EQUAL : OPCODE_TRAP;
+                break;
+            case 0x06:
+                opcode = is_unsigned ? OPCODE_VECTOR_COMPARE_HIGHER : OPCODE_VECTOR_COMPARE_GREATER;
+                break;
+            case 0x07:
+                opcode = is_unsigned ? OPCODE_VECTOR_COMPARE_HIGHER_SAME
+                                     : OPCODE_VECTOR_COMPARE_GREATER_EQUAL;
+                break;
+            default:
+                break;
+        }
+
+        // 64-bit lanes need the whole register, and MUL has none.
+        //
+        if (3U == size && (false == is_128 || OPCODE_VECTOR_MUL == opcode))
+        {
+            return false;
+        }
+    }
+
+    // ZIP1 and ZIP2 among the permutes.
+    //
+    else if ((instruction & 0xBF208C00U) == 0x0E000800U)
+    {
+        const uint32_t operation = (instruction >> 12) & 7U;
+
+        if (3U == size && false == is_128)
+        {
+            return false;
+        }
+
+        if (3U == operation || 7U == operation)
+        {
+            opcode = (3U == operation) ? OPCODE_VECTOR_ZIP_LOW : OPCODE_VECTOR_ZIP_HIGH;
+        }
+    }
+
+    // EXT. A 64-bit EXT can only start in its first 8 bytes.
+    //
+    else if ((instruction & 0xBFE08400U) == 0x2E000000U)
+    {
+        immediate = (instruction >> 11) & 0xFU;
+
+        if (false == is_128 && immediate >= 8U)
+        {
+            return false;
+        }
+
+        opcode = OPCODE_VECTOR_EXTRACT;
+        size   = 0;
+    }
+
+    // TBL with a single table register.
+    //
+    else if ((instruction & 0xBFE0FC00U) == 0x0E000000U)
+    {
+        opcode = OPCODE_VECTOR_TABLE;
+        size   = 0;
+    }
+
+    // DUP (element) and DUP (general). The lowest set bit of imm5 gives the
+    // lane size, and the bits above it the lane.
+    //
+    else if ((instruction & 0xBFE0F400U) == 0x0E000400U)
+    {
+        const uint32_t imm5       = rm;
+        const bool     is_general = ((instruction >> 11) & 1U) != 0;
+
+        if (0 == (imm5 & 0xFU))
+        {
+            return false;
+        }
+
+        size = 0;
+
+        while (0 == (imm5 & (1U << size)))
+        {
+            ++size;
+        }
+
+        if (3U == size && false == is_128)
+        {
+            return false;
+        }
+
+        if (is_general)
+        {
+            opcode  = OPCODE_VECTOR_DUPLICATE_SCALAR;
+            source1 = BAL_SOURCE_NONE;
+            source2 = read_register(context, rn, false);
+        }
+        else
+        {
+            opcode    = OPCODE_VECTOR_DUPLICATE;
+            source2   = BAL_SOURCE_NONE;
+            immediate = imm5 >> (size + 1U);
+        }
+    }
+
+    if (OPCODE_TRAP == opcode)
+    {
+        return false;
+    }
+
+    (void)emit_ir(context,
+                  opcode,
+                  source1,
+                  source2,
+                  bal_ir_vector(rd, size, is_128, immediate),
+                  BAL_IR_VECTOR_BIT_WIDTH);
+    context->cannot_restart = true;
+    return true;
+}
+
+/// Translates LDXR, STXR and their acquire, release, byte and halfword
+/// forms, and the CAS, SWP and LDADD families. Every ordering maps to the
+/// sequentially consistent host atomics. Returns `false` if `instruction` is
+/// none of them, including the pair forms.
+static bool
+translate_atomic(bal_translation_context_t *BAL_RESTRICT context, uint32_t instruction)
+{
+    const uint32_t        size        = 1U << (instruction >> 30);
+    const bal_bit_width_t bit_width   = (bal_bit_width_t)(size * 8U);
+    const uint32_t        rt          = instruction & 0x1FU;
+    const uint32_t        rn          = (instruction >> 5) & 0x1FU;
+    const uint32_t        rs          = (instruction >> 16) & 0x1FU;
+    bal_opcode_t          opcode      = OPCODE_TRAP;
+    uint32_t              destination = rt;
+
+    if ((instruction & 0x3FA07C00U) == 0x08007C00U)
+    {
+        const bool is_load = ((instruction >> 22) & 1U) != 0;
+        opcode             = is_load ? OPCODE_LOAD_EXCLUSIVE : OPCODE_STORE_EXCLUSIVE;
+        destination        = is_load ? rt : rs;
+    }
+    else if ((instruction & 0x3FA07C00U) == 0x08A07C00U)
+    {
+        opcode      = OPCODE_ATOMIC_COMPARE_SWAP;
+        destination = rs;
+    }
+    else if ((instruction & 0x3F20FC00U) == 0x38200000U)
+    {
+        opcode = OPCODE_ATOMIC_ADD;
+    }
+    else if ((instruction & 0x3F20FC00U) == 0x38208000U)
+    {
+        opcode = OPCODE_ATOMIC_SWAP;
+    }
+    else
+    {
+        return false;
+    }
+
+    uint32_t base    = read_register(context, rn, true);
+    uint32_t source2 = BAL_SOURCE_NONE;
+    uint32_t source3 = BAL_SOURCE_NONE;
+
+    if (OPCODE_STORE_EXCLUSIVE == opcode)
+    {
+        source2 = read_register(context, rt, false);
+    }
+    else if (opcode != OPCODE_LOAD_EXCLUSIVE)
+    {
+        source2 = read_register(context, rs, false);
+    }
+
+    if (OPCODE_ATOMIC_COMPARE_SWAP == opcode)
+    {
+        source3 = read_register(context, rt, false);
+    }
+
+    uint32_t result = emit_ir(context, opcode, base, source2, source3, bit_width);
+
+    if (destination != REGISTER_SP_OR_ZR)
+    {
+        context->source_variables[destination].current_ssa_index = result;
+    }
+
+    // Loads exclusive only rearm the monitor when replayed.
+    //
+    if (opcode != OPCODE_LOAD_EXCLUSIVE)
+    {
+        context->cannot_restart = true;
+    }
+
+    return true;
+}
+
+/// Emits `OPCODE_SET_REGISTER` for every general purpose register the unit
+/// redefined, and `SP`, so the backend can write them back to the guest
+/// state.
+static void
+emit_register_writebacks(bal_translation_context_t *BAL_RESTRICT context,
+                         const bal_instruction_t *BAL_RESTRICT   instructions,
+                         const bal_instruction_t *BAL_RESTRICT   instructions_end)
+{
+    const uint32_t invalid_ssa_index = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i <= BAL_GUEST_REGISTER_SP; ++i)
+    {
+        uint32_t ssa_index = context->source_variables[i].current_ssa_index;
+
+        if (invalid_ssa_index == ssa_index)
+        {
+            continue;
+        }
+
+        // Skip registers that were only read.
+        //
+        bal_opcode_t opcode
+            = bal_ir_opcode((bal_ir_instruction_t) { .word = instructions[ssa_index] });
+
+        if (OPCODE_GET_REGISTER == opcode)
+        {
+            continue;
+        }
+
+        if (BAL_UNLIKELY(context->ir_instruction_cursor >= instructions_end))
+        {
+            BAL_LOG_ERROR(context->logger, "Instruction overflow during register writeback.");
+            context->status = BAL_ERROR_INSTRUCTION_OVERFLOW;
+            return;
+        }
+
+        write_ir(context, bal_ir_encode(OPCODE_SET_REGISTER, i, ssa_index, BAL_SOURCE_NONE));
+
+        BAL_LOG_DEBUG(context->logger,
+                      "  EMIT: v%u = SET_REGISTER X%u, v%u",
+                      context->instruction_count,
+                      i,
+                      ssa_index);
+
+        context->instruction_count++;
+        context->ir_instruction_cursor++;
+        context->bit_width_cursor++;
+    }
+}
+
+/// Returns `true` and sets `kind` if `metadata` is an unconditional branch
+/// that ends the unit.
+static bool
+classify_branch(const bal_decoder_instruction_metadata_t *metadata, bal_unit_exit_kind_t *kind)
+{
+    // Conditional branches share the `B` mnemonic but start with a 4-bit
+    // condition operand.
+    //
+    if (0 == strcmp(metadata->name, "B") && 26 == metadata->operands[0].bit_width)
+    {
+        *kind = BAL_UNIT_EXIT_BRANCH;
+        return true;
+    }
+
+    if (0 == strcmp(metadata->name, "BL"))
+    {
+        *kind = BAL_UNIT_EXIT_CALL;
+        return true;
+    }
+
+    if (0 == strcmp(metadata->name, "BR"))
+    {
+        *kind = BAL_UNIT_EXIT_INDIRECT_BRANCH;
+        return true;
+    }
+
+    if (0 == strcmp(metadata->name, "BLR"))
+    {
+        *kind = BAL_UNIT_EXIT_INDIRECT_CALL;
+        return true;
+    }
+
+    if (0 == strcmp(metadata->name, "RET"))
+    {
+        *kind = BAL_UNIT_EXIT_RETURN;
+        return true;
+    }
+
+    return false;
+}
+
+/// Fills in `unit_exit` for the branch at `address` and returns the operand that
+/// holds its target. Calls also define `X30`.
+static uint32_t
+translate_branch(bal_translation_context_t *BAL_RESTRICT context,
+                 bal_unit_exit_t *BAL_RESTRICT           unit_exit,
+                 const uint32_t *BAL_RESTRICT            arm_registers,
+                 bal_guest_address_t                     address)
+{
+    const uint32_t link_register = 30;
+    uint32_t       target;
+
+    unit_exit->return_address = address + sizeof(uint32_t);
+
+    if (bal_unit_exit_is_direct(unit_exit->kind))
+    {
+        // imm26 is a signed word offset from the branch.
+        //
+        int64_t offset    = (int64_t)((uint64_t)arm_registers[0] << 38) >> 36;
+        unit_exit->target = address + (uint64_t)offset;
+        target            = intern_constant(context, unit_exit->target);
+
+        BAL_LOG_DEBUG(context->logger, "  EXIT: Direct to 0x%llx", unit_exit->target);
+    }
+    else
+    {
+        // A plain `RET` encodes X30 in the same field as `BR`. The target is
+        // read before `BLR` overwrites the link register.
+        //
+        unit_exit->target          = 0;
+        unit_exit->target_register = arm_registers[0];
+        target = get_or_create_ssa_index(context, unit_exit->target_register);
+
+        BAL_LOG_DEBUG(context->logger, "  EXIT: Indirect through X%u", unit_exit->target_register);
+    }
+
+    if (BAL_UNIT_EXIT_CALL == unit_exit->kind || BAL_UNIT_EXIT_INDIRECT_CALL == unit_exit->kind)
+    {
+        uint32_t return_index = intern_constant(context, unit_exit->return_address);
+
+        if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+        {
+            return target;
+        }
+
+        write_ir(context,
+                 bal_ir_encode(OPCODE_CONST, return_index, BAL_SOURCE_NONE, BAL_SOURCE_NONE));
+
+        context->source_variables[link_register].current_ssa_index = context->instruction_count;
+        context->instruction_count++;
+        context->ir_instruction_cursor++;
+        context->bit_width_cursor++;
+    }
+
+    return target;
+}
+
+/// Translates `B.cond`, `CBZ`, `CBNZ`, `TBZ` and `TBNZ` at `address` into
+/// a conditional exit, and records what it tests in `context`. `B.cond`
+/// with the `AL` or `NV` condition is a plain branch. Returns `false` if
+/// `instruction` is none of them.
+static bool
+translate_conditional_branch(bal_translation_context_t *BAL_RESTRICT context,
+                             bal_unit_exit_t *BAL_RESTRICT           unit_exit,
+                             uint32_t                                instruction,
+                             bal_guest_address_t                     address)
+{
+    const uint32_t rt        = instruction & 0x1FU;
+    const bool     is_64     = (instruction >> 31) != 0;
+    const bool     not_zero  = ((instruction >> 24) & 1U) != 0;
+    int64_t        offset    = 0;
+    uint32_t       condition = BAL_SOURCE_NONE;
+
+    if ((instruction & 0xFF000010U) == 0x54000000U)
+    {
+        // imm19 is a signed word offset from the branch, like the one of
+        // CBZ.
+        //
+        offset                   = (int64_t)((uint64_t)(instruction >> 5) << 45) >> 43;
+        condition                = instruction & 0xFU;
+        context->branch_opcode   = OPCODE_BRANCH_NOT_ZERO;
+        context->branch_on_flags = true;
+        unit_exit->kind
+            = (condition >= 0xEU) ? BAL_UNIT_EXIT_BRANCH : BAL_UNIT_EXIT_CONDITIONAL;
+    }
+    else if ((instruction & 0x7C000000U) == 0x34000000U)
+    {
+        // XZR reads as zero.
+        //
+        const uint32_t value
+            = (31 == rt) ? intern_constant(context, 0) : get_or_create_ssa_index(context, rt);
+
+        if ((instruction & 0x7E000000U) == 0x34000000U)
+        {
+            // imm19 is a signed word offset from the branch.
+            //
+            offset    = (int64_t)((uint64_t)(instruction >> 5) << 45) >> 43;
+            condition = value;
+
+            if (false == is_64)
+            {
+                condition = emit_ir(context,
+                                    OPCODE_AND,
+                                    value,
+                                    intern_constant(context, 0xFFFFFFFFU),
+                                    BAL_SOURCE_NONE,
+                                    32);
+            }
+        }
+        else
+        {
+            // The bit number is b5:b40, and imm14 a signed word offset.
+            //
+            const uint32_t bit = ((instruction >> 26) & 0x20U) | ((instruction >> 19) & 0x1FU);
+
+            offset    = (int64_t)((uint64_t)(instruction >> 5) << 50) >> 48;
+            condition = emit_ir(context,
+                                OPCODE_AND,
+                                value,
+                                intern_constant(context, 1ULL << bit),
+                                BAL_SOURCE_NONE,
+                                64);
+        }
+
+        context->branch_opcode = not_zero ? OPCODE_BRANCH_NOT_ZERO : OPCODE_BRANCH_ZERO;
+        unit_exit->kind        = BAL_UNIT_EXIT_CONDITIONAL;
+    }
+    else
+    {
+        return false;
+    }
+
+    context->branch_condition = condition;
+    unit_exit->target         = address + (uint64_t)offset;
+    unit_exit->return_address = address + sizeof(uint32_t);
+
+    BAL_LOG_DEBUG(context->logger,
+                  "  EXIT: Conditional to 0x%llx or 0x%llx",
+                  unit_exit->target,
+                  unit_exit->return_address);
+
+    return true;
+}
+
+/// Emits the instruction that leaves the unit through `unit_exit`. A
+/// conditional exit on the flags tests them after the register writebacks,
+/// so it is preceded by `OPCODE_CMP_COND`.
+static void
+emit_terminator(bal_translation_context_t *BAL_RESTRICT context,
+                const bal_unit_exit_t *BAL_RESTRICT     unit_exit,
+                uint32_t                                target,
+                const bal_instruction_t *BAL_RESTRICT   instructions_end)
+{
+    if (BAL_UNLIKELY(context->status != BAL_SUCCESS))
+    {
+        return;
+    }
+
+    const bool is_conditional = (BAL_UNIT_EXIT_CONDITIONAL == unit_exit->kind);
+    const bool tests_flags    = is_conditional && context->branch_on_flags;
+
+    if (BAL_UNLIKELY(instructions_end - context->ir_instruction_cursor < (tests_flags ? 2 : 1)))
+    {
+        BAL_LOG_ERROR(context->logger, "Instruction overflow while ending the unit.");
+        context->status = BAL_ERROR_INSTRUCTION_OVERFLOW;
+        return;
+    }
+
+    bal_opcode_t opcode  = OPCODE_JUMP;
+    uint32_t     source1 = target;
+    uint32_t     source2 = BAL_SOURCE_NONE;
+    uint32_t     source3 = BAL_SOURCE_NONE;
+
+    if (BAL_UNIT_EXIT_CALL == unit_exit->kind || BAL_UNIT_EXIT_INDIRECT_CALL == unit_exit->kind)
+    {
+        opcode  = OPCODE_CALL;
+        source2 = intern_constant(context, unit_exit->return_address);
+    }
+    else if (BAL_UNIT_EXIT_RETURN == unit_exit->kind)
+    {
+        opcode = OPCODE_RETURN;
+    }
+    else if (is_conditional)
+    {
+        opcode  = context->branch_opcode;
+        source1 = context->branch_condition;
+        source2 = target;
+        source3 = intern_constant(context, unit_exit->return_address);
+
+        if (tests_flags)
+        {
+            source1 = emit_ir(
+                context, OPCODE_CMP_COND, source1, BAL_SOURCE_NONE, BAL_SOURCE_NONE, 32);
+        }
+    }
+
+    write_ir(context, bal_ir_encode(opcode, source1, source2, source3));
+
+    BAL_LOG_DEBUG(context->logger,
+                  "  EMIT: v%u = opcode %u 0x%x, 0x%x, 0x%x",
+                  context->instruction_count,
+                  opcode,
+                  source1,
+                  source2,
+                  source3);
+
+    context->instruction_count++;
+    context->ir_instruction_cursor++;
+    context->bit_width_cursor++;
+}
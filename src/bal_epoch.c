@@ -0,0 +1,136 @@
+#include "bal_epoch.h"
+#include "bal_assert.h"
+#include "bal_atomic.h"
+#include <string.h>
+
+bal_error_t
+bal_epoch_init(bal_allocator_t *allocator,
+               bal_epoch_t     *epoch,
+               uint32_t         slots_count,
+               bal_logger_t     logger)
+{
+    if (NULL == allocator || NULL == epoch || 0 == slots_count)
+    {
+        BAL_LOG_ERROR(&logger, "Epoch init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t slots_size = (size_t)slots_count * sizeof(bal_epoch_slot_t);
+
+    epoch->slots
+        = (bal_epoch_slot_t *)allocator->allocate(allocator->handle, 64U, slots_size);
+
+    if (NULL == epoch->slots)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to allocate %u epoch slots.", slots_count);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    (void)memset(epoch->slots, 0, slots_size);
+    epoch->global      = 1;
+    epoch->slots_count = slots_count;
+    epoch->logger      = logger;
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_epoch_claim(bal_epoch_t *epoch, uint32_t *slot)
+{
+    for (uint32_t i = 0; i < epoch->slots_count; ++i)
+    {
+        if (0 == bal_atomic_compare_swap(&epoch->slots[i].claimed, 0, 1, sizeof(uint64_t)))
+        {
+            *slot = i;
+            bal_epoch_online(epoch, i);
+            return BAL_SUCCESS;
+        }
+    }
+
+    BAL_LOG_ERROR(&epoch->logger,
+                  "More than %u threads are running guest code at once.",
+                  epoch->slots_count);
+    return BAL_ERROR_INVALID_ARGUMENT;
+}
+
+void
+bal_epoch_release(bal_epoch_t *epoch, uint32_t slot)
+{
+    bal_epoch_offline(epoch, slot);
+    bal_atomic_store_64(&epoch->slots[slot].claimed, 0);
+}
+
+void
+bal_epoch_quiesce(bal_epoch_t *epoch, uint32_t slot)
+{
+    BAL_ASSERT(epoch->slots[slot].observed != BAL_EPOCH_OFFLINE);
+
+    bal_atomic_store_64(&epoch->slots[slot].observed, bal_atomic_load_64(&epoch->global));
+}
+
+void
+bal_epoch_online(bal_epoch_t *epoch, uint32_t slot)
+{
+    bal_atomic_store_64(&epoch->slots[slot].observed, bal_atomic_load_64(&epoch->global));
+
+    // A writer that checks the slot before the store lands must not have
+    // removed anything this thread reads next. The fence pairs with the one
+    // in bal_epoch_safe(), so either the writer sees the slot or this thread
+    // sees the removal.
+    //
+    bal_atomic_fence();
+}
+
+void
+bal_epoch_offline(bal_epoch_t *epoch, uint32_t slot)
+{
+    bal_atomic_store_64(&epoch->slots[slot].observed, BAL_EPOCH_OFFLINE);
+}
+
+uint64_t
+bal_epoch_current(const bal_epoch_t *epoch)
+{
+    return bal_atomic_load_64(&epoch->global);
+}
+
+void
+bal_epoch_advance(bal_epoch_t *epoch)
+{
+    (void)bal_atomic_fetch_add(&epoch->global, 1, sizeof(uint64_t));
+}
+
+uint64_t
+bal_epoch_safe(const bal_epoch_t *epoch)
+{
+    bal_atomic_fence();
+
+    uint64_t safe = bal_atomic_load_64(&epoch->global);
+
+    for (uint32_t i = 0; i < epoch->slots_count; ++i)
+    {
+        uint64_t observed = bal_atomic_load_64(&epoch->slots[i].observed);
+
+        if (observed != BAL_EPOCH_OFFLINE && observed < safe)
+        {
+            safe = observed;
+        }
+    }
+
+    return safe;
+}
+
+void
+bal_epoch_destroy(bal_allocator_t *allocator, bal_epoch_t *epoch)
+{
+    if (NULL == allocator || NULL == epoch || NULL == epoch->slots)
+    {
+        return;
+    }
+
+    allocator->free(allocator->handle,
+                    epoch->slots,
+                    (size_t)epoch->slots_count * sizeof(bal_epoch_slot_t));
+    epoch->slots = NULL;
+}
+
+/*** end of file ***/
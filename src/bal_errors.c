@@ -25,6 +25,30 @@ bal_error_to_string(bal_error_t error)
         case BAL_ERROR_INSTRUCTION_OVERFLOW:
             string = "instructions array overflowed";
             break;
+        case BAL_ERROR_SPILL_SLOT_OVERFLOW:
+            string = "ran out of spill slots during register allocation";
+            break;
+        case BAL_ERROR_CODE_BUFFER_OVERFLOW:
+            string = "code buffer overflowed";
+            break;
+        case BAL_ERROR_UNSUPPORTED_OPCODE:
+            string = "the backend has no template for an IR opcode";
+            break;
+        case BAL_ERROR_UNSUPPORTED_HOST:
+            string = "no backend exists for the host architecture";
+            break;
+        case BAL_ERROR_TRANSLATION_CACHE_FULL:
+            string = "translation cache has no free entries";
+            break;
+        case BAL_ERROR_GUEST_MEMORY_FAULT:
+            string = "guest address is not mapped";
+            break;
+        case BAL_ERROR_FILE_IO:
+            string = "failed to read or write a file";
+            break;
+        case BAL_ERROR_INVALID_FILE:
+            string = "file is malformed or was written by another version";
+            break;
         case BAL_SUCCESS:
             string = "there is no error";
             break;
@@ -0,0 +1,483 @@
+// REG_RIP is a GNU extension.
+//
+#define _GNU_SOURCE
+
+#include "bal_fastmem.h"
+#include "bal_platform.h"
+#include <string.h>
+
+#if defined(__linux__) && BAL_ARCHITECTURE_X86
+#define FASTMEM_SUPPORTED 1
+#else
+#define FASTMEM_SUPPORTED 0
+#endif
+
+static bal_error_t check_range(const bal_fastmem_t *, bal_guest_address_t, size_t);
+static uint32_t    lower_bound(const bal_fastmem_t *, const uint8_t *);
+static size_t      host_page_size(void);
+static bool        reserve(bal_fastmem_t *);
+static void        release(bal_fastmem_t *);
+static bool        protect(bal_fastmem_t *, bal_guest_address_t, size_t, bool, bool);
+static bool        install_handler(bal_fastmem_t *);
+static void        remove_handler(const bal_fastmem_t *);
+
+bal_error_t
+bal_fastmem_init(bal_allocator_t *allocator,
+                 bal_fastmem_t   *fastmem,
+                 uint32_t         address_bits,
+                 uint32_t         site_capacity,
+                 bal_logger_t     logger)
+{
+    if (NULL == allocator || NULL == fastmem || 0 == site_capacity
+        || address_bits < BAL_FASTMEM_MIN_ADDRESS_BITS
+        || address_bits > BAL_FASTMEM_MAX_ADDRESS_BITS)
+    {
+        BAL_LOG_ERROR(&logger, "Fastmem init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    (void)memset(fastmem, 0, sizeof(bal_fastmem_t));
+    fastmem->size          = (size_t)1 << address_bits;
+    fastmem->address_bits  = address_bits;
+    fastmem->site_capacity = site_capacity;
+    fastmem->logger        = logger;
+
+    if (0 == FASTMEM_SUPPORTED)
+    {
+        BAL_LOG_ERROR(&logger, "Fastmem is not supported on this host.");
+        return BAL_ERROR_UNSUPPORTED_HOST;
+    }
+
+    size_t sites_size = (size_t)site_capacity * sizeof(bal_fastmem_site_t);
+    fastmem->sites
+        = (bal_fastmem_site_t *)allocator->allocate(allocator->handle, 64U, sites_size);
+
+    if (NULL == fastmem->sites)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to allocate %u fastmem sites.", site_capacity);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    if (false == reserve(fastmem))
+    {
+        BAL_LOG_ERROR(&logger, "Failed to reserve 2^%u bytes of guest memory.", address_bits);
+        bal_fastmem_destroy(allocator, fastmem);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    if (false == install_handler(fastmem))
+    {
+        BAL_LOG_ERROR(&logger, "Failed to install the fastmem fault handler.");
+        bal_fastmem_destroy(allocator, fastmem);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    BAL_LOG_INFO(&logger,
+                 "Reserved 2^%u bytes of guest memory at %p.",
+                 address_bits,
+                 (void *)fastmem->base);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_fastmem_map(bal_fastmem_t      *fastmem,
+                bal_guest_address_t guest_address,
+                size_t              size,
+                bool                writable)
+{
+    bal_error_t error = check_range(fastmem, guest_address, size);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    if (false == protect(fastmem, guest_address, size, true, writable))
+    {
+        BAL_LOG_ERROR(&fastmem->logger,
+                      "Failed to map guest memory [0x%llx, 0x%llx).",
+                      (unsigned long long)guest_address,
+                      (unsigned long long)(guest_address + size));
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_fastmem_unmap(bal_fastmem_t *fastmem, bal_guest_address_t guest_address, size_t size)
+{
+    bal_error_t error = check_range(fastmem, guest_address, size);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    if (false == protect(fastmem, guest_address, size, false, false))
+    {
+        BAL_LOG_ERROR(&fastmem->logger,
+                      "Failed to unmap guest memory [0x%llx, 0x%llx).",
+                      (unsigned long long)guest_address,
+                      (unsigned long long)(guest_address + size));
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    return BAL_SUCCESS;
+}
+
+bool
+bal_fastmem_add_site(bal_fastmem_t *fastmem, const bal_fastmem_site_t *site)
+{
+    if (fastmem->site_count == fastmem->site_capacity)
+    {
+        return false;
+    }
+
+    // Units are appended to the code buffer, so the new site almost always
+    // goes last.
+    //
+    uint32_t index = lower_bound(fastmem, site->access);
+
+    (void)memmove(&fastmem->sites[index + 1],
+                  &fastmem->sites[index],
+                  (fastmem->site_count - index) * sizeof(bal_fastmem_site_t));
+
+    fastmem->sites[index] = *site;
+    fastmem->site_count++;
+    return true;
+}
+
+void
+bal_fastmem_remove_sites(bal_fastmem_t *fastmem, const uint8_t *begin, const uint8_t *end)
+{
+    uint32_t first = lower_bound(fastmem, begin);
+    uint32_t last  = lower_bound(fastmem, end);
+
+    (void)memmove(&fastmem->sites[first],
+                  &fastmem->sites[last],
+                  (fastmem->site_count - last) * sizeof(bal_fastmem_site_t));
+
+    fastmem->site_count -= last - first;
+}
+
+void
+bal_fastmem_destroy(bal_allocator_t *allocator, bal_fastmem_t *fastmem)
+{
+    if (NULL == allocator || NULL == fastmem)
+    {
+        return;
+    }
+
+    remove_handler(fastmem);
+    release(fastmem);
+
+    if (fastmem->sites != NULL)
+    {
+        allocator->free(allocator->handle,
+                        fastmem->sites,
+                        (size_t)fastmem->site_capacity * sizeof(bal_fastmem_site_t));
+        fastmem->sites = NULL;
+    }
+
+    fastmem->site_count = 0;
+}
+
+static bal_error_t
+check_range(const bal_fastmem_t *fastmem, bal_guest_address_t guest_address, size_t size)
+{
+    if (NULL == fastmem || NULL == fastmem->base || 0 == size || guest_address >= fastmem->size
+        || size > fastmem->size - guest_address)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t page_mask = host_page_size() - 1U;
+
+    if ((guest_address & page_mask) != 0 || (size & page_mask) != 0)
+    {
+        return BAL_ERROR_MEMORY_ALIGNMENT;
+    }
+
+    return BAL_SUCCESS;
+}
+
+/// Returns the index of the first site at or after `access`.
+static uint32_t
+lower_bound(const bal_fastmem_t *fastmem, const uint8_t *access)
+{
+    uint32_t low  = 0;
+    uint32_t high = fastmem->site_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2U;
+
+        if ((uintptr_t)fastmem->sites[middle].access < (uintptr_t)access)
+        {
+            low = middle + 1U;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+#if FASTMEM_SUPPORTED
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+static void handle_fault(int, siginfo_t *, void *);
+
+/// Every live region, for the fault handler to search.
+static bal_fastmem_t *regions[BAL_FASTMEM_MAX_REGIONS];
+static uint32_t       region_count;
+
+/// The handler that was installed before the first region, which faults
+/// outside of every site are passed on to.
+static struct sigaction previous_action;
+
+static size_t
+host_page_size(void)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    return (page_size > 0) ? (size_t)page_size : 4096U;
+}
+
+static bool
+reserve(bal_fastmem_t *fastmem)
+{
+    // Nothing is backed until it is mapped, so the reservation only costs
+    // address space.
+    //
+    void *base = mmap(NULL,
+                      fastmem->size + BAL_FASTMEM_GUARD_SIZE,
+                      PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1,
+                      0);
+
+    if (MAP_FAILED == base)
+    {
+        return false;
+    }
+
+    fastmem->base = (uint8_t *)base;
+    return true;
+}
+
+static void
+release(bal_fastmem_t *fastmem)
+{
+    if (fastmem->base != NULL)
+    {
+        (void)munmap(fastmem->base, fastmem->size + BAL_FASTMEM_GUARD_SIZE);
+        fastmem->base = NULL;
+    }
+}
+
+static bool
+protect(bal_fastmem_t      *fastmem,
+        bal_guest_address_t guest_address,
+        size_t              size,
+        bool                accessible,
+        bool                writable)
+{
+    uint8_t *host       = fastmem->base + guest_address;
+    int      protection = PROT_NONE;
+
+    if (accessible)
+    {
+        protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    }
+    else if (madvise(host, size, MADV_DONTNEED) != 0)
+    {
+        return false;
+    }
+
+    return 0 == mprotect(host, size, protection);
+}
+
+static bool
+install_handler(bal_fastmem_t *fastmem)
+{
+    uint32_t slot = BAL_FASTMEM_MAX_REGIONS;
+
+    for (uint32_t i = 0; i < BAL_FASTMEM_MAX_REGIONS; ++i)
+    {
+        if (NULL == regions[i])
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    if (BAL_FASTMEM_MAX_REGIONS == slot)
+    {
+        return false;
+    }
+
+    if (0 == region_count)
+    {
+        struct sigaction action;
+        (void)memset(&action, 0, sizeof(action));
+        action.sa_sigaction = handle_fault;
+        action.sa_flags     = SA_SIGINFO | SA_ONSTACK;
+        (void)sigemptyset(&action.sa_mask);
+
+        if (sigaction(SIGSEGV, &action, &previous_action) != 0)
+        {
+            return false;
+        }
+    }
+
+    regions[slot] = fastmem;
+    region_count++;
+    return true;
+}
+
+static void
+remove_handler(const bal_fastmem_t *fastmem)
+{
+    for (uint32_t i = 0; i < BAL_FASTMEM_MAX_REGIONS; ++i)
+    {
+        if (regions[i] != fastmem)
+        {
+            continue;
+        }
+
+        regions[i] = NULL;
+
+        if (0 == --region_count)
+        {
+            (void)sigaction(SIGSEGV, &previous_action, NULL);
+        }
+
+        return;
+    }
+}
+
+/// Redirects a fault on a registered site to its slow path, patching the
+/// site so later executions jump there without faulting. Any other fault is
+/// passed on to the previous handler.
+static void
+handle_fault(int signal_number, siginfo_t *info, void *context)
+{
+    ucontext_t    *user_context = (ucontext_t *)context;
+    const uint8_t *pc = (const uint8_t *)(uintptr_t)user_context->uc_mcontext.gregs[REG_RIP];
+    const uint8_t *address = (const uint8_t *)info->si_addr;
+
+    for (uint32_t i = 0; i < BAL_FASTMEM_MAX_REGIONS; ++i)
+    {
+        bal_fastmem_t *fastmem = regions[i];
+
+        if (NULL == fastmem || (uintptr_t)address < (uintptr_t)fastmem->base
+            || (uintptr_t)address
+                   >= (uintptr_t)fastmem->base + fastmem->size + BAL_FASTMEM_GUARD_SIZE)
+        {
+            continue;
+        }
+
+        uint32_t index = lower_bound(fastmem, pc);
+
+        if (index == fastmem->site_count || fastmem->sites[index].access != pc)
+        {
+            continue;
+        }
+
+        // The slow path is in the same code reservation as the site.
+        //
+        const bal_fastmem_site_t *site     = &fastmem->sites[index];
+        int64_t                   distance = (int64_t)((uintptr_t)site->slow_path
+                                     - ((uintptr_t)site->access + 5U));
+        uint8_t                   jump[5]  = { 0xE9 };
+
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            jump[1 + j] = (uint8_t)((uint64_t)distance >> (j * 8U));
+        }
+
+        (void)memcpy(site->writable, jump, sizeof(jump));
+        fastmem->patches++;
+
+        user_context->uc_mcontext.gregs[REG_RIP] = (greg_t)(uintptr_t)site->slow_path;
+        return;
+    }
+
+    if (previous_action.sa_flags & SA_SIGINFO)
+    {
+        previous_action.sa_sigaction(signal_number, info, context);
+        return;
+    }
+
+    if (SIG_DFL == previous_action.sa_handler || SIG_IGN == previous_action.sa_handler)
+    {
+        // Returning runs the faulting instruction again, which now takes the
+        // default action.
+        //
+        (void)signal(signal_number, SIG_DFL);
+        return;
+    }
+
+    previous_action.sa_handler(signal_number);
+}
+
+#else
+
+static size_t
+host_page_size(void)
+{
+    return 4096U;
+}
+
+static bool
+reserve(bal_fastmem_t *fastmem)
+{
+    (void)fastmem;
+    return false;
+}
+
+static void
+release(bal_fastmem_t *fastmem)
+{
+    (void)fastmem;
+}
+
+static bool
+protect(bal_fastmem_t      *fastmem,
+        bal_guest_address_t guest_address,
+        size_t              size,
+        bool                accessible,
+        bool                writable)
+{
+    (void)fastmem;
+    (void)guest_address;
+    (void)size;
+    (void)accessible;
+    (void)writable;
+    return false;
+}
+
+static bool
+install_handler(bal_fastmem_t *fastmem)
+{
+    (void)fastmem;
+    return false;
+}
+
+static void
+remove_handler(const bal_fastmem_t *fastmem)
+{
+    (void)fastmem;
+}
+
+#endif /* FASTMEM_SUPPORTED */
+
+/*** end of file ***/
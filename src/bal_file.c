@@ -0,0 +1,128 @@
+#include "bal_file.h"
+#include "bal_platform.h"
+#include <stdio.h>
+
+#if BAL_PLATFORM_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if BAL_PLATFORM_WINDOWS
+#include <windows.h>
+#endif
+
+#if BAL_PLATFORM_POSIX
+
+bool
+bal_file_map(const char *path, const uint8_t **mapping, size_t *size)
+{
+    int descriptor = open(path, O_RDONLY);
+
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+
+    if (fstat(descriptor, &status) != 0 || status.st_size <= 0)
+    {
+        (void)close(descriptor);
+        return false;
+    }
+
+    size_t length = (size_t)status.st_size;
+    void  *view   = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    (void)close(descriptor);
+
+    if (MAP_FAILED == view)
+    {
+        return false;
+    }
+
+    *mapping = (const uint8_t *)view;
+    *size    = length;
+    return true;
+}
+
+void
+bal_file_unmap(const uint8_t *mapping, size_t size)
+{
+    if (mapping != NULL)
+    {
+        (void)munmap((void *)(uintptr_t)mapping, size);
+    }
+}
+
+bool
+bal_file_replace(const char *source, const char *destination)
+{
+    return 0 == rename(source, destination);
+}
+
+#endif /* BAL_PLATFORM_POSIX */
+
+#if BAL_PLATFORM_WINDOWS
+
+bool
+bal_file_map(const char *path, const uint8_t **mapping, size_t *size)
+{
+    HANDLE file = CreateFileA(
+        path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER length;
+
+    if (0 == GetFileSizeEx(file, &length) || length.QuadPart <= 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE section = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+
+    if (NULL == section)
+    {
+        return false;
+    }
+
+    const void *view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(section);
+
+    if (NULL == view)
+    {
+        return false;
+    }
+
+    *mapping = (const uint8_t *)view;
+    *size    = (size_t)length.QuadPart;
+    return true;
+}
+
+void
+bal_file_unmap(const uint8_t *mapping, size_t size)
+{
+    (void)size;
+
+    if (mapping != NULL)
+    {
+        UnmapViewOfFile(mapping);
+    }
+}
+
+bool
+bal_file_replace(const char *source, const char *destination)
+{
+    return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#endif /* BAL_PLATFORM_WINDOWS */
+
+/*** end of file ***/
@@ -0,0 +1,30 @@
+/** @file bal_file.h
+ *
+ * @brief Internal helpers for mapping and replacing files on every
+ * supported platform.
+ */
+
+#ifndef BALLISTIC_FILE_H
+#define BALLISTIC_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Maps the whole file at `path` read-only, storing its address in `mapping`
+/// and its size in `size`.
+///
+/// Returns `false` if the file is missing, empty or can not be mapped.
+bool bal_file_map(const char *path, const uint8_t **mapping, size_t *size);
+
+/// Unmaps a result of [`bal_file_map`]. Does nothing if `mapping` is `NULL`.
+void bal_file_unmap(const uint8_t *mapping, size_t size);
+
+/// Renames `source` to `destination`, replacing any file already there.
+///
+/// Returns `false` on failure.
+bool bal_file_replace(const char *source, const char *destination);
+
+#endif /* BALLISTIC_FILE_H */
+
+/*** end of file ***/
@@ -0,0 +1,94 @@
+#include "bal_guest_state.h"
+#include <stdbool.h>
+
+static uint32_t nzcv_from(uint64_t, uint64_t, bool);
+
+/// Bit `nzcv` of entry `condition` is set if the condition holds for the
+/// flags `nzcv`, packed as the top 4 bits of the `NZCV` system register.
+static const uint16_t condition_masks[16] = {
+    0xF0F0, // EQ: Z
+    0x0F0F, // NE: !Z
+    0xCCCC, // CS: C
+    0x3333, // CC: !C
+    0xFF00, // MI: N
+    0x00FF, // PL: !N
+    0xAAAA, // VS: V
+    0x5555, // VC: !V
+    0x0C0C, // HI: C && !Z
+    0xF3F3, // LS: !C || Z
+    0xAA55, // GE: N == V
+    0x55AA, // LT: N != V
+    0x0A05, // GT: !Z && N == V
+    0xF5FA, // LE: Z || N != V
+    0xFFFF, // AL
+    0xFFFF, // NV, which behaves like AL.
+};
+
+uint32_t
+bal_guest_state_nzcv(const bal_guest_state_t *state)
+{
+    const uint64_t left  = state->flags.left;
+    const uint64_t right = state->flags.right;
+
+    // The 32-bit forms compute the flags of the low words, so shifting them
+    // into the high word lets every form share the 64-bit rules.
+    //
+    const uint64_t left32  = left << 32U;
+    const uint64_t right32 = right << 32U;
+
+    switch ((bal_flags_operation_t)state->flags.operation)
+    {
+        case BAL_FLAGS_NONE:
+            return (uint32_t)left;
+
+        case BAL_FLAGS_ADD_64: {
+            uint64_t result = left + right;
+            return nzcv_from(result, (left ^ result) & (right ^ result), result < left);
+        }
+
+        case BAL_FLAGS_ADD_32: {
+            uint64_t result = left32 + right32;
+            return nzcv_from(result, (left32 ^ result) & (right32 ^ result), result < left32);
+        }
+
+        case BAL_FLAGS_SUB_64: {
+            uint64_t result = left - right;
+            return nzcv_from(result, (left ^ right) & (left ^ result), left >= right);
+        }
+
+        case BAL_FLAGS_SUB_32: {
+            uint64_t result = left32 - right32;
+            return nzcv_from(result, (left32 ^ right32) & (left32 ^ result), left32 >= right32);
+        }
+
+        case BAL_FLAGS_LOGICAL_64:
+            return nzcv_from(left, 0, false);
+
+        case BAL_FLAGS_LOGICAL_32:
+            return nzcv_from(left32, 0, false);
+
+        default:
+            return 0;
+    }
+}
+
+uint32_t
+bal_guest_state_condition_holds(const bal_guest_state_t *state, uint32_t condition)
+{
+    uint32_t nzcv = bal_guest_state_nzcv(state) >> 28U;
+    return (condition_masks[condition & 0xFU] >> nzcv) & 1U;
+}
+
+/// Packs the flags of a 64-bit `result`. `V` is the sign bit of `overflow`.
+static uint32_t
+nzcv_from(uint64_t result, uint64_t overflow, bool carry)
+{
+    uint32_t nzcv = 0;
+    nzcv |= (result >> 63U) != 0 ? BAL_NZCV_N : 0;
+    nzcv |= 0 == result ? BAL_NZCV_Z : 0;
+    nzcv |= carry ? BAL_NZCV_C : 0;
+    nzcv |= (overflow >> 63U) != 0 ? BAL_NZCV_V : 0;
+    return nzcv;
+}
+
+/*** end of file ***/
@@ -0,0 +1,972 @@
+#include "bal_interpreter.h"
+#include "bal_atomic.h"
+#include "bal_ir.h"
+#include "bal_vector.h"
+#include <stdbool.h>
+#include <string.h>
+
+/// Marks an SSA value that is read but has not been given a slot yet.
+#define SLOT_USED 0xFFFFFFFEU
+
+/// Marks an SSA value that is never read.
+#define SLOT_UNUSED 0xFFFFFFFFU
+
+typedef const bal_interpreter_instruction_t instruction_t;
+
+static uint32_t                  unit_index(const bal_interpreter_t *, bal_guest_address_t);
+static void                      flush(bal_interpreter_t *);
+static bool                      is_dead(bal_ir_instruction_t, uint32_t);
+static bal_interpreter_handler_t handler_for(bal_opcode_t, uint32_t);
+static bal_interpreter_handler_t compare_swap_handler(uint32_t);
+
+static instruction_t *handle_get_register(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_set_register(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_move(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_add(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_sub(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_and(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_or(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_xor(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_add_modified(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_sub_modified(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_and_modified(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_or_modified(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_xor_modified(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_load(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_store(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_load_exclusive(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_store_exclusive(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_atomic_add(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_atomic_swap(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_compare_swap_8(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_compare_swap_16(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_compare_swap_32(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_compare_swap_64(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_vector(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_vector_duplicate_scalar(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_jump(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_call(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_return(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_compare_condition(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_branch_zero(instruction_t *, bal_interpreter_frame_t *);
+static instruction_t *handle_branch_not_zero(instruction_t *, bal_interpreter_frame_t *);
+
+bal_error_t
+bal_interpreter_init(bal_allocator_t   *allocator,
+                     bal_interpreter_t *interpreter,
+                     uint32_t           unit_count,
+                     uint32_t           instruction_capacity,
+                     bal_logger_t       logger)
+{
+    // Every unit has at most one constant per instruction, so the value
+    // arena needs twice the slots.
+    //
+    if (NULL == allocator || NULL == interpreter || 0 == unit_count || 0 == instruction_capacity
+        || instruction_capacity > UINT32_MAX / 2)
+    {
+        BAL_LOG_ERROR(&logger, "Interpreter init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t slots = 1;
+
+    while (slots < unit_count && slots < (1U << 31))
+    {
+        slots <<= 1;
+    }
+
+    size_t memory_alignment  = 64U;
+    size_t units_size        = (size_t)slots * sizeof(bal_interpreter_unit_t);
+    size_t instructions_size = (size_t)instruction_capacity * sizeof(bal_interpreter_instruction_t);
+    size_t values_size       = (size_t)instruction_capacity * 2U * sizeof(uint64_t);
+
+    (void)memset(interpreter, 0, sizeof(*interpreter));
+    interpreter->unit_mask            = slots - 1;
+    interpreter->instruction_capacity = instruction_capacity;
+    interpreter->value_capacity       = instruction_capacity * 2U;
+    interpreter->logger               = logger;
+
+    interpreter->units = (bal_interpreter_unit_t *)allocator->allocate(
+        allocator->handle, memory_alignment, units_size);
+    interpreter->instructions = (bal_interpreter_instruction_t *)allocator->allocate(
+        allocator->handle, memory_alignment, instructions_size);
+    interpreter->values
+        = (uint64_t *)allocator->allocate(allocator->handle, memory_alignment, values_size);
+
+    if (NULL == interpreter->units || NULL == interpreter->instructions
+        || NULL == interpreter->values)
+    {
+        BAL_LOG_ERROR(&logger,
+                      "Failed to allocate an interpreter of %u instructions.",
+                      instruction_capacity);
+        bal_interpreter_destroy(allocator, interpreter);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    (void)memset(interpreter->units, 0, units_size);
+
+    BAL_LOG_INFO(&logger,
+                 "Interpreter initialized. Units: %u, Instructions: %u.",
+                 slots,
+                 instruction_capacity);
+
+    return BAL_SUCCESS;
+}
+
+bal_interpreter_unit_t *
+bal_interpreter_lookup(bal_interpreter_t *interpreter, bal_guest_address_t guest_address)
+{
+    bal_interpreter_unit_t *unit = &interpreter->units[unit_index(interpreter, guest_address)];
+
+    if (unit->guest_size != 0 && unit->guest_address == guest_address)
+    {
+        return unit;
+    }
+
+    return NULL;
+}
+
+bal_error_t
+bal_interpreter_decode(bal_interpreter_t *BAL_RESTRICT       interpreter,
+                       const bal_engine_t *BAL_RESTRICT      engine,
+                       int32_t                               counter,
+                       bal_interpreter_unit_t **BAL_RESTRICT unit)
+{
+    if (BAL_UNLIKELY(NULL == interpreter || NULL == engine || NULL == unit))
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (BAL_UNLIKELY(engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    const uint32_t instruction_count = engine->instruction_count;
+    const uint32_t constant_count    = engine->constant_count;
+
+    if (BAL_UNLIKELY(instruction_count > interpreter->instruction_capacity
+                     || instruction_count + constant_count > interpreter->value_capacity))
+    {
+        BAL_LOG_ERROR(&interpreter->logger,
+                      "Unit of %u instructions does not fit in the interpreter.",
+                      instruction_count);
+        return BAL_ERROR_INSTRUCTION_OVERFLOW;
+    }
+
+    if (false == bal_interpreter_fits(interpreter, engine))
+    {
+        flush(interpreter);
+    }
+
+    // Walk backwards to find the values read by instructions that are kept,
+    // then give each of them a slot after the constants.
+    //
+    uint32_t *BAL_RESTRICT slots = (uint32_t *)engine->scratch;
+    (void)memset(slots, 0xFF, (size_t)instruction_count * sizeof(uint32_t));
+
+    for (uint32_t i = instruction_count; i-- > 0;)
+    {
+        if (is_dead(bal_ir_get(engine, i), slots[i]))
+        {
+            continue;
+        }
+
+        uint32_t sources[3];
+        uint32_t count = bal_ir_variable_sources(bal_ir_get(engine, i), sources);
+
+        for (uint32_t j = 0; j < count; ++j)
+        {
+            slots[sources[j]] = SLOT_USED;
+        }
+    }
+
+    bal_interpreter_instruction_t *BAL_RESTRICT decoded
+        = interpreter->instructions + interpreter->instruction_count;
+    uint64_t *BAL_RESTRICT values = interpreter->values + interpreter->value_count;
+
+    (void)memcpy(values, engine->constants, (size_t)constant_count * sizeof(uint64_t));
+
+    uint32_t decoded_count = 0;
+    uint32_t value_count   = constant_count;
+    bool     terminated    = false;
+
+    for (uint32_t i = 0; i < instruction_count; ++i)
+    {
+        const bal_ir_instruction_t instruction = bal_ir_get(engine, i);
+        const bal_opcode_t         opcode      = bal_ir_opcode(instruction);
+
+        if (is_dead(instruction, slots[i]))
+        {
+            continue;
+        }
+
+        if (BAL_UNLIKELY(terminated))
+        {
+            BAL_LOG_ERROR(&interpreter->logger, "Instruction v%u follows the unit terminator.", i);
+            return BAL_ERROR_ENGINE_STATE_INVALID;
+        }
+
+        const uint32_t            modifier = bal_ir_modifier_of(instruction);
+        bal_interpreter_handler_t handler  = handler_for(opcode, modifier);
+
+        if (BAL_UNLIKELY(NULL == handler))
+        {
+            BAL_LOG_ERROR(
+                &interpreter->logger, "No interpreter handler for opcode %u (v%u).", opcode, i);
+            return BAL_ERROR_UNSUPPORTED_OPCODE;
+        }
+
+        const uint32_t sources[3] = { bal_ir_source1(instruction),
+                                      bal_ir_source2(instruction),
+                                      bal_ir_source3(instruction) };
+
+        if (BAL_UNLIKELY((OPCODE_GET_REGISTER == opcode || OPCODE_SET_REGISTER == opcode)
+                         && sources[0] >= BAL_GUEST_REGISTER_COUNT))
+        {
+            BAL_LOG_ERROR(
+                &interpreter->logger, "Guest register %u out of range (v%u).", sources[0], i);
+            return BAL_ERROR_ENGINE_STATE_INVALID;
+        }
+
+        if (BAL_UNLIKELY(false == bal_ir_modifier_is_valid(modifier)))
+        {
+            BAL_LOG_ERROR(
+                &interpreter->logger, "Invalid operand modifier 0x%x (v%u).", modifier, i);
+            return BAL_ERROR_ENGINE_STATE_INVALID;
+        }
+
+        if (BAL_UNLIKELY(bal_ir_is_vector(opcode) && false == bal_ir_vector_is_valid(instruction)))
+        {
+            BAL_LOG_ERROR(&interpreter->logger, "Invalid vector operation (v%u).", i);
+            return BAL_ERROR_ENGINE_STATE_INVALID;
+        }
+
+        const bool is_atomic   = bal_ir_is_atomic(opcode);
+        uint32_t   access_size = 0;
+        uint32_t   immediate   = modifier;
+
+        if (OPCODE_LOAD == opcode || OPCODE_STORE == opcode)
+        {
+            access_size = bal_ir_access_size(instruction);
+            immediate   = (uint32_t)bal_ir_access_offset(instruction);
+        }
+        else if (is_atomic)
+        {
+            access_size = engine->ssa_bit_widths[i] / 8U;
+            immediate   = access_size;
+        }
+
+        if (BAL_UNLIKELY((OPCODE_LOAD == opcode || OPCODE_STORE == opcode || is_atomic)
+                         && access_size != 1 && access_size != 2 && access_size != 4
+                         && access_size != 8))
+        {
+            BAL_LOG_ERROR(&interpreter->logger, "Invalid access size %u (v%u).", access_size, i);
+            return BAL_ERROR_ENGINE_STATE_INVALID;
+        }
+
+        uint32_t                                    operands[3];
+        bal_interpreter_instruction_t *BAL_RESTRICT entry = &decoded[decoded_count++];
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            if (bal_ir_is_constant(sources[j]))
+            {
+                operands[j] = sources[j] & ~BAL_DECODED_CONSTANT_BIT;
+            }
+            else if (bal_ir_is_variable(sources[j]) && sources[j] < i)
+            {
+                operands[j] = slots[sources[j]];
+            }
+            else
+            {
+                operands[j] = 0;
+            }
+        }
+
+        entry->handler     = handler;
+        entry->destination = 0;
+        entry->immediate   = immediate;
+        entry->operands[0] = operands[0];
+        entry->operands[1] = operands[1];
+
+        if (OPCODE_GET_REGISTER == opcode || OPCODE_CMP_COND == opcode)
+        {
+            entry->operands[0] = sources[0];
+        }
+        else if (OPCODE_SET_REGISTER == opcode)
+        {
+            entry->destination = sources[0];
+        }
+        else if (OPCODE_BRANCH_ZERO == opcode || OPCODE_BRANCH_NOT_ZERO == opcode)
+        {
+            entry->destination = operands[2];
+        }
+        else if (OPCODE_LOAD == opcode)
+        {
+            entry->operands[1] = access_size;
+        }
+        else if (OPCODE_STORE == opcode)
+        {
+            entry->destination = access_size;
+        }
+        else if (OPCODE_ATOMIC_COMPARE_SWAP == opcode)
+        {
+            entry->handler   = compare_swap_handler(access_size);
+            entry->immediate = operands[2];
+        }
+        else if (bal_ir_is_vector(opcode))
+        {
+            // Vector operations write the guest vector registers, so the
+            // destination holds the opcode for the shared handler instead.
+            //
+            entry->destination = opcode;
+            entry->immediate   = bal_ir_source3(instruction);
+
+            if (opcode != OPCODE_VECTOR_DUPLICATE_SCALAR)
+            {
+                entry->operands[0] = sources[0];
+                entry->operands[1] = sources[1];
+            }
+        }
+
+        if (bal_ir_defines_value(opcode))
+        {
+            slots[i]           = value_count++;
+            entry->destination = slots[i];
+        }
+
+        terminated = (OPCODE_JUMP == opcode || OPCODE_CALL == opcode || OPCODE_RETURN == opcode
+                      || OPCODE_BRANCH_ZERO == opcode || OPCODE_BRANCH_NOT_ZERO == opcode);
+    }
+
+    if (BAL_UNLIKELY(false == terminated))
+    {
+        BAL_LOG_ERROR(&interpreter->logger, "Unit does not end with a terminator.");
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    bal_interpreter_unit_t *entry = &interpreter->units[unit_index(interpreter,
+                                                                   engine->guest_address)];
+
+    bal_interpreter_evict(interpreter, entry);
+
+    entry->guest_address     = engine->guest_address;
+    entry->guest_size        = engine->unit_exit.guest_size;
+    entry->first_instruction = interpreter->instruction_count;
+    entry->first_value       = interpreter->value_count;
+    entry->constant_count    = constant_count;
+    entry->value_count       = value_count;
+    entry->counter           = counter;
+
+    interpreter->instruction_count += decoded_count;
+    interpreter->value_count += constant_count;
+
+    if (interpreter->code_pages != NULL)
+    {
+        bal_code_pages_add(interpreter->code_pages, entry->guest_address, entry->guest_size);
+    }
+
+    BAL_LOG_DEBUG(&interpreter->logger,
+                  "Decoded unit 0x%llx. Instructions: %u, Values: %u.",
+                  (unsigned long long)entry->guest_address,
+                  decoded_count,
+                  value_count);
+
+    *unit = entry;
+    return BAL_SUCCESS;
+}
+
+bool
+bal_interpreter_fits(const bal_interpreter_t *interpreter, const bal_engine_t *engine)
+{
+    return engine->instruction_count
+               <= interpreter->instruction_capacity - interpreter->instruction_count
+           && engine->constant_count <= interpreter->value_capacity - interpreter->value_count;
+}
+
+bal_guest_address_t
+bal_interpreter_run(const bal_interpreter_t      *interpreter,
+                    const bal_interpreter_unit_t *unit,
+                    bal_vcpu_t                   *vcpu,
+                    uint64_t                     *values)
+{
+    bal_interpreter_frame_t frame = {
+        .values = values,
+        .vcpu   = vcpu,
+        .target = unit->guest_address,
+    };
+
+    (void)memcpy(values,
+                 interpreter->values + unit->first_value,
+                 (size_t)unit->constant_count * sizeof(uint64_t));
+
+    instruction_t *instruction = interpreter->instructions + unit->first_instruction;
+
+    do
+    {
+        instruction = instruction->handler(instruction, &frame);
+    } while (instruction != NULL);
+
+    return frame.target;
+}
+
+void
+bal_interpreter_evict(bal_interpreter_t *interpreter, bal_interpreter_unit_t *unit)
+{
+    if (0 == unit->guest_size)
+    {
+        return;
+    }
+
+    if (interpreter->code_pages != NULL)
+    {
+        bal_code_pages_remove(interpreter->code_pages, unit->guest_address, unit->guest_size);
+    }
+
+    unit->guest_size = 0;
+}
+
+void
+bal_interpreter_invalidate(bal_interpreter_t  *interpreter,
+                           bal_guest_address_t guest_address,
+                           size_t              size)
+{
+    for (uint32_t i = 0; i <= interpreter->unit_mask; ++i)
+    {
+        bal_interpreter_unit_t *unit = &interpreter->units[i];
+
+        if (0 == unit->guest_size)
+        {
+            continue;
+        }
+
+        bal_guest_address_t begin = unit->guest_address;
+        bal_guest_address_t end   = begin + unit->guest_size;
+
+        if (end > guest_address && begin < guest_address + size)
+        {
+            bal_interpreter_evict(interpreter, unit);
+        }
+    }
+}
+
+void
+bal_interpreter_destroy(bal_allocator_t *allocator, bal_interpreter_t *interpreter)
+{
+    if (NULL == allocator || NULL == interpreter)
+    {
+        return;
+    }
+
+    if (interpreter->units != NULL)
+    {
+        allocator->free(allocator->handle,
+                        interpreter->units,
+                        ((size_t)interpreter->unit_mask + 1) * sizeof(bal_interpreter_unit_t));
+        interpreter->units = NULL;
+    }
+
+    if (interpreter->instructions != NULL)
+    {
+        allocator->free(allocator->handle,
+                        interpreter->instructions,
+                        (size_t)interpreter->instruction_capacity
+                            * sizeof(bal_interpreter_instruction_t));
+        interpreter->instructions = NULL;
+    }
+
+    if (interpreter->values != NULL)
+    {
+        allocator->free(allocator->handle,
+                        interpreter->values,
+                        (size_t)interpreter->value_capacity * sizeof(uint64_t));
+        interpreter->values = NULL;
+    }
+}
+
+/// Hashes the word address like the translation cache does.
+static inline uint32_t
+unit_index(const bal_interpreter_t *interpreter, bal_guest_address_t guest_address)
+{
+    uint64_t hash = (guest_address >> 2) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(hash >> 32) & interpreter->unit_mask;
+}
+
+/// Discards every unit and empties both arenas.
+static void
+flush(bal_interpreter_t *interpreter)
+{
+    for (uint32_t i = 0; i <= interpreter->unit_mask; ++i)
+    {
+        bal_interpreter_evict(interpreter, &interpreter->units[i]);
+    }
+
+    (void)memset(interpreter->units,
+                 0,
+                 ((size_t)interpreter->unit_mask + 1) * sizeof(bal_interpreter_unit_t));
+    interpreter->instruction_count = 0;
+    interpreter->value_count       = 0;
+    interpreter->flushes++;
+
+    BAL_LOG_DEBUG(&interpreter->logger, "Interpreter arenas full. Discarded every unit.");
+}
+
+/// Returns `true` if `instruction`, whose value has `slot`, can be dropped.
+static inline bool
+is_dead(bal_ir_instruction_t instruction, uint32_t slot)
+{
+    const bal_opcode_t opcode = bal_ir_opcode(instruction);
+
+    return OPCODE_NOP == opcode
+           || (SLOT_UNUSED == slot
+               && (bal_ir_is_side_effect_free(opcode) || OPCODE_GET_REGISTER == opcode));
+}
+
+static bal_interpreter_handler_t
+handler_for(bal_opcode_t opcode, uint32_t modifier)
+{
+    if (modifier != 0)
+    {
+        switch (opcode)
+        {
+            case OPCODE_ADD:
+                return handle_add_modified;
+            case OPCODE_SUB:
+                return handle_sub_modified;
+            case OPCODE_AND:
+                return handle_and_modified;
+            case OPCODE_OR:
+                return handle_or_modified;
+            case OPCODE_XOR:
+                return handle_xor_modified;
+            default:
+                return NULL;
+        }
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_GET_REGISTER:
+            return handle_get_register;
+        case OPCODE_SET_REGISTER:
+            return handle_set_register;
+        case OPCODE_CONST:
+        case OPCODE_MOV:
+            return handle_move;
+        case OPCODE_ADD:
+            return handle_add;
+        case OPCODE_SUB:
+            return handle_sub;
+        case OPCODE_AND:
+            return handle_and;
+        case OPCODE_OR:
+            return handle_or;
+        case OPCODE_XOR:
+            return handle_xor;
+        case OPCODE_LOAD:
+            return handle_load;
+        case OPCODE_STORE:
+            return handle_store;
+        case OPCODE_LOAD_EXCLUSIVE:
+            return handle_load_exclusive;
+        case OPCODE_STORE_EXCLUSIVE:
+            return handle_store_exclusive;
+        case OPCODE_ATOMIC_ADD:
+            return handle_atomic_add;
+        case OPCODE_ATOMIC_SWAP:
+            return handle_atomic_swap;
+        case OPCODE_ATOMIC_COMPARE_SWAP:
+            return handle_compare_swap_64;
+        case OPCODE_VECTOR_DUPLICATE_SCALAR:
+            return handle_vector_duplicate_scalar;
+        case OPCODE_JUMP:
+            return handle_jump;
+        case OPCODE_CALL:
+            return handle_call;
+        case OPCODE_RETURN:
+            return handle_return;
+        case OPCODE_CMP_COND:
+            return handle_compare_condition;
+        case OPCODE_BRANCH_ZERO:
+            return handle_branch_zero;
+        case OPCODE_BRANCH_NOT_ZERO:
+            return handle_branch_not_zero;
+        default:
+            return bal_ir_is_vector(opcode) ? handle_vector : NULL;
+    }
+}
+
+/// Returns the `OPCODE_ATOMIC_COMPARE_SWAP` handler for `size` bytes, one
+/// of 1, 2, 4 or 8.
+static bal_interpreter_handler_t
+compare_swap_handler(uint32_t size)
+{
+    switch (size)
+    {
+        case 1:
+            return handle_compare_swap_8;
+        case 2:
+            return handle_compare_swap_16;
+        case 4:
+            return handle_compare_swap_32;
+        default:
+            return handle_compare_swap_64;
+    }
+}
+
+static instruction_t *
+handle_get_register(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    frame->values[instruction->destination]
+        = *bal_guest_state_register(&frame->vcpu->state, instruction->operands[0]);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_set_register(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    *bal_guest_state_register(&frame->vcpu->state, instruction->destination)
+        = frame->values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_move(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    frame->values[instruction->destination] = frame->values[instruction->operands[0]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_add(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    values[instruction->destination]
+        = values[instruction->operands[0]] + values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_sub(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    values[instruction->destination]
+        = values[instruction->operands[0]] - values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_and(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    values[instruction->destination]
+        = values[instruction->operands[0]] & values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_or(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    values[instruction->destination]
+        = values[instruction->operands[0]] | values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_xor(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    values[instruction->destination]
+        = values[instruction->operands[0]] ^ values[instruction->operands[1]];
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_add_modified(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint32_t modifier = instruction->immediate;
+    uint64_t      *values   = frame->values;
+    uint64_t       operand  = bal_ir_apply_modifier(values[instruction->operands[1]], modifier);
+    values[instruction->destination]
+        = bal_ir_apply_width(values[instruction->operands[0]] + operand, modifier);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_sub_modified(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint32_t modifier = instruction->immediate;
+    uint64_t      *values   = frame->values;
+    uint64_t       operand  = bal_ir_apply_modifier(values[instruction->operands[1]], modifier);
+    values[instruction->destination]
+        = bal_ir_apply_width(values[instruction->operands[0]] - operand, modifier);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_and_modified(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint32_t modifier = instruction->immediate;
+    uint64_t      *values   = frame->values;
+    uint64_t       operand  = bal_ir_apply_modifier(values[instruction->operands[1]], modifier);
+    values[instruction->destination]
+        = bal_ir_apply_width(values[instruction->operands[0]] & operand, modifier);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_or_modified(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint32_t modifier = instruction->immediate;
+    uint64_t      *values   = frame->values;
+    uint64_t       operand  = bal_ir_apply_modifier(values[instruction->operands[1]], modifier);
+    values[instruction->destination]
+        = bal_ir_apply_width(values[instruction->operands[0]] | operand, modifier);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_xor_modified(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint32_t modifier = instruction->immediate;
+    uint64_t      *values   = frame->values;
+    uint64_t       operand  = bal_ir_apply_modifier(values[instruction->operands[1]], modifier);
+    values[instruction->destination]
+        = bal_ir_apply_width(values[instruction->operands[0]] ^ operand, modifier);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_load(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_tlb_t *tlb     = &frame->vcpu->tlb;
+    uint64_t   address = frame->values[instruction->operands[0]]
+                       + (uint64_t)(int64_t)(int32_t)instruction->immediate;
+    frame->values[instruction->destination] = bal_tlb_load(tlb, address, instruction->operands[1]);
+    return BAL_UNLIKELY(tlb->fault != 0) ? NULL : instruction + 1;
+}
+
+static instruction_t *
+handle_store(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_tlb_t *tlb     = &frame->vcpu->tlb;
+    uint64_t   address = frame->values[instruction->operands[0]]
+                       + (uint64_t)(int64_t)(int32_t)instruction->immediate;
+    bal_tlb_store(tlb, address, frame->values[instruction->operands[1]], instruction->destination);
+    return BAL_UNLIKELY(tlb->fault != 0) ? NULL : instruction + 1;
+}
+
+static instruction_t *
+handle_load_exclusive(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_vcpu_t *vcpu    = frame->vcpu;
+    uint64_t    address = frame->values[instruction->operands[0]];
+    uint64_t    value   = bal_tlb_load(&vcpu->tlb, address, instruction->immediate);
+
+    if (BAL_UNLIKELY(vcpu->tlb.fault != 0))
+    {
+        return NULL;
+    }
+
+    vcpu->monitor.address                   = address;
+    vcpu->monitor.value                     = value;
+    frame->values[instruction->destination] = value;
+    return instruction + 1;
+}
+
+/// Translates the address before checking the monitor, so a store exclusive
+/// to unmapped memory faults whether it would succeed or not, like compiled
+/// code.
+static instruction_t *
+handle_store_exclusive(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_vcpu_t *vcpu    = frame->vcpu;
+    uint64_t    address = frame->values[instruction->operands[0]];
+    uint64_t    size    = instruction->immediate;
+    uint8_t    *host    = bal_tlb_atomic(&vcpu->tlb, address, size);
+    uint64_t    status  = 1;
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        return NULL;
+    }
+
+    if (vcpu->monitor.address == address)
+    {
+        uint64_t expected = vcpu->monitor.value;
+        uint64_t value    = frame->values[instruction->operands[1]];
+        status = (bal_atomic_compare_swap(host, expected, value, size) == expected) ? 0U : 1U;
+    }
+
+    bal_vcpu_clear_exclusive_monitor(vcpu);
+    frame->values[instruction->destination] = status;
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_atomic_add(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint64_t size    = instruction->immediate;
+    uint64_t      *values  = frame->values;
+    uint64_t       address = values[instruction->operands[0]];
+    uint8_t       *host    = bal_tlb_atomic(&frame->vcpu->tlb, address, size);
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        return NULL;
+    }
+
+    uint64_t value                   = values[instruction->operands[1]];
+    values[instruction->destination] = bal_atomic_fetch_add(host, value, size);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_atomic_swap(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    const uint64_t size    = instruction->immediate;
+    uint64_t      *values  = frame->values;
+    uint64_t       address = values[instruction->operands[0]];
+    uint8_t       *host    = bal_tlb_atomic(&frame->vcpu->tlb, address, size);
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        return NULL;
+    }
+
+    uint64_t value                   = values[instruction->operands[1]];
+    values[instruction->destination] = bal_atomic_exchange(host, value, size);
+    return instruction + 1;
+}
+
+/// Compares memory with `operands[1]` and writes the value in the slot held
+/// by `immediate`.
+static inline instruction_t *
+compare_swap(instruction_t *instruction, bal_interpreter_frame_t *frame, uint64_t size)
+{
+    uint64_t *values = frame->values;
+    uint8_t  *host   = bal_tlb_atomic(&frame->vcpu->tlb, values[instruction->operands[0]], size);
+
+    if (BAL_UNLIKELY(NULL == host))
+    {
+        return NULL;
+    }
+
+    values[instruction->destination] = bal_atomic_compare_swap(
+        host, values[instruction->operands[1]], values[instruction->immediate], size);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_compare_swap_8(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    return compare_swap(instruction, frame, 1);
+}
+
+static instruction_t *
+handle_compare_swap_16(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    return compare_swap(instruction, frame, 2);
+}
+
+static instruction_t *
+handle_compare_swap_32(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    return compare_swap(instruction, frame, 4);
+}
+
+static instruction_t *
+handle_compare_swap_64(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    return compare_swap(instruction, frame, 8);
+}
+
+static instruction_t *
+handle_vector(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_vector_execute(frame->vcpu->state.vectors,
+                       (bal_opcode_t)instruction->destination,
+                       instruction->operands[0],
+                       instruction->operands[1],
+                       instruction->immediate,
+                       0);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_vector_duplicate_scalar(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_vector_execute(frame->vcpu->state.vectors,
+                       OPCODE_VECTOR_DUPLICATE_SCALAR,
+                       0,
+                       0,
+                       instruction->immediate,
+                       frame->values[instruction->operands[1]]);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_jump(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    frame->target = frame->values[instruction->operands[0]];
+    return NULL;
+}
+
+/// Pushes the return address like compiled code does, but without host code
+/// so the entry never predicts.
+static instruction_t *
+handle_call(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_return_stack_t *stack = &frame->vcpu->return_stack;
+    uint64_t            mask  = BAL_RETURN_STACK_SIZE * sizeof(bal_return_stack_entry_t) - 1U;
+
+    stack->top = (stack->top + sizeof(bal_return_stack_entry_t)) & mask;
+
+    bal_return_stack_entry_t *entry = &stack->entries[stack->top / sizeof(*entry)];
+    entry->guest_address            = frame->values[instruction->operands[1]];
+    entry->host_code                = NULL;
+
+    frame->target = frame->values[instruction->operands[0]];
+    return NULL;
+}
+
+static instruction_t *
+handle_return(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    bal_return_stack_t *stack = &frame->vcpu->return_stack;
+    uint64_t            mask  = BAL_RETURN_STACK_SIZE * sizeof(bal_return_stack_entry_t) - 1U;
+
+    stack->top    = (stack->top - sizeof(bal_return_stack_entry_t)) & mask;
+    frame->target = frame->values[instruction->operands[0]];
+    return NULL;
+}
+
+static instruction_t *
+handle_compare_condition(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    frame->values[instruction->destination]
+        = bal_guest_state_condition_holds(&frame->vcpu->state, instruction->operands[0]);
+    return instruction + 1;
+}
+
+static instruction_t *
+handle_branch_zero(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    frame->target    = values[(0 == values[instruction->operands[0]]) ? instruction->operands[1]
+                                                                      : instruction->destination];
+    return NULL;
+}
+
+static instruction_t *
+handle_branch_not_zero(instruction_t *instruction, bal_interpreter_frame_t *frame)
+{
+    uint64_t *values = frame->values;
+    frame->target    = values[(values[instruction->operands[0]] != 0) ? instruction->operands[1]
+                                                                      : instruction->destination];
+    return NULL;
+}
+
+/*** end of file ***/
@@ -0,0 +1,657 @@
+/** @file bal_ir.h
+ *
+ * @brief Internal helpers for encoding and decoding IR instructions.
+ */
+
+#ifndef BALLISTIC_IR_H
+#define BALLISTIC_IR_H
+
+#include "bal_attributes.h"
+#include "bal_engine.h"
+#include "bal_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Operand modifiers fold the shifted, extended and inverted second operands
+/// of ARM data processing instructions into the `src3` of the ALU opcode that
+/// uses them, along with the width of the operation:
+///
+/// 16  13   12     11     10    08 07   06 05      00
+/// |----| |----| |------| |------| |------| |--------|
+///  zero   is32   invert   extend   shift    amount
+///
+/// `src2` is truncated to 32 bits if `is32` is set, then extended, shifted
+/// within the operation width and inverted. The result of a 32-bit operation
+/// is zero extended. Modifier 0 leaves `src2` and the result untouched, and
+/// so does [`BAL_SOURCE_NONE`].
+
+/// The mask of the shift amount of an operand modifier.
+#define BAL_IR_MODIFIER_AMOUNT_MASK 0x3FU
+
+/// The least significant bit of the shift kind of an operand modifier.
+#define BAL_IR_MODIFIER_SHIFT_POSITION 6U
+
+/// The least significant bit of the extension of an operand modifier.
+#define BAL_IR_MODIFIER_EXTEND_POSITION 8U
+
+/// Inverts the operand after shifting it, as `BIC`, `ORN` and `EON` do.
+#define BAL_IR_MODIFIER_INVERT (1U << 11U)
+
+/// Makes the operation 32 bits wide.
+#define BAL_IR_MODIFIER_32 (1U << 12U)
+
+/// Every bit an operand modifier may set.
+#define BAL_IR_MODIFIER_MASK ((1U << 13U) - 1U)
+
+/// The shift of an operand modifier, in the order of the ARM `shift` field.
+typedef enum
+{
+    BAL_IR_SHIFT_LSL,
+    BAL_IR_SHIFT_LSR,
+    BAL_IR_SHIFT_ASR,
+    BAL_IR_SHIFT_ROR,
+} bal_ir_shift_t;
+
+/// The extension of an operand modifier, applied before the shift.
+typedef enum
+{
+    BAL_IR_EXTEND_NONE,
+    BAL_IR_EXTEND_UXTB,
+    BAL_IR_EXTEND_UXTH,
+    BAL_IR_EXTEND_UXTW,
+    BAL_IR_EXTEND_SXTB,
+    BAL_IR_EXTEND_SXTH,
+    BAL_IR_EXTEND_SXTW,
+} bal_ir_extend_t;
+
+/// Packs an operand modifier. `amount` must be less than the operation
+/// width.
+static inline uint32_t
+bal_ir_modifier(
+    bal_ir_shift_t shift, uint32_t amount, bal_ir_extend_t extend, bool invert, bool is_32)
+{
+    return (amount & BAL_IR_MODIFIER_AMOUNT_MASK)
+           | ((uint32_t)shift << BAL_IR_MODIFIER_SHIFT_POSITION)
+           | ((uint32_t)extend << BAL_IR_MODIFIER_EXTEND_POSITION)
+           | (invert ? BAL_IR_MODIFIER_INVERT : 0U) | (is_32 ? BAL_IR_MODIFIER_32 : 0U);
+}
+
+/// Returns the shift of the operand modifier `modifier`.
+static inline bal_ir_shift_t
+bal_ir_modifier_shift(uint32_t modifier)
+{
+    return (bal_ir_shift_t)((modifier >> BAL_IR_MODIFIER_SHIFT_POSITION) & 3U);
+}
+
+/// Returns the extension of the operand modifier `modifier`.
+static inline bal_ir_extend_t
+bal_ir_modifier_extend(uint32_t modifier)
+{
+    return (bal_ir_extend_t)((modifier >> BAL_IR_MODIFIER_EXTEND_POSITION) & 7U);
+}
+
+/// An IR instruction as passes and backends read it: the stored word and,
+/// in a wide unit, its entry in `source_extensions`, which is 0 otherwise.
+typedef struct
+{
+    bal_instruction_t word;
+    uint64_t          extension;
+} bal_ir_instruction_t;
+
+/// Returns the source bitfield of the decoded source `source`.
+static inline uint64_t
+bal_ir_source_field(uint32_t source)
+{
+    if (BAL_SOURCE_NONE == source)
+    {
+        return BAL_SOURCE_MASK_WITH_FLAG;
+    }
+
+    return (source & BAL_SOURCE_MASK)
+           | ((source & BAL_DECODED_CONSTANT_BIT) != 0 ? BAL_IS_CONSTANT_BIT_POSITION : 0U);
+}
+
+/// Returns the high index bits of the decoded source `source`.
+static inline uint64_t
+bal_ir_source_extension(uint32_t source)
+{
+    if (BAL_SOURCE_NONE == source)
+    {
+        return 0;
+    }
+
+    return (source >> 16U) & BAL_SOURCE_EXTENSION_MASK;
+}
+
+/// Returns the decoded source of the bitfield `field` and its high index
+/// bits `extension`.
+static inline uint32_t
+bal_ir_source_decode(uint64_t field, uint64_t extension)
+{
+    field &= BAL_SOURCE_MASK_WITH_FLAG;
+    extension &= BAL_SOURCE_EXTENSION_MASK;
+
+    if (BAL_SOURCE_MASK_WITH_FLAG == field && 0 == extension)
+    {
+        return BAL_SOURCE_NONE;
+    }
+
+    return (uint32_t)(field & BAL_SOURCE_MASK) | (uint32_t)(extension << 16U)
+           | ((field & BAL_IS_CONSTANT_BIT_POSITION) != 0 ? BAL_DECODED_CONSTANT_BIT : 0U);
+}
+
+/// Packs `opcode` and its three decoded sources into an instruction.
+static inline bal_ir_instruction_t
+bal_ir_encode(bal_opcode_t opcode, uint32_t source1, uint32_t source2, uint32_t source3)
+{
+    bal_ir_instruction_t instruction;
+
+    instruction.word = ((bal_instruction_t)opcode << BAL_OPCODE_SHIFT_POSITION)
+                       | (bal_ir_source_field(source1) << BAL_SOURCE1_SHIFT_POSITION)
+                       | (bal_ir_source_field(source2) << BAL_SOURCE2_SHIFT_POSITION)
+                       | bal_ir_source_field(source3);
+    instruction.extension
+        = (bal_ir_source_extension(source1) << BAL_SOURCE1_EXTENSION_POSITION)
+          | (bal_ir_source_extension(source2) << BAL_SOURCE2_EXTENSION_POSITION)
+          | bal_ir_source_extension(source3);
+
+    return instruction;
+}
+
+/// Returns instruction `index` of the current unit of `engine`.
+static inline bal_ir_instruction_t
+bal_ir_get(const bal_engine_t *engine, uint32_t index)
+{
+    bal_ir_instruction_t instruction = { engine->instructions[index], 0 };
+
+    if (engine->is_wide)
+    {
+        instruction.extension = engine->source_extensions[index];
+    }
+
+    return instruction;
+}
+
+/// Replaces instruction `index` of the current unit of `engine`. A narrow
+/// unit drops the high index bits, which it never has.
+static inline void
+bal_ir_set(bal_engine_t *engine, uint32_t index, bal_ir_instruction_t instruction)
+{
+    engine->instructions[index] = instruction.word;
+
+    if (engine->is_wide)
+    {
+        engine->source_extensions[index] = instruction.extension;
+    }
+}
+
+/// Returns the opcode of `instruction`.
+static inline bal_opcode_t
+bal_ir_opcode(bal_ir_instruction_t instruction)
+{
+    return (bal_opcode_t)((instruction.word >> BAL_OPCODE_SHIFT_POSITION)
+                          & (BAL_OPCODE_SIZE - 1U));
+}
+
+/// Returns the decoded `src1` of `instruction`, including the is constant flag.
+static inline uint32_t
+bal_ir_source1(bal_ir_instruction_t instruction)
+{
+    return bal_ir_source_decode(instruction.word >> BAL_SOURCE1_SHIFT_POSITION,
+                                instruction.extension >> BAL_SOURCE1_EXTENSION_POSITION);
+}
+
+/// Returns the decoded `src2` of `instruction`, including the is constant flag.
+static inline uint32_t
+bal_ir_source2(bal_ir_instruction_t instruction)
+{
+    return bal_ir_source_decode(instruction.word >> BAL_SOURCE2_SHIFT_POSITION,
+                                instruction.extension >> BAL_SOURCE2_EXTENSION_POSITION);
+}
+
+/// Returns the decoded `src3` of `instruction`, including the is constant flag.
+static inline uint32_t
+bal_ir_source3(bal_ir_instruction_t instruction)
+{
+    return bal_ir_source_decode(instruction.word, instruction.extension);
+}
+
+/// Returns `true` if `source` is an index into the constant pool.
+static inline bool
+bal_ir_is_constant(uint32_t source)
+{
+    return (source & BAL_DECODED_CONSTANT_BIT) != 0 && source != BAL_SOURCE_NONE;
+}
+
+/// Returns `true` if `source` refers to an SSA variable.
+static inline bool
+bal_ir_is_variable(uint32_t source)
+{
+    return (source & BAL_DECODED_CONSTANT_BIT) == 0;
+}
+
+/// Returns `true` if executing `opcode` unconditionally can not be observed
+/// outside of the compilation unit. Such instructions are safe to hoist out
+/// of a branch.
+static inline bool
+bal_ir_is_side_effect_free(bal_opcode_t opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_CONST:
+        case OPCODE_MOV:
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_XOR:
+        case OPCODE_OR:
+        case OPCODE_OR_NOT:
+        case OPCODE_SHIFT:
+        case OPCODE_CMP:
+        case OPCODE_CMP_COND:
+        case OPCODE_CONDITIONAL_SELECT:
+        case OPCODE_NOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// Returns `true` if the `src3` of `opcode` is an operand modifier.
+static inline bool
+bal_ir_takes_modifier(bal_opcode_t opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// Returns the operand modifier of `instruction`, 0 if it has none.
+static inline uint32_t
+bal_ir_modifier_of(bal_ir_instruction_t instruction)
+{
+    uint32_t modifier = bal_ir_source3(instruction);
+
+    if (false == bal_ir_takes_modifier(bal_ir_opcode(instruction)) || BAL_SOURCE_NONE == modifier)
+    {
+        return 0;
+    }
+
+    return modifier;
+}
+
+/// Returns `false` if `modifier` shifts by at least its operation width,
+/// names an unknown extension, or sets bits outside its fields.
+static inline bool
+bal_ir_modifier_is_valid(uint32_t modifier)
+{
+    uint32_t width = (modifier & BAL_IR_MODIFIER_32) != 0 ? 32U : 64U;
+
+    return (modifier & ~BAL_IR_MODIFIER_MASK) == 0
+           && (modifier & BAL_IR_MODIFIER_AMOUNT_MASK) < width
+           && bal_ir_modifier_extend(modifier) <= BAL_IR_EXTEND_SXTW;
+}
+
+/// Returns `value` as the operand modifier `modifier` transforms it. See
+/// [`bal_ir_modifier`].
+static inline uint64_t
+bal_ir_apply_modifier(uint64_t value, uint32_t modifier)
+{
+    const bool     is_32  = (modifier & BAL_IR_MODIFIER_32) != 0;
+    const uint32_t amount = modifier & BAL_IR_MODIFIER_AMOUNT_MASK;
+
+    if (is_32)
+    {
+        value &= 0xFFFFFFFFULL;
+    }
+
+    switch (bal_ir_modifier_extend(modifier))
+    {
+        case BAL_IR_EXTEND_UXTB:
+            value = (uint8_t)value;
+            break;
+        case BAL_IR_EXTEND_UXTH:
+            value = (uint16_t)value;
+            break;
+        case BAL_IR_EXTEND_UXTW:
+            value = (uint32_t)value;
+            break;
+        case BAL_IR_EXTEND_SXTB:
+            value = (uint64_t)(int64_t)(int8_t)value;
+            break;
+        case BAL_IR_EXTEND_SXTH:
+            value = (uint64_t)(int64_t)(int16_t)value;
+            break;
+        case BAL_IR_EXTEND_SXTW:
+            value = (uint64_t)(int64_t)(int32_t)value;
+            break;
+        default:
+            break;
+    }
+
+    switch (bal_ir_modifier_shift(modifier))
+    {
+        case BAL_IR_SHIFT_LSL:
+            value <<= amount;
+            break;
+        case BAL_IR_SHIFT_LSR:
+            value >>= amount;
+            break;
+        case BAL_IR_SHIFT_ASR:
+            value = is_32 ? (uint64_t)(int64_t)((int32_t)(uint32_t)value >> amount)
+                          : (uint64_t)((int64_t)value >> amount);
+            break;
+        case BAL_IR_SHIFT_ROR:
+            if (amount != 0)
+            {
+                value = is_32 ? (uint32_t)((value >> amount) | (value << (32U - amount)))
+                              : (value >> amount) | (value << (64U - amount));
+            }
+            break;
+    }
+
+    return (modifier & BAL_IR_MODIFIER_INVERT) != 0 ? ~value : value;
+}
+
+/// Returns `result` truncated to the width of the operation `modifier`
+/// belongs to.
+static inline uint64_t
+bal_ir_apply_width(uint64_t result, uint32_t modifier)
+{
+    return (modifier & BAL_IR_MODIFIER_32) != 0 ? (result & 0xFFFFFFFFULL) : result;
+}
+
+/// A raw access packs the size of an `OPCODE_LOAD` or `OPCODE_STORE` with
+/// a signed offset added to its address, in units of the size, so a base
+/// register plus an immediate stays a single IR instruction:
+///
+///   16    15      04 03  00
+/// |----| |-------| |----|
+///  zero   offset    size
+
+/// The mask of the size of a raw access.
+#define BAL_IR_ACCESS_SIZE_MASK 0xFU
+
+/// The least significant bit of the offset of a raw access.
+#define BAL_IR_ACCESS_OFFSET_POSITION 4U
+
+/// The offset of a raw access is in `[-BAL_IR_ACCESS_OFFSET_LIMIT,
+/// BAL_IR_ACCESS_OFFSET_LIMIT)` units of its size.
+#define BAL_IR_ACCESS_OFFSET_LIMIT 2048
+
+/// Returns `true` if `offset` bytes can be folded into a raw access of
+/// `size` bytes.
+static inline bool
+bal_ir_access_fits(uint32_t size, int64_t offset)
+{
+    return offset % (int64_t)size == 0 && offset / (int64_t)size >= -BAL_IR_ACCESS_OFFSET_LIMIT
+           && offset / (int64_t)size < BAL_IR_ACCESS_OFFSET_LIMIT;
+}
+
+/// Packs a raw access of `size` bytes at `offset` bytes from its address.
+/// `offset` must satisfy [`bal_ir_access_fits`].
+static inline uint32_t
+bal_ir_access(uint32_t size, int64_t offset)
+{
+    uint32_t units = (uint32_t)(offset / (int64_t)size) & ((2U * BAL_IR_ACCESS_OFFSET_LIMIT) - 1U);
+    return (units << BAL_IR_ACCESS_OFFSET_POSITION) | size;
+}
+
+/// Returns `true` if `opcode` is an atomic access. Those take their size
+/// from their bit width instead of a raw access.
+static inline bool
+bal_ir_is_atomic(bal_opcode_t opcode)
+{
+    return opcode >= OPCODE_LOAD_EXCLUSIVE && opcode <= OPCODE_ATOMIC_COMPARE_SWAP;
+}
+
+/// Returns the raw access of an `OPCODE_LOAD` or `OPCODE_STORE`.
+static inline uint32_t
+bal_ir_raw_access(bal_ir_instruction_t instruction)
+{
+    return (OPCODE_LOAD == bal_ir_opcode(instruction)) ? bal_ir_source2(instruction)
+                                                       : bal_ir_source3(instruction);
+}
+
+/// Returns the raw access size of an `OPCODE_LOAD` or `OPCODE_STORE`.
+/// Anything but 1, 2, 4 or 8 is invalid, including a raw access with its
+/// top bit set.
+static inline uint32_t
+bal_ir_access_size(bal_ir_instruction_t instruction)
+{
+    uint32_t access = bal_ir_raw_access(instruction);
+    return (access & BAL_DECODED_CONSTANT_BIT) != 0 ? 0U : access & BAL_IR_ACCESS_SIZE_MASK;
+}
+
+/// Returns the offset in bytes an `OPCODE_LOAD` or `OPCODE_STORE` adds to
+/// its address, 0 for an atomic access.
+static inline int64_t
+bal_ir_access_offset(bal_ir_instruction_t instruction)
+{
+    if (bal_ir_is_atomic(bal_ir_opcode(instruction)))
+    {
+        return 0;
+    }
+
+    uint32_t units = (bal_ir_raw_access(instruction) >> BAL_IR_ACCESS_OFFSET_POSITION)
+                     & ((2U * BAL_IR_ACCESS_OFFSET_LIMIT) - 1U);
+    int64_t  value = (int64_t)units;
+
+    if (value >= BAL_IR_ACCESS_OFFSET_LIMIT)
+    {
+        value -= 2 * BAL_IR_ACCESS_OFFSET_LIMIT;
+    }
+
+    return value * (int64_t)bal_ir_access_size(instruction);
+}
+
+/// A vector descriptor is the `src3` of a vector opcode. It names the
+/// destination register and the lane size, and whether the operation covers
+/// all 128 bits or only the low 64:
+///
+///   16   12 11       08 07    06 05 04 00
+/// |------| |---------| |----| |---| |--|
+///   zero    immediate   is128  size   vd
+///
+/// `size` is the log2 of the lane size in bytes. `immediate` is the byte
+/// index of `OPCODE_VECTOR_EXTRACT` and the lane index of
+/// `OPCODE_VECTOR_DUPLICATE`, and 0 otherwise.
+
+/// The least significant bit of the lane size of a vector descriptor.
+#define BAL_IR_VECTOR_SIZE_POSITION 5U
+
+/// Makes the vector operation cover all 128 bits.
+#define BAL_IR_VECTOR_128 (1U << 7U)
+
+/// The least significant bit of the immediate of a vector descriptor.
+#define BAL_IR_VECTOR_IMMEDIATE_POSITION 8U
+
+/// Every bit a vector descriptor may set.
+#define BAL_IR_VECTOR_MASK ((1U << 12U) - 1U)
+
+/// The width recorded in `ssa_bit_widths` for vector operations.
+#define BAL_IR_VECTOR_BIT_WIDTH 128U
+
+/// Packs a vector descriptor writing `vd` with lanes of `1 << size` bytes.
+static inline uint32_t
+bal_ir_vector(uint32_t vd, uint32_t size, bool is_128, uint32_t immediate)
+{
+    return (vd & 0x1FU) | ((size & 3U) << BAL_IR_VECTOR_SIZE_POSITION)
+           | (is_128 ? BAL_IR_VECTOR_128 : 0U)
+           | ((immediate & 0xFU) << BAL_IR_VECTOR_IMMEDIATE_POSITION);
+}
+
+/// Returns the destination register of the vector descriptor `descriptor`.
+static inline uint32_t
+bal_ir_vector_register(uint32_t descriptor)
+{
+    return descriptor & 0x1FU;
+}
+
+/// Returns the log2 of the lane size in bytes of `descriptor`.
+static inline uint32_t
+bal_ir_vector_size(uint32_t descriptor)
+{
+    return (descriptor >> BAL_IR_VECTOR_SIZE_POSITION) & 3U;
+}
+
+/// Returns `true` if `descriptor` covers all 128 bits.
+static inline bool
+bal_ir_vector_is_128(uint32_t descriptor)
+{
+    return (descriptor & BAL_IR_VECTOR_128) != 0;
+}
+
+/// Returns the immediate of `descriptor`.
+static inline uint32_t
+bal_ir_vector_immediate(uint32_t descriptor)
+{
+    return (descriptor >> BAL_IR_VECTOR_IMMEDIATE_POSITION) & 0xFU;
+}
+
+/// Returns `true` if `opcode` operates on the guest vector registers.
+static inline bool
+bal_ir_is_vector(bal_opcode_t opcode)
+{
+    return opcode >= OPCODE_VECTOR_ADD && opcode <= OPCODE_VECTOR_DUPLICATE_SCALAR;
+}
+
+/// Returns `false` if the vector instruction `instruction` names a register
+/// out of range, sets descriptor bits outside its fields, multiplies 64-bit
+/// lanes, zips the single 64-bit lane of a 64-bit operation, or has an
+/// immediate beyond its operands.
+static inline bool
+bal_ir_vector_is_valid(bal_ir_instruction_t instruction)
+{
+    const bal_opcode_t opcode     = bal_ir_opcode(instruction);
+    const uint32_t     descriptor = bal_ir_source3(instruction);
+    const uint32_t     size       = bal_ir_vector_size(descriptor);
+    const uint32_t     immediate  = bal_ir_vector_immediate(descriptor);
+    const uint32_t     bytes      = bal_ir_vector_is_128(descriptor) ? 16U : 8U;
+
+    if ((descriptor & ~BAL_IR_VECTOR_MASK) != 0)
+    {
+        return false;
+    }
+
+    if (OPCODE_VECTOR_DUPLICATE_SCALAR == opcode)
+    {
+        return 0 == immediate;
+    }
+
+    if (bal_ir_source1(instruction) >= 32U
+        || (OPCODE_VECTOR_DUPLICATE != opcode && bal_ir_source2(instruction) >= 32U))
+    {
+        return false;
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_VECTOR_MUL:
+            return 0 == immediate && size < 3U;
+        case OPCODE_VECTOR_ZIP_LOW:
+        case OPCODE_VECTOR_ZIP_HIGH:
+            return 0 == immediate && (2U << size) <= bytes;
+        case OPCODE_VECTOR_EXTRACT:
+            return immediate < bytes;
+        case OPCODE_VECTOR_DUPLICATE:
+            return immediate < (16U >> size);
+        default:
+            return 0 == immediate;
+    }
+}
+
+/// Writes the SSA indices `instruction` reads into `sources` and returns how
+/// many were written. Constants, unused operands and immediates like the
+/// guest register index of `OPCODE_GET_REGISTER`, the condition code of
+/// `OPCODE_CMP_COND`, operand modifiers or the vector register operands of
+/// vector opcodes are skipped.
+static inline uint32_t
+bal_ir_variable_sources(bal_ir_instruction_t instruction, uint32_t sources[3])
+{
+    const bal_opcode_t opcode = bal_ir_opcode(instruction);
+
+    if (OPCODE_GET_REGISTER == opcode || OPCODE_CMP_COND == opcode)
+    {
+        return 0;
+    }
+
+    if (bal_ir_is_vector(opcode))
+    {
+        const uint32_t scalar = bal_ir_source2(instruction);
+
+        if (OPCODE_VECTOR_DUPLICATE_SCALAR != opcode || false == bal_ir_is_variable(scalar))
+        {
+            return 0;
+        }
+
+        sources[0] = scalar;
+        return 1;
+    }
+
+    const uint32_t operands[3]
+        = { bal_ir_source1(instruction), bal_ir_source2(instruction), bal_ir_source3(instruction) };
+    uint32_t count = 0;
+    uint32_t first
+        = (OPCODE_SET_REGISTER == opcode || OPCODE_SET_REGISTER_ON_EXIT == opcode) ? 1U : 0U;
+    uint32_t end   = 3;
+
+    if (OPCODE_LOAD == opcode)
+    {
+        end = 1;
+    }
+    else if (OPCODE_STORE == opcode || bal_ir_takes_modifier(opcode))
+    {
+        end = 2;
+    }
+
+    for (uint32_t i = first; i < end; ++i)
+    {
+        if (bal_ir_is_variable(operands[i]))
+        {
+            sources[count++] = operands[i];
+        }
+    }
+
+    return count;
+}
+
+/// Returns `false` if the SSA variable defined by `opcode` is `TYPE_VOID`.
+static inline bool
+bal_ir_defines_value(bal_opcode_t opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_NOP:
+        case OPCODE_IF:
+        case OPCODE_ELSE:
+        case OPCODE_END_BLOCK:
+        case OPCODE_YIELD:
+        case OPCODE_STORE:
+        case OPCODE_JUMP:
+        case OPCODE_CALL:
+        case OPCODE_RETURN:
+        case OPCODE_BRANCH_ZERO:
+        case OPCODE_BRANCH_NOT_ZERO:
+        case OPCODE_TEST_BIT_ZERO:
+        case OPCODE_TRAP:
+        case OPCODE_SET_REGISTER:
+        case OPCODE_SET_REGISTER_ON_EXIT:
+            return false;
+        default:
+            return false == bal_ir_is_vector(opcode);
+    }
+}
+
+#endif /* BALLISTIC_IR_H */
+
+/*** end of file ***/
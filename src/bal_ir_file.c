@@ -0,0 +1,234 @@
+#include "bal_ir_file.h"
+#include "bal_file.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Helper macro to align `x` UP to `alignment`, which must be a power of two.
+#define ALIGN_UP(x, alignment) (((x) + ((alignment) - 1)) & ~((alignment) - 1))
+
+/// The most instructions or constants a unit can index, in the narrow and
+/// the wide form.
+#define MAX_NARROW_COUNT BAL_SOURCE_MASK
+#define MAX_WIDE_COUNT   BAL_SOURCE_INDEX_MASK
+
+static size_t file_size(size_t, size_t, bool);
+
+bal_error_t
+bal_ir_write(const bal_engine_t *engine, const char *path)
+{
+    if (NULL == engine || NULL == path)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    bal_logger_t logger = engine->logger;
+
+    if (engine->status != BAL_SUCCESS)
+    {
+        BAL_LOG_ERROR(&logger, "Refusing to write IR of a failed engine to %s.", path);
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    const bool   is_wide           = engine->is_wide;
+    const size_t instruction_count = engine->instruction_count;
+    const size_t constant_count    = engine->constant_count;
+    const size_t extension_count   = is_wide ? instruction_count : 0;
+    const size_t size              = file_size(instruction_count, constant_count, is_wide);
+
+    bal_ir_file_header_t header = {
+        .version              = BAL_IR_FILE_VERSION,
+        .instruction_count    = (uint32_t)instruction_count,
+        .constant_count       = (uint32_t)constant_count,
+        .exit_kind            = (uint32_t)engine->unit_exit.kind,
+        .exit_target_register = engine->unit_exit.target_register,
+        .flags                = is_wide ? BAL_IR_FILE_WIDE : 0U,
+        .guest_address        = engine->guest_address,
+        .exit_target          = engine->unit_exit.target,
+        .exit_return_address  = engine->unit_exit.return_address,
+        .exit_guest_size      = engine->unit_exit.guest_size,
+        .file_size            = size,
+    };
+    (void)memcpy(header.magic, BAL_IR_FILE_MAGIC, sizeof(header.magic));
+
+    FILE *file = fopen(path, "wb");
+
+    if (NULL == file)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to open %s for writing.", path);
+        return BAL_ERROR_FILE_IO;
+    }
+
+    static const uint8_t padding[8] = { 0 };
+    const size_t         widths_end = sizeof(header)
+                              + instruction_count * sizeof(bal_instruction_t)
+                              + extension_count * sizeof(uint64_t)
+                              + constant_count * sizeof(bal_constant_t)
+                              + instruction_count * sizeof(bal_bit_width_t);
+
+    bool written
+        = (1 == fwrite(&header, sizeof(header), 1, file))
+          && instruction_count
+                 == fwrite(engine->instructions, sizeof(bal_instruction_t), instruction_count, file)
+          && (0 == extension_count
+              || extension_count
+                     == fwrite(engine->source_extensions, sizeof(uint64_t), extension_count, file))
+          && constant_count
+                 == fwrite(engine->constants, sizeof(bal_constant_t), constant_count, file)
+          && instruction_count
+                 == fwrite(engine->ssa_bit_widths, sizeof(bal_bit_width_t), instruction_count, file)
+          && size - widths_end == fwrite(padding, 1, size - widths_end, file);
+
+    written = (0 == fclose(file)) && written;
+
+    if (false == written)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to write IR to %s.", path);
+        (void)remove(path);
+        return BAL_ERROR_FILE_IO;
+    }
+
+    BAL_LOG_DEBUG(&logger,
+                  "Wrote IR of 0x%llx to %s. Instructions: %zu, constants: %zu.",
+                  (unsigned long long)engine->guest_address,
+                  path,
+                  instruction_count,
+                  constant_count);
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_ir_map(bal_ir_mapping_t *mapping, const char *path, bal_logger_t logger)
+{
+    if (NULL == mapping || NULL == path)
+    {
+        BAL_LOG_ERROR(&logger, "IR map failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    (void)memset(mapping, 0, sizeof(*mapping));
+
+    const uint8_t *bytes = NULL;
+    size_t         size  = 0;
+
+    if (false == bal_file_map(path, &bytes, &size))
+    {
+        BAL_LOG_ERROR(&logger, "Failed to map IR file %s.", path);
+        return BAL_ERROR_FILE_IO;
+    }
+
+    const bal_ir_file_header_t *header = (const bal_ir_file_header_t *)(const void *)bytes;
+
+    bool     is_wide   = size >= sizeof(*header) && (header->flags & BAL_IR_FILE_WIDE) != 0;
+    uint32_t max_count = is_wide ? MAX_WIDE_COUNT : MAX_NARROW_COUNT;
+
+    if (size < sizeof(*header)
+        || memcmp(header->magic, BAL_IR_FILE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != BAL_IR_FILE_VERSION || header->file_size != size
+        || (header->flags & ~BAL_IR_FILE_WIDE) != 0 || header->instruction_count > max_count
+        || header->constant_count > max_count
+        || file_size(header->instruction_count, header->constant_count, is_wide) != size
+        || header->exit_kind > BAL_UNIT_EXIT_CONDITIONAL)
+    {
+        BAL_LOG_ERROR(&logger, "%s is not a valid IR file of this version.", path);
+        bal_file_unmap(bytes, size);
+        return BAL_ERROR_INVALID_FILE;
+    }
+
+    const size_t   extension_count = is_wide ? header->instruction_count : 0;
+    const uint8_t *instructions    = bytes + sizeof(*header);
+    const uint8_t *extensions
+        = instructions + header->instruction_count * sizeof(bal_instruction_t);
+    const uint8_t *constants      = extensions + extension_count * sizeof(uint64_t);
+    const uint8_t *ssa_bit_widths = constants + header->constant_count * sizeof(bal_constant_t);
+
+    mapping->mapping           = bytes;
+    mapping->mapping_size      = size;
+    mapping->instructions      = (const bal_instruction_t *)(const void *)instructions;
+    mapping->source_extensions = is_wide ? (const uint64_t *)(const void *)extensions : NULL;
+    mapping->constants         = (const bal_constant_t *)(const void *)constants;
+    mapping->ssa_bit_widths    = (const bal_bit_width_t *)ssa_bit_widths;
+    mapping->instruction_count = (bal_instruction_count_t)header->instruction_count;
+    mapping->constant_count    = (bal_constant_count_t)header->constant_count;
+    mapping->guest_address     = header->guest_address;
+    mapping->unit_exit         = (bal_unit_exit_t) {
+                .kind            = (bal_unit_exit_kind_t)header->exit_kind,
+                .target_register = header->exit_target_register,
+                .target          = header->exit_target,
+                .return_address  = header->exit_return_address,
+                .guest_size      = (size_t)header->exit_guest_size,
+    };
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_ir_load(bal_engine_t *engine, const bal_ir_mapping_t *mapping)
+{
+    if (NULL == engine || NULL == mapping)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    (void)bal_engine_reset(engine);
+
+    if (mapping->instruction_count > engine->instructions_size
+        || mapping->constant_count > engine->constants_size
+        || (mapping->source_extensions != NULL && NULL == engine->source_extensions))
+    {
+        BAL_LOG_ERROR(&engine->logger,
+                      "IR of 0x%llx does not fit in the engine.",
+                      (unsigned long long)mapping->guest_address);
+        engine->status = BAL_ERROR_INSTRUCTION_OVERFLOW;
+        return engine->status;
+    }
+
+    (void)memcpy(engine->instructions,
+                 mapping->instructions,
+                 mapping->instruction_count * sizeof(bal_instruction_t));
+
+    if (mapping->source_extensions != NULL)
+    {
+        (void)memcpy(engine->source_extensions,
+                     mapping->source_extensions,
+                     mapping->instruction_count * sizeof(uint64_t));
+    }
+    (void)memcpy(
+        engine->constants, mapping->constants, mapping->constant_count * sizeof(bal_constant_t));
+    (void)memcpy(engine->ssa_bit_widths,
+                 mapping->ssa_bit_widths,
+                 mapping->instruction_count * sizeof(bal_bit_width_t));
+
+    engine->instruction_count = mapping->instruction_count;
+    engine->constant_count    = mapping->constant_count;
+    engine->guest_address     = mapping->guest_address;
+    engine->is_wide           = (mapping->source_extensions != NULL);
+    engine->unit_exit         = mapping->unit_exit;
+    return BAL_SUCCESS;
+}
+
+void
+bal_ir_unmap(bal_ir_mapping_t *mapping)
+{
+    if (NULL == mapping)
+    {
+        return;
+    }
+
+    bal_file_unmap(mapping->mapping, mapping->mapping_size);
+    (void)memset(mapping, 0, sizeof(*mapping));
+}
+
+/// Returns the size of a file holding `instruction_count` instructions and
+/// `constant_count` constants, in the wide form if `is_wide` is set.
+static size_t
+file_size(size_t instruction_count, size_t constant_count, bool is_wide)
+{
+    size_t size = sizeof(bal_ir_file_header_t) + instruction_count * sizeof(bal_instruction_t)
+                  + (is_wide ? instruction_count * sizeof(uint64_t) : 0)
+                  + constant_count * sizeof(bal_constant_t)
+                  + instruction_count * sizeof(bal_bit_width_t);
+    return ALIGN_UP(size, (size_t)8U);
+}
+
+/*** end of file ***/
@@ -1,11 +1,44 @@
 #include "bal_memory.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+
+/// The number of tables a paged translation walks. The last level holds
+/// page entries, the others hold pointers to the tables of the next level.
+#define PAGED_LEVELS 4U
+
+/// The bits of a page entry holding its [`bal_memory_permission_t`]. The
+/// rest is the host address of the page, which is 16-byte aligned.
+#define PAGED_PERMISSION_MASK ((uintptr_t)15U)
+
+typedef struct paged_translation_interface_s paged_translation_interface_t;
 
 static void                  *default_allocate(bal_allocator_handle_t, size_t, size_t);
 static void                   default_free(bal_allocator_handle_t, void *, size_t);
 BAL_HOT static const uint8_t *bal_translate_flat(void *, bal_guest_address_t, size_t *);
+BAL_HOT static uint8_t       *bal_translate_write_flat(void *, bal_guest_address_t, size_t *);
+BAL_HOT static const uint8_t *bal_translate_paged(void *, bal_guest_address_t, size_t *);
+BAL_HOT static uint8_t       *bal_translate_write_paged(void *, bal_guest_address_t, size_t *);
+static uint8_t               *translate_paged(paged_translation_interface_t *,
+                                              bal_guest_address_t,
+                                              size_t *,
+                                              uintptr_t);
+static bal_error_t            check_paged_range(const bal_memory_interface_t *,
+                                                bal_guest_address_t,
+                                                size_t,
+                                                uint32_t);
+static uintptr_t             *find_leaf(const paged_translation_interface_t *, uint64_t);
+static uintptr_t             *make_leaf(paged_translation_interface_t *, uint64_t);
+static uint32_t              *leaf_runs(const paged_translation_interface_t *, uintptr_t *);
+static void                   update_runs(const paged_translation_interface_t *, uintptr_t *);
+static void                   free_empty_tables(paged_translation_interface_t *, uint64_t);
+static void                   free_tables(bal_allocator_t *,
+                                          const paged_translation_interface_t *,
+                                          void **,
+                                          uint32_t);
+static void                  *allocate_table(paged_translation_interface_t *, size_t);
 
 typedef struct
 {
@@ -17,6 +50,33 @@ typedef struct
 
 static_assert(0 == sizeof(flat_translation_interface_t) % 16, "Struct must be aligned to 16 bytes");
 
+struct paged_translation_interface_s
+{
+    /// Allocates the tables of pages mapped later.
+    bal_allocator_t allocator;
+
+    /// The table of the first level.
+    void **root;
+
+    size_t page_size;
+
+    /// log2 of `page_size`.
+    uint32_t page_shift;
+
+    /// The number of page number bits each level translates. Every table has
+    /// `1 << level_bits` entries.
+    uint32_t level_bits;
+
+    /// The size of the tables of every level but the last.
+    size_t table_size;
+
+    /// The size of the tables of the last level, the page entries followed
+    /// by their runs. See [`leaf_runs`].
+    size_t leaf_size;
+
+    bal_logger_t logger;
+};
+
 void
 bal_get_default_allocator(bal_allocator_t *out_allocator)
 {
@@ -68,11 +128,12 @@ bal_memory_init_flat(bal_allocator_t *BAL_RESTRICT        allocator,
         return BAL_ERROR_ALLOCATION_FAILED;
     }
 
-    flat_interface->host_base = (uint8_t *)buffer;
-    flat_interface->size      = size;
-    flat_interface->logger    = logger;
-    interface->context        = flat_interface;
-    interface->translate      = bal_translate_flat;
+    flat_interface->host_base  = (uint8_t *)buffer;
+    flat_interface->size       = size;
+    flat_interface->logger     = logger;
+    interface->context         = flat_interface;
+    interface->translate       = bal_translate_flat;
+    interface->translate_write = bal_translate_write_flat;
 
     BAL_LOG_INFO(&logger, "Flat interface created successfully at %p.", (void *)flat_interface);
 
@@ -183,4 +244,573 @@ bal_translate_flat(void *BAL_RESTRICT   interface,
     return host_address;
 }
 
+static uint8_t *
+bal_translate_write_flat(void *BAL_RESTRICT   interface,
+                         bal_guest_address_t  guest_address,
+                         size_t *BAL_RESTRICT max_writable_size)
+{
+    // The buffer is owned by the caller and always writable.
+    //
+    return (uint8_t *)(uintptr_t)bal_translate_flat(interface, guest_address, max_writable_size);
+}
+
+BAL_COLD bal_error_t
+bal_memory_init_paged(bal_allocator_t *BAL_RESTRICT        allocator,
+                      bal_memory_interface_t *BAL_RESTRICT interface,
+                      size_t                               page_size,
+                      bal_logger_t                         logger)
+{
+    if (NULL == allocator || NULL == interface || (page_size != 0x1000U && page_size != 0x10000U))
+    {
+        BAL_LOG_ERROR(
+            &logger, "Memory init failed. Invalid arguments (Page size: %zu).", page_size);
+
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    paged_translation_interface_t *paged_interface
+        = (paged_translation_interface_t *)allocator->allocate(
+            allocator->handle, 16U, sizeof(paged_translation_interface_t));
+
+    if (NULL == paged_interface)
+    {
+        BAL_LOG_ERROR(&logger,
+                      "Failed to allocate interface context (%zu bytes).",
+                      sizeof(paged_translation_interface_t));
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    // Every level translates the same number of bits: 9 for 4 KiB pages and
+    // 8 for 64 KiB pages.
+    //
+    uint32_t page_shift = (0x1000U == page_size) ? 12U : 16U;
+    uint32_t level_bits = (BAL_MEMORY_PAGED_ADDRESS_BITS - page_shift) / PAGED_LEVELS;
+    size_t   entries    = (size_t)1U << level_bits;
+
+    paged_interface->allocator  = *allocator;
+    paged_interface->page_size  = page_size;
+    paged_interface->page_shift = page_shift;
+    paged_interface->level_bits = level_bits;
+    paged_interface->table_size = entries * sizeof(void *);
+    paged_interface->leaf_size  = entries * (sizeof(uintptr_t) + sizeof(uint32_t));
+    paged_interface->logger     = logger;
+    paged_interface->root
+        = (void **)allocate_table(paged_interface, paged_interface->table_size);
+
+    if (NULL == paged_interface->root)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to allocate the root page table.");
+        allocator->free(allocator->handle, paged_interface, sizeof(paged_translation_interface_t));
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    interface->context         = paged_interface;
+    interface->translate       = bal_translate_paged;
+    interface->translate_write = bal_translate_write_paged;
+
+    BAL_LOG_INFO(&logger,
+                 "Paged interface created successfully at %p (Page size: %zu).",
+                 (void *)paged_interface,
+                 page_size);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_memory_map_paged(bal_memory_interface_t *interface,
+                     bal_guest_address_t     guest_address,
+                     void                   *host,
+                     size_t                  size,
+                     uint32_t                permissions)
+{
+    bal_error_t error = check_paged_range(interface, guest_address, size, permissions);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    paged_translation_interface_t *context = (paged_translation_interface_t *)interface->context;
+
+    if (NULL == host || ((uintptr_t)host & PAGED_PERMISSION_MASK) != 0)
+    {
+        BAL_LOG_ERROR(&context->logger, "Host memory %p is not 16-byte aligned.", host);
+        return (NULL == host) ? BAL_ERROR_INVALID_ARGUMENT : BAL_ERROR_MEMORY_ALIGNMENT;
+    }
+
+    uint64_t first   = guest_address >> context->page_shift;
+    uint64_t end     = first + (size >> context->page_shift);
+    uint64_t entries = (uint64_t)1U << context->level_bits;
+
+    // Every table is allocated before any page is mapped, so a failure
+    // leaves the mappings as they were.
+    //
+    for (uint64_t page = first; page < end; page = (page | (entries - 1U)) + 1U)
+    {
+        if (NULL == make_leaf(context, page))
+        {
+            BAL_LOG_ERROR(&context->logger,
+                          "Failed to allocate the page table of GVA 0x%llx.",
+                          (unsigned long long)(page << context->page_shift));
+            return BAL_ERROR_ALLOCATION_FAILED;
+        }
+    }
+
+    uintptr_t entry = (uintptr_t)host | permissions;
+
+    for (uint64_t page = first; page < end;)
+    {
+        uintptr_t *leaf  = find_leaf(context, page);
+        uint64_t   index = page & (entries - 1U);
+
+        for (; index < entries && page < end; ++index, ++page)
+        {
+            leaf[index] = entry;
+            entry += context->page_size;
+        }
+
+        update_runs(context, leaf);
+    }
+
+    BAL_LOG_DEBUG(&context->logger,
+                  "Mapped GVA 0x%llx-0x%llx -> Host %p (Permissions: %u).",
+                  (unsigned long long)guest_address,
+                  (unsigned long long)(guest_address + size),
+                  host,
+                  permissions);
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_memory_unmap_paged(bal_memory_interface_t *interface,
+                       bal_guest_address_t     guest_address,
+                       size_t                  size)
+{
+    bal_error_t error
+        = check_paged_range(interface, guest_address, size, BAL_MEMORY_PERMISSION_NONE);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    paged_translation_interface_t *context = (paged_translation_interface_t *)interface->context;
+
+    uint64_t first   = guest_address >> context->page_shift;
+    uint64_t end     = first + (size >> context->page_shift);
+    uint64_t entries = (uint64_t)1U << context->level_bits;
+
+    for (uint64_t page = first; page < end; page = (page | (entries - 1U)) + 1U)
+    {
+        uintptr_t *leaf = find_leaf(context, page);
+
+        if (NULL == leaf)
+        {
+            continue;
+        }
+
+        uint64_t begin = page & (entries - 1U);
+        uint64_t count = entries - begin;
+
+        if (count > end - page)
+        {
+            count = end - page;
+        }
+
+        (void)memset(leaf + begin, 0, (size_t)count * sizeof(uintptr_t));
+        update_runs(context, leaf);
+        free_empty_tables(context, page);
+    }
+
+    BAL_LOG_DEBUG(&context->logger,
+                  "Unmapped GVA 0x%llx-0x%llx.",
+                  (unsigned long long)guest_address,
+                  (unsigned long long)(guest_address + size));
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_memory_protect_paged(bal_memory_interface_t *interface,
+                         bal_guest_address_t     guest_address,
+                         size_t                  size,
+                         uint32_t                permissions)
+{
+    bal_error_t error = check_paged_range(interface, guest_address, size, permissions);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    paged_translation_interface_t *context = (paged_translation_interface_t *)interface->context;
+
+    uint64_t first   = guest_address >> context->page_shift;
+    uint64_t end     = first + (size >> context->page_shift);
+    uint64_t entries = (uint64_t)1U << context->level_bits;
+
+    // Every page is checked before any is changed, so a failure leaves the
+    // permissions as they were.
+    //
+    for (uint64_t page = first; page < end; ++page)
+    {
+        const uintptr_t *leaf = find_leaf(context, page);
+
+        if (NULL == leaf || 0 == leaf[page & (entries - 1U)])
+        {
+            BAL_LOG_ERROR(&context->logger,
+                          "Protect failed. GVA 0x%llx is not mapped.",
+                          (unsigned long long)(page << context->page_shift));
+            return BAL_ERROR_GUEST_MEMORY_FAULT;
+        }
+    }
+
+    for (uint64_t page = first; page < end;)
+    {
+        uintptr_t *leaf  = find_leaf(context, page);
+        uint64_t   index = page & (entries - 1U);
+
+        for (; index < entries && page < end; ++index, ++page)
+        {
+            leaf[index] = (leaf[index] & ~PAGED_PERMISSION_MASK) | permissions;
+        }
+
+        update_runs(context, leaf);
+    }
+
+    return BAL_SUCCESS;
+}
+
+void
+bal_memory_destroy_paged(bal_allocator_t *allocator, bal_memory_interface_t *interface)
+{
+    if (NULL == allocator || NULL == interface || NULL == interface->context)
+    {
+        return;
+    }
+
+    paged_translation_interface_t *context = (paged_translation_interface_t *)interface->context;
+
+    free_tables(allocator, context, context->root, 0);
+    allocator->free(allocator->handle, context, sizeof(paged_translation_interface_t));
+    interface->context = NULL;
+}
+
+static const uint8_t *
+bal_translate_paged(void *BAL_RESTRICT   interface,
+                    bal_guest_address_t  guest_address,
+                    size_t *BAL_RESTRICT max_readable_size)
+{
+    if (BAL_UNLIKELY(NULL == interface || NULL == max_readable_size))
+    {
+        return NULL;
+    }
+
+    paged_translation_interface_t *BAL_RESTRICT context
+        = (paged_translation_interface_t *)((bal_memory_interface_t *)interface)->context;
+
+    return translate_paged(
+        context, guest_address, max_readable_size, BAL_MEMORY_PERMISSION_READ);
+}
+
+static uint8_t *
+bal_translate_write_paged(void *BAL_RESTRICT   interface,
+                          bal_guest_address_t  guest_address,
+                          size_t *BAL_RESTRICT max_writable_size)
+{
+    if (BAL_UNLIKELY(NULL == interface || NULL == max_writable_size))
+    {
+        return NULL;
+    }
+
+    paged_translation_interface_t *BAL_RESTRICT context
+        = (paged_translation_interface_t *)((bal_memory_interface_t *)interface)->context;
+
+    return translate_paged(
+        context, guest_address, max_writable_size, BAL_MEMORY_PERMISSION_WRITE);
+}
+
+/// Walks the tables to the page of `guest_address` and returns its host
+/// address if it allows `permission`. The span written to `available` grows
+/// run by run, so it takes a step per run of pages rather than per page.
+static uint8_t *
+translate_paged(paged_translation_interface_t *context,
+                bal_guest_address_t            guest_address,
+                size_t                        *available,
+                uintptr_t                      permission)
+{
+    uint64_t   page  = guest_address >> context->page_shift;
+    uint64_t   mask  = ((uint64_t)1U << context->level_bits) - 1U;
+    uintptr_t *leaf  = NULL;
+    uintptr_t  entry = 0;
+
+    if (BAL_LIKELY(0 == (guest_address >> BAL_MEMORY_PAGED_ADDRESS_BITS)))
+    {
+        leaf = find_leaf(context, page);
+    }
+
+    if (leaf != NULL)
+    {
+        entry = leaf[page & mask];
+    }
+
+    // Faults on pages the host maps lazily or protects are expected, so they
+    // are not reported as errors.
+    //
+    if (BAL_UNLIKELY(0 == (entry & permission)))
+    {
+        BAL_LOG_DEBUG(&context->logger,
+                      "GVA 0x%llx is not mapped with permission %u.",
+                      (unsigned long long)guest_address,
+                      (unsigned)permission);
+        return NULL;
+    }
+
+    uint64_t  last     = ((uint64_t)1U << (BAL_MEMORY_PAGED_ADDRESS_BITS - context->page_shift));
+    uintptr_t expected = entry & ~PAGED_PERMISSION_MASK;
+    uint64_t  next     = page;
+    uint64_t  pages    = 0;
+
+    // A run ends where the permissions change, or at the end of its table,
+    // so the span goes on while the next page continues the host memory and
+    // still allows the access.
+    //
+    while (leaf != NULL)
+    {
+        uint64_t  index = next & mask;
+        uintptr_t value = leaf[index];
+
+        if (0 == (value & permission) || (value & ~PAGED_PERMISSION_MASK) != expected)
+        {
+            break;
+        }
+
+        uint32_t run = leaf_runs(context, leaf)[index];
+        pages += run;
+        next += run;
+        expected += (uintptr_t)run << context->page_shift;
+
+        if ((next & mask) != 0)
+        {
+            continue;
+        }
+
+        leaf = (next < last) ? find_leaf(context, next) : NULL;
+    }
+
+    size_t offset = (size_t)(guest_address & (context->page_size - 1U));
+    *available    = (size_t)(pages << context->page_shift) - offset;
+
+    uint8_t *host_address = (uint8_t *)(entry & ~PAGED_PERMISSION_MASK) + offset;
+
+    BAL_LOG_TRACE(&context->logger,
+                  "Translate 0x%llx -> Host %p",
+                  (unsigned long long)guest_address,
+                  (void *)host_address);
+    return host_address;
+}
+
+static bal_error_t
+check_paged_range(const bal_memory_interface_t *interface,
+                  bal_guest_address_t           guest_address,
+                  size_t                        size,
+                  uint32_t                      permissions)
+{
+    if (NULL == interface || NULL == interface->context)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    paged_translation_interface_t *context = (paged_translation_interface_t *)interface->context;
+
+    uint64_t limit = (uint64_t)1U << BAL_MEMORY_PAGED_ADDRESS_BITS;
+
+    uint32_t known = BAL_MEMORY_PERMISSION_READ | BAL_MEMORY_PERMISSION_WRITE;
+
+    if (0 == size || guest_address >= limit || size > limit - guest_address
+        || (permissions & ~known) != 0)
+    {
+        BAL_LOG_ERROR(&context->logger,
+                      "Invalid guest range 0x%llx (Size: %zu, Permissions: %u).",
+                      (unsigned long long)guest_address,
+                      size,
+                      permissions);
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (((guest_address | size) & (context->page_size - 1U)) != 0)
+    {
+        BAL_LOG_ERROR(&context->logger,
+                      "Guest range 0x%llx (Size: %zu) is not page aligned.",
+                      (unsigned long long)guest_address,
+                      size);
+        return BAL_ERROR_MEMORY_ALIGNMENT;
+    }
+
+    return BAL_SUCCESS;
+}
+
+/// Returns the table of page entries holding `page`, or `NULL` if nothing
+/// was mapped near it.
+static uintptr_t *
+find_leaf(const paged_translation_interface_t *context, uint64_t page)
+{
+    uint64_t mask  = ((uint64_t)1U << context->level_bits) - 1U;
+    void   **table = context->root;
+
+    for (uint32_t level = 0; level + 1U < PAGED_LEVELS && table != NULL; ++level)
+    {
+        uint32_t shift = context->level_bits * (PAGED_LEVELS - 1U - level);
+        table          = (void **)table[(page >> shift) & mask];
+    }
+
+    return (uintptr_t *)table;
+}
+
+/// Like [`find_leaf`], but allocates the missing tables on the way.
+static uintptr_t *
+make_leaf(paged_translation_interface_t *context, uint64_t page)
+{
+    uint64_t mask  = ((uint64_t)1U << context->level_bits) - 1U;
+    void   **table = context->root;
+
+    for (uint32_t level = 0; level + 1U < PAGED_LEVELS; ++level)
+    {
+        uint32_t shift = context->level_bits * (PAGED_LEVELS - 1U - level);
+        void   **slot  = &table[(page >> shift) & mask];
+
+        if (NULL == *slot)
+        {
+            bool last = (level + 2U == PAGED_LEVELS);
+            *slot     = allocate_table(context, last ? context->leaf_size : context->table_size);
+
+            if (NULL == *slot)
+            {
+                return NULL;
+            }
+        }
+
+        table = (void **)*slot;
+    }
+
+    return (uintptr_t *)table;
+}
+
+/// Returns the runs of a table of page entries, stored after them. The run
+/// of a mapped entry counts it and the following entries of the table whose
+/// host memory continues it with the same permissions.
+static uint32_t *
+leaf_runs(const paged_translation_interface_t *context, uintptr_t *leaf)
+{
+    return (uint32_t *)(void *)(leaf + ((size_t)1U << context->level_bits));
+}
+
+static void
+update_runs(const paged_translation_interface_t *context, uintptr_t *leaf)
+{
+    uint32_t *runs    = leaf_runs(context, leaf);
+    uint32_t  entries = 1U << context->level_bits;
+    uint32_t  run     = 0;
+    uintptr_t next    = 0;
+
+    for (uint32_t i = entries; i-- > 0;)
+    {
+        uintptr_t entry = leaf[i];
+
+        if (0 == entry)
+        {
+            run = 0;
+        }
+        else if (next != 0 && next == entry + context->page_size)
+        {
+            ++run;
+        }
+        else
+        {
+            run = 1;
+        }
+
+        runs[i] = run;
+        next    = entry;
+    }
+}
+
+/// Frees the table of page entries holding `page` if it maps nothing, and
+/// then every table above it that became empty.
+static void
+free_empty_tables(paged_translation_interface_t *context, uint64_t page)
+{
+    uint64_t mask  = ((uint64_t)1U << context->level_bits) - 1U;
+    size_t   count = (size_t)1U << context->level_bits;
+    void   **slots[PAGED_LEVELS - 1U];
+    void   **table = context->root;
+
+    for (uint32_t level = 0; level + 1U < PAGED_LEVELS; ++level)
+    {
+        uint32_t shift = context->level_bits * (PAGED_LEVELS - 1U - level);
+        slots[level]   = &table[(page >> shift) & mask];
+        table          = (void **)*slots[level];
+    }
+
+    for (uint32_t level = PAGED_LEVELS - 1U; level-- > 0;)
+    {
+        void **child = (void **)*slots[level];
+        bool   last  = (level + 2U == PAGED_LEVELS);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Page entries and table pointers are both pointer sized, and
+            // zero when empty.
+            //
+            if (child[i] != NULL)
+            {
+                return;
+            }
+        }
+
+        context->allocator.free(
+            context->allocator.handle, child, last ? context->leaf_size : context->table_size);
+        *slots[level] = NULL;
+    }
+}
+
+static void
+free_tables(bal_allocator_t                     *allocator,
+            const paged_translation_interface_t *context,
+            void                               **table,
+            uint32_t                             level)
+{
+    if (NULL == table)
+    {
+        return;
+    }
+
+    if (level + 1U == PAGED_LEVELS)
+    {
+        allocator->free(allocator->handle, table, context->leaf_size);
+        return;
+    }
+
+    for (size_t i = 0; i < ((size_t)1U << context->level_bits); ++i)
+    {
+        free_tables(allocator, context, (void **)table[i], level + 1U);
+    }
+
+    allocator->free(allocator->handle, table, context->table_size);
+}
+
+static void *
+allocate_table(paged_translation_interface_t *context, size_t size)
+{
+    void *table = context->allocator.allocate(context->allocator.handle, 64U, size);
+
+    if (table != NULL)
+    {
+        (void)memset(table, 0, size);
+    }
+
+    return table;
+}
+
 /*** end of file ***/
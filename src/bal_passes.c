@@ -0,0 +1,480 @@
+#include "bal_passes.h"
+#include "bal_guest_state.h"
+#include "bal_ir.h"
+#include "bal_logging.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Marks a scope index that has not been seen yet.
+#define INVALID_INDEX 0xFFFFFFFFU
+
+/// One bit per lazy flag field, starting at `BAL_GUEST_REGISTER_FLAGS_OPERATION`.
+#define ALL_FLAG_FIELDS 0x7U
+
+/// Tracks an `IF` diamond that is still open while scanning forward.
+typedef struct
+{
+    uint32_t if_index;
+    uint32_t else_index;
+    uint32_t yield_indices[2];
+    uint32_t arm_instruction_counts[2];
+    bool     is_flattenable;
+} if_scope_t;
+
+BAL_HOT bal_error_t
+bal_pass_if_to_select(bal_engine_t *engine)
+{
+    if (BAL_UNLIKELY(NULL == engine || engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    if_scope_t scopes[BAL_PASS_MAX_SCOPE_DEPTH];
+    size_t     depth           = 0;
+    size_t     overflow_depth  = 0;
+    uint32_t   flattened_count = 0;
+
+    const uint32_t             instruction_count = engine->instruction_count;
+    const bal_ir_instruction_t nop
+        = bal_ir_encode(OPCODE_NOP, BAL_SOURCE_NONE, BAL_SOURCE_NONE, BAL_SOURCE_NONE);
+
+    for (uint32_t i = 0; i < instruction_count; ++i)
+    {
+        const bal_ir_instruction_t instruction = bal_ir_get(engine, i);
+        const bal_opcode_t         opcode      = bal_ir_opcode(instruction);
+        if_scope_t                *scope       = (depth > 0) ? &scopes[depth - 1] : NULL;
+
+        switch (opcode)
+        {
+            case OPCODE_IF:
+                if (BAL_UNLIKELY(depth >= BAL_PASS_MAX_SCOPE_DEPTH || overflow_depth > 0))
+                {
+                    // We can not see the end of this scope, so the parent can
+                    // never be flattened.
+                    //
+                    scopes[BAL_PASS_MAX_SCOPE_DEPTH - 1].is_flattenable = false;
+                    ++overflow_depth;
+                    break;
+                }
+
+                scopes[depth]
+                    = (if_scope_t) { .if_index               = i,
+                                     .else_index             = INVALID_INDEX,
+                                     .yield_indices          = { INVALID_INDEX, INVALID_INDEX },
+                                     .arm_instruction_counts = { 0, 0 },
+                                     .is_flattenable         = true };
+                ++depth;
+                break;
+
+            case OPCODE_ELSE:
+                if (overflow_depth > 0 || NULL == scope)
+                {
+                    break;
+                }
+
+                if (scope->else_index != INVALID_INDEX)
+                {
+                    scope->is_flattenable = false;
+                }
+
+                scope->else_index = i;
+                break;
+
+            case OPCODE_YIELD: {
+                if (overflow_depth > 0 || NULL == scope)
+                {
+                    break;
+                }
+
+                size_t arm = (INVALID_INDEX == scope->else_index) ? 0 : 1;
+
+                // Only single value yields map onto a select.
+                //
+                if (scope->yield_indices[arm] != INVALID_INDEX
+                    || bal_ir_source2(instruction) != BAL_SOURCE_NONE
+                    || bal_ir_source3(instruction) != BAL_SOURCE_NONE)
+                {
+                    scope->is_flattenable = false;
+                }
+
+                scope->yield_indices[arm] = i;
+                break;
+            }
+
+            case OPCODE_MERGE:
+            case OPCODE_END_BLOCK: {
+                if (overflow_depth > 0)
+                {
+                    --overflow_depth;
+                    break;
+                }
+
+                if (NULL == scope)
+                {
+                    break;
+                }
+
+                --depth;
+
+                const uint32_t max_arm_size = BAL_IF_TO_SELECT_MAX_ARM_INSTRUCTIONS;
+
+                bool is_flattened = (OPCODE_MERGE == opcode) && scope->is_flattenable
+                                    && (scope->else_index != INVALID_INDEX)
+                                    && (scope->yield_indices[0] != INVALID_INDEX)
+                                    && (scope->yield_indices[1] != INVALID_INDEX)
+                                    && (scope->arm_instruction_counts[0] <= max_arm_size)
+                                    && (scope->arm_instruction_counts[1] <= max_arm_size);
+
+                if (is_flattened)
+                {
+                    uint32_t condition = bal_ir_source1(bal_ir_get(engine, scope->if_index));
+                    uint32_t then_value
+                        = bal_ir_source1(bal_ir_get(engine, scope->yield_indices[0]));
+                    uint32_t else_value
+                        = bal_ir_source1(bal_ir_get(engine, scope->yield_indices[1]));
+
+                    bal_ir_set(engine,
+                               i,
+                               bal_ir_encode(
+                                   OPCODE_CONDITIONAL_SELECT, condition, then_value, else_value));
+                    bal_ir_set(engine, scope->if_index, nop);
+                    bal_ir_set(engine, scope->else_index, nop);
+                    bal_ir_set(engine, scope->yield_indices[0], nop);
+                    bal_ir_set(engine, scope->yield_indices[1], nop);
+                    ++flattened_count;
+
+                    BAL_LOG_DEBUG(&engine->logger,
+                                  "  IF-TO-SELECT: v%u = SELECT 0x%05x, 0x%05x, 0x%05x",
+                                  i,
+                                  condition,
+                                  then_value,
+                                  else_value);
+                }
+
+                if (depth > 0)
+                {
+                    if_scope_t *parent = &scopes[depth - 1];
+                    size_t      arm    = (INVALID_INDEX == parent->else_index) ? 0 : 1;
+
+                    if (is_flattened)
+                    {
+                        // The speculated arms and the select now live in the
+                        // parent's arm.
+                        //
+                        parent->arm_instruction_counts[arm] += scope->arm_instruction_counts[0]
+                                                               + scope->arm_instruction_counts[1]
+                                                               + 1;
+                    }
+                    else
+                    {
+                        parent->is_flattenable = false;
+                    }
+                }
+
+                break;
+            }
+
+            case OPCODE_NOP:
+                break;
+
+            default: {
+                if (overflow_depth > 0 || NULL == scope)
+                {
+                    break;
+                }
+
+                size_t arm = (INVALID_INDEX == scope->else_index) ? 0 : 1;
+                ++scope->arm_instruction_counts[arm];
+
+                if (false == bal_ir_is_side_effect_free(opcode))
+                {
+                    scope->is_flattenable = false;
+                }
+
+                break;
+            }
+        }
+    }
+
+    BAL_LOG_INFO(&engine->logger, "IF-to-SELECT flattened %u diamonds.", flattened_count);
+
+    // Remove unused variable warning from release builds.
+    //
+    (void)flattened_count;
+
+    return BAL_SUCCESS;
+}
+
+/// Writes the value of `source` to `value` and returns `true` if it is known
+/// at compile time, either as a constant or as an `OPCODE_CONST` variable.
+static bool
+constant_value(const bal_engine_t *engine, uint32_t source, bal_constant_t *value)
+{
+    if (bal_ir_is_constant(source))
+    {
+        *value = engine->constants[source & ~BAL_DECODED_CONSTANT_BIT];
+        return true;
+    }
+
+    if (bal_ir_is_variable(source) && OPCODE_CONST == bal_ir_opcode(bal_ir_get(engine, source)))
+    {
+        return constant_value(engine, bal_ir_source1(bal_ir_get(engine, source)), value);
+    }
+
+    return false;
+}
+
+BAL_HOT bal_error_t
+bal_pass_constant_folding(bal_engine_t *engine)
+{
+    if (BAL_UNLIKELY(NULL == engine || engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    const uint32_t instruction_count = engine->instruction_count;
+    uint32_t       folded_count      = 0;
+
+    for (uint32_t i = 0; i < instruction_count; ++i)
+    {
+        const bal_ir_instruction_t instruction = bal_ir_get(engine, i);
+        const bal_opcode_t         opcode      = bal_ir_opcode(instruction);
+
+        bal_constant_t left  = 0;
+        bal_constant_t right = 0;
+        bal_constant_t result;
+
+        switch (opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_AND:
+            case OPCODE_XOR:
+                if (false == constant_value(engine, bal_ir_source1(instruction), &left)
+                    || false == constant_value(engine, bal_ir_source2(instruction), &right))
+                {
+                    continue;
+                }
+                break;
+
+            default:
+                continue;
+        }
+
+        switch (opcode)
+        {
+            case OPCODE_ADD:
+                result = left + right;
+                break;
+            case OPCODE_SUB:
+                result = left - right;
+                break;
+            case OPCODE_AND:
+                result = left & right;
+                break;
+            default:
+                result = left ^ right;
+                break;
+        }
+
+        // Pool index 0xFFFF is reserved for BAL_SOURCE_NONE. A wide unit
+        // skips it, a narrow one stops there.
+        //
+        uint32_t index = engine->constant_count;
+
+        if (BAL_SOURCE_MASK == index && engine->is_wide && index < engine->constants_size)
+        {
+            engine->constants[index] = 0;
+            ++index;
+        }
+
+        if (index >= engine->constants_size
+            || (index >= BAL_SOURCE_MASK && false == engine->is_wide))
+        {
+            break;
+        }
+
+        engine->constants[index] = result;
+        engine->constant_count   = (bal_constant_count_t)(index + 1);
+        bal_ir_set(engine,
+                   i,
+                   bal_ir_encode(OPCODE_CONST,
+                                 index | BAL_DECODED_CONSTANT_BIT,
+                                 BAL_SOURCE_NONE,
+                                 BAL_SOURCE_NONE));
+        ++folded_count;
+
+        BAL_LOG_DEBUG(&engine->logger, "  FOLD: v%u = CONST 0x%llX", i, (unsigned long long)result);
+    }
+
+    BAL_LOG_INFO(&engine->logger, "Constant folding folded %u instructions.", folded_count);
+
+    // Remove unused variable warning from release builds.
+    //
+    (void)folded_count;
+
+    return BAL_SUCCESS;
+}
+
+BAL_HOT bal_error_t
+bal_pass_dead_flags(bal_engine_t *engine, bool flags_dead_on_exit, bool *flags_live_on_entry)
+{
+    if (BAL_UNLIKELY(NULL == engine || engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    const bal_ir_instruction_t nop
+        = bal_ir_encode(OPCODE_NOP, BAL_SOURCE_NONE, BAL_SOURCE_NONE, BAL_SOURCE_NONE);
+
+    // The successor only overwrites the flags when the exit is linked to it,
+    // so the last write of every field is left to the exit, which stores it
+    // on the way back to the dispatcher.
+    //
+    uint32_t live          = flags_dead_on_exit ? 0 : ALL_FLAG_FIELDS;
+    uint32_t exiting       = flags_dead_on_exit ? ALL_FLAG_FIELDS : 0;
+    uint32_t depth         = 0;
+    uint32_t removed_count = 0;
+    uint32_t exit_count    = 0;
+
+    for (uint32_t i = engine->instruction_count; i-- > 0;)
+    {
+        const bal_ir_instruction_t instruction = bal_ir_get(engine, i);
+        const bal_opcode_t         opcode      = bal_ir_opcode(instruction);
+        const uint32_t             field       = bal_ir_source1(instruction);
+
+        switch (opcode)
+        {
+            // Scanning backwards, a scope opens at its end.
+            //
+            case OPCODE_MERGE:
+            case OPCODE_END_BLOCK:
+                ++depth;
+                break;
+
+            case OPCODE_IF:
+                depth = (depth > 0) ? depth - 1 : 0;
+                break;
+
+            case OPCODE_GET_REGISTER:
+                if (field >= BAL_GUEST_REGISTER_FLAGS_OPERATION
+                    && field <= BAL_GUEST_REGISTER_FLAGS_RIGHT)
+                {
+                    live |= 1U << (field - BAL_GUEST_REGISTER_FLAGS_OPERATION);
+                }
+
+                break;
+
+            // Reads NZCV, which every field goes into.
+            //
+            case OPCODE_CMP_COND:
+                live |= ALL_FLAG_FIELDS;
+                break;
+
+            // A fault returns to the host, which may read NZCV.
+            //
+            case OPCODE_LOAD:
+            case OPCODE_STORE:
+            case OPCODE_LOAD_EXCLUSIVE:
+            case OPCODE_STORE_EXCLUSIVE:
+            case OPCODE_ATOMIC_ADD:
+            case OPCODE_ATOMIC_SWAP:
+            case OPCODE_ATOMIC_COMPARE_SWAP:
+                live |= ALL_FLAG_FIELDS;
+                break;
+
+            case OPCODE_SET_REGISTER: {
+                if (field < BAL_GUEST_REGISTER_FLAGS_OPERATION
+                    || field > BAL_GUEST_REGISTER_FLAGS_RIGHT)
+                {
+                    break;
+                }
+
+                uint32_t bit = 1U << (field - BAL_GUEST_REGISTER_FLAGS_OPERATION);
+
+                if (live & bit)
+                {
+                    exiting &= ~bit;
+
+                    if (0 == depth)
+                    {
+                        live &= ~bit;
+                    }
+                }
+                else if (exiting & bit)
+                {
+                    exiting &= ~bit;
+
+                    // The exit stores it unconditionally, so a write inside a
+                    // scope stays where it is, along with the ones before it.
+                    //
+                    if (depth > 0)
+                    {
+                        live |= bit;
+                        break;
+                    }
+
+                    bal_ir_set(engine,
+                               i,
+                               bal_ir_encode(OPCODE_SET_REGISTER_ON_EXIT,
+                                             field,
+                                             bal_ir_source2(instruction),
+                                             BAL_SOURCE_NONE));
+                    ++exit_count;
+                }
+                else
+                {
+                    bal_ir_set(engine, i, nop);
+                    ++removed_count;
+                }
+
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    // A field the unit never writes reaches the dispatcher as it was on
+    // entry.
+    //
+    if (flags_live_on_entry != NULL)
+    {
+        *flags_live_on_entry = ((live | exiting) != 0);
+    }
+
+    BAL_LOG_INFO(&engine->logger,
+                 "Dead flags removed %u flag writes and left %u to the exit.",
+                 removed_count,
+                 exit_count);
+
+    // Remove unused variable warning from release builds.
+    //
+    (void)removed_count;
+    (void)exit_count;
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_passes_run_tier2(bal_engine_t *engine)
+{
+    bal_error_t (*const passes[])(bal_engine_t *)
+        = { bal_pass_if_to_select, bal_pass_constant_folding };
+
+    for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i)
+    {
+        bal_error_t error = passes[i](engine);
+
+        if (BAL_UNLIKELY(error != BAL_SUCCESS))
+        {
+            return error;
+        }
+    }
+
+    return BAL_SUCCESS;
+}
+
+/*** end of file ***/
@@ -0,0 +1,546 @@
+#include "bal_persistent_cache.h"
+#include "bal_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Helper macro to align `x` UP to `alignment`, which must be a power of two.
+#define ALIGN_UP(x, alignment) (((x) + ((alignment) - 1)) & ~((alignment) - 1))
+
+/// The records and data reserved by the first [`bal_persistent_cache_record`].
+#define INITIAL_RECORDS     64U
+#define INITIAL_RECORD_DATA (64U * 1024U)
+
+/// An entry to write, from either the mapped file or the records.
+typedef struct
+{
+    const bal_persistent_cache_entry_t *entry;
+    const uint8_t                      *data;
+
+    /// 0 for an entry of the mapped file, and one more than the index of a
+    /// record otherwise. The highest priority of a key is written.
+    uint32_t priority;
+} source_t;
+
+static size_t      entry_data_size(const bal_persistent_cache_entry_t *);
+static int         compare_keys(const bal_persistent_cache_entry_t *,
+                                const bal_persistent_cache_entry_t *);
+static int         compare_sources(const void *, const void *);
+static bool        load_file(bal_persistent_cache_t *);
+static bool        validate_file(const bal_persistent_cache_t *);
+static bool        reserve_records(bal_persistent_cache_t *, size_t);
+static bal_error_t write_file(const bal_persistent_cache_t *,
+                              const char *,
+                              const source_t *,
+                              uint32_t);
+static void        unmap_file(bal_persistent_cache_t *);
+
+uint64_t
+bal_persistent_cache_hash(uint64_t hash, const void *bytes, size_t size)
+{
+    const uint8_t *data = (const uint8_t *)bytes;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+bal_error_t
+bal_persistent_cache_open(const bal_allocator_t  *allocator,
+                          bal_persistent_cache_t *cache,
+                          const char             *path,
+                          uint64_t                context,
+                          bal_logger_t            logger)
+{
+    if (NULL == allocator || NULL == cache || NULL == path)
+    {
+        BAL_LOG_ERROR(&logger, "Persistent cache open failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    (void)memset(cache, 0, sizeof(*cache));
+    cache->context   = context;
+    cache->path      = path;
+    cache->allocator = *allocator;
+    cache->logger    = logger;
+
+    if (load_file(cache))
+    {
+        BAL_LOG_INFO(
+            &logger, "Mapped persistent cache %s. Entries: %u.", path, cache->entry_count);
+    }
+
+    return BAL_SUCCESS;
+}
+
+const bal_persistent_cache_entry_t *
+bal_persistent_cache_find(const bal_persistent_cache_t *cache,
+                          bal_guest_address_t           guest_address,
+                          uint32_t                      tier)
+{
+    bal_persistent_cache_entry_t key = { .guest_address = guest_address, .tier = tier };
+
+    uint32_t low  = 0;
+    uint32_t high = cache->entry_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2U;
+        int      order  = compare_keys(&cache->entries[middle], &key);
+
+        if (0 == order)
+        {
+            return &cache->entries[middle];
+        }
+
+        if (order < 0)
+        {
+            low = middle + 1U;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return NULL;
+}
+
+void
+bal_persistent_cache_unit(const bal_persistent_cache_t       *cache,
+                          const bal_persistent_cache_entry_t *entry,
+                          bal_compiled_unit_t                *unit)
+{
+    unit->entry            = NULL;
+    unit->offset           = entry->code_alignment;
+    unit->size             = entry->code_size;
+    unit->body_offset      = entry->body_offset;
+    unit->cold_offset      = 0;
+    unit->cold_size        = entry->cold_size;
+    unit->relocation_count = entry->relocation_count;
+    unit->relocatable      = true;
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        unit->link_offsets[kind] = entry->link_offsets[kind];
+    }
+
+    (void)memcpy(unit->relocations,
+                 bal_persistent_cache_relocations(cache, entry),
+                 entry->relocation_count * sizeof(bal_relocation_t));
+}
+
+bal_error_t
+bal_persistent_cache_record(bal_persistent_cache_t             *cache,
+                            const bal_persistent_cache_entry_t *entry,
+                            const uint8_t                      *code,
+                            const uint8_t                      *cold_code,
+                            const bal_relocation_t             *relocations)
+{
+    size_t size = entry_data_size(entry);
+
+    if (BAL_UNLIKELY(false == reserve_records(cache, size)))
+    {
+        BAL_LOG_ERROR(&cache->logger,
+                      "Failed to record unit 0x%llx for the persistent cache.",
+                      (unsigned long long)entry->guest_address);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    uint8_t *data = cache->record_data + cache->record_data_size;
+    (void)memset(data, 0, size);
+    (void)memcpy(data, code, entry->code_size);
+
+    if (entry->cold_size != 0)
+    {
+        (void)memcpy(data + entry->code_size, cold_code, entry->cold_size);
+    }
+
+    (void)memcpy(data + ALIGN_UP((size_t)entry->code_size + entry->cold_size, 4U),
+                 relocations,
+                 entry->relocation_count * sizeof(bal_relocation_t));
+
+    bal_persistent_cache_entry_t *record = &cache->records[cache->record_count++];
+    *record                              = *entry;
+    record->data_offset                  = cache->record_data_size;
+    cache->record_data_size += size;
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_persistent_cache_save(bal_persistent_cache_t *cache)
+{
+    bal_allocator_t *allocator = &cache->allocator;
+    uint32_t         count     = cache->entry_count + cache->record_count;
+    size_t           length    = strlen(cache->path);
+    size_t           size      = ALIGN_UP(length + sizeof(".tmp"), 8U);
+    char            *path      = (char *)allocator->allocate(allocator->handle, 8U, size);
+    source_t        *sources   = NULL;
+
+    if (count != 0)
+    {
+        sources = (source_t *)allocator->allocate(allocator->handle, 8U, count * sizeof(source_t));
+    }
+
+    if (NULL == path || (count != 0 && NULL == sources))
+    {
+        BAL_LOG_ERROR(&cache->logger, "Failed to allocate the persistent cache index.");
+
+        if (path != NULL)
+        {
+            allocator->free(allocator->handle, path, size);
+        }
+
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < cache->record_count; ++i)
+    {
+        const bal_persistent_cache_entry_t *record = &cache->records[i];
+        sources[written++]
+            = (source_t) { record, cache->record_data + record->data_offset, i + 1U };
+    }
+
+    for (uint32_t i = 0; i < cache->entry_count; ++i)
+    {
+        const bal_persistent_cache_entry_t *entry = &cache->entries[i];
+        sources[written++] = (source_t) { entry, cache->mapping + entry->data_offset, 0 };
+    }
+
+    // Only the newest unit of every key is kept, which sorts first.
+    //
+    if (count != 0)
+    {
+        qsort(sources, count, sizeof(source_t), compare_sources);
+        written = 0;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (0 == written || compare_keys(sources[written - 1U].entry, sources[i].entry) != 0)
+            {
+                sources[written++] = sources[i];
+            }
+        }
+    }
+
+    (void)memcpy(path, cache->path, length);
+    (void)memcpy(path + length, ".tmp", sizeof(".tmp"));
+
+    bal_error_t error = write_file(cache, path, sources, written);
+
+    // A mapped file can not be replaced on every platform.
+    //
+    if (BAL_SUCCESS == error)
+    {
+        unmap_file(cache);
+
+        if (false == bal_file_replace(path, cache->path))
+        {
+            error = BAL_ERROR_FILE_IO;
+        }
+
+        (void)load_file(cache);
+    }
+
+    if (error != BAL_SUCCESS)
+    {
+        (void)remove(path);
+        BAL_LOG_ERROR(&cache->logger, "Failed to write persistent cache %s.", cache->path);
+    }
+    else
+    {
+        BAL_LOG_INFO(
+            &cache->logger, "Saved persistent cache %s. Entries: %u.", cache->path, written);
+        cache->record_count     = 0;
+        cache->record_data_size = 0;
+    }
+
+    if (sources != NULL)
+    {
+        allocator->free(allocator->handle, sources, count * sizeof(source_t));
+    }
+
+    allocator->free(allocator->handle, path, size);
+    return error;
+}
+
+void
+bal_persistent_cache_close(bal_persistent_cache_t *cache)
+{
+    if (NULL == cache)
+    {
+        return;
+    }
+
+    bal_allocator_t *allocator = &cache->allocator;
+
+    unmap_file(cache);
+
+    if (cache->records != NULL)
+    {
+        allocator->free(allocator->handle,
+                        cache->records,
+                        cache->record_capacity * sizeof(bal_persistent_cache_entry_t));
+    }
+
+    if (cache->record_data != NULL)
+    {
+        allocator->free(allocator->handle, cache->record_data, cache->record_data_capacity);
+    }
+
+    cache->records     = NULL;
+    cache->record_data = NULL;
+}
+
+/// Returns the bytes the data of `entry` takes up in the file.
+static size_t
+entry_data_size(const bal_persistent_cache_entry_t *entry)
+{
+    size_t code = ALIGN_UP((size_t)entry->code_size + entry->cold_size, 4U);
+    return ALIGN_UP(code + entry->relocation_count * sizeof(bal_relocation_t), 8U);
+}
+
+static int
+compare_keys(const bal_persistent_cache_entry_t *left, const bal_persistent_cache_entry_t *right)
+{
+    if (left->guest_address != right->guest_address)
+    {
+        return (left->guest_address < right->guest_address) ? -1 : 1;
+    }
+
+    if (left->tier != right->tier)
+    {
+        return (left->tier < right->tier) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int
+compare_sources(const void *left, const void *right)
+{
+    const source_t *a     = (const source_t *)left;
+    const source_t *b     = (const source_t *)right;
+    int             order = compare_keys(a->entry, b->entry);
+
+    if (order != 0)
+    {
+        return order;
+    }
+
+    return (a->priority > b->priority) ? -1 : (a->priority < b->priority);
+}
+
+/// Maps the file of `cache` and exposes its entries if it is valid.
+static bool
+load_file(bal_persistent_cache_t *cache)
+{
+    if (false == bal_file_map(cache->path, &cache->mapping, &cache->mapping_size))
+    {
+        BAL_LOG_INFO(&cache->logger, "No persistent cache at %s.", cache->path);
+        return false;
+    }
+
+    if (false == validate_file(cache))
+    {
+        BAL_LOG_WARN(
+            &cache->logger, "Ignoring invalid or outdated persistent cache %s.", cache->path);
+        unmap_file(cache);
+        return false;
+    }
+
+    const bal_persistent_cache_header_t *header
+        = (const bal_persistent_cache_header_t *)(const void *)cache->mapping;
+
+    cache->entries = (const bal_persistent_cache_entry_t *)(const void *)(cache->mapping
+                                                                            + sizeof(*header));
+    cache->entry_count = header->entry_count;
+    return true;
+}
+
+/// Checks the header of the mapped file and that every entry and its data
+/// lie inside it. Relocations are checked by the backend when a unit is
+/// loaded.
+static bool
+validate_file(const bal_persistent_cache_t *cache)
+{
+    const size_t                         size   = cache->mapping_size;
+    const bal_persistent_cache_header_t *header
+        = (const bal_persistent_cache_header_t *)(const void *)cache->mapping;
+
+    if (size < sizeof(*header)
+        || memcmp(header->magic, BAL_PERSISTENT_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != BAL_PERSISTENT_CACHE_VERSION || header->context != cache->context
+        || header->file_size != size
+        || header->entry_count > (size - sizeof(*header)) / sizeof(bal_persistent_cache_entry_t))
+    {
+        return false;
+    }
+
+    const bal_persistent_cache_entry_t *entries
+        = (const bal_persistent_cache_entry_t *)(const void *)(cache->mapping + sizeof(*header));
+    const size_t data_begin
+        = sizeof(*header) + header->entry_count * sizeof(bal_persistent_cache_entry_t);
+
+    for (uint32_t i = 0; i < header->entry_count; ++i)
+    {
+        const bal_persistent_cache_entry_t *entry = &entries[i];
+
+        if (0 == entry->code_size || entry->body_offset >= entry->code_size
+            || entry->code_alignment >= 8U || entry->relocation_count > BAL_MAX_RELOCATIONS
+            || entry->exit_kind > BAL_UNIT_EXIT_CONDITIONAL || 0 == entry->tier
+            || (entry->data_offset & 7U) != 0 || entry->data_offset < data_begin
+            || entry->data_offset > size || entry_data_size(entry) > size - entry->data_offset)
+        {
+            return false;
+        }
+
+        for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+        {
+            if (entry->link_offsets[kind] >= entry->code_size)
+            {
+                return false;
+            }
+        }
+
+        if (i != 0 && compare_keys(&entries[i - 1U], entry) >= 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+unmap_file(bal_persistent_cache_t *cache)
+{
+    bal_file_unmap(cache->mapping, cache->mapping_size);
+    cache->mapping      = NULL;
+    cache->mapping_size = 0;
+    cache->entries      = NULL;
+    cache->entry_count  = 0;
+}
+
+/// Makes room for one more record with `size` bytes of data.
+static bool
+reserve_records(bal_persistent_cache_t *cache, size_t size)
+{
+    bal_allocator_t *allocator = &cache->allocator;
+    if (cache->record_count == cache->record_capacity)
+    {
+        uint32_t capacity = (0 == cache->record_capacity) ? INITIAL_RECORDS
+                                                          : cache->record_capacity * 2U;
+        size_t   bytes    = capacity * sizeof(bal_persistent_cache_entry_t);
+        bal_persistent_cache_entry_t *records
+            = (bal_persistent_cache_entry_t *)allocator->allocate(allocator->handle, 8U, bytes);
+
+        if (NULL == records)
+        {
+            return false;
+        }
+
+        if (cache->records != NULL)
+        {
+            (void)memcpy(records,
+                         cache->records,
+                         cache->record_count * sizeof(bal_persistent_cache_entry_t));
+            allocator->free(allocator->handle,
+                            cache->records,
+                            cache->record_capacity * sizeof(bal_persistent_cache_entry_t));
+        }
+
+        cache->records         = records;
+        cache->record_capacity = capacity;
+    }
+
+    if (size > cache->record_data_capacity - cache->record_data_size)
+    {
+        size_t capacity = (0 == cache->record_data_capacity) ? INITIAL_RECORD_DATA
+                                                             : cache->record_data_capacity;
+
+        while (size > capacity - cache->record_data_size)
+        {
+            capacity *= 2U;
+        }
+
+        uint8_t *data = (uint8_t *)allocator->allocate(allocator->handle, 8U, capacity);
+
+        if (NULL == data)
+        {
+            return false;
+        }
+
+        if (cache->record_data != NULL)
+        {
+            (void)memcpy(data, cache->record_data, cache->record_data_size);
+            allocator->free(allocator->handle, cache->record_data, cache->record_data_capacity);
+        }
+
+        cache->record_data          = data;
+        cache->record_data_capacity = capacity;
+    }
+
+    return true;
+}
+
+/// Writes the `count` entries of `sources`, which are sorted and unique, to
+/// a new file at `path`.
+static bal_error_t
+write_file(const bal_persistent_cache_t *cache,
+           const char                   *path,
+           const source_t               *sources,
+           uint32_t                      count)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (NULL == file)
+    {
+        return BAL_ERROR_FILE_IO;
+    }
+
+    uint64_t data_begin
+        = sizeof(bal_persistent_cache_header_t) + count * sizeof(bal_persistent_cache_entry_t);
+    uint64_t offset = data_begin;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        offset += entry_data_size(sources[i].entry);
+    }
+
+    bal_persistent_cache_header_t header = {
+        .version     = BAL_PERSISTENT_CACHE_VERSION,
+        .entry_count = count,
+        .context     = cache->context,
+        .file_size   = offset,
+    };
+    (void)memcpy(header.magic, BAL_PERSISTENT_CACHE_MAGIC, sizeof(header.magic));
+
+    bool written = (1 == fwrite(&header, sizeof(header), 1, file));
+    offset       = data_begin;
+
+    for (uint32_t i = 0; written && i < count; ++i)
+    {
+        bal_persistent_cache_entry_t entry = *sources[i].entry;
+        entry.data_offset                  = offset;
+        offset += entry_data_size(&entry);
+        written = (1 == fwrite(&entry, sizeof(entry), 1, file));
+    }
+
+    for (uint32_t i = 0; written && i < count; ++i)
+    {
+        size_t size = entry_data_size(sources[i].entry);
+        written     = (size == fwrite(sources[i].data, 1, size, file));
+    }
+
+    written = (0 == fclose(file)) && written;
+    return written ? BAL_SUCCESS : BAL_ERROR_FILE_IO;
+}
+
+/*** end of file ***/
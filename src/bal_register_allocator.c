@@ -0,0 +1,432 @@
+#include "bal_register_allocator.h"
+#include "bal_assert.h"
+#include "bal_ir.h"
+#include "bal_logging.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/// Marks an SSA index or instruction index that does not exist.
+#define INVALID_INDEX 0xFFFFFFFFU
+
+/// The deepest `IF` nesting tracked when pairing yields with merges.
+#define MAX_SCOPE_DEPTH 64U
+
+/// The maximum number of live ranges that can overlap at any point.
+#define MAX_ACTIVE_INTERVALS (BAL_MAX_HOST_REGISTERS + BAL_MAX_SPILL_SLOTS)
+
+#define X86_RAX 0U
+#define X86_RCX 1U
+#define X86_RDX 2U
+#define X86_RBX 3U
+#define X86_RSP 4U
+#define X86_RBP 5U
+#define X86_RSI 6U
+#define X86_RDI 7U
+#define X86_R8  8U
+#define X86_R9  9U
+#define X86_R10 10U
+#define X86_R11 11U
+#define X86_R12 12U
+#define X86_R13 13U
+#define X86_R14 14U
+#define X86_R15 15U
+
+#define ARM64_X16 16U
+#define ARM64_X17 17U
+#define ARM64_X19 19U
+#define ARM64_X28 28U
+#define ARM64_X29 29U
+
+/// A live range that currently holds a register or a spill slot.
+typedef struct
+{
+    uint32_t ssa_index;
+    uint32_t end;
+} active_interval_t;
+
+typedef struct
+{
+    const bal_register_class_t *register_class;
+    bal_value_location_t       *locations;
+    active_interval_t           active[MAX_ACTIVE_INTERVALS];
+    uint64_t                    used_spill_slots[BAL_MAX_SPILL_SLOTS / 64U];
+    size_t                      active_count;
+    uint32_t                    busy_registers_mask;
+    uint32_t                    used_registers_mask;
+    uint32_t                    spill_slot_count;
+    bal_error_t                 status;
+    bal_logger_t               *logger;
+} allocator_context_t;
+
+static void                 allocate_interval(allocator_context_t *, uint32_t, uint32_t);
+static void                 insert_active(allocator_context_t *, uint32_t, uint32_t);
+static bal_value_location_t allocate_spill_slot(allocator_context_t *);
+
+void
+bal_register_class_init(bal_register_class_t *register_class, bal_host_architecture_t architecture)
+{
+    (void)memset(register_class, 0, sizeof(bal_register_class_t));
+
+    if (BAL_HOST_ARCHITECTURE_X86_64 == architecture)
+    {
+        // Caller saved registers come first so small units do not need to
+        // save anything in the prologue.
+        //
+        const uint8_t registers[] = { X86_RSI, X86_RDI, X86_R8,  X86_R9,  X86_R10, X86_R11,
+                                      X86_RDX, X86_RBX, X86_RBP, X86_R12, X86_R13, X86_R14 };
+
+        (void)memcpy(register_class->registers, registers, sizeof(registers));
+        register_class->registers_count      = (uint8_t)sizeof(registers);
+        register_class->guest_state_register = X86_R15;
+        register_class->scratch_registers[0] = X86_RAX;
+        register_class->scratch_registers[1] = X86_RCX;
+        register_class->callee_saved_mask    = (1U << X86_RBX) | (1U << X86_RBP) | (1U << X86_R12)
+                                            | (1U << X86_R13) | (1U << X86_R14) | (1U << X86_R15);
+
+#if BAL_PLATFORM_WINDOWS
+        register_class->callee_saved_mask |= (1U << X86_RSI) | (1U << X86_RDI);
+#endif
+        return;
+    }
+
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < ARM64_X16; ++i)
+    {
+        register_class->registers[count++] = i;
+    }
+
+    for (uint8_t i = ARM64_X19; i < ARM64_X28; ++i)
+    {
+        register_class->registers[count++] = i;
+    }
+
+    register_class->registers_count      = count;
+    register_class->guest_state_register = ARM64_X28;
+    register_class->scratch_registers[0] = ARM64_X16;
+    register_class->scratch_registers[1] = ARM64_X17;
+
+    for (uint32_t i = ARM64_X19; i <= ARM64_X29; ++i)
+    {
+        register_class->callee_saved_mask |= (1U << i);
+    }
+}
+
+void
+bal_register_class_pin(bal_register_class_t *register_class, uint8_t host_register)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < register_class->registers_count; ++i)
+    {
+        if (register_class->registers[i] != host_register)
+        {
+            register_class->registers[count++] = register_class->registers[i];
+        }
+    }
+
+    register_class->registers_count = count;
+}
+
+BAL_HOT bal_error_t
+bal_register_allocate(bal_engine_t *BAL_RESTRICT               engine,
+                      const bal_register_class_t *BAL_RESTRICT register_class,
+                      bal_register_allocation_t *BAL_RESTRICT  allocation)
+{
+    if (BAL_UNLIKELY(NULL == engine || NULL == register_class || NULL == allocation))
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (BAL_UNLIKELY(engine->status != BAL_SUCCESS))
+    {
+        return BAL_ERROR_ENGINE_STATE_INVALID;
+    }
+
+    const uint32_t count = engine->instruction_count;
+
+    // Carve the per-SSA arrays out of scratch memory. The 32-bit arrays come
+    // first to keep them aligned.
+    //
+    uint32_t *BAL_RESTRICT             live_range_ends = (uint32_t *)engine->scratch;
+    uint32_t *BAL_RESTRICT             merge_targets   = live_range_ends + count;
+    bal_value_location_t *BAL_RESTRICT locations
+        = (bal_value_location_t *)(merge_targets + count);
+
+    (void)memset(live_range_ends, 0xFF, count * sizeof(uint32_t));
+
+    // Backward sweep: the first read of a variable we encounter is its last
+    // use. Yields are paired with the merge that closes their scope.
+    //
+    uint32_t merge_stack[MAX_SCOPE_DEPTH];
+    size_t   depth          = 0;
+    size_t   overflow_depth = 0;
+
+    for (uint32_t i = count; i-- > 0;)
+    {
+        const bal_ir_instruction_t instruction = bal_ir_get(engine, i);
+        const bal_opcode_t         opcode      = bal_ir_opcode(instruction);
+
+        locations[i]     = BAL_LOCATION_NONE;
+        merge_targets[i] = INVALID_INDEX;
+
+        switch (opcode)
+        {
+            case OPCODE_MERGE:
+            case OPCODE_END_BLOCK:
+                if (depth >= MAX_SCOPE_DEPTH)
+                {
+                    ++overflow_depth;
+                    break;
+                }
+
+                merge_stack[depth++] = (OPCODE_MERGE == opcode) ? i : INVALID_INDEX;
+                break;
+
+            case OPCODE_IF:
+                if (overflow_depth > 0)
+                {
+                    --overflow_depth;
+                }
+                else if (depth > 0)
+                {
+                    --depth;
+                }
+
+                break;
+
+            case OPCODE_YIELD:
+                if (depth > 0 && 0 == overflow_depth)
+                {
+                    merge_targets[i] = merge_stack[depth - 1];
+                }
+
+                break;
+
+            default:
+                break;
+        }
+
+        // The terminator stores the value of a write left to it, so the
+        // value lives until the end of the unit.
+        //
+        uint32_t sources[3];
+        uint32_t sources_count = bal_ir_variable_sources(instruction, sources);
+        uint32_t end           = (OPCODE_SET_REGISTER_ON_EXIT == opcode) ? count - 1 : i;
+
+        for (uint32_t s = 0; s < sources_count; ++s)
+        {
+            if (sources[s] < count
+                && (INVALID_INDEX == live_range_ends[sources[s]]
+                    || live_range_ends[sources[s]] < end))
+            {
+                live_range_ends[sources[s]] = end;
+            }
+        }
+    }
+
+    BAL_ASSERT_MSG(0 == overflow_depth, "Scopes nested deeper than %u levels.", MAX_SCOPE_DEPTH);
+
+    // Forward linear scan in SSA order. Live ranges start at their definition,
+    // so walking `instructions[]` visits them sorted by start point.
+    //
+    allocator_context_t context;
+    context.register_class      = register_class;
+    context.locations           = locations;
+    context.active_count        = 0;
+    context.busy_registers_mask = 0;
+    context.used_registers_mask = 0;
+    context.spill_slot_count    = 0;
+    context.status              = BAL_SUCCESS;
+    context.logger              = &engine->logger;
+    (void)memset(context.used_spill_slots, 0, sizeof(context.used_spill_slots));
+
+    for (uint32_t i = 0; i < count && BAL_SUCCESS == context.status; ++i)
+    {
+        const bal_opcode_t opcode = bal_ir_opcode(bal_ir_get(engine, i));
+
+        // Expire live ranges that ended before this instruction. Operands read
+        // here stay live so the result never aliases a source.
+        //
+        size_t expired_count = 0;
+
+        while (expired_count < context.active_count && context.active[expired_count].end < i)
+        {
+            bal_value_location_t location = locations[context.active[expired_count].ssa_index];
+
+            if (location & BAL_LOCATION_SPILLED)
+            {
+                uint32_t slot = location & ~BAL_LOCATION_SPILLED;
+                context.used_spill_slots[slot / 64U] &= ~(1ULL << (slot % 64U));
+            }
+            else
+            {
+                context.busy_registers_mask &= ~(1U << location);
+            }
+
+            ++expired_count;
+        }
+
+        if (expired_count > 0)
+        {
+            context.active_count -= expired_count;
+            (void)memmove(context.active,
+                          context.active + expired_count,
+                          context.active_count * sizeof(active_interval_t));
+        }
+
+        if (OPCODE_YIELD == opcode)
+        {
+            uint32_t merge = merge_targets[i];
+
+            if (merge != INVALID_INDEX && BAL_LOCATION_NONE == locations[merge]
+                && live_range_ends[merge] != INVALID_INDEX)
+            {
+                allocate_interval(&context, merge, live_range_ends[merge]);
+            }
+
+            continue;
+        }
+
+        if (false == bal_ir_defines_value(opcode) || INVALID_INDEX == live_range_ends[i]
+            || locations[i] != BAL_LOCATION_NONE)
+        {
+            continue;
+        }
+
+        allocate_interval(&context, i, live_range_ends[i]);
+    }
+
+    allocation->locations           = locations;
+    allocation->live_range_ends     = live_range_ends;
+    allocation->spill_slot_count    = context.spill_slot_count;
+    allocation->used_registers_mask = context.used_registers_mask;
+
+    BAL_LOG_INFO(&engine->logger,
+                 "Register allocation finished. Registers: 0x%08x, Spill slots: %u.",
+                 context.used_registers_mask,
+                 context.spill_slot_count);
+
+    return context.status;
+}
+
+/// Inserts a live range into the active list, keeping it sorted by end point.
+static void
+insert_active(allocator_context_t *context, uint32_t ssa_index, uint32_t end)
+{
+    size_t position = context->active_count;
+
+    while (position > 0 && context->active[position - 1].end > end)
+    {
+        context->active[position] = context->active[position - 1];
+        --position;
+    }
+
+    context->active[position] = (active_interval_t) { .ssa_index = ssa_index, .end = end };
+    ++context->active_count;
+}
+
+static bal_value_location_t
+allocate_spill_slot(allocator_context_t *context)
+{
+    for (uint32_t word = 0; word < BAL_MAX_SPILL_SLOTS / 64U; ++word)
+    {
+        uint64_t used = context->used_spill_slots[word];
+
+        if (UINT64_MAX == used)
+        {
+            continue;
+        }
+
+        uint32_t bit = 0;
+
+        while (used & (1ULL << bit))
+        {
+            ++bit;
+        }
+
+        uint32_t slot = (word * 64U) + bit;
+        context->used_spill_slots[word] |= (1ULL << bit);
+
+        if (slot + 1 > context->spill_slot_count)
+        {
+            context->spill_slot_count = slot + 1;
+        }
+
+        return (bal_value_location_t)(slot | BAL_LOCATION_SPILLED);
+    }
+
+    BAL_LOG_ERROR(context->logger, "Ran out of %u spill slots.", BAL_MAX_SPILL_SLOTS);
+    context->status = BAL_ERROR_SPILL_SLOT_OVERFLOW;
+    return BAL_LOCATION_NONE;
+}
+
+static void
+allocate_interval(allocator_context_t *context, uint32_t ssa_index, uint32_t end)
+{
+    const bal_register_class_t *register_class = context->register_class;
+
+    for (uint8_t i = 0; i < register_class->registers_count; ++i)
+    {
+        uint8_t host_register = register_class->registers[i];
+
+        if (0 == (context->busy_registers_mask & (1U << host_register)))
+        {
+            context->busy_registers_mask |= (1U << host_register);
+            context->used_registers_mask |= (1U << host_register);
+            context->locations[ssa_index] = host_register;
+            insert_active(context, ssa_index, end);
+
+            BAL_LOG_TRACE(context->logger, "  RA: v%u -> r%u", ssa_index, host_register);
+            return;
+        }
+    }
+
+    // Every register is taken. Spill whichever register resident live range
+    // ends last, which might be the new one.
+    //
+    size_t victim = context->active_count;
+
+    for (size_t i = context->active_count; i-- > 0;)
+    {
+        if (0 == (context->locations[context->active[i].ssa_index] & BAL_LOCATION_SPILLED))
+        {
+            victim = i;
+            break;
+        }
+    }
+
+    bal_value_location_t slot = allocate_spill_slot(context);
+
+    if (BAL_UNLIKELY(BAL_LOCATION_NONE == slot))
+    {
+        return;
+    }
+
+    if (victim < context->active_count && context->active[victim].end > end)
+    {
+        uint32_t victim_index         = context->active[victim].ssa_index;
+        context->locations[ssa_index] = context->locations[victim_index];
+        context->locations[victim_index] = slot;
+
+        BAL_LOG_TRACE(context->logger,
+                      "  RA: v%u -> r%u, spilled v%u -> [slot %u]",
+                      ssa_index,
+                      context->locations[ssa_index],
+                      victim_index,
+                      slot & ~BAL_LOCATION_SPILLED);
+    }
+    else
+    {
+        context->locations[ssa_index] = slot;
+        BAL_LOG_TRACE(context->logger,
+                      "  RA: v%u -> [slot %u]",
+                      ssa_index,
+                      slot & ~BAL_LOCATION_SPILLED);
+    }
+
+    insert_active(context, ssa_index, end);
+}
+
+/*** end of file ***/
@@ -0,0 +1,1770 @@
+#include "bal_runtime.h"
+#include "bal_backend.h"
+#include "bal_assert.h"
+#include "bal_atomic.h"
+#include "bal_passes.h"
+#include "bal_platform.h"
+#include <string.h>
+
+static bal_error_t dispatch_slow(bal_runtime_t *,
+                                 bal_vcpu_t *,
+                                 bal_guest_address_t,
+                                 uint32_t,
+                                 bal_interpreter_unit_t *);
+static bal_error_t translate_unit(bal_runtime_t *, bal_guest_address_t);
+static bal_error_t compile_unit(bal_runtime_t *, bal_guest_address_t, uint32_t, uint32_t *);
+static bal_error_t prepare_unit(bal_runtime_t *, bal_guest_address_t, uint32_t, size_t *, bool *);
+static bal_error_t emit_unit(bal_runtime_t *,
+                             const bal_persistent_cache_entry_t *,
+                             uint32_t,
+                             bal_compiled_unit_t *,
+                             uint32_t *);
+static const bal_persistent_cache_entry_t *find_cached_unit(bal_runtime_t *,
+                                                            bal_guest_address_t,
+                                                            uint32_t);
+static void        record_unit(bal_runtime_t *,
+                               const bal_translation_t *,
+                               const bal_compiled_unit_t *);
+static bool        hash_guest_code(bal_runtime_t *, const bal_translation_t *, uint64_t *);
+static uint64_t    persistent_cache_context(const bal_runtime_t *);
+static void        start_code_segment(bal_runtime_t *, uint32_t);
+static void        evict_code_segment(bal_runtime_t *);
+static bool        make_room(bal_runtime_t *);
+static bool        wait_for_vcpus(bal_runtime_t *, uint64_t);
+static void        lock_runtime(bal_runtime_t *, const void *);
+static void        unlock_runtime(bal_runtime_t *);
+static void        invalidate(bal_runtime_t *, bal_guest_address_t, size_t);
+static uint32_t    evicted_filter_bit(bal_guest_address_t);
+static bal_error_t find_interpreted_unit(bal_runtime_t *,
+                                         bal_guest_address_t,
+                                         bal_interpreter_unit_t *);
+static bool        wait_for_interpreter(bal_runtime_t *);
+static bal_error_t run_interpreted_unit(bal_runtime_t *,
+                                        bal_vcpu_t *,
+                                        uint32_t,
+                                        const bal_interpreter_unit_t *,
+                                        bal_guest_address_t *);
+static void        retire_unit(bal_runtime_t *, uint32_t);
+static void        watch_code(bal_runtime_t *, const bal_translation_t *, bool);
+static void        protect_code(bal_runtime_t *, bal_guest_address_t, size_t, bool);
+static void        handle_code_write(void *, bal_tlb_t *, bal_guest_address_t, uint64_t);
+static bool        sync_return_stack(const bal_runtime_t *, bal_vcpu_t *);
+static bal_error_t take_memory_fault(bal_runtime_t *, bal_vcpu_t *);
+static void        promote_hot_units(bal_runtime_t *);
+static size_t      interpreter_values_size(const bal_runtime_t *);
+static void        free_interpreter(bal_allocator_t *, bal_runtime_t *);
+static void        free_promotion_state(bal_allocator_t *, bal_runtime_t *);
+static void        link_unit(bal_runtime_t *, uint32_t);
+static void        patch_link(bal_runtime_t *, uint32_t, uint32_t);
+static void        unlink_incoming(bal_runtime_t *, uint32_t);
+static void        unlink_all(bal_runtime_t *);
+static void        relink_all(bal_runtime_t *);
+static void        fill_inline_cache(bal_runtime_t *, uint32_t, uint32_t);
+
+void
+bal_runtime_config_init_default(bal_runtime_config_t *config)
+{
+    config->code_memory_size     = 64U * 1024U * 1024U;
+    config->cold_code_size       = 8U * 1024U * 1024U;
+    config->code_segments        = 8U;
+    config->max_unit_size        = 256U * sizeof(uint32_t);
+    config->max_translations     = 16384U;
+    config->max_vcpus            = 1U;
+    config->enable_block_linking = true;
+    config->inline_cache_entries = 2U;
+
+    config->enable_execution_counters = false;
+    config->promotion_threshold       = 4096U;
+
+    config->enable_interpreter    = false;
+    config->interpreter_threshold = 8U;
+    config->interpreter_capacity  = 64U * 1024U;
+
+    config->fastmem               = NULL;
+    config->persistent_cache_path = NULL;
+}
+
+bal_error_t
+bal_runtime_init(bal_allocator_t            *allocator,
+                 bal_runtime_t              *runtime,
+                 bal_memory_interface_t     *interface,
+                 const bal_runtime_config_t *config,
+                 bal_logger_t                logger)
+{
+    if (NULL == allocator || NULL == runtime || NULL == interface)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+#if !BAL_ARCHITECTURE_X86
+    BAL_LOG_ERROR(&logger, "Runtime init failed. No backend for the host architecture.");
+    return BAL_ERROR_UNSUPPORTED_HOST;
+#endif
+
+    (void)memset(runtime, 0, sizeof(*runtime));
+
+    if (NULL == config)
+    {
+        bal_runtime_config_init_default(&runtime->config);
+    }
+    else
+    {
+        runtime->config = *config;
+    }
+
+    if (0 == runtime->config.code_segments)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. The code memory has no segments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (0 == runtime->config.max_vcpus)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. No vCPU may run.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (runtime->config.enable_execution_counters && 0 == runtime->config.promotion_threshold)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. The promotion threshold is zero.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (runtime->config.enable_interpreter && 0 == runtime->config.interpreter_threshold)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. The interpreter threshold is zero.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Units spanning at most two pages keep the page index of the cache
+    // exact.
+    //
+    if (runtime->config.max_unit_size > BAL_TLB_PAGE_SIZE)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. Units may not exceed one page.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (runtime->config.fastmem != NULL && NULL == runtime->config.fastmem->base)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. The fastmem region is not initialized.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Fastmem sites are patched by the fault handler without taking the
+    // lock.
+    //
+    if (runtime->config.fastmem != NULL && runtime->config.max_vcpus > 1)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. Fastmem only supports one vCPU.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Hot code branches into cold code with 32-bit displacements.
+    //
+    if (runtime->config.cold_code_size != 0
+        && runtime->config.code_memory_size > (size_t)INT32_MAX + 1U)
+    {
+        BAL_LOG_ERROR(&logger, "Runtime init failed. Code memory too large for a cold region.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    runtime->interface = interface;
+    runtime->logger    = logger;
+    bal_code_pages_init(&runtime->code_pages);
+
+    bal_register_class_init(&runtime->register_class, BAL_HOST_ARCHITECTURE_NATIVE);
+
+    if (runtime->config.fastmem != NULL)
+    {
+        bal_register_class_pin(&runtime->register_class, BAL_FASTMEM_BASE_REGISTER_X86_64);
+    }
+
+    bal_error_t error = bal_engine_init(allocator, &runtime->engine, logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return error;
+    }
+
+    error = bal_code_memory_init(&runtime->code_memory, runtime->config.code_memory_size, logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        bal_engine_destroy(allocator, &runtime->engine);
+        return error;
+    }
+
+    if (runtime->config.cold_code_size != 0)
+    {
+        error = bal_code_memory_split(&runtime->code_memory, runtime->config.cold_code_size);
+
+        if (BAL_SUCCESS == error)
+        {
+            error = bal_code_buffer_init_code_memory_region(&runtime->cold_code_buffer,
+                                                            &runtime->code_memory,
+                                                            BAL_CODE_REGION_COLD,
+                                                            logger);
+        }
+    }
+
+    if (BAL_SUCCESS == error)
+    {
+        error = bal_code_buffer_init_code_memory(
+            &runtime->code_buffer, &runtime->code_memory, logger);
+    }
+
+    if (BAL_SUCCESS == error)
+    {
+        const bal_code_memory_t *code_memory = &runtime->code_memory;
+        const uint32_t           segments    = runtime->config.code_segments;
+
+        runtime->hot_segment_size  = code_memory->cold_offset / segments;
+        runtime->cold_segment_size = (code_memory->reserved_size - code_memory->cold_offset)
+                                     / segments;
+        start_code_segment(runtime, 0);
+
+        error = bal_translation_cache_init(
+            allocator, &runtime->cache, runtime->config.max_translations, logger);
+    }
+
+    if (BAL_SUCCESS == error)
+    {
+        error = bal_epoch_init(allocator, &runtime->epoch, runtime->config.max_vcpus, logger);
+
+        if (error != BAL_SUCCESS)
+        {
+            bal_translation_cache_destroy(allocator, &runtime->cache);
+        }
+    }
+
+    if (BAL_SUCCESS == error && runtime->config.enable_execution_counters)
+    {
+        size_t count = runtime->config.max_translations;
+
+        runtime->execution_counters = (int32_t *)allocator->allocate(
+            allocator->handle, 64U, count * sizeof(int32_t));
+        runtime->promotion_queue = (uint32_t *)allocator->allocate(
+            allocator->handle, 64U, count * sizeof(uint32_t));
+
+        if (NULL == runtime->execution_counters || NULL == runtime->promotion_queue)
+        {
+            BAL_LOG_ERROR(&logger, "Failed to allocate %zu execution counters.", count);
+            free_promotion_state(allocator, runtime);
+            bal_translation_cache_destroy(allocator, &runtime->cache);
+            error = BAL_ERROR_ALLOCATION_FAILED;
+        }
+    }
+
+    if (BAL_SUCCESS == error && runtime->config.enable_interpreter)
+    {
+        error = bal_interpreter_init(allocator,
+                                     &runtime->interpreter,
+                                     runtime->config.max_translations,
+                                     runtime->config.interpreter_capacity,
+                                     logger);
+
+        if (BAL_SUCCESS == error)
+        {
+            runtime->interpreter_values = (uint64_t *)allocator->allocate(
+                allocator->handle, 64U, interpreter_values_size(runtime));
+
+            if (NULL == runtime->interpreter_values)
+            {
+                BAL_LOG_ERROR(&logger,
+                              "Failed to allocate interpreter values for %u vCPUs.",
+                              runtime->config.max_vcpus);
+                bal_interpreter_destroy(allocator, &runtime->interpreter);
+                error = BAL_ERROR_ALLOCATION_FAILED;
+            }
+        }
+
+        if (error != BAL_SUCCESS)
+        {
+            free_promotion_state(allocator, runtime);
+            bal_translation_cache_destroy(allocator, &runtime->cache);
+        }
+
+        runtime->interpreter.code_pages = &runtime->code_pages;
+    }
+
+    if (BAL_SUCCESS == error && runtime->config.persistent_cache_path != NULL)
+    {
+        error = bal_persistent_cache_open(allocator,
+                                          &runtime->persistent_cache,
+                                          runtime->config.persistent_cache_path,
+                                          persistent_cache_context(runtime),
+                                          logger);
+
+        if (error != BAL_SUCCESS)
+        {
+            free_interpreter(allocator, runtime);
+            free_promotion_state(allocator, runtime);
+            bal_translation_cache_destroy(allocator, &runtime->cache);
+        }
+    }
+
+    if (error != BAL_SUCCESS)
+    {
+        bal_epoch_destroy(allocator, &runtime->epoch);
+        bal_code_memory_destroy(&runtime->code_memory);
+        bal_engine_destroy(allocator, &runtime->engine);
+        return error;
+    }
+
+    BAL_LOG_INFO(&logger,
+                 "Runtime initialized. Block linking: %s, Inline cache entries: %u, "
+                 "Execution counters: %s, Interpreter: %s.",
+                 runtime->config.enable_block_linking ? "on" : "off",
+                 runtime->config.inline_cache_entries,
+                 runtime->config.enable_execution_counters ? "on" : "off",
+                 runtime->config.enable_interpreter ? "on" : "off");
+
+    return BAL_SUCCESS;
+}
+
+bal_error_t
+bal_runtime_run(bal_runtime_t *BAL_RESTRICT       runtime,
+                bal_vcpu_t *BAL_RESTRICT          vcpu,
+                bal_guest_address_t *BAL_RESTRICT guest_address,
+                bal_guest_address_t               halt_address)
+{
+    bal_guest_address_t address     = *guest_address;
+    uint32_t            miss_source = BAL_VCPU_EXIT_UNIT_NONE;
+    uint64_t            dispatches  = 0;
+    uint32_t            slot        = 0;
+    bal_error_t         error       = bal_epoch_claim(&runtime->epoch, &slot);
+
+    if (BAL_UNLIKELY(error != BAL_SUCCESS))
+    {
+        return error;
+    }
+
+    if (BAL_UNLIKELY(vcpu->tlb.interface != runtime->interface
+                     || vcpu->tlb.code_pages != &runtime->code_pages))
+    {
+        bal_tlb_init(&vcpu->tlb, runtime->interface);
+        bal_tlb_watch_code(&vcpu->tlb, &runtime->code_pages, handle_code_write, runtime);
+        bal_vcpu_clear_exclusive_monitor(vcpu);
+    }
+
+    while (address != halt_address)
+    {
+        // The last unit has returned, so whatever it ran may be reused once
+        // the other vCPUs are done with it too.
+        //
+        bal_epoch_quiesce(&runtime->epoch, slot);
+
+        // Units the return stack predicts, and the unit that missed, may
+        // have been discarded since.
+        //
+        if (BAL_UNLIKELY(sync_return_stack(runtime, vcpu)))
+        {
+            miss_source = BAL_VCPU_EXIT_UNIT_NONE;
+        }
+
+        uint32_t    index = bal_translation_cache_lookup(&runtime->cache, address);
+        const void *entry = NULL;
+
+        if (BAL_LIKELY(index != BAL_TRANSLATION_NONE))
+        {
+            entry = bal_atomic_load_pointer(&runtime->cache.translations[index].entry);
+        }
+
+        bool fill = miss_source != BAL_VCPU_EXIT_UNIT_NONE && runtime->config.enable_block_linking
+                    && runtime->config.inline_cache_entries != 0;
+
+        if (BAL_UNLIKELY(NULL == entry || fill
+                         || bal_atomic_load_32(&runtime->promotion_queue_count) != 0))
+        {
+            bal_interpreter_unit_t interpreted = { 0 };
+
+            // Going offline first lets a lock holder waiting for the other
+            // vCPUs count this one as done. Coming back online before the
+            // lock is released keeps the arenas of the unit to interpret
+            // from being emptied before it runs.
+            //
+            bal_epoch_offline(&runtime->epoch, slot);
+            lock_runtime(runtime, vcpu);
+            error = dispatch_slow(runtime,
+                                  vcpu,
+                                  address,
+                                  fill ? miss_source : BAL_VCPU_EXIT_UNIT_NONE,
+                                  &interpreted);
+            bal_epoch_online(&runtime->epoch, slot);
+            unlock_runtime(runtime);
+
+            miss_source = BAL_VCPU_EXIT_UNIT_NONE;
+
+            if (BAL_SUCCESS == error && interpreted.guest_size != 0)
+            {
+                error = run_interpreted_unit(runtime, vcpu, slot, &interpreted, &address);
+            }
+
+            if (error != BAL_SUCCESS)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        bal_unit_function_t unit = (bal_unit_function_t)(uintptr_t)entry;
+
+        // The unit may have been translated from a page this TLB still maps
+        // for writes.
+        //
+        bal_tlb_sync_code(&vcpu->tlb);
+
+        dispatches++;
+        vcpu->exit_unit = BAL_VCPU_EXIT_UNIT_NONE;
+        vcpu->hot_unit  = BAL_VCPU_EXIT_UNIT_NONE;
+        address         = unit(vcpu);
+        miss_source     = vcpu->exit_unit;
+
+        if (BAL_UNLIKELY(vcpu->tlb.fault != 0))
+        {
+            error = take_memory_fault(runtime, vcpu);
+            break;
+        }
+
+        if (miss_source != BAL_VCPU_EXIT_UNIT_NONE)
+        {
+            vcpu->counters.inline_cache_misses++;
+        }
+
+        if (BAL_UNLIKELY(vcpu->hot_unit != BAL_VCPU_EXIT_UNIT_NONE))
+        {
+            lock_runtime(runtime, vcpu);
+
+            if (runtime->promotion_queue_count < runtime->cache.capacity)
+            {
+                runtime->promotion_queue[runtime->promotion_queue_count] = vcpu->hot_unit;
+                bal_atomic_store_32(&runtime->promotion_queue_count,
+                                    runtime->promotion_queue_count + 1);
+            }
+
+            unlock_runtime(runtime);
+        }
+    }
+
+    (void)bal_atomic_fetch_add(&runtime->stats.dispatches, dispatches, sizeof(uint64_t));
+    bal_epoch_release(&runtime->epoch, slot);
+
+    *guest_address = address;
+    vcpu->state.pc = address;
+    return error;
+}
+
+void
+bal_runtime_invalidate(bal_runtime_t *runtime, bal_guest_address_t guest_address, size_t size)
+{
+    lock_runtime(runtime, runtime);
+    invalidate(runtime, guest_address, size);
+    unlock_runtime(runtime);
+}
+
+bal_error_t
+bal_runtime_save_cache(bal_runtime_t *runtime)
+{
+    if (NULL == runtime || NULL == runtime->config.persistent_cache_path)
+    {
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    lock_runtime(runtime, runtime);
+    bal_error_t error = bal_persistent_cache_save(&runtime->persistent_cache);
+    unlock_runtime(runtime);
+
+    return error;
+}
+
+void
+bal_runtime_destroy(bal_allocator_t *allocator, bal_runtime_t *runtime)
+{
+    if (NULL == allocator || NULL == runtime)
+    {
+        return;
+    }
+
+    if (runtime->config.persistent_cache_path != NULL)
+    {
+        bal_persistent_cache_close(&runtime->persistent_cache);
+    }
+
+    free_interpreter(allocator, runtime);
+    free_promotion_state(allocator, runtime);
+    bal_epoch_destroy(allocator, &runtime->epoch);
+    bal_translation_cache_destroy(allocator, &runtime->cache);
+    bal_code_memory_destroy(&runtime->code_memory);
+    bal_engine_destroy(allocator, &runtime->engine);
+}
+
+/// Does what the dispatcher can not do without the lock, which the caller
+/// holds: promotes hot units, then compiles the unit at `address` if it is
+/// missing, or copies it to `interpreted` if the interpreter runs it, which
+/// the caller does after releasing the lock. `miss_source` is the unit whose
+/// inline cache missed on the way to `address`, filled with the unit found
+/// there, or [`BAL_VCPU_EXIT_UNIT_NONE`].
+static bal_error_t
+dispatch_slow(bal_runtime_t          *runtime,
+              bal_vcpu_t             *vcpu,
+              bal_guest_address_t     address,
+              uint32_t                miss_source,
+              bal_interpreter_unit_t *interpreted)
+{
+    // Promotion discards units, including possibly the one that missed.
+    //
+    if (runtime->promotion_queue_count != 0)
+    {
+        promote_hot_units(runtime);
+    }
+
+    uint32_t index = bal_translation_cache_lookup(&runtime->cache, address);
+
+    if (BAL_TRANSLATION_NONE == index && runtime->config.enable_interpreter)
+    {
+        bal_error_t error = find_interpreted_unit(runtime, address, interpreted);
+
+        if (error != BAL_SUCCESS || interpreted->guest_size != 0)
+        {
+            return error;
+        }
+    }
+
+    if (BAL_TRANSLATION_NONE == index)
+    {
+        bal_error_t error = compile_unit(runtime, address, 1, &index);
+
+        if (error != BAL_SUCCESS)
+        {
+            return error;
+        }
+    }
+
+    // Making room for a unit, or a store to code by another vCPU, may have
+    // discarded the unit that missed since the dispatcher looked at it.
+    //
+    // No site is linked while another vCPU waits for the rest to return to
+    // the dispatcher.
+    //
+    if (miss_source != BAL_VCPU_EXIT_UNIT_NONE
+        && vcpu->return_stack.generation == runtime->generation && 0 == runtime->waiters)
+    {
+        fill_inline_cache(runtime, miss_source, index);
+    }
+
+    return BAL_SUCCESS;
+}
+
+/// Discards every unit overlapping `[guest_address, guest_address + size)`.
+/// See [`bal_runtime_invalidate`]. The caller holds the lock.
+static void
+invalidate(bal_runtime_t *runtime, bal_guest_address_t guest_address, size_t size)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    for (;;)
+    {
+        uint32_t index = bal_translation_cache_find_overlapping(cache, guest_address, size);
+
+        if (BAL_TRANSLATION_NONE == index)
+        {
+            break;
+        }
+
+        BAL_LOG_DEBUG(&runtime->logger,
+                      "Invalidated unit 0x%llx (%zu bytes).",
+                      (unsigned long long)cache->translations[index].guest_address,
+                      cache->translations[index].exit.guest_size);
+
+        retire_unit(runtime, index);
+        runtime->stats.invalidations++;
+    }
+
+    if (runtime->config.enable_interpreter)
+    {
+        bal_interpreter_invalidate(&runtime->interpreter, guest_address, size);
+    }
+}
+
+/// Takes the lock that serializes every change to `runtime`, spinning until
+/// it is free. `owner` is the vCPU taking it, or the runtime itself for a
+/// call from the host.
+static void
+lock_runtime(bal_runtime_t *runtime, const void *owner)
+{
+    while (bal_atomic_compare_swap(
+               &runtime->lock_owner, 0, (uint64_t)(uintptr_t)owner, sizeof(uint64_t))
+           != 0)
+    {
+        bal_atomic_yield();
+    }
+}
+
+static void
+unlock_runtime(bal_runtime_t *runtime)
+{
+    bal_atomic_store_64(&runtime->lock_owner, 0);
+}
+
+/// Clears the return stack buffer of `vcpu` if units were discarded since it
+/// was last used, as its predictions may point at them. Returns `true` if it
+/// did.
+static inline bool
+sync_return_stack(const bal_runtime_t *runtime, bal_vcpu_t *vcpu)
+{
+    uint64_t generation = bal_atomic_load_64(&runtime->generation);
+
+    if (BAL_UNLIKELY(vcpu->return_stack.generation != generation))
+    {
+        bal_vcpu_clear_return_stack(vcpu);
+        vcpu->return_stack.generation = generation;
+        return true;
+    }
+
+    return false;
+}
+
+/// Clears the fault flag of the TLB of `vcpu` so the next access can run, and
+/// returns the error reported for it. The faulting address stays in
+/// `vcpu->tlb.fault_address`.
+static bal_error_t
+take_memory_fault(bal_runtime_t *runtime, bal_vcpu_t *vcpu)
+{
+    BAL_LOG_DEBUG(&runtime->logger,
+                  "Guest memory fault at 0x%llx.",
+                  (unsigned long long)vcpu->tlb.fault_address);
+
+    vcpu->tlb.fault = 0;
+    return BAL_ERROR_GUEST_MEMORY_FAULT;
+}
+
+/// Translates the guest code at `guest_address` into the IR of the engine.
+static bal_error_t
+translate_unit(bal_runtime_t *runtime, bal_guest_address_t guest_address)
+{
+    bal_memory_interface_t *interface = runtime->interface;
+    size_t                  readable  = 0;
+    const uint8_t          *code      = interface->translate(interface, guest_address, &readable);
+
+    if (BAL_UNLIKELY(NULL == code || readable < sizeof(uint32_t)))
+    {
+        BAL_LOG_ERROR(&runtime->logger,
+                      "Failed to fetch guest code at 0x%llx.",
+                      (unsigned long long)guest_address);
+        return BAL_ERROR_GUEST_MEMORY_FAULT;
+    }
+
+    size_t size = (readable < runtime->config.max_unit_size) ? readable
+                                                             : runtime->config.max_unit_size;
+    size &= ~(sizeof(uint32_t) - 1);
+
+    bal_engine_t *engine = &runtime->engine;
+    (void)bal_engine_reset(engine);
+    engine->guest_address = guest_address;
+
+    return bal_engine_translate(engine, interface, (const uint32_t *)code, size);
+}
+
+/// Copies the unit at `guest_address` in the interpreter to `unit`, decoding
+/// it first if it is not there yet, and counts it down. `unit` stays empty
+/// if the unit can not be interpreted and has to be compiled instead. The
+/// caller holds the lock.
+static bal_error_t
+find_interpreted_unit(bal_runtime_t          *runtime,
+                      bal_guest_address_t     guest_address,
+                      bal_interpreter_unit_t *unit)
+{
+    bal_interpreter_t      *interpreter = &runtime->interpreter;
+    bal_interpreter_unit_t *entry       = bal_interpreter_lookup(interpreter, guest_address);
+
+    while (NULL == entry)
+    {
+        bal_error_t error = translate_unit(runtime, guest_address);
+
+        if (error != BAL_SUCCESS)
+        {
+            return error;
+        }
+
+        // A unit that does not fit empties the arenas, which other vCPUs may
+        // still be running units from. Waiting for them releases the lock, so
+        // the IR may be gone and the unit decoded by someone else.
+        //
+        if (false == bal_interpreter_fits(interpreter, &runtime->engine)
+            && wait_for_interpreter(runtime))
+        {
+            entry = bal_interpreter_lookup(interpreter, guest_address);
+            continue;
+        }
+
+        error = bal_interpreter_decode(interpreter,
+                                       &runtime->engine,
+                                       (int32_t)runtime->config.interpreter_threshold,
+                                       &entry);
+
+        if (error != BAL_SUCCESS)
+        {
+            BAL_LOG_DEBUG(&runtime->logger,
+                          "Unit 0x%llx can not be interpreted: %s.",
+                          (unsigned long long)guest_address,
+                          bal_error_to_string(error));
+            return BAL_SUCCESS;
+        }
+    }
+
+    runtime->stats.interpretations++;
+    entry->counter--;
+    *unit = *entry;
+    return BAL_SUCCESS;
+}
+
+/// Waits until no vCPU runs a unit from the interpreter arenas, so they can
+/// be emptied. The caller holds the lock and is offline. Returns `true` if
+/// the lock was released meanwhile, like [`wait_for_vcpus`].
+static bool
+wait_for_interpreter(bal_runtime_t *runtime)
+{
+    uint64_t epoch = bal_epoch_current(&runtime->epoch);
+    bal_epoch_advance(&runtime->epoch);
+    return wait_for_vcpus(runtime, epoch);
+}
+
+/// Runs `unit`, copied out by [`find_interpreted_unit`], on `vcpu` without
+/// the lock and moves `*address` to where it exits. `slot` is the epoch slot
+/// of the vCPU, which also picks its value slots. Compiles the unit at Tier 1
+/// if this run used up its counter.
+static bal_error_t
+run_interpreted_unit(bal_runtime_t                *runtime,
+                     bal_vcpu_t                   *vcpu,
+                     uint32_t                      slot,
+                     const bal_interpreter_unit_t *unit,
+                     bal_guest_address_t          *address)
+{
+    uint64_t *values
+        = runtime->interpreter_values + (size_t)slot * runtime->interpreter.value_capacity;
+
+    bal_tlb_sync_code(&vcpu->tlb);
+    *address = bal_interpreter_run(&runtime->interpreter, unit, vcpu, values);
+
+    if (BAL_UNLIKELY(vcpu->tlb.fault != 0))
+    {
+        return take_memory_fault(runtime, vcpu);
+    }
+
+    if (BAL_LIKELY(unit->counter != 0))
+    {
+        return BAL_SUCCESS;
+    }
+
+    bal_epoch_offline(&runtime->epoch, slot);
+    lock_runtime(runtime, vcpu);
+
+    uint32_t    index = BAL_TRANSLATION_NONE;
+    bal_error_t error = compile_unit(runtime, unit->guest_address, 1, &index);
+
+    // Other vCPUs may have discarded the unit, or decoded it again, since it
+    // was copied.
+    //
+    bal_interpreter_unit_t *entry = bal_interpreter_lookup(&runtime->interpreter,
+                                                           unit->guest_address);
+
+    if (BAL_UNLIKELY(error != BAL_SUCCESS))
+    {
+        BAL_LOG_WARN(&runtime->logger,
+                     "Failed to compile warm unit 0x%llx: %s.",
+                     (unsigned long long)unit->guest_address,
+                     bal_error_to_string(error));
+
+        if (entry != NULL)
+        {
+            entry->counter = (int32_t)runtime->config.interpreter_threshold;
+        }
+    }
+    else if (entry != NULL)
+    {
+        bal_interpreter_evict(&runtime->interpreter, entry);
+    }
+
+    bal_epoch_online(&runtime->epoch, slot);
+    unlock_runtime(runtime);
+    return BAL_SUCCESS;
+}
+
+/// Translates and compiles the unit at `guest_address` at `tier`, or loads
+/// it from the persistent cache, then links it into the block graph. Returns
+/// the unit another vCPU compiled there instead if it had to wait for them.
+static bal_error_t
+compile_unit(bal_runtime_t      *runtime,
+             bal_guest_address_t guest_address,
+             uint32_t            tier,
+             uint32_t           *index)
+{
+    const bal_persistent_cache_entry_t *cached = NULL;
+
+    size_t              flags_assumption_size = 0;
+    bool                flags_live_on_entry   = true;
+    bal_error_t         error                 = BAL_SUCCESS;
+    bal_compiled_unit_t unit;
+    uint32_t            unit_id = BAL_TRANSLATION_NONE;
+
+    // Waiting for other vCPUs to leave a segment lets them take the lock and
+    // reuse the engine, so the unit is translated again afterwards.
+    //
+    for (;;)
+    {
+        cached                = find_cached_unit(runtime, guest_address, tier);
+        flags_assumption_size = 0;
+        flags_live_on_entry   = true;
+        error                 = BAL_SUCCESS;
+
+        if (NULL == cached)
+        {
+            error = prepare_unit(
+                runtime, guest_address, tier, &flags_assumption_size, &flags_live_on_entry);
+        }
+
+        if (error != BAL_SUCCESS)
+        {
+            break;
+        }
+
+        bool stale = make_room(runtime);
+
+        if (false == stale)
+        {
+            error = emit_unit(runtime, cached, tier, &unit, &unit_id);
+        }
+
+        // The unit did not fit in the rest of the segment, so it starts the
+        // next one instead.
+        //
+        if (false == stale && BAL_ERROR_CODE_BUFFER_OVERFLOW == error)
+        {
+            evict_code_segment(runtime);
+            stale = wait_for_vcpus(runtime, runtime->segment_epoch);
+
+            if (false == stale)
+            {
+                error = emit_unit(runtime, cached, tier, &unit, &unit_id);
+            }
+        }
+
+        if (false == stale)
+        {
+            break;
+        }
+
+        *index = bal_translation_cache_lookup(&runtime->cache, guest_address);
+
+        if (*index != BAL_TRANSLATION_NONE)
+        {
+            return BAL_SUCCESS;
+        }
+    }
+
+    if (BAL_UNLIKELY(error != BAL_SUCCESS))
+    {
+        BAL_LOG_ERROR(&runtime->logger,
+                      "Failed to compile unit at 0x%llx: %s.",
+                      (unsigned long long)guest_address,
+                      bal_error_to_string(error));
+        return error;
+    }
+
+    bal_translation_t translation = {
+        .guest_address = guest_address,
+        .entry         = unit.entry,
+        .body          = (const uint8_t *)unit.entry + unit.body_offset,
+        .code_offset   = unit.offset,
+        .code_size     = unit.size,
+        .cold_offset   = unit.cold_offset,
+        .cold_size     = unit.cold_size,
+        .exit          = runtime->engine.unit_exit,
+        .tier          = tier,
+
+        .flags_live_on_entry   = flags_live_on_entry,
+        .flags_assumption_size = flags_assumption_size,
+    };
+
+    if (cached != NULL)
+    {
+        translation.exit.kind            = (bal_unit_exit_kind_t)cached->exit_kind;
+        translation.exit.target_register = cached->exit_target_register;
+        translation.exit.target          = cached->exit_target;
+        translation.exit.return_address  = cached->exit_return_address;
+        translation.exit.guest_size      = cached->guest_size;
+
+        translation.flags_live_on_entry   = (cached->flags_live_on_entry != 0);
+        translation.flags_assumption_size = cached->flags_assumption_size;
+    }
+    else if (runtime->config.persistent_cache_path != NULL)
+    {
+        record_unit(runtime, &translation, &unit);
+    }
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        translation.links[kind].target = BAL_LINK_TARGET_NONE;
+
+        if (unit.link_offsets[kind] != 0)
+        {
+            translation.links[kind].site = unit.offset + unit.link_offsets[kind];
+        }
+    }
+
+    translation.links[BAL_LINK_KIND_JUMP].target           = translation.exit.target;
+    translation.links[BAL_LINK_KIND_RETURN_ADDRESS].target = translation.exit.return_address;
+    translation.links[BAL_LINK_KIND_NOT_TAKEN].target      = translation.exit.return_address;
+
+    error = bal_translation_cache_insert(&runtime->cache, &translation, index);
+
+    if (BAL_UNLIKELY(error != BAL_SUCCESS))
+    {
+        return error;
+    }
+
+    BAL_ASSERT(*index == unit_id);
+
+    watch_code(runtime, &runtime->cache.translations[*index], true);
+
+    if (cached != NULL)
+    {
+        runtime->stats.cache_loads++;
+    }
+    else
+    {
+        runtime->stats.translations++;
+    }
+
+    uint32_t  bit     = evicted_filter_bit(guest_address);
+    uint64_t *evicted = &runtime->evicted_filter[bit / 64U];
+
+    if (BAL_UNLIKELY((*evicted >> (bit % 64U)) & 1U))
+    {
+        *evicted &= ~(1ULL << (bit % 64U));
+        runtime->stats.retranslations++;
+    }
+
+    // While another vCPU waits for the rest to return to the dispatcher, the
+    // unit is linked by the last one to stop waiting.
+    //
+    if (runtime->config.enable_block_linking && 0 == runtime->waiters)
+    {
+        link_unit(runtime, *index);
+    }
+
+    return BAL_SUCCESS;
+}
+
+/// Translates the unit at `guest_address` into the IR of the engine and
+/// optimizes it for `tier`. Flags the known successor overwrites before
+/// reading are only stored when the exit is not linked to it, which is
+/// reported like in [`bal_translation_t`].
+static bal_error_t
+prepare_unit(bal_runtime_t      *runtime,
+             bal_guest_address_t guest_address,
+             uint32_t            tier,
+             size_t             *flags_assumption_size,
+             bool               *flags_live_on_entry)
+{
+    bal_engine_t *engine = &runtime->engine;
+    bal_error_t   error  = translate_unit(runtime, guest_address);
+
+    if (BAL_SUCCESS == error && bal_unit_exit_is_direct(engine->unit_exit.kind))
+    {
+        const bal_translation_cache_t *cache = &runtime->cache;
+        uint32_t successor = bal_translation_cache_lookup(cache, engine->unit_exit.target);
+
+        if (successor != BAL_TRANSLATION_NONE
+            && false == cache->translations[successor].flags_live_on_entry)
+        {
+            *flags_assumption_size = cache->translations[successor].exit.guest_size;
+        }
+    }
+
+    if (BAL_SUCCESS == error)
+    {
+        error = bal_pass_dead_flags(engine, *flags_assumption_size != 0, flags_live_on_entry);
+    }
+
+    if (BAL_SUCCESS == error && tier > 1)
+    {
+        error = bal_passes_run_tier2(engine);
+    }
+
+    return error;
+}
+
+/// Compiles the IR in the engine at `tier` into the current code segment,
+/// or copies `cached` there if it is not `NULL`, and writes the unit id it
+/// was emitted for to `unit_id`. The unit id is the index the translation is
+/// inserted at afterwards.
+static bal_error_t
+emit_unit(bal_runtime_t                      *runtime,
+          const bal_persistent_cache_entry_t *cached,
+          uint32_t                            tier,
+          bal_compiled_unit_t                *unit,
+          uint32_t                           *unit_id)
+{
+    bal_backend_options_t options = {
+        .unit_id              = runtime->cache.free_head,
+        .inline_cache_entries = runtime->config.inline_cache_entries,
+        .execution_counter    = NULL,
+        .cold_code_buffer     = NULL,
+        .fastmem              = runtime->config.fastmem,
+    };
+
+    if (runtime->config.cold_code_size != 0)
+    {
+        options.cold_code_buffer = &runtime->cold_code_buffer;
+    }
+
+    if (1 == tier && runtime->execution_counters != NULL
+        && options.unit_id != BAL_TRANSLATION_NONE)
+    {
+        options.execution_counter  = &runtime->execution_counters[options.unit_id];
+        *options.execution_counter = (int32_t)runtime->config.promotion_threshold;
+    }
+
+    *unit_id = options.unit_id;
+
+    if (cached != NULL)
+    {
+        const bal_persistent_cache_t *cache = &runtime->persistent_cache;
+        const uint8_t                *code  = bal_persistent_cache_data(cache, cached);
+
+        bal_persistent_cache_unit(cache, cached, unit);
+        return bal_backend_load_x86_64(
+            &runtime->code_buffer, &options, code, code + cached->code_size, unit);
+    }
+
+    return bal_backend_compile_x86_64(
+        &runtime->engine, &runtime->register_class, &runtime->code_buffer, &options, unit);
+}
+
+/// Returns the entry of the persistent cache for the unit at `guest_address`
+/// and `tier`, or `NULL` if there is none, its guest code changed since it
+/// was compiled, or the fastmem region has no room for its sites.
+static const bal_persistent_cache_entry_t *
+find_cached_unit(bal_runtime_t *runtime, bal_guest_address_t guest_address, uint32_t tier)
+{
+    if (NULL == runtime->config.persistent_cache_path)
+    {
+        return NULL;
+    }
+
+    const bal_persistent_cache_t       *cache = &runtime->persistent_cache;
+    const bal_persistent_cache_entry_t *entry
+        = bal_persistent_cache_find(cache, guest_address, tier);
+
+    if (NULL == entry)
+    {
+        return NULL;
+    }
+
+    bal_translation_t translation = {
+        .guest_address         = guest_address,
+        .exit.target           = entry->exit_target,
+        .exit.guest_size       = entry->guest_size,
+        .flags_assumption_size = entry->flags_assumption_size,
+    };
+    uint64_t hash = 0;
+
+    if (false == hash_guest_code(runtime, &translation, &hash) || hash != entry->guest_hash)
+    {
+        BAL_LOG_DEBUG(&runtime->logger,
+                      "Persistent cache entry for 0x%llx is stale.",
+                      (unsigned long long)guest_address);
+        return NULL;
+    }
+
+    const bal_fastmem_t *fastmem = runtime->config.fastmem;
+
+    if (fastmem != NULL)
+    {
+        const bal_relocation_t *relocations = bal_persistent_cache_relocations(cache, entry);
+        uint32_t                sites       = 0;
+
+        for (uint32_t i = 0; i < entry->relocation_count; ++i)
+        {
+            sites += (BAL_RELOCATION_FASTMEM_SITE == relocations[i].kind);
+        }
+
+        if (sites > fastmem->site_capacity - fastmem->site_count)
+        {
+            return NULL;
+        }
+    }
+
+    return entry;
+}
+
+/// Records the unit `translation` was just compiled into for the persistent
+/// cache, before it is linked. Units that can not be relocated are skipped.
+static void
+record_unit(bal_runtime_t             *runtime,
+            const bal_translation_t   *translation,
+            const bal_compiled_unit_t *unit)
+{
+    bal_persistent_cache_entry_t entry = {
+        .guest_address         = translation->guest_address,
+        .exit_target           = translation->exit.target,
+        .exit_return_address   = translation->exit.return_address,
+        .guest_size            = (uint32_t)translation->exit.guest_size,
+        .flags_assumption_size = (uint32_t)translation->flags_assumption_size,
+        .exit_kind             = (uint32_t)translation->exit.kind,
+        .exit_target_register  = translation->exit.target_register,
+        .tier                  = translation->tier,
+        .flags_live_on_entry   = translation->flags_live_on_entry ? 1U : 0U,
+        .code_size             = (uint32_t)unit->size,
+        .cold_size             = (uint32_t)unit->cold_size,
+        .body_offset           = (uint32_t)unit->body_offset,
+        .code_alignment        = (uint32_t)(unit->offset & 7U),
+        .relocation_count      = unit->relocation_count,
+    };
+
+    if (false == unit->relocatable
+        || false == hash_guest_code(runtime, translation, &entry.guest_hash))
+    {
+        return;
+    }
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        entry.link_offsets[kind] = (uint32_t)unit->link_offsets[kind];
+    }
+
+    const uint8_t *code      = runtime->code_buffer.buffer + unit->offset;
+    const uint8_t *cold_code = NULL;
+
+    if (unit->cold_size != 0)
+    {
+        cold_code = runtime->cold_code_buffer.buffer + unit->cold_offset;
+    }
+
+    (void)bal_persistent_cache_record(
+        &runtime->persistent_cache, &entry, code, cold_code, unit->relocations);
+}
+
+/// Hashes the guest code of `translation` followed by the code its flags
+/// assumption covers, as stored in [`bal_persistent_cache_entry_t`]. Returns
+/// `false` if any of it can not be read.
+static bool
+hash_guest_code(bal_runtime_t *runtime, const bal_translation_t *translation, uint64_t *hash)
+{
+    bal_memory_interface_t *interface = runtime->interface;
+    bal_guest_address_t     addresses[2]
+        = { translation->guest_address, translation->exit.target };
+    size_t sizes[2] = { translation->exit.guest_size, translation->flags_assumption_size };
+
+    *hash = BAL_PERSISTENT_CACHE_HASH_SEED;
+
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        size_t         readable = 0;
+        const uint8_t *code     = NULL;
+
+        if (0 == sizes[i])
+        {
+            continue;
+        }
+
+        code = interface->translate(interface, addresses[i], &readable);
+
+        if (NULL == code || readable < sizes[i])
+        {
+            return false;
+        }
+
+        *hash = bal_persistent_cache_hash(*hash, code, sizes[i]);
+    }
+
+    return true;
+}
+
+/// Returns a hash of everything besides the guest code that shapes the
+/// units of `runtime`, which a persistent cache file must match.
+static uint64_t
+persistent_cache_context(const bal_runtime_t *runtime)
+{
+    const bal_runtime_config_t *config    = &runtime->config;
+    const uint64_t              context[] = {
+        BAL_HOST_ARCHITECTURE_NATIVE,
+        sizeof(bal_vcpu_t),
+        config->max_unit_size,
+        config->inline_cache_entries,
+        config->cold_code_size != 0,
+        config->enable_execution_counters,
+        (config->fastmem != NULL) ? config->fastmem->address_bits : 0U,
+    };
+
+    return bal_persistent_cache_hash(BAL_PERSISTENT_CACHE_HASH_SEED, context, sizeof(context));
+}
+
+/// Makes `segment` the code segment new units are emitted into, from its
+/// start.
+static void
+start_code_segment(bal_runtime_t *runtime, uint32_t segment)
+{
+    size_t hot_begin  = segment * runtime->hot_segment_size;
+    size_t cold_begin = segment * runtime->cold_segment_size;
+
+    runtime->code_segment = segment;
+    bal_code_buffer_set_window(
+        &runtime->code_buffer, hot_begin, hot_begin + runtime->hot_segment_size);
+
+    if (runtime->config.cold_code_size != 0)
+    {
+        bal_code_buffer_set_window(
+            &runtime->cold_code_buffer, cold_begin, cold_begin + runtime->cold_segment_size);
+    }
+}
+
+/// Discards every unit in the code segment after the current one, which is
+/// the oldest, and emits new units into it from then on.
+static void
+evict_code_segment(bal_runtime_t *runtime)
+{
+    bal_translation_cache_t *cache   = &runtime->cache;
+    uint32_t                 segment = (runtime->code_segment + 1U) % runtime->config.code_segments;
+    size_t                   begin   = segment * runtime->hot_segment_size;
+    size_t                   end     = begin + runtime->hot_segment_size;
+    uint64_t                 evicted = 0;
+
+    for (uint32_t i = 0; i < cache->capacity; ++i)
+    {
+        const bal_translation_t *translation = &cache->translations[i];
+
+        if (NULL == translation->entry || translation->code_offset < begin
+            || translation->code_offset >= end)
+        {
+            continue;
+        }
+
+        uint32_t bit = evicted_filter_bit(translation->guest_address);
+        runtime->evicted_filter[bit / 64U] |= 1ULL << (bit % 64U);
+
+        retire_unit(runtime, i);
+        evicted++;
+    }
+
+    // Fastmem sites only live in the hot region, even with a cold one.
+    //
+    if (runtime->config.fastmem != NULL)
+    {
+        const uint8_t *base = runtime->code_buffer.executable_buffer;
+        bal_fastmem_remove_sites(runtime->config.fastmem, base + begin, base + end);
+    }
+
+    // Other vCPUs may still be running the code of the segment, so it is
+    // only written again once they have all moved past this epoch.
+    //
+    runtime->segment_epoch = bal_epoch_current(&runtime->epoch);
+    bal_epoch_advance(&runtime->epoch);
+    start_code_segment(runtime, segment);
+
+    if (evicted != 0)
+    {
+        runtime->stats.evictions++;
+        runtime->stats.evicted_units += evicted;
+
+        BAL_LOG_INFO(&runtime->logger,
+                     "Evicted code segment %u. Units: %llu.",
+                     segment,
+                     (unsigned long long)evicted);
+    }
+}
+
+/// Frees the translation entries no vCPU can be looking at anymore, evicting
+/// code segments until one is free, and waits until no vCPU is running the
+/// code of the current segment. Returns `true` if it had to wait, in which
+/// case the lock was released meanwhile. See [`wait_for_vcpus`].
+static bool
+make_room(bal_runtime_t *runtime)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    // Another vCPU may have emptied the segment and not waited for it yet.
+    //
+    bool stale = wait_for_vcpus(runtime, runtime->segment_epoch);
+    bal_translation_cache_reclaim(cache, bal_epoch_safe(&runtime->epoch));
+
+    // Eviction frees translation entries, so it has to happen before the
+    // unit id is taken from the free list.
+    //
+    for (uint32_t i = 0;
+         i < runtime->config.code_segments && BAL_TRANSLATION_NONE == cache->free_head;
+         ++i)
+    {
+        evict_code_segment(runtime);
+        stale = wait_for_vcpus(runtime, runtime->segment_epoch) || stale;
+        bal_translation_cache_reclaim(cache, bal_epoch_safe(&runtime->epoch));
+    }
+
+    return stale;
+}
+
+/// Waits until no vCPU can be running code or looking up entries discarded
+/// in `epoch` or before. The caller holds the lock and is offline. Returns
+/// `false` right away if no other vCPU is behind. Otherwise every site is
+/// unlinked, so the other vCPUs return to the dispatcher soon, and the lock
+/// is released while waiting, so they can take it. Returns `true` then, as
+/// anything read under the lock may have changed.
+static bool
+wait_for_vcpus(bal_runtime_t *runtime, uint64_t epoch)
+{
+    if (BAL_LIKELY(bal_epoch_safe(&runtime->epoch) > epoch))
+    {
+        return false;
+    }
+
+    const void *owner = (const void *)(uintptr_t)bal_atomic_load_64(&runtime->lock_owner);
+
+    // A vCPU looping through linked units would never come back to the
+    // dispatcher on its own.
+    //
+    if (0 == runtime->waiters++ && runtime->config.enable_block_linking)
+    {
+        unlink_all(runtime);
+    }
+
+    unlock_runtime(runtime);
+
+    while (bal_epoch_safe(&runtime->epoch) <= epoch)
+    {
+        bal_atomic_yield();
+    }
+
+    lock_runtime(runtime, owner);
+
+    if (0 == --runtime->waiters && runtime->config.enable_block_linking)
+    {
+        relink_all(runtime);
+    }
+
+    return true;
+}
+
+static inline uint32_t
+evicted_filter_bit(bal_guest_address_t guest_address)
+{
+    uint64_t hash = (guest_address >> 2) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(hash >> 32) & (BAL_RUNTIME_EVICTED_FILTER_BITS - 1U);
+}
+
+/// Links the sites of the new unit at `index`, and every pending site that
+/// targets it.
+static void
+link_unit(bal_runtime_t *runtime, uint32_t index)
+{
+    bal_translation_cache_t *cache       = &runtime->cache;
+    const bal_translation_t *translation = &cache->translations[index];
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        const bal_link_t *link = &translation->links[kind];
+
+        if (0 == link->site)
+        {
+            continue;
+        }
+
+        uint32_t target = bal_translation_cache_lookup(cache, link->target);
+
+        if (target != BAL_TRANSLATION_NONE)
+        {
+            patch_link(runtime, bal_link_id(index, (bal_link_kind_t)kind), target);
+        }
+    }
+
+    for (;;)
+    {
+        uint32_t link_id = bal_translation_cache_find_pending(cache, translation->guest_address);
+
+        if (BAL_TRANSLATION_NONE == link_id)
+        {
+            break;
+        }
+
+        patch_link(runtime, link_id, index);
+    }
+}
+
+static void
+patch_link(bal_runtime_t *runtime, uint32_t link_id, uint32_t to)
+{
+    bal_translation_cache_t *cache  = &runtime->cache;
+    uint32_t                 from   = bal_link_id_translation(link_id);
+    bal_link_kind_t          kind   = bal_link_id_kind(link_id);
+    size_t                   site   = cache->translations[from].links[kind].site;
+    const void              *target = cache->translations[to].body;
+
+    bal_translation_cache_link(cache, link_id, to);
+    bal_backend_link_x86_64(&runtime->code_buffer, kind, site, target);
+    runtime->stats.links++;
+
+    BAL_LOG_DEBUG(&runtime->logger,
+                  "Linked unit 0x%llx -> 0x%llx (kind %u).",
+                  (unsigned long long)cache->translations[from].guest_address,
+                  (unsigned long long)cache->translations[to].guest_address,
+                  (unsigned)kind);
+}
+
+/// Unlinks the unit at `index` from every other unit and removes it from the
+/// cache. Its host code is not reclaimed.
+static void
+retire_unit(bal_runtime_t *runtime, uint32_t index)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    unlink_incoming(runtime, index);
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        bal_translation_cache_unlink(cache, bal_link_id(index, (bal_link_kind_t)kind));
+    }
+
+    bal_translation_t translation = cache->translations[index];
+    bal_translation_cache_remove(cache, index, bal_epoch_current(&runtime->epoch));
+    watch_code(runtime, &translation, false);
+
+    // A vCPU that sees the next epoch sees the removal and the generation.
+    //
+    bal_atomic_store_64(&runtime->generation, runtime->generation + 1);
+    bal_epoch_advance(&runtime->epoch);
+}
+
+/// Adds or removes the code of `translation`, and the code it assumed
+/// overwrites the flags, to or from the code pages of `runtime`. Both are
+/// write protected in the fastmem region while the unit is alive.
+static void
+watch_code(bal_runtime_t *runtime, const bal_translation_t *translation, bool add)
+{
+    const bal_guest_address_t addresses[2] = { translation->guest_address,
+                                               translation->exit.target };
+    const size_t sizes[2] = { translation->exit.guest_size, translation->flags_assumption_size };
+
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (add)
+        {
+            bal_code_pages_add(&runtime->code_pages, addresses[i], sizes[i]);
+        }
+        else
+        {
+            bal_code_pages_remove(&runtime->code_pages, addresses[i], sizes[i]);
+        }
+
+        protect_code(runtime, addresses[i], sizes[i], add);
+    }
+}
+
+/// Write protects every page of guest RAM overlapping `size` bytes at
+/// `guest_address` in the fastmem region, or lifts the protection of those
+/// no compiled unit is on anymore. Only pages the memory interface maps to
+/// the same bytes as the region are touched, so the host's own protection
+/// of the rest is kept.
+static void
+protect_code(bal_runtime_t *runtime, bal_guest_address_t guest_address, size_t size, bool protect)
+{
+    bal_fastmem_t          *fastmem   = runtime->config.fastmem;
+    bal_memory_interface_t *interface = runtime->interface;
+
+    if (NULL == fastmem || NULL == interface->translate_write || 0 == size)
+    {
+        return;
+    }
+
+    bal_guest_address_t first = guest_address & BAL_TLB_PAGE_MASK;
+    bal_guest_address_t last  = (guest_address + size - 1U) & BAL_TLB_PAGE_MASK;
+
+    for (bal_guest_address_t page = first; page <= last; page += BAL_TLB_PAGE_SIZE)
+    {
+        size_t         available = 0;
+        const uint8_t *host      = interface->translate_write(interface, page, &available);
+
+        if (page >= fastmem->size || host != fastmem->base + page
+            || available < BAL_TLB_PAGE_SIZE)
+        {
+            continue;
+        }
+
+        if (false == protect
+            && bal_translation_cache_find_overlapping(&runtime->cache, page, BAL_TLB_PAGE_SIZE)
+                   != BAL_TRANSLATION_NONE)
+        {
+            continue;
+        }
+
+        if (bal_fastmem_map(fastmem, page, BAL_TLB_PAGE_SIZE, false == protect) != BAL_SUCCESS)
+        {
+            BAL_LOG_WARN(&runtime->logger,
+                         "Failed to change the protection of code page 0x%llx.",
+                         (unsigned long long)page);
+        }
+    }
+}
+
+/// Called by the TLB of a vCPU before a store to a page with translated
+/// code. Discards the units the store overwrites, or with fastmem every unit
+/// on the pages it touches, so no protected page is written.
+static void
+handle_code_write(void               *context,
+                  bal_tlb_t          *tlb,
+                  bal_guest_address_t guest_address,
+                  uint64_t            size)
+{
+    bal_runtime_t *runtime = (bal_runtime_t *)context;
+    bal_vcpu_t    *vcpu    = (bal_vcpu_t *)(void *)((uint8_t *)tlb - offsetof(bal_vcpu_t, tlb));
+
+    lock_runtime(runtime, vcpu);
+    runtime->stats.code_writes++;
+
+    BAL_LOG_DEBUG(&runtime->logger,
+                  "Guest store to code at 0x%llx (%llu bytes).",
+                  (unsigned long long)guest_address,
+                  (unsigned long long)size);
+
+    if (runtime->config.fastmem != NULL)
+    {
+        bal_guest_address_t end = guest_address + size;
+        guest_address &= BAL_TLB_PAGE_MASK;
+        size = ((end - guest_address) + BAL_TLB_PAGE_SIZE - 1U) & BAL_TLB_PAGE_MASK;
+    }
+
+    invalidate(runtime, guest_address, (size_t)size);
+
+    // The unit running the store may return through predictions of discarded
+    // units before the dispatcher runs again. The dispatcher clears it again
+    // when it sees the new generation.
+    //
+    bal_vcpu_clear_return_stack(vcpu);
+    unlock_runtime(runtime);
+}
+
+/// Replaces every queued hot unit with a Tier 2 unit. A unit that fails to
+/// compile at Tier 2 is recompiled at Tier 1 the next time it runs. Units
+/// are taken off the end of the queue one at a time, as other vCPUs may
+/// queue more while compiling waits for them.
+static void
+promote_hot_units(bal_runtime_t *runtime)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    while (runtime->promotion_queue_count != 0)
+    {
+        uint32_t count = runtime->promotion_queue_count - 1U;
+        uint32_t index = runtime->promotion_queue[count];
+        bal_atomic_store_32(&runtime->promotion_queue_count, count);
+
+        const bal_translation_t *translation = &cache->translations[index];
+
+        // The entry may have been invalidated or reused since it was queued.
+        //
+        if (NULL == translation->entry || translation->tier != 1
+            || runtime->execution_counters[index] > 0)
+        {
+            continue;
+        }
+
+        bal_guest_address_t guest_address = translation->guest_address;
+        retire_unit(runtime, index);
+
+        uint32_t    promoted = BAL_TRANSLATION_NONE;
+        bal_error_t error    = compile_unit(runtime, guest_address, 2, &promoted);
+
+        if (BAL_UNLIKELY(error != BAL_SUCCESS))
+        {
+            BAL_LOG_WARN(&runtime->logger,
+                         "Failed to promote unit 0x%llx: %s.",
+                         (unsigned long long)guest_address,
+                         bal_error_to_string(error));
+            continue;
+        }
+
+        runtime->stats.promotions++;
+
+        BAL_LOG_DEBUG(
+            &runtime->logger, "Promoted unit 0x%llx to tier 2.", (unsigned long long)guest_address);
+    }
+}
+
+/// Returns the size in bytes of `runtime->interpreter_values`.
+static size_t
+interpreter_values_size(const bal_runtime_t *runtime)
+{
+    return (size_t)runtime->config.max_vcpus * runtime->interpreter.value_capacity
+           * sizeof(uint64_t);
+}
+
+static void
+free_interpreter(bal_allocator_t *allocator, bal_runtime_t *runtime)
+{
+    if (false == runtime->config.enable_interpreter)
+    {
+        return;
+    }
+
+    if (runtime->interpreter_values != NULL)
+    {
+        allocator->free(
+            allocator->handle, runtime->interpreter_values, interpreter_values_size(runtime));
+        runtime->interpreter_values = NULL;
+    }
+
+    bal_interpreter_destroy(allocator, &runtime->interpreter);
+}
+
+static void
+free_promotion_state(bal_allocator_t *allocator, bal_runtime_t *runtime)
+{
+    size_t count = runtime->config.max_translations;
+
+    if (runtime->execution_counters != NULL)
+    {
+        allocator->free(allocator->handle, runtime->execution_counters, count * sizeof(int32_t));
+        runtime->execution_counters = NULL;
+    }
+
+    if (runtime->promotion_queue != NULL)
+    {
+        allocator->free(allocator->handle, runtime->promotion_queue, count * sizeof(uint32_t));
+        runtime->promotion_queue = NULL;
+    }
+}
+
+/// Points an inline cache entry of the unit at `from` to the unit at `to`,
+/// after an indirect exit of `from` missed with the target of `to`. Empty
+/// entries are filled first, then the entries are replaced round robin.
+static void
+fill_inline_cache(bal_runtime_t *runtime, uint32_t from, uint32_t to)
+{
+    bal_translation_cache_t *cache       = &runtime->cache;
+    bal_translation_t       *translation = &cache->translations[from];
+    bal_guest_address_t      target      = cache->translations[to].guest_address;
+    uint32_t                 entries     = 0;
+    uint32_t                 victim      = BAL_INLINE_CACHE_MAX_ENTRIES;
+
+    for (uint32_t i = 0; i < BAL_INLINE_CACHE_MAX_ENTRIES; ++i)
+    {
+        const bal_link_t *link = &translation->links[BAL_LINK_KIND_INLINE_CACHE + i];
+
+        if (0 == link->site)
+        {
+            break;
+        }
+
+        // Already waiting for the target to be recompiled.
+        //
+        if (link->target == target)
+        {
+            return;
+        }
+
+        if (BAL_LINK_TARGET_NONE == link->target && BAL_INLINE_CACHE_MAX_ENTRIES == victim)
+        {
+            victim = i;
+        }
+
+        ++entries;
+    }
+
+    if (0 == entries)
+    {
+        return;
+    }
+
+    if (BAL_INLINE_CACHE_MAX_ENTRIES == victim)
+    {
+        victim                           = translation->inline_cache_victim % entries;
+        translation->inline_cache_victim = (victim + 1) % entries;
+    }
+
+    bal_link_kind_t kind    = (bal_link_kind_t)(BAL_LINK_KIND_INLINE_CACHE + victim);
+    uint32_t        link_id = bal_link_id(from, kind);
+    bal_link_t     *link    = &translation->links[kind];
+
+    if (link->linked_to != BAL_TRANSLATION_NONE)
+    {
+        bal_backend_link_x86_64(&runtime->code_buffer, kind, link->site, NULL);
+        bal_translation_cache_unlink(cache, link_id);
+        runtime->stats.unlinks++;
+    }
+
+    bal_backend_set_inline_cache_target_x86_64(&runtime->code_buffer, link->site, target);
+    bal_translation_cache_retarget(cache, link_id, target);
+    patch_link(runtime, link_id, to);
+    runtime->stats.inline_cache_fills++;
+}
+
+/// Points every site linked to the unit at `index` back to the dispatcher.
+static void
+unlink_incoming(bal_runtime_t *runtime, uint32_t index)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    for (;;)
+    {
+        uint32_t link_id = cache->translations[index].first_incoming;
+
+        if (BAL_TRANSLATION_NONE == link_id)
+        {
+            break;
+        }
+
+        bal_link_kind_t kind = bal_link_id_kind(link_id);
+        size_t site = cache->translations[bal_link_id_translation(link_id)].links[kind].site;
+
+        bal_backend_link_x86_64(&runtime->code_buffer, kind, site, NULL);
+        bal_translation_cache_unlink(cache, link_id);
+        runtime->stats.unlinks++;
+    }
+}
+
+/// Points every linked site back to the dispatcher.
+static void
+unlink_all(bal_runtime_t *runtime)
+{
+    for (uint32_t i = 0; i < runtime->cache.capacity; ++i)
+    {
+        if (runtime->cache.translations[i].entry != NULL)
+        {
+            unlink_incoming(runtime, i);
+        }
+    }
+}
+
+/// Links every site again after [`unlink_all`], including the sites of units
+/// compiled since. Every unlinked site waits for its target as a pending
+/// link, so only those have to be looked at.
+static void
+relink_all(bal_runtime_t *runtime)
+{
+    bal_translation_cache_t *cache = &runtime->cache;
+
+    for (uint32_t i = 0; i < cache->capacity; ++i)
+    {
+        if (NULL == cache->translations[i].entry)
+        {
+            continue;
+        }
+
+        for (;;)
+        {
+            uint32_t link_id
+                = bal_translation_cache_find_pending(cache, cache->translations[i].guest_address);
+
+            if (BAL_TRANSLATION_NONE == link_id)
+            {
+                break;
+            }
+
+            patch_link(runtime, link_id, i);
+        }
+    }
+}
+
+/*** end of file ***/
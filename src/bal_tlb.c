@@ -0,0 +1,284 @@
+#include "bal_tlb.h"
+
+static bool fill(bal_tlb_t *, bal_guest_address_t, bool);
+static bool access_bytes(bal_tlb_t *, bal_guest_address_t, uint8_t *, uint64_t, bool);
+
+void
+bal_tlb_init(bal_tlb_t *tlb, bal_memory_interface_t *interface)
+{
+    tlb->interface     = interface;
+    tlb->fault         = 0;
+    tlb->fault_address = 0;
+    tlb->misses        = 0;
+    bal_tlb_watch_code(tlb, NULL, NULL, NULL);
+}
+
+void
+bal_tlb_watch_code(bal_tlb_t                    *tlb,
+                   const bal_code_pages_t       *code_pages,
+                   bal_tlb_code_write_function_t code_write,
+                   void                         *context)
+{
+    tlb->code_pages         = code_pages;
+    tlb->code_generation    = (code_pages != NULL) ? code_pages->generation : 0;
+    tlb->code_write         = code_write;
+    tlb->code_write_context = context;
+    bal_tlb_flush(tlb);
+}
+
+void
+bal_tlb_flush(bal_tlb_t *tlb)
+{
+    for (uint32_t i = 0; i < BAL_TLB_SIZE; ++i)
+    {
+        tlb->entries[i].read_tag    = BAL_TLB_INVALID_TAG;
+        tlb->entries[i].write_tag   = BAL_TLB_INVALID_TAG;
+        tlb->entries[i].host_offset = 0;
+    }
+}
+
+void
+bal_tlb_flush_range(bal_tlb_t *tlb, bal_guest_address_t guest_address, size_t size)
+{
+    if (0 == size)
+    {
+        return;
+    }
+
+    bal_guest_address_t first = guest_address & BAL_TLB_PAGE_MASK;
+    bal_guest_address_t last  = (guest_address + size - 1U) & BAL_TLB_PAGE_MASK;
+
+    // Past one lap around the entries every entry is hit anyway.
+    //
+    if ((last - first) >> BAL_TLB_PAGE_SHIFT >= BAL_TLB_SIZE)
+    {
+        bal_tlb_flush(tlb);
+        return;
+    }
+
+    for (bal_guest_address_t page = first;; page += BAL_TLB_PAGE_SIZE)
+    {
+        bal_tlb_entry_t *entry = bal_tlb_entry(tlb, page);
+
+        if (entry->read_tag == page)
+        {
+            entry->read_tag = BAL_TLB_INVALID_TAG;
+        }
+
+        if (entry->write_tag == page)
+        {
+            entry->write_tag = BAL_TLB_INVALID_TAG;
+        }
+
+        if (page == last)
+        {
+            break;
+        }
+    }
+}
+
+uint64_t
+bal_tlb_load_slow(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size)
+{
+    uint8_t bytes[sizeof(uint64_t)] = { 0 };
+
+    tlb->misses++;
+
+    if (BAL_UNLIKELY(false == access_bytes(tlb, guest_address, bytes, size, false)))
+    {
+        return 0;
+    }
+
+    uint64_t value = 0;
+
+    for (uint64_t i = size; i-- > 0;)
+    {
+        value = (value << 8U) | bytes[i];
+    }
+
+    return value;
+}
+
+void
+bal_tlb_store_slow(bal_tlb_t          *tlb,
+                   bal_guest_address_t guest_address,
+                   uint64_t            value,
+                   uint64_t            size)
+{
+    uint8_t bytes[sizeof(uint64_t)];
+
+    tlb->misses++;
+
+    if (tlb->code_pages != NULL
+        && bal_code_pages_contains(tlb->code_pages, guest_address, (size_t)size))
+    {
+        tlb->code_write(tlb->code_write_context, tlb, guest_address, size);
+    }
+
+    for (uint64_t i = 0; i < sizeof(bytes); ++i)
+    {
+        bytes[i] = (uint8_t)(value >> (i * 8U));
+    }
+
+    (void)access_bytes(tlb, guest_address, bytes, size, true);
+}
+
+uint8_t *
+bal_tlb_atomic_slow(bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size)
+{
+    bal_memory_interface_t *interface = tlb->interface;
+    bal_guest_address_t     last      = guest_address + size - 1U;
+    uint8_t                *host      = NULL;
+    size_t                  available = 0;
+
+    tlb->misses++;
+
+    if (BAL_LIKELY(((guest_address ^ last) & BAL_TLB_PAGE_MASK) == 0
+                   && interface->translate_write != NULL))
+    {
+        if (tlb->code_pages != NULL
+            && bal_code_pages_contains(tlb->code_pages, guest_address, (size_t)size))
+        {
+            tlb->code_write(tlb->code_write_context, tlb, guest_address, size);
+        }
+
+        if (fill(tlb, guest_address, true))
+        {
+            return bal_tlb_probe(tlb, guest_address, size, true);
+        }
+
+        // Pages the interface only backs in part are translated uncached.
+        //
+        host = interface->translate_write(interface, guest_address, &available);
+    }
+
+    if (BAL_UNLIKELY(NULL == host || available < size))
+    {
+        tlb->fault         = 1;
+        tlb->fault_address = guest_address;
+        return NULL;
+    }
+
+    return host;
+}
+
+/// Maps the page of `guest_address` for reads or writes. Returns `false` if
+/// the interface does not back the whole page, in which case the entry is
+/// left alone and the access has to be translated byte by byte.
+static bool
+fill(bal_tlb_t *tlb, bal_guest_address_t guest_address, bool write)
+{
+    bal_memory_interface_t *interface = tlb->interface;
+    bal_guest_address_t     page      = guest_address & BAL_TLB_PAGE_MASK;
+    size_t                  available = 0;
+    const uint8_t          *host      = NULL;
+
+    if (write)
+    {
+        // Stores to code pages have to keep reaching the slow path.
+        //
+        if (NULL == interface->translate_write
+            || (tlb->code_pages != NULL
+                && bal_code_pages_contains(tlb->code_pages, page, BAL_TLB_PAGE_SIZE)))
+        {
+            return false;
+        }
+
+        host = interface->translate_write(interface, page, &available);
+    }
+    else
+    {
+        host = interface->translate(interface, page, &available);
+    }
+
+    if (NULL == host || available < BAL_TLB_PAGE_SIZE)
+    {
+        return false;
+    }
+
+    bal_tlb_entry_t *entry       = bal_tlb_entry(tlb, page);
+    uint64_t         host_offset = (uint64_t)(uintptr_t)host - page;
+
+    // Reads and writes share the offset, so a page mapped elsewhere for the
+    // other kind of access loses that mapping.
+    //
+    if (entry->host_offset != host_offset)
+    {
+        entry->read_tag    = BAL_TLB_INVALID_TAG;
+        entry->write_tag   = BAL_TLB_INVALID_TAG;
+        entry->host_offset = host_offset;
+    }
+
+    if (write)
+    {
+        entry->write_tag = page;
+    }
+    else
+    {
+        entry->read_tag = page;
+    }
+
+    return true;
+}
+
+/// Copies `size` bytes between `bytes` and guest memory at `guest_address`,
+/// one page at a time. Returns `false` and records the fault if part of the
+/// range can not be translated.
+static bool
+access_bytes(bal_tlb_t          *tlb,
+             bal_guest_address_t guest_address,
+             uint8_t            *bytes,
+             uint64_t            size,
+             bool                write)
+{
+    bal_memory_interface_t *interface = tlb->interface;
+
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        bal_guest_address_t address = guest_address + i;
+        uint8_t            *host    = bal_tlb_probe(tlb, address, 1, write);
+
+        if (NULL == host && fill(tlb, address, write))
+        {
+            host = bal_tlb_probe(tlb, address, 1, write);
+        }
+
+        // Pages the interface only backs in part are translated uncached.
+        //
+        if (NULL == host)
+        {
+            size_t available = 0;
+
+            if (write)
+            {
+                host = (NULL == interface->translate_write)
+                           ? NULL
+                           : interface->translate_write(interface, address, &available);
+            }
+            else
+            {
+                host = (uint8_t *)(uintptr_t)interface->translate(interface, address, &available);
+            }
+
+            if (BAL_UNLIKELY(NULL == host || 0 == available))
+            {
+                tlb->fault         = 1;
+                tlb->fault_address = address;
+                return false;
+            }
+        }
+
+        if (write)
+        {
+            *host = bytes[i];
+        }
+        else
+        {
+            bytes[i] = *host;
+        }
+    }
+
+    return true;
+}
+
+/*** end of file ***/
@@ -0,0 +1,541 @@
+#include "bal_translation_cache.h"
+#include "bal_assert.h"
+#include "bal_atomic.h"
+#include <stdbool.h>
+#include <string.h>
+
+static uint32_t    bucket_index(const bal_translation_cache_t *, bal_guest_address_t);
+static bal_link_t *link_at(const bal_translation_cache_t *, uint32_t);
+static bool        has_target(const bal_link_t *);
+static void        remove_pending(bal_translation_cache_t *, uint32_t);
+static void        add_pending(bal_translation_cache_t *, uint32_t);
+static uint32_t    page_bucket_index(const bal_translation_cache_t *, bal_guest_address_t);
+static uint32_t    translation_pages(const bal_translation_t *, bal_guest_address_t *);
+static bool        overlaps(const bal_translation_t *, bal_guest_address_t, size_t);
+
+bal_error_t
+bal_translation_cache_init(bal_allocator_t         *allocator,
+                           bal_translation_cache_t *cache,
+                           uint32_t                 capacity,
+                           bal_logger_t             logger)
+{
+    // Every link id has to stay below BAL_TRANSLATION_NONE.
+    //
+    if (NULL == allocator || NULL == cache || 0 == capacity
+        || capacity > BAL_TRANSLATION_NONE / BAL_LINK_KIND_COUNT)
+    {
+        BAL_LOG_ERROR(&logger, "Translation cache init failed. Invalid arguments.");
+        return BAL_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Keep the load factor at or below one.
+    //
+    uint32_t bucket_count = 1;
+
+    while (bucket_count < capacity && bucket_count < (1U << 31))
+    {
+        bucket_count <<= 1;
+    }
+
+    size_t memory_alignment  = 64U;
+    size_t translations_size = (size_t)capacity * sizeof(bal_translation_t);
+    size_t buckets_size      = (size_t)bucket_count * sizeof(uint32_t);
+
+    cache->translations = (bal_translation_t *)allocator->allocate(
+        allocator->handle, memory_alignment, translations_size);
+    cache->buckets
+        = (uint32_t *)allocator->allocate(allocator->handle, memory_alignment, buckets_size);
+    cache->pending_buckets
+        = (uint32_t *)allocator->allocate(allocator->handle, memory_alignment, buckets_size);
+    cache->page_buckets
+        = (uint32_t *)allocator->allocate(allocator->handle, memory_alignment, buckets_size);
+
+    if (NULL == cache->translations || NULL == cache->buckets || NULL == cache->pending_buckets
+        || NULL == cache->page_buckets)
+    {
+        BAL_LOG_ERROR(&logger, "Failed to allocate a translation cache of %u entries.", capacity);
+        cache->capacity    = capacity;
+        cache->bucket_mask = bucket_count - 1;
+        bal_translation_cache_destroy(allocator, cache);
+        return BAL_ERROR_ALLOCATION_FAILED;
+    }
+
+    (void)memset(cache->translations, 0, translations_size);
+    (void)memset(cache->buckets, 0xFF, buckets_size);
+    (void)memset(cache->pending_buckets, 0xFF, buckets_size);
+    (void)memset(cache->page_buckets, 0xFF, buckets_size);
+
+    for (uint32_t i = 0; i < capacity; ++i)
+    {
+        cache->translations[i].next_in_bucket = (i + 1 < capacity) ? i + 1 : BAL_TRANSLATION_NONE;
+    }
+
+    cache->capacity    = capacity;
+    cache->bucket_mask = bucket_count - 1;
+    cache->count        = 0;
+    cache->free_head    = 0;
+    cache->retired_head = BAL_TRANSLATION_NONE;
+    cache->retired_tail = BAL_TRANSLATION_NONE;
+    cache->logger       = logger;
+
+    BAL_LOG_INFO(&logger,
+                 "Translation cache initialized. Entries: %u, Buckets: %u.",
+                 capacity,
+                 bucket_count);
+
+    return BAL_SUCCESS;
+}
+
+uint32_t
+bal_translation_cache_lookup(const bal_translation_cache_t *cache,
+                             bal_guest_address_t            guest_address)
+{
+    uint32_t index = bal_atomic_load_32(&cache->buckets[bucket_index(cache, guest_address)]);
+
+    while (index != BAL_TRANSLATION_NONE)
+    {
+        const bal_translation_t *translation = &cache->translations[index];
+
+        if (translation->guest_address == guest_address)
+        {
+            return index;
+        }
+
+        index = bal_atomic_load_32(&translation->next_in_bucket);
+    }
+
+    return BAL_TRANSLATION_NONE;
+}
+
+bal_error_t
+bal_translation_cache_insert(bal_translation_cache_t *BAL_RESTRICT cache,
+                             const bal_translation_t *BAL_RESTRICT translation,
+                             uint32_t *BAL_RESTRICT                index)
+{
+    uint32_t free_index = cache->free_head;
+
+    if (BAL_UNLIKELY(BAL_TRANSLATION_NONE == free_index))
+    {
+        BAL_LOG_WARN(&cache->logger, "Translation cache full (%u entries).", cache->capacity);
+        return BAL_ERROR_TRANSLATION_CACHE_FULL;
+    }
+
+    bal_translation_t *entry = &cache->translations[free_index];
+    cache->free_head         = entry->next_in_bucket;
+
+    // The entry is complete before a lookup on another thread can reach it.
+    //
+    uint32_t bucket       = bucket_index(cache, translation->guest_address);
+    *entry                = *translation;
+    entry->first_incoming = BAL_TRANSLATION_NONE;
+    entry->next_in_bucket = cache->buckets[bucket];
+    entry->next_retired   = BAL_TRANSLATION_NONE;
+    bal_atomic_store_32(&cache->buckets[bucket], free_index);
+    cache->count++;
+
+    bal_guest_address_t pages[BAL_TRANSLATION_PAGE_NODES];
+    uint32_t            page_count = translation_pages(entry, pages);
+
+    for (uint32_t i = 0; i < page_count; ++i)
+    {
+        uint32_t page_bucket             = page_bucket_index(cache, pages[i]);
+        entry->next_in_page[i]           = cache->page_buckets[page_bucket];
+        cache->page_buckets[page_bucket] = free_index * BAL_TRANSLATION_PAGE_NODES + i;
+    }
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        bal_link_t *link = &entry->links[kind];
+        link->linked_to  = BAL_TRANSLATION_NONE;
+        link->next       = BAL_TRANSLATION_NONE;
+
+        if (has_target(link))
+        {
+            add_pending(cache, bal_link_id(free_index, (bal_link_kind_t)kind));
+        }
+    }
+
+    *index = free_index;
+    return BAL_SUCCESS;
+}
+
+uint32_t
+bal_translation_cache_find_pending(const bal_translation_cache_t *cache,
+                                   bal_guest_address_t            guest_address)
+{
+    uint32_t link_id = cache->pending_buckets[bucket_index(cache, guest_address)];
+
+    while (link_id != BAL_TRANSLATION_NONE)
+    {
+        const bal_link_t *link = link_at(cache, link_id);
+
+        if (link->target == guest_address)
+        {
+            return link_id;
+        }
+
+        link_id = link->next;
+    }
+
+    return BAL_TRANSLATION_NONE;
+}
+
+void
+bal_translation_cache_link(bal_translation_cache_t *cache, uint32_t link_id, uint32_t to)
+{
+    bal_link_t        *link   = link_at(cache, link_id);
+    bal_translation_t *target = &cache->translations[to];
+
+    BAL_ASSERT(BAL_TRANSLATION_NONE == link->linked_to);
+    BAL_ASSERT(link->site != 0);
+
+    remove_pending(cache, link_id);
+    link->linked_to        = to;
+    link->next             = target->first_incoming;
+    target->first_incoming = link_id;
+}
+
+void
+bal_translation_cache_unlink(bal_translation_cache_t *cache, uint32_t link_id)
+{
+    bal_link_t *link = link_at(cache, link_id);
+
+    if (BAL_TRANSLATION_NONE == link->linked_to)
+    {
+        return;
+    }
+
+    uint32_t *cursor = &cache->translations[link->linked_to].first_incoming;
+
+    while (*cursor != link_id)
+    {
+        BAL_ASSERT(*cursor != BAL_TRANSLATION_NONE);
+        cursor = &link_at(cache, *cursor)->next;
+    }
+
+    *cursor         = link->next;
+    link->linked_to = BAL_TRANSLATION_NONE;
+    link->next      = BAL_TRANSLATION_NONE;
+    add_pending(cache, link_id);
+}
+
+void
+bal_translation_cache_retarget(bal_translation_cache_t *cache,
+                               uint32_t                 link_id,
+                               bal_guest_address_t      guest_address)
+{
+    bal_link_t *link = link_at(cache, link_id);
+
+    BAL_ASSERT(BAL_TRANSLATION_NONE == link->linked_to);
+    BAL_ASSERT(link->site != 0);
+
+    if (has_target(link))
+    {
+        remove_pending(cache, link_id);
+    }
+
+    link->target = guest_address;
+
+    if (has_target(link))
+    {
+        add_pending(cache, link_id);
+    }
+}
+
+uint32_t
+bal_translation_cache_find_overlapping(const bal_translation_cache_t *cache,
+                                       bal_guest_address_t            guest_address,
+                                       size_t                         size)
+{
+    if (0 == size)
+    {
+        return BAL_TRANSLATION_NONE;
+    }
+
+    bal_guest_address_t first = guest_address >> BAL_CODE_PAGE_SHIFT;
+    bal_guest_address_t last  = (guest_address + size - 1U) >> BAL_CODE_PAGE_SHIFT;
+
+    // Walking more page chains than there are translations costs more than
+    // checking each of them.
+    //
+    if (last - first >= cache->count)
+    {
+        for (uint32_t i = 0; i < cache->capacity; ++i)
+        {
+            const bal_translation_t *translation = &cache->translations[i];
+
+            if (translation->entry != NULL && overlaps(translation, guest_address, size))
+            {
+                return i;
+            }
+        }
+
+        return BAL_TRANSLATION_NONE;
+    }
+
+    for (bal_guest_address_t page = first;; ++page)
+    {
+        uint32_t node = cache->page_buckets[page_bucket_index(cache, page)];
+
+        while (node != BAL_TRANSLATION_NONE)
+        {
+            uint32_t                 index       = node / BAL_TRANSLATION_PAGE_NODES;
+            const bal_translation_t *translation = &cache->translations[index];
+
+            if (overlaps(translation, guest_address, size))
+            {
+                return index;
+            }
+
+            node = translation->next_in_page[node % BAL_TRANSLATION_PAGE_NODES];
+        }
+
+        if (page == last)
+        {
+            return BAL_TRANSLATION_NONE;
+        }
+    }
+}
+
+void
+bal_translation_cache_remove(bal_translation_cache_t *cache, uint32_t index, uint64_t epoch)
+{
+    bal_translation_t *translation = &cache->translations[index];
+
+    BAL_ASSERT(BAL_TRANSLATION_NONE == translation->first_incoming);
+
+    for (uint32_t kind = 0; kind < BAL_LINK_KIND_COUNT; ++kind)
+    {
+        BAL_ASSERT(BAL_TRANSLATION_NONE == translation->links[kind].linked_to);
+
+        if (has_target(&translation->links[kind]))
+        {
+            remove_pending(cache, bal_link_id(index, (bal_link_kind_t)kind));
+        }
+    }
+
+    uint32_t *cursor = &cache->buckets[bucket_index(cache, translation->guest_address)];
+
+    while (*cursor != index)
+    {
+        BAL_ASSERT(*cursor != BAL_TRANSLATION_NONE);
+        cursor = &cache->translations[*cursor].next_in_bucket;
+    }
+
+    bal_atomic_store_32(cursor, translation->next_in_bucket);
+
+    bal_guest_address_t pages[BAL_TRANSLATION_PAGE_NODES];
+    uint32_t            page_count = translation_pages(translation, pages);
+
+    for (uint32_t i = 0; i < page_count; ++i)
+    {
+        uint32_t node = index * BAL_TRANSLATION_PAGE_NODES + i;
+        cursor        = &cache->page_buckets[page_bucket_index(cache, pages[i])];
+
+        while (*cursor != node)
+        {
+            BAL_ASSERT(*cursor != BAL_TRANSLATION_NONE);
+            cursor = &cache->translations[*cursor / BAL_TRANSLATION_PAGE_NODES]
+                          .next_in_page[*cursor % BAL_TRANSLATION_PAGE_NODES];
+        }
+
+        *cursor = translation->next_in_page[i];
+    }
+
+    // A lookup may still be on the entry, so it keeps its guest address and
+    // the rest of its chain until it is reclaimed.
+    //
+    bal_atomic_store_pointer(&translation->entry, NULL);
+    translation->retired_epoch = epoch;
+    translation->next_retired  = BAL_TRANSLATION_NONE;
+
+    if (BAL_TRANSLATION_NONE == cache->retired_tail)
+    {
+        cache->retired_head = index;
+    }
+    else
+    {
+        cache->translations[cache->retired_tail].next_retired = index;
+    }
+
+    cache->retired_tail = index;
+    cache->count--;
+}
+
+void
+bal_translation_cache_reclaim(bal_translation_cache_t *cache, uint64_t safe_epoch)
+{
+    while (cache->retired_head != BAL_TRANSLATION_NONE
+           && cache->translations[cache->retired_head].retired_epoch < safe_epoch)
+    {
+        uint32_t           index       = cache->retired_head;
+        bal_translation_t *translation = &cache->translations[index];
+
+        cache->retired_head = translation->next_retired;
+
+        if (BAL_TRANSLATION_NONE == cache->retired_head)
+        {
+            cache->retired_tail = BAL_TRANSLATION_NONE;
+        }
+
+        (void)memset(translation, 0, sizeof(*translation));
+        translation->next_in_bucket = cache->free_head;
+        cache->free_head            = index;
+    }
+}
+
+void
+bal_translation_cache_destroy(bal_allocator_t *allocator, bal_translation_cache_t *cache)
+{
+    if (NULL == allocator || NULL == cache)
+    {
+        return;
+    }
+
+    if (cache->translations != NULL)
+    {
+        allocator->free(allocator->handle,
+                        cache->translations,
+                        (size_t)cache->capacity * sizeof(bal_translation_t));
+        cache->translations = NULL;
+    }
+
+    if (cache->buckets != NULL)
+    {
+        allocator->free(allocator->handle,
+                        cache->buckets,
+                        ((size_t)cache->bucket_mask + 1) * sizeof(uint32_t));
+        cache->buckets = NULL;
+    }
+
+    if (cache->pending_buckets != NULL)
+    {
+        allocator->free(allocator->handle,
+                        cache->pending_buckets,
+                        ((size_t)cache->bucket_mask + 1) * sizeof(uint32_t));
+        cache->pending_buckets = NULL;
+    }
+
+    if (cache->page_buckets != NULL)
+    {
+        allocator->free(allocator->handle,
+                        cache->page_buckets,
+                        ((size_t)cache->bucket_mask + 1) * sizeof(uint32_t));
+        cache->page_buckets = NULL;
+    }
+}
+
+/// Hashes the word address with a Fibonacci multiplier so neighbouring
+/// blocks spread over the buckets.
+static inline uint32_t
+bucket_index(const bal_translation_cache_t *cache, bal_guest_address_t guest_address)
+{
+    uint64_t hash = (guest_address >> 2) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(hash >> 32) & cache->bucket_mask;
+}
+
+static inline bal_link_t *
+link_at(const bal_translation_cache_t *cache, uint32_t link_id)
+{
+    return &cache->translations[bal_link_id_translation(link_id)]
+                .links[bal_link_id_kind(link_id)];
+}
+
+/// Returns true if `link` can be pointed at a translation. Only those links
+/// are kept in the pending table.
+static inline bool
+has_target(const bal_link_t *link)
+{
+    return link->site != 0 && link->target != BAL_LINK_TARGET_NONE;
+}
+
+static inline uint32_t
+page_bucket_index(const bal_translation_cache_t *cache, bal_guest_address_t page)
+{
+    uint64_t hash = page * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(hash >> 32) & cache->bucket_mask;
+}
+
+/// Writes the distinct pages `translation` is chained under to `pages` and
+/// returns how many there are. The order only depends on `translation`, so
+/// the position of a page names the same node on insertion and removal.
+static uint32_t
+translation_pages(const bal_translation_t *translation, bal_guest_address_t *pages)
+{
+    const bal_guest_address_t addresses[2] = { translation->guest_address,
+                                               translation->exit.target };
+    const size_t sizes[2] = { translation->exit.guest_size, translation->flags_assumption_size };
+    uint32_t     count    = 0;
+
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (0 == sizes[i])
+        {
+            continue;
+        }
+
+        bal_guest_address_t ends[2] = { addresses[i] >> BAL_CODE_PAGE_SHIFT,
+                                        (addresses[i] + sizes[i] - 1U) >> BAL_CODE_PAGE_SHIFT };
+
+        BAL_ASSERT(ends[1] - ends[0] <= 1);
+
+        for (uint32_t end = 0; end < 2; ++end)
+        {
+            bool seen = false;
+
+            for (uint32_t j = 0; j < count; ++j)
+            {
+                seen = seen || pages[j] == ends[end];
+            }
+
+            if (false == seen)
+            {
+                pages[count++] = ends[end];
+            }
+        }
+    }
+
+    return count;
+}
+
+/// Returns true if the code of `translation`, or the code it assumed
+/// overwrites the flags, overlaps `[guest_address, guest_address + size)`.
+static bool
+overlaps(const bal_translation_t *translation, bal_guest_address_t guest_address, size_t size)
+{
+    bal_guest_address_t begin         = translation->guest_address;
+    bal_guest_address_t end           = begin + translation->exit.guest_size;
+    bal_guest_address_t successor     = translation->exit.target;
+    bal_guest_address_t successor_end = successor + translation->flags_assumption_size;
+
+    return (end > guest_address && begin < guest_address + size)
+           || (successor_end > guest_address && successor < guest_address + size);
+}
+
+static void
+add_pending(bal_translation_cache_t *cache, uint32_t link_id)
+{
+    bal_link_t *link   = link_at(cache, link_id);
+    uint32_t    bucket = bucket_index(cache, link->target);
+
+    link->next                     = cache->pending_buckets[bucket];
+    cache->pending_buckets[bucket] = link_id;
+}
+
+static void
+remove_pending(bal_translation_cache_t *cache, uint32_t link_id)
+{
+    bal_link_t *link   = link_at(cache, link_id);
+    uint32_t   *cursor = &cache->pending_buckets[bucket_index(cache, link->target)];
+
+    while (*cursor != link_id)
+    {
+        BAL_ASSERT(*cursor != BAL_TRANSLATION_NONE);
+        cursor = &link_at(cache, *cursor)->next;
+    }
+
+    *cursor    = link->next;
+    link->next = BAL_TRANSLATION_NONE;
+}
+
+/*** end of file ***/
@@ -0,0 +1,196 @@
+#include "bal_vector.h"
+#include "bal_ir.h"
+#include <stdbool.h>
+
+/// The size of a vector register in bytes.
+#define VECTOR_BYTES 16U
+
+static void     unpack(const bal_guest_vector_register_t *, uint8_t *);
+static void     pack(const uint8_t *, bal_guest_vector_register_t *);
+static uint64_t lane(const uint8_t *, uint32_t, uint32_t);
+static void     set_lane(uint8_t *, uint32_t, uint32_t, uint64_t);
+static uint64_t execute_lane(bal_opcode_t, uint64_t, uint64_t, uint32_t);
+
+void
+bal_vector_execute(bal_guest_vector_register_t *vectors,
+                   bal_opcode_t                 opcode,
+                   uint32_t                     n,
+                   uint32_t                     m,
+                   uint32_t                     descriptor,
+                   uint64_t                     scalar)
+{
+    const uint32_t size      = 1U << bal_ir_vector_size(descriptor);
+    const uint32_t bytes     = bal_ir_vector_is_128(descriptor) ? VECTOR_BYTES : 8U;
+    const uint32_t lanes     = bytes / size;
+    const uint32_t immediate = bal_ir_vector_immediate(descriptor);
+
+    uint8_t left[VECTOR_BYTES]   = { 0 };
+    uint8_t right[VECTOR_BYTES]  = { 0 };
+    uint8_t result[VECTOR_BYTES] = { 0 };
+
+    // Both operands are copied out first since the destination may be
+    // either of them.
+    //
+    if (opcode != OPCODE_VECTOR_DUPLICATE_SCALAR)
+    {
+        unpack(&vectors[n], left);
+    }
+
+    if (opcode != OPCODE_VECTOR_DUPLICATE && opcode != OPCODE_VECTOR_DUPLICATE_SCALAR)
+    {
+        unpack(&vectors[m], right);
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_VECTOR_ZIP_LOW:
+        case OPCODE_VECTOR_ZIP_HIGH: {
+            uint32_t first = (OPCODE_VECTOR_ZIP_HIGH == opcode) ? lanes / 2U : 0U;
+
+            for (uint32_t i = 0; i < lanes / 2U; ++i)
+            {
+                set_lane(result, 2U * i, size, lane(left, first + i, size));
+                set_lane(result, 2U * i + 1U, size, lane(right, first + i, size));
+            }
+
+            break;
+        }
+
+        case OPCODE_VECTOR_EXTRACT:
+            for (uint32_t i = 0; i < bytes; ++i)
+            {
+                uint32_t index = i + immediate;
+                result[i]      = (index < bytes) ? left[index] : right[index - bytes];
+            }
+
+            break;
+
+        case OPCODE_VECTOR_TABLE:
+            for (uint32_t i = 0; i < bytes; ++i)
+            {
+                result[i] = (right[i] < VECTOR_BYTES) ? left[right[i]] : 0U;
+            }
+
+            break;
+
+        case OPCODE_VECTOR_DUPLICATE:
+        case OPCODE_VECTOR_DUPLICATE_SCALAR: {
+            uint64_t value = (OPCODE_VECTOR_DUPLICATE == opcode) ? lane(left, immediate, size)
+                                                                 : scalar;
+
+            for (uint32_t i = 0; i < lanes; ++i)
+            {
+                set_lane(result, i, size, value);
+            }
+
+            break;
+        }
+
+        default:
+            for (uint32_t i = 0; i < lanes; ++i)
+            {
+                set_lane(result,
+                         i,
+                         size,
+                         execute_lane(opcode, lane(left, i, size), lane(right, i, size), size));
+            }
+
+            break;
+    }
+
+    pack(result, &vectors[bal_ir_vector_register(descriptor)]);
+}
+
+/// Copies the bytes of `vector` to `bytes` in guest order.
+static void
+unpack(const bal_guest_vector_register_t *vector, uint8_t *bytes)
+{
+    for (uint32_t i = 0; i < VECTOR_BYTES; ++i)
+    {
+        bytes[i] = (uint8_t)(vector->lanes[i / 8U] >> ((i % 8U) * 8U));
+    }
+}
+
+/// Copies `bytes`, in guest order, to `vector`.
+static void
+pack(const uint8_t *bytes, bal_guest_vector_register_t *vector)
+{
+    vector->lanes[0] = lane(bytes, 0, 8);
+    vector->lanes[1] = lane(bytes, 1, 8);
+}
+
+/// Returns lane `index` of `size` bytes.
+static uint64_t
+lane(const uint8_t *bytes, uint32_t index, uint32_t size)
+{
+    uint64_t value = 0;
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        value |= (uint64_t)bytes[index * size + i] << (i * 8U);
+    }
+
+    return value;
+}
+
+/// Writes the low `size` bytes of `value` to lane `index`.
+static void
+set_lane(uint8_t *bytes, uint32_t index, uint32_t size, uint64_t value)
+{
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        bytes[index * size + i] = (uint8_t)(value >> (i * 8U));
+    }
+}
+
+/// Returns the lane-wise `opcode` of the `size` byte lanes `left` and
+/// `right`. Only the low `size` bytes of the result are meaningful.
+static uint64_t
+execute_lane(bal_opcode_t opcode, uint64_t left, uint64_t right, uint32_t size)
+{
+    const uint32_t shift        = 64U - size * 8U;
+    const int64_t  signed_left  = (int64_t)(left << shift) >> shift;
+    const int64_t  signed_right = (int64_t)(right << shift) >> shift;
+    bool           condition    = false;
+
+    switch (opcode)
+    {
+        case OPCODE_VECTOR_ADD:
+            return left + right;
+        case OPCODE_VECTOR_SUB:
+            return left - right;
+        case OPCODE_VECTOR_MUL:
+            return left * right;
+        case OPCODE_VECTOR_AND:
+            return left & right;
+        case OPCODE_VECTOR_BIC:
+            return left & ~right;
+        case OPCODE_VECTOR_OR:
+            return left | right;
+        case OPCODE_VECTOR_OR_NOT:
+            return left | ~right;
+        case OPCODE_VECTOR_XOR:
+            return left ^ right;
+        case OPCODE_VECTOR_COMPARE_EQUAL:
+            condition = (left == right);
+            break;
+        case OPCODE_VECTOR_COMPARE_GREATER:
+            condition = (signed_left > signed_right);
+            break;
+        case OPCODE_VECTOR_COMPARE_GREATER_EQUAL:
+            condition = (signed_left >= signed_right);
+            break;
+        case OPCODE_VECTOR_COMPARE_HIGHER:
+            condition = (left > right);
+            break;
+        case OPCODE_VECTOR_COMPARE_HIGHER_SAME:
+            condition = (left >= right);
+            break;
+        default:
+            break;
+    }
+
+    return condition ? UINT64_MAX : 0U;
+}
+
+/*** end of file ***/
@@ -0,0 +1,29 @@
+/** @file bal_vector.h
+ *
+ * @brief Internal reference implementation of the vector opcodes, used by
+ * the interpreter.
+ */
+
+#ifndef BALLISTIC_VECTOR_H
+#define BALLISTIC_VECTOR_H
+
+#include "bal_guest_state.h"
+#include "bal_types.h"
+#include <stdint.h>
+
+/// Executes the vector opcode `opcode` with the vector descriptor
+/// `descriptor` on the vector registers `vectors`. `n` and `m` are the
+/// registers it reads and `scalar` the value `OPCODE_VECTOR_DUPLICATE_SCALAR`
+/// copies. `Vd` may alias `Vn` or `Vm`.
+///
+/// The instruction must satisfy `bal_ir_vector_is_valid`.
+void bal_vector_execute(bal_guest_vector_register_t *vectors,
+                        bal_opcode_t                 opcode,
+                        uint32_t                     n,
+                        uint32_t                     m,
+                        uint32_t                     descriptor,
+                        uint64_t                     scalar);
+
+#endif /* BALLISTIC_VECTOR_H */
+
+/*** end of file ***/
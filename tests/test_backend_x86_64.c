@@ -0,0 +1,506 @@
+#include "bal_assembler.h"
+#include "bal_backend.h"
+#include "bal_engine.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include "bal_passes.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE              BAL_SOURCE_NONE
+#define CODE_MEMORY_SIZE  (4 * 1024 * 1024)
+#define GUEST_MEMORY_SIZE 0x4000U
+#define WIDE_CAPACITY     (1U << 18U)
+#define WIDE_ADDS         70000U
+
+typedef struct
+{
+    bal_engine_t           engine;
+    bal_register_class_t   register_class;
+    bal_code_buffer_t      code_buffer;
+    bal_memory_interface_t interface;
+    uint8_t               *memory;
+    bal_vcpu_t             vcpu;
+} test_fixture_t;
+
+static uint32_t
+emit(bal_engine_t *engine,
+     bal_opcode_t  opcode,
+     uint32_t      source1,
+     uint32_t      source2,
+     uint32_t      source3)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, source3));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+static void
+emit_jump(bal_engine_t *engine, bal_guest_address_t target)
+{
+    emit(engine, OPCODE_JUMP, emit_constant(engine, target), NONE, NONE);
+}
+
+static bool
+compile_and_run(test_fixture_t *fixture, bal_guest_address_t next_guest_address)
+{
+    bal_compiled_unit_t unit;
+    bal_error_t         error = bal_backend_compile_x86_64(
+        &fixture->engine, &fixture->register_class, &fixture->code_buffer, NULL, &unit);
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr,
+                "FAIL: bal_backend_compile_x86_64() returned %s.\n",
+                bal_error_to_string(error));
+        return false;
+    }
+
+    bal_unit_function_t function = (bal_unit_function_t)(uintptr_t)unit.entry;
+    uint64_t            returned = function(&fixture->vcpu);
+
+    if (returned != next_guest_address)
+    {
+        fprintf(stderr, "FAIL: Unit returned 0x%llx.\n", (unsigned long long)returned);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+expect_register(const test_fixture_t *fixture, uint32_t index, uint64_t expected)
+{
+    if (fixture->vcpu.state.registers[index] != expected)
+    {
+        fprintf(stderr,
+                "FAIL: X%u = 0x%llx, expected 0x%llx.\n",
+                index,
+                (unsigned long long)fixture->vcpu.state.registers[index],
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+// X2 = ((X0 + X1) & 0xFF) + 0x123456789ABCDEF0; X3 = 0x123456789ABCDEF0
+//
+static bool
+test_templates(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+
+    uint32_t mask  = emit_constant(engine, 0xFF);
+    uint32_t large = emit_constant(engine, 0x123456789ABCDEF0ULL);
+    uint32_t x0    = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t x1    = emit(engine, OPCODE_GET_REGISTER, 1, NONE, NONE);
+    uint32_t sum   = emit(engine, OPCODE_ADD, x0, x1, NONE);
+    uint32_t low   = emit(engine, OPCODE_AND, sum, mask, NONE);
+    uint32_t value = emit(engine, OPCODE_CONST, large, NONE, NONE);
+    uint32_t total = emit(engine, OPCODE_ADD, low, value, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 2, total, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 3, value, NONE);
+    emit_jump(engine, 0x1000);
+
+    fixture->vcpu.state.registers[0] = 0x1F0;
+    fixture->vcpu.state.registers[1] = 0x20;
+
+    return compile_and_run(fixture, 0x1000) && expect_register(fixture, 2, 0x123456789ABCDF00ULL)
+           && expect_register(fixture, 3, 0x123456789ABCDEF0ULL);
+}
+
+// X4 = X0 + X1 + X2 + X3 with a single allocatable register.
+//
+static bool
+test_spills(test_fixture_t *fixture)
+{
+    bal_engine_t *engine                    = &fixture->engine;
+    fixture->register_class.registers_count = 1;
+
+    uint32_t values[4];
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        values[i]                        = emit(engine, OPCODE_GET_REGISTER, i, NONE, NONE);
+        fixture->vcpu.state.registers[i] = (uint64_t)(i + 1) << (i * 16);
+    }
+
+    uint32_t sum = emit(engine, OPCODE_ADD, values[0], values[1], NONE);
+    sum          = emit(engine, OPCODE_ADD, sum, values[2], NONE);
+    sum          = emit(engine, OPCODE_ADD, sum, values[3], NONE);
+    emit(engine, OPCODE_SET_REGISTER, 4, sum, NONE);
+    emit_jump(engine, 0x2000);
+
+    return compile_and_run(fixture, 0x2000) && expect_register(fixture, 4, 0x0004000300020001ULL);
+}
+
+// MOVZ X0, #0x1234, LSL #16; MOVK X0, #0x5678; MOVZ X1, #0xBEEF
+//
+// The unit falls through to the address after the last instruction.
+//
+static bool
+test_end_to_end(test_fixture_t *fixture)
+{
+    uint32_t        code[3];
+    bal_assembler_t assembler;
+    bal_logger_t    logger = fixture->engine.logger;
+    (void)bal_assembler_init(&assembler, code, 3, logger);
+    bal_emit_movz(&assembler, BAL_REGISTER_X0, 0x1234, 16);
+    bal_emit_movk(&assembler, BAL_REGISTER_X0, 0x5678, 0);
+    bal_emit_movz(&assembler, BAL_REGISTER_X1, 0xBEEF, 0);
+
+    fixture->engine.guest_address = 0x400000;
+    bal_error_t error = bal_engine_translate(&fixture->engine, NULL, code, sizeof(code));
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_translate() returned %s.\n", bal_error_to_string(error));
+        return false;
+    }
+
+    fixture->vcpu.state.registers[0] = 0xFFFFFFFFFFFFFFFFULL;
+    fixture->vcpu.state.registers[1] = 0;
+
+    return compile_and_run(fixture, 0x400000 + sizeof(code))
+           && expect_register(fixture, 0, 0x12345678) && expect_register(fixture, 1, 0xBEEF);
+}
+
+// X5 = X0, left to the exit. The exit is not linked, so it stores X5 before
+// returning.
+//
+static bool
+test_exit_writes(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+
+    uint32_t x0  = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t sum = emit(engine, OPCODE_ADD, x0, x0, NONE);
+    emit(engine, OPCODE_SET_REGISTER_ON_EXIT, 5, x0, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 6, sum, NONE);
+    emit_jump(engine, 0x3000);
+
+    fixture->vcpu.state.registers[0] = 0x1234;
+
+    return compile_and_run(fixture, 0x3000) && expect_register(fixture, 5, 0x1234)
+           && expect_register(fixture, 6, 0x2468);
+}
+
+/// Translates `code` at 0x400000, then runs the Tier 2 pipeline over it if
+/// `tier2` is set.
+static bool
+translate(test_fixture_t *fixture, const uint32_t *code, size_t size, bool tier2)
+{
+    (void)bal_engine_reset(&fixture->engine);
+    fixture->engine.guest_address = 0x400000;
+    bal_error_t error = bal_engine_translate(&fixture->engine, NULL, code, size);
+
+    if (BAL_SUCCESS == error && tier2)
+    {
+        error = bal_passes_run_tier2(&fixture->engine);
+    }
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Translation returned %s.\n", bal_error_to_string(error));
+        return false;
+    }
+
+    return true;
+}
+
+// X2 = [X0]; [X0 + 8].w = X2 + 1; X3 = [X0 + 8].h; [0x1FFC] = X2;
+// X4 = [0x1FFE].w; X5 = X0
+//
+// The first run misses the TLB on every access, the second only on the ones
+// crossing a page.
+//
+static bool
+test_memory_access(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+
+    uint32_t one     = emit_constant(engine, 1);
+    uint32_t eight   = emit_constant(engine, 8);
+    uint32_t crossed = emit_constant(engine, 0x1FFC);
+    uint32_t inside  = emit_constant(engine, 0x1FFE);
+    uint32_t address = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t loaded  = emit(engine, OPCODE_LOAD, address, 8, NONE);
+    uint32_t next    = emit(engine, OPCODE_ADD, loaded, one, NONE);
+    uint32_t field   = emit(engine, OPCODE_ADD, address, eight, NONE);
+    emit(engine, OPCODE_STORE, field, next, 4);
+    uint32_t half = emit(engine, OPCODE_LOAD, field, 2, NONE);
+    emit(engine, OPCODE_STORE, crossed, loaded, 8);
+    uint32_t word = emit(engine, OPCODE_LOAD, inside, 4, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 2, loaded, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 3, half, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 4, word, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 5, address, NONE);
+    emit_jump(engine, 0x1000);
+
+    const uint64_t value = 0x1122334455667788ULL;
+    (void)memcpy(fixture->memory + 0x1000, &value, sizeof(value));
+    fixture->vcpu.state.registers[0] = 0x1000;
+
+    for (uint64_t misses = 4; misses <= 6; misses += 2)
+    {
+        if (false == compile_and_run(fixture, 0x1000) || false == expect_register(fixture, 2, value)
+            || false == expect_register(fixture, 3, 0x7789)
+            || false == expect_register(fixture, 4, 0x33445566)
+            || false == expect_register(fixture, 5, 0x1000))
+        {
+            return false;
+        }
+
+        if (fixture->vcpu.tlb.misses != misses)
+        {
+            fprintf(stderr,
+                    "FAIL: %llu TLB misses, expected %llu.\n",
+                    (unsigned long long)fixture->vcpu.tlb.misses,
+                    (unsigned long long)misses);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// MOVZ X0, #0x1234, LSL #16; MOVK X0, #0x5678
+//
+// Tier 2 folds the MOVK into a single constant, so the unit shrinks and
+// still computes the same value.
+//
+static bool
+test_tier2_folding(test_fixture_t *fixture)
+{
+    uint32_t        code[2];
+    bal_assembler_t assembler;
+    (void)bal_assembler_init(&assembler, code, 2, fixture->engine.logger);
+    bal_emit_movz(&assembler, BAL_REGISTER_X0, 0x1234, 16);
+    bal_emit_movk(&assembler, BAL_REGISTER_X0, 0x5678, 0);
+
+    size_t sizes[2];
+
+    for (uint32_t tier = 0; tier < 2; ++tier)
+    {
+        if (false == translate(fixture, code, sizeof(code), 1 == tier))
+        {
+            return false;
+        }
+
+        size_t offset                    = fixture->code_buffer.offset;
+        fixture->vcpu.state.registers[0] = 0;
+
+        if (false == compile_and_run(fixture, 0x400000 + sizeof(code))
+            || false == expect_register(fixture, 0, 0x12345678))
+        {
+            return false;
+        }
+
+        sizes[tier] = fixture->code_buffer.offset - offset;
+    }
+
+    // v0 = CONST, v1 = AND v0, v2 = ADD v1.
+    //
+    if (bal_ir_opcode(bal_ir_get(&fixture->engine, 2)) != OPCODE_CONST)
+    {
+        fprintf(stderr, "FAIL: Tier 2 did not fold the MOVK.\n");
+        return false;
+    }
+
+    if (sizes[1] >= sizes[0])
+    {
+        fprintf(stderr, "FAIL: Tier 2 unit is %zu bytes, Tier 1 is %zu.\n", sizes[1], sizes[0]);
+        return false;
+    }
+
+    return true;
+}
+
+// X1 = the sum of 40 bytes at X0. More accesses than there are slow paths
+// call into the TLB inline.
+//
+static bool
+test_many_accesses(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+
+    uint32_t one     = emit_constant(engine, 1);
+    uint32_t address = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t sum     = emit(engine, OPCODE_LOAD, address, 1, NONE);
+
+    for (uint32_t i = 1; i < 40; ++i)
+    {
+        address     = emit(engine, OPCODE_ADD, address, one, NONE);
+        uint32_t xi = emit(engine, OPCODE_LOAD, address, 1, NONE);
+        sum         = emit(engine, OPCODE_ADD, sum, xi, NONE);
+    }
+
+    emit(engine, OPCODE_SET_REGISTER, 1, sum, NONE);
+    emit_jump(engine, 0x1000);
+
+    for (uint32_t i = 0; i < 40; ++i)
+    {
+        fixture->memory[0x2000 + i] = (uint8_t)(i + 1);
+    }
+
+    fixture->vcpu.state.registers[0] = 0x2000;
+
+    return compile_and_run(fixture, 0x1000) && expect_register(fixture, 1, 40 * 41 / 2);
+}
+
+// A faulting load leaves the unit with its own address before X0 is written.
+//
+static bool
+test_memory_fault(test_fixture_t *fixture)
+{
+    bal_engine_t *engine  = &fixture->engine;
+    engine->guest_address = 0x3000;
+
+    uint32_t seven   = emit_constant(engine, 7);
+    uint32_t outside = emit_constant(engine, GUEST_MEMORY_SIZE);
+    uint32_t loaded  = emit(engine, OPCODE_LOAD, outside, 4, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 0, seven, NONE);
+    emit(engine, OPCODE_SET_REGISTER, 1, loaded, NONE);
+    emit_jump(engine, 0x1000);
+
+    return compile_and_run(fixture, 0x3000) && expect_register(fixture, 0, 0)
+           && 1 == fixture->vcpu.tlb.fault
+           && GUEST_MEMORY_SIZE == fixture->vcpu.tlb.fault_address;
+}
+
+static bool
+test_unterminated(test_fixture_t *fixture)
+{
+    bal_compiled_unit_t unit;
+    size_t              offset = fixture->code_buffer.offset;
+    emit(&fixture->engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+
+    bal_error_t error = bal_backend_compile_x86_64(
+        &fixture->engine, &fixture->register_class, &fixture->code_buffer, NULL, &unit);
+
+    if (error != BAL_ERROR_ENGINE_STATE_INVALID || fixture->code_buffer.offset != offset)
+    {
+        fprintf(stderr, "FAIL: A unit without a terminator was compiled.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// X0 += 0 + 1 + ... + (WIDE_ADDS - 1), one pooled constant per addition, in a
+// wide unit whose SSA and constant indices run past 65536.
+//
+static bool
+test_wide_unit(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+    engine->is_wide      = true;
+
+    uint32_t sum      = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint64_t expected = 5;
+
+    for (uint32_t i = 0; i < WIDE_ADDS; ++i)
+    {
+        // Pool index 0xFFFF spells BAL_SOURCE_NONE.
+        //
+        engine->constant_count += (BAL_SOURCE_MASK == engine->constant_count) ? 1U : 0U;
+
+        sum = emit(engine, OPCODE_ADD, sum, emit_constant(engine, i), NONE);
+        expected += i;
+    }
+
+    emit(engine, OPCODE_SET_REGISTER, 0, sum, NONE);
+    emit_jump(engine, 0x1000);
+
+    fixture->vcpu.state.registers[0] = 5;
+
+    return compile_and_run(fixture, 0x1000) && expect_register(fixture, 0, expected);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *);
+
+    const test_function_t tests[] = {
+        test_templates,     test_spills,        test_end_to_end,
+        test_exit_writes,   test_tier2_folding, test_memory_access,
+        test_many_accesses, test_memory_fault,  test_unterminated,
+        test_wide_unit,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    test_fixture_t  fixture;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    bal_code_memory_t code_memory;
+
+    if (bal_code_memory_init(&code_memory, CODE_MEMORY_SIZE, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_code_memory_init() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (bal_engine_init_with_capacity(&allocator, &fixture.engine, logger, WIDE_CAPACITY)
+        != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init_with_capacity() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    (void)bal_code_buffer_init_code_memory(&fixture.code_buffer, &code_memory, logger);
+
+    fixture.memory = (uint8_t *)allocator.allocate(allocator.handle, 16, GUEST_MEMORY_SIZE);
+
+    if (NULL == fixture.memory
+        || bal_memory_init_flat(
+               &allocator, &fixture.interface, fixture.memory, GUEST_MEMORY_SIZE, logger)
+               != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Failed to set up guest memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&fixture.engine);
+        bal_register_class_init(&fixture.register_class, BAL_HOST_ARCHITECTURE_X86_64);
+        (void)memset(&fixture.vcpu, 0, sizeof(fixture.vcpu));
+        (void)memset(fixture.memory, 0, GUEST_MEMORY_SIZE);
+        bal_tlb_init(&fixture.vcpu.tlb, &fixture.interface);
+
+        if (false == tests[i](&fixture))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    bal_memory_destroy_flat(&allocator, &fixture.interface);
+    allocator.free(allocator.handle, fixture.memory, GUEST_MEMORY_SIZE);
+    bal_engine_destroy(&allocator, &fixture.engine);
+    bal_code_memory_destroy(&code_memory);
+    return return_code;
+}
+
+/*** end of file ***/
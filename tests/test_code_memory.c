@@ -0,0 +1,221 @@
+#include "bal_code_buffer.h"
+#include "bal_code_memory.h"
+#include "bal_platform.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESERVE_SIZE (4U * BAL_CODE_MEMORY_COMMIT_GRANULARITY)
+
+static bool
+test_dual_mapping(bal_code_memory_t *code_memory)
+{
+    if (bal_code_memory_commit(code_memory, 1) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_code_memory_commit() failed.\n");
+        return false;
+    }
+
+    if (code_memory->writable_base == code_memory->executable_base)
+    {
+        fprintf(stderr, "FAIL: Writable and executable views share an address.\n");
+        return false;
+    }
+
+    const uint8_t pattern[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+    (void)memcpy(code_memory->writable_base + 128, pattern, sizeof(pattern));
+
+    if (memcmp(code_memory->executable_base + 128, pattern, sizeof(pattern)) != 0)
+    {
+        fprintf(stderr, "FAIL: Write is not visible through the executable view.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+test_commit_on_demand(bal_code_memory_t *code_memory)
+{
+    bal_code_buffer_t code_buffer;
+    bal_logger_t      logger = code_memory->logger;
+
+    if (bal_code_buffer_init_code_memory(&code_buffer, code_memory, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_code_buffer_init_code_memory() failed.\n");
+        return false;
+    }
+
+    size_t  initial_commit = code_memory->committed_size;
+    uint8_t filler[256];
+    (void)memset(filler, 0xCC, sizeof(filler));
+
+    while (code_buffer.offset <= initial_commit)
+    {
+        bal_code_buffer_emit(&code_buffer, filler, sizeof(filler));
+    }
+
+    if (code_buffer.status != BAL_SUCCESS || code_memory->committed_size <= initial_commit)
+    {
+        fprintf(stderr, "FAIL: Code buffer did not commit more memory.\n");
+        return false;
+    }
+
+    // Running past the reservation fails without touching unmapped memory.
+    //
+    while (BAL_SUCCESS == code_buffer.status)
+    {
+        bal_code_buffer_emit(&code_buffer, filler, sizeof(filler));
+    }
+
+    if (code_buffer.status != BAL_ERROR_CODE_BUFFER_OVERFLOW
+        || code_memory->committed_size != code_memory->reserved_size)
+    {
+        fprintf(stderr, "FAIL: Expected overflow at the end of the reservation.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+test_cold_region(bal_code_memory_t *code_memory)
+{
+    if (bal_code_memory_split(code_memory, BAL_CODE_MEMORY_COMMIT_GRANULARITY) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_code_memory_split() failed.\n");
+        return false;
+    }
+
+    bal_code_buffer_t hot;
+    bal_code_buffer_t cold;
+    bal_logger_t      logger = code_memory->logger;
+
+    if (bal_code_buffer_init_code_memory(&hot, code_memory, logger) != BAL_SUCCESS
+        || bal_code_buffer_init_code_memory_region(
+               &cold, code_memory, BAL_CODE_REGION_COLD, logger)
+               != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Code buffer init failed.\n");
+        return false;
+    }
+
+    if (cold.executable_buffer != code_memory->executable_base + code_memory->cold_offset
+        || code_memory->cold_offset != RESERVE_SIZE - BAL_CODE_MEMORY_COMMIT_GRANULARITY)
+    {
+        fprintf(stderr, "FAIL: Cold region is not at the end of the reservation.\n");
+        return false;
+    }
+
+    // The hot region ends where the cold one starts.
+    //
+    uint8_t filler[256];
+    (void)memset(filler, 0xCC, sizeof(filler));
+
+    while (BAL_SUCCESS == hot.status)
+    {
+        bal_code_buffer_emit(&hot, filler, sizeof(filler));
+    }
+
+    if (hot.status != BAL_ERROR_CODE_BUFFER_OVERFLOW
+        || code_memory->committed_size != code_memory->cold_offset)
+    {
+        fprintf(stderr, "FAIL: Hot code ran into the cold region.\n");
+        return false;
+    }
+
+    bal_code_buffer_emit(&cold, filler, sizeof(filler));
+
+    if (cold.status != BAL_SUCCESS || cold.offset != sizeof(filler))
+    {
+        fprintf(stderr, "FAIL: Cold region is not usable after the hot region fills.\n");
+        return false;
+    }
+
+    if (bal_code_memory_split(code_memory, 0) != BAL_ERROR_INVALID_ARGUMENT)
+    {
+        fprintf(stderr, "FAIL: Splitting committed code memory succeeded.\n");
+        return false;
+    }
+
+    return true;
+}
+
+#if BAL_ARCHITECTURE_X86
+
+static bool
+test_execute(bal_code_memory_t *code_memory)
+{
+    // MOV EAX, 42; RET
+    //
+    const uint8_t code[] = { 0xB8, 0x2A, 0x00, 0x00, 0x00, 0xC3 };
+
+    if (bal_code_memory_commit(code_memory, sizeof(code)) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_code_memory_commit() failed.\n");
+        return false;
+    }
+
+    (void)memcpy(code_memory->writable_base, code, sizeof(code));
+    bal_code_memory_flush_instruction_cache(code_memory->executable_base, sizeof(code));
+
+    typedef uint32_t (*function_t)(void);
+    function_t function = (function_t)(uintptr_t)code_memory->executable_base;
+
+    if (function() != 42)
+    {
+        fprintf(stderr, "FAIL: Code in the executable view returned the wrong value.\n");
+        return false;
+    }
+
+    return true;
+}
+
+#endif
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_code_memory_t *);
+
+    const test_function_t tests[] = {
+        test_dual_mapping,
+        test_commit_on_demand,
+        test_cold_region,
+#if BAL_ARCHITECTURE_X86
+        test_execute,
+#endif
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_logger_t logger;
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        bal_code_memory_t code_memory;
+
+        if (bal_code_memory_init(&code_memory, RESERVE_SIZE, logger) != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_code_memory_init() failed.\n");
+            return EXIT_FAILURE;
+        }
+
+        if (false == tests[i](&code_memory))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_code_memory_destroy(&code_memory);
+    }
+
+    return return_code;
+}
+
+/*** end of file ***/
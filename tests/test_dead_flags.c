@@ -0,0 +1,246 @@
+#include "bal_engine.h"
+#include "bal_guest_state.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include "bal_passes.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NONE BAL_SOURCE_NONE
+
+static uint32_t
+emit(bal_engine_t *engine, bal_opcode_t opcode, uint32_t source1, uint32_t source2)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, NONE));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+/// Emits the flag writes of `CMP left, right` and returns the first one.
+static uint32_t
+emit_compare(bal_engine_t *engine, uint32_t left, uint32_t right)
+{
+    uint32_t operation = emit_constant(engine, BAL_FLAGS_SUB_64);
+    uint32_t first
+        = emit(engine, OPCODE_SET_REGISTER, BAL_GUEST_REGISTER_FLAGS_OPERATION, operation);
+    (void)emit(engine, OPCODE_SET_REGISTER, BAL_GUEST_REGISTER_FLAGS_LEFT, left);
+    (void)emit(engine, OPCODE_SET_REGISTER, BAL_GUEST_REGISTER_FLAGS_RIGHT, right);
+    return first;
+}
+
+/// Checks that the three flag writes from `first` on became `opcode`.
+static bool
+expect_writes(const bal_engine_t *engine, uint32_t first, bal_opcode_t opcode)
+{
+    for (uint32_t i = first; i < first + 3; ++i)
+    {
+        bal_opcode_t actual = bal_ir_opcode(bal_ir_get(engine, i));
+
+        if (actual != opcode)
+        {
+            fprintf(stderr, "FAIL: Flag write v%u is opcode %u, expected %u.\n", i, actual, opcode);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+run_pass(bal_engine_t *engine, bool flags_dead_on_exit, bool *flags_live_on_entry)
+{
+    if (bal_pass_dead_flags(engine, flags_dead_on_exit, flags_live_on_entry) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_pass_dead_flags() returned an error.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// CMP X0, X1; CMP X0, #1; B
+//
+static bool
+test_overwritten(bal_engine_t *engine)
+{
+    uint32_t one    = emit_constant(engine, 1);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    uint32_t first  = emit_compare(engine, x0, x1);
+    uint32_t second = emit_compare(engine, x0, one);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = true;
+
+    return run_pass(engine, false, &live_on_entry) && expect_writes(engine, first, OPCODE_NOP)
+           && expect_writes(engine, second, OPCODE_SET_REGISTER) && false == live_on_entry;
+}
+
+// CMP X0, X1; read NZCV; CMP X0, #1; B, where the successor overwrites the
+// flags. The last writes are left to the exit.
+//
+static bool
+test_read_between(bal_engine_t *engine)
+{
+    uint32_t one    = emit_constant(engine, 1);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    uint32_t first  = emit_compare(engine, x0, x1);
+
+    for (uint32_t field = BAL_GUEST_REGISTER_FLAGS_OPERATION;
+         field <= BAL_GUEST_REGISTER_FLAGS_RIGHT;
+         ++field)
+    {
+        (void)emit(engine, OPCODE_GET_REGISTER, field, NONE);
+    }
+
+    uint32_t second = emit_compare(engine, x0, one);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = true;
+
+    return run_pass(engine, true, &live_on_entry)
+           && expect_writes(engine, first, OPCODE_SET_REGISTER)
+           && expect_writes(engine, second, OPCODE_SET_REGISTER_ON_EXIT) && false == live_on_entry;
+}
+
+// if (X0) CMP X0, X1; B
+//
+static bool
+test_conditional_write(bal_engine_t *engine)
+{
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    (void)emit(engine, OPCODE_IF, x0, NONE);
+    uint32_t write = emit_compare(engine, x0, x1);
+    (void)emit(engine, OPCODE_END_BLOCK, NONE, NONE);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = false;
+
+    return run_pass(engine, false, &live_on_entry)
+           && expect_writes(engine, write, OPCODE_SET_REGISTER) && live_on_entry;
+}
+
+// if (X0) CMP X0, X1; B, where the successor overwrites the flags. The exit
+// can not store a conditional write.
+//
+static bool
+test_conditional_write_on_exit(bal_engine_t *engine)
+{
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    (void)emit(engine, OPCODE_IF, x0, NONE);
+    uint32_t write = emit_compare(engine, x0, x1);
+    (void)emit(engine, OPCODE_END_BLOCK, NONE, NONE);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = false;
+
+    return run_pass(engine, true, &live_on_entry)
+           && expect_writes(engine, write, OPCODE_SET_REGISTER) && live_on_entry;
+}
+
+// CMP X0, X1; LDR X2, [X0]; CMP X0, #1; B, where the successor overwrites the
+// flags. The load may fault back to the host before the second CMP.
+//
+static bool
+test_memory_access(bal_engine_t *engine)
+{
+    uint32_t one    = emit_constant(engine, 1);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    uint32_t first  = emit_compare(engine, x0, x1);
+    (void)emit(engine, OPCODE_LOAD, x0, bal_ir_access(8, 0));
+    uint32_t second = emit_compare(engine, x0, one);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = true;
+
+    return run_pass(engine, true, &live_on_entry)
+           && expect_writes(engine, first, OPCODE_SET_REGISTER)
+           && expect_writes(engine, second, OPCODE_SET_REGISTER_ON_EXIT) && false == live_on_entry;
+}
+
+// LDR X2, [X0]; CMP X0, #1; B. A fault on the load reports the flags of the
+// previous unit.
+//
+static bool
+test_memory_access_on_entry(bal_engine_t *engine)
+{
+    uint32_t one    = emit_constant(engine, 1);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    (void)emit(engine, OPCODE_LOAD, x0, bal_ir_access(8, 0));
+    uint32_t write = emit_compare(engine, x0, one);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bool live_on_entry = false;
+
+    return run_pass(engine, false, &live_on_entry)
+           && expect_writes(engine, write, OPCODE_SET_REGISTER) && live_on_entry;
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_engine_t *);
+
+    const test_function_t tests[] = {
+        test_overwritten,
+        test_read_between,
+        test_conditional_write,
+        test_conditional_write_on_exit,
+        test_memory_access,
+        test_memory_access_on_entry,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    bal_engine_t    engine;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_engine_init(&allocator, &engine, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&engine);
+
+        if (false == tests[i](&engine))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    bal_engine_destroy(&allocator, &engine);
+    return return_code;
+}
+
+/*** end of file ***/
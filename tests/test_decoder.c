@@ -54,7 +54,7 @@ main(void)
             for (size_t i = 0; i < bucket->count; ++i)
             {
                 const bal_decoder_instruction_metadata_t *metadata
-                    = g_decoder_hash_candidates[bucket->index];
+                    = g_decoder_hash_candidates[bucket->index + i];
                 local_candidates[i].mask     = metadata->mask;
                 local_candidates[i].expected = metadata->expected;
                 local_candidates[i].priority = POPCOUNT(metadata->mask);
@@ -0,0 +1,166 @@
+#include "bal_epoch.h"
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLOTS_COUNT 2U
+
+static bool
+expect_value(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s is %llu, expected %llu.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+// With no thread online, everything retired so far can be reused.
+//
+static bool
+test_idle(bal_epoch_t *epoch)
+{
+    uint64_t tag = bal_epoch_current(epoch);
+    bal_epoch_advance(epoch);
+
+    return expect_value("safe epoch", bal_epoch_safe(epoch), tag + 1);
+}
+
+// An online slot holds back reuse until it quiesces past the tag.
+//
+static bool
+test_quiesce(bal_epoch_t *epoch)
+{
+    uint32_t slot = 0;
+
+    if (bal_epoch_claim(epoch, &slot) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_epoch_claim() failed.\n");
+        return false;
+    }
+
+    uint64_t tag = bal_epoch_current(epoch);
+    bal_epoch_advance(epoch);
+
+    bool held = expect_value("safe epoch before quiesce", bal_epoch_safe(epoch), tag);
+
+    bal_epoch_quiesce(epoch, slot);
+    bool released = expect_value("safe epoch after quiesce", bal_epoch_safe(epoch), tag + 1);
+
+    bal_epoch_release(epoch, slot);
+    return held && released;
+}
+
+// An offline slot never holds back reuse, and comes back online at the
+// current epoch.
+//
+static bool
+test_offline(bal_epoch_t *epoch)
+{
+    uint32_t slot = 0;
+
+    if (bal_epoch_claim(epoch, &slot) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_epoch_claim() failed.\n");
+        return false;
+    }
+
+    bal_epoch_offline(epoch, slot);
+
+    uint64_t tag = bal_epoch_current(epoch);
+    bal_epoch_advance(epoch);
+
+    bool offline = expect_value("safe epoch while offline", bal_epoch_safe(epoch), tag + 1);
+
+    bal_epoch_online(epoch, slot);
+    bool online = expect_value("safe epoch while online", bal_epoch_safe(epoch), tag + 1);
+
+    bal_epoch_release(epoch, slot);
+    return offline && online;
+}
+
+// Claiming fails once every slot is held, and a released slot is claimed
+// again.
+//
+static bool
+test_claim(bal_epoch_t *epoch)
+{
+    uint32_t slots[SLOTS_COUNT];
+
+    for (uint32_t i = 0; i < SLOTS_COUNT; ++i)
+    {
+        if (bal_epoch_claim(epoch, &slots[i]) != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_epoch_claim() failed.\n");
+            return false;
+        }
+    }
+
+    uint32_t    extra  = SLOTS_COUNT;
+    bal_error_t status = bal_epoch_claim(epoch, &extra);
+
+    bal_epoch_release(epoch, slots[0]);
+
+    bool reclaimed = (BAL_SUCCESS == bal_epoch_claim(epoch, &extra));
+
+    bal_epoch_release(epoch, slots[1]);
+    bal_epoch_release(epoch, extra);
+
+    return expect_value("status when full", (uint64_t)status, (uint64_t)BAL_ERROR_INVALID_ARGUMENT)
+           && expect_value("reclaimed", reclaimed, true)
+           && expect_value("reclaimed slot", extra, slots[0]);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_epoch_t *);
+
+    const test_function_t tests[] = {
+        test_idle,
+        test_quiesce,
+        test_offline,
+        test_claim,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        bal_epoch_t epoch;
+
+        if (bal_epoch_init(&allocator, &epoch, SLOTS_COUNT, logger) != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_epoch_init() failed.\n");
+            return_code = EXIT_FAILURE;
+            break;
+        }
+
+        if (false == tests[i](&epoch))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_epoch_destroy(&allocator, &epoch);
+    }
+
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,300 @@
+#include "bal_backend.h"
+#include "bal_engine.h"
+#include "bal_fastmem.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE             BAL_SOURCE_NONE
+#define CODE_MEMORY_SIZE (1024 * 1024)
+#define ADDRESS_BITS     32U
+#define RAM_SIZE         0x10000U
+#define DEVICE_ADDRESS   0x20000U
+#define DEVICE_SIZE      0x1000U
+
+typedef struct
+{
+    bal_engine_t           engine;
+    bal_register_class_t   register_class;
+    bal_code_buffer_t      code_buffer;
+    bal_fastmem_t          fastmem;
+    bal_memory_interface_t interface;
+    bal_vcpu_t             vcpu;
+} test_fixture_t;
+
+/// Guest RAM is mapped in the fastmem region. The device page is not, so
+/// only the slow path reaches it.
+static uint8_t *ram;
+static uint8_t  device[DEVICE_SIZE];
+
+static uint8_t *
+translate_write(void *context, bal_guest_address_t guest_address, size_t *max_writable_size)
+{
+    (void)context;
+
+    if (guest_address < RAM_SIZE)
+    {
+        *max_writable_size = RAM_SIZE - (size_t)guest_address;
+        return ram + guest_address;
+    }
+
+    if (guest_address >= DEVICE_ADDRESS && guest_address < DEVICE_ADDRESS + DEVICE_SIZE)
+    {
+        *max_writable_size = DEVICE_ADDRESS + DEVICE_SIZE - (size_t)guest_address;
+        return device + (guest_address - DEVICE_ADDRESS);
+    }
+
+    *max_writable_size = 0;
+    return NULL;
+}
+
+static const uint8_t *
+translate(void *context, bal_guest_address_t guest_address, size_t *max_readable_size)
+{
+    return translate_write(context, guest_address, max_readable_size);
+}
+
+static uint32_t
+emit(bal_engine_t *engine,
+     bal_opcode_t  opcode,
+     uint32_t      source1,
+     uint32_t      source2,
+     uint32_t      source3)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, source3));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+/// X1 = the 8 bytes at X0; store X1 + 1 as 4 bytes at X0 + 8.
+static void
+emit_copy(bal_engine_t *engine)
+{
+    uint32_t one     = emit_constant(engine, 1);
+    uint32_t eight   = emit_constant(engine, 8);
+    uint32_t address = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t loaded  = emit(engine, OPCODE_LOAD, address, 8, NONE);
+    uint32_t next    = emit(engine, OPCODE_ADD, loaded, one, NONE);
+    uint32_t field   = emit(engine, OPCODE_ADD, address, eight, NONE);
+    emit(engine, OPCODE_STORE, field, next, 4);
+    emit(engine, OPCODE_SET_REGISTER, 1, loaded, NONE);
+    emit(engine, OPCODE_JUMP, emit_constant(engine, 0x1000), NONE, NONE);
+}
+
+static bool
+compile(test_fixture_t *fixture, bal_unit_function_t *function)
+{
+    bal_backend_options_t options = { .fastmem = &fixture->fastmem };
+    bal_compiled_unit_t   unit;
+    bal_error_t           error = bal_backend_compile_x86_64(
+        &fixture->engine, &fixture->register_class, &fixture->code_buffer, &options, &unit);
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr,
+                "FAIL: bal_backend_compile_x86_64() returned %s.\n",
+                bal_error_to_string(error));
+        return false;
+    }
+
+    *function = (bal_unit_function_t)(uintptr_t)unit.entry;
+    return true;
+}
+
+static bool
+expect_value(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s is 0x%llx, expected 0x%llx.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+// Accesses to mapped RAM neither fault nor touch the TLB.
+//
+static bool
+test_mapped(test_fixture_t *fixture)
+{
+    bal_unit_function_t function;
+    emit_copy(&fixture->engine);
+
+    const uint64_t value = 0x1122334455667788ULL;
+    (void)memcpy(ram + 0x1000, &value, sizeof(value));
+    fixture->vcpu.state.registers[0] = 0x1000;
+
+    if (false == compile(fixture, &function))
+    {
+        return false;
+    }
+
+    uint32_t field = 0;
+    uint64_t next  = function(&fixture->vcpu);
+    (void)memcpy(&field, ram + 0x1008, sizeof(field));
+
+    return expect_value("next", next, 0x1000)
+           && expect_value("X1", fixture->vcpu.state.registers[1], value)
+           && expect_value("field", field, 0x55667789)
+           && expect_value("misses", fixture->vcpu.tlb.misses, 0)
+           && expect_value("patches", fixture->fastmem.patches, 0);
+}
+
+// Accesses to the device page fault once, are patched into jumps to their
+// slow path and go through the memory interface from then on.
+//
+static bool
+test_unmapped(test_fixture_t *fixture)
+{
+    bal_unit_function_t function;
+    emit_copy(&fixture->engine);
+
+    const uint64_t value = 0x0102030405060708ULL;
+    (void)memcpy(device, &value, sizeof(value));
+    fixture->vcpu.state.registers[0] = DEVICE_ADDRESS;
+
+    if (false == compile(fixture, &function))
+    {
+        return false;
+    }
+
+    for (uint64_t run = 1; run <= 2; ++run)
+    {
+        uint32_t field = 0;
+        uint64_t next  = function(&fixture->vcpu);
+        (void)memcpy(&field, device + 8, sizeof(field));
+
+        if (false == expect_value("next", next, 0x1000)
+            || false == expect_value("X1", fixture->vcpu.state.registers[1], value)
+            || false == expect_value("field", field, 0x05060709)
+            || false == expect_value("misses", fixture->vcpu.tlb.misses, 2 * run)
+            || false == expect_value("patches", fixture->fastmem.patches, 2))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Addresses past the region take the slow path without faulting, which
+// reports them like any other unmapped address.
+//
+static bool
+test_out_of_range(test_fixture_t *fixture)
+{
+    bal_unit_function_t function;
+    fixture->engine.guest_address = 0x3000;
+    emit_copy(&fixture->engine);
+
+    fixture->vcpu.state.registers[0] = (1ULL << ADDRESS_BITS) + 0x1000;
+
+    if (false == compile(fixture, &function))
+    {
+        return false;
+    }
+
+    return expect_value("next", function(&fixture->vcpu), 0x3000)
+           && expect_value("fault", fixture->vcpu.tlb.fault, 1)
+           && expect_value("patches", fixture->fastmem.patches, 0);
+}
+
+static bool
+test_map_arguments(test_fixture_t *fixture)
+{
+    bal_fastmem_t *fastmem = &fixture->fastmem;
+
+    return BAL_ERROR_MEMORY_ALIGNMENT == bal_fastmem_map(fastmem, 0x10, 0x1000, true)
+           && BAL_ERROR_INVALID_ARGUMENT
+                  == bal_fastmem_map(fastmem, 1ULL << ADDRESS_BITS, 0x1000, true)
+           && BAL_ERROR_INVALID_ARGUMENT == bal_fastmem_map(fastmem, 0, 0, true);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *);
+
+    const test_function_t tests[] = {
+        test_mapped,
+        test_unmapped,
+        test_out_of_range,
+        test_map_arguments,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t   allocator;
+    bal_logger_t      logger;
+    test_fixture_t    fixture;
+    bal_code_memory_t code_memory;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_fastmem_init(&allocator, &fixture.fastmem, ADDRESS_BITS, 64, logger) != BAL_SUCCESS
+        || bal_fastmem_map(&fixture.fastmem, 0, RAM_SIZE, true) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Failed to set up the fastmem region.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (bal_code_memory_init(&code_memory, CODE_MEMORY_SIZE, logger) != BAL_SUCCESS
+        || bal_engine_init(&allocator, &fixture.engine, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Failed to set up the backend.\n");
+        return EXIT_FAILURE;
+    }
+
+    (void)bal_code_buffer_init_code_memory(&fixture.code_buffer, &code_memory, logger);
+
+    ram                               = fixture.fastmem.base;
+    fixture.interface.context         = NULL;
+    fixture.interface.translate       = translate;
+    fixture.interface.translate_write = translate_write;
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&fixture.engine);
+        bal_register_class_init(&fixture.register_class, BAL_HOST_ARCHITECTURE_X86_64);
+        bal_register_class_pin(&fixture.register_class, BAL_FASTMEM_BASE_REGISTER_X86_64);
+        (void)memset(&fixture.vcpu, 0, sizeof(fixture.vcpu));
+        (void)memset(ram, 0, RAM_SIZE);
+        (void)memset(device, 0, sizeof(device));
+        bal_tlb_init(&fixture.vcpu.tlb, &fixture.interface);
+        fixture.fastmem.patches = 0;
+
+        if (false == tests[i](&fixture))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    bal_engine_destroy(&allocator, &fixture.engine);
+    bal_code_memory_destroy(&code_memory);
+    bal_fastmem_destroy(&allocator, &fixture.fastmem);
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,212 @@
+#include "bal_guest_state.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N BAL_NZCV_N
+#define Z BAL_NZCV_Z
+#define C BAL_NZCV_C
+#define V BAL_NZCV_V
+
+typedef struct
+{
+    bal_flags_operation_t operation;
+    uint64_t              left;
+    uint64_t              right;
+    uint32_t              nzcv;
+} flags_case_t;
+
+static bool
+test_nzcv(void)
+{
+    const flags_case_t cases[] = {
+        { BAL_FLAGS_NONE, 0, 0, 0 },
+        { BAL_FLAGS_SUB_64, 1, 2, N },
+        { BAL_FLAGS_SUB_64, 5, 5, Z | C },
+        { BAL_FLAGS_SUB_64, 0x8000000000000000ULL, 1, C | V },
+        { BAL_FLAGS_ADD_64, UINT64_MAX, 1, Z | C },
+        { BAL_FLAGS_ADD_64, 0x7FFFFFFFFFFFFFFFULL, 1, N | V },
+        { BAL_FLAGS_ADD_32, 0xAAAA0000FFFFFFFFULL, 1, Z | C },
+        { BAL_FLAGS_ADD_32, 0x7FFFFFFF, 1, N | V },
+        { BAL_FLAGS_SUB_32, 0, 1, N },
+        { BAL_FLAGS_SUB_32, 0x80000000, 0x500000001ULL, C | V },
+        { BAL_FLAGS_LOGICAL_64, 0, 0, Z },
+        { BAL_FLAGS_LOGICAL_64, 0x8000000000000000ULL, 0, N },
+        { BAL_FLAGS_LOGICAL_32, 0x180000000ULL, 0, N },
+        { BAL_FLAGS_LOGICAL_32, 0x100000000ULL, 0, Z },
+    };
+    const size_t cases_count = sizeof(cases) / sizeof(cases[0]);
+
+    bool passed = true;
+
+    for (size_t i = 0; i < cases_count; ++i)
+    {
+        bal_guest_state_t state;
+        (void)memset(&state, 0, sizeof(state));
+        bal_guest_state_set_flags(&state, cases[i].operation, cases[i].left, cases[i].right);
+
+        uint32_t nzcv = bal_guest_state_nzcv(&state);
+
+        if (nzcv != cases[i].nzcv)
+        {
+            fprintf(stderr,
+                    "FAIL: Case %zu computed NZCV 0x%08x, expected 0x%08x.\n",
+                    i,
+                    nzcv,
+                    cases[i].nzcv);
+            passed = false;
+        }
+    }
+
+    return passed;
+}
+
+static bool
+test_set_nzcv(void)
+{
+    bal_guest_state_t state;
+    (void)memset(&state, 0, sizeof(state));
+    bal_guest_state_set_flags(&state, BAL_FLAGS_SUB_64, 1, 2);
+    bal_guest_state_set_nzcv(&state, Z | C | 0xF);
+
+    if (bal_guest_state_nzcv(&state) != (Z | C))
+    {
+        fprintf(stderr, "FAIL: Stored NZCV did not replace the lazy flags.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/// `ConditionHolds` from the A64 pseudocode.
+static bool
+condition_holds(uint32_t condition, uint32_t nzcv)
+{
+    const bool n = (nzcv & N) != 0;
+    const bool z = (nzcv & Z) != 0;
+    const bool c = (nzcv & C) != 0;
+    const bool v = (nzcv & V) != 0;
+    bool       result;
+
+    switch (condition >> 1)
+    {
+        case 0:
+            result = z;
+            break;
+        case 1:
+            result = c;
+            break;
+        case 2:
+            result = n;
+            break;
+        case 3:
+            result = v;
+            break;
+        case 4:
+            result = c && !z;
+            break;
+        case 5:
+            result = (n == v);
+            break;
+        case 6:
+            result = (n == v) && !z;
+            break;
+        default:
+            result = true;
+            break;
+    }
+
+    return ((condition & 1U) != 0 && condition != 0xF) ? !result : result;
+}
+
+static bool
+test_conditions(void)
+{
+    bool passed = true;
+
+    for (uint32_t flags = 0; flags < 16; ++flags)
+    {
+        bal_guest_state_t state;
+        (void)memset(&state, 0, sizeof(state));
+        bal_guest_state_set_nzcv(&state, flags << 28);
+
+        for (uint32_t condition = 0; condition < 16; ++condition)
+        {
+            uint32_t expected = condition_holds(condition, flags << 28) ? 1U : 0U;
+            uint32_t actual   = bal_guest_state_condition_holds(&state, condition);
+
+            if (actual != expected)
+            {
+                fprintf(stderr,
+                        "FAIL: Condition %u with NZCV 0x%x is %u, expected %u.\n",
+                        condition,
+                        flags,
+                        actual,
+                        expected);
+                passed = false;
+            }
+        }
+    }
+
+    return passed;
+}
+
+static bool
+test_layout(void)
+{
+    bal_guest_state_t state;
+    (void)memset(&state, 0, sizeof(state));
+
+    *bal_guest_state_register(&state, BAL_GUEST_REGISTER_SP)         = 1;
+    *bal_guest_state_register(&state, BAL_GUEST_REGISTER_PC)         = 2;
+    *bal_guest_state_register(&state, BAL_GUEST_REGISTER_FLAGS_LEFT) = 3;
+
+    if (state.sp != 1 || state.pc != 2 || state.flags.left != 3)
+    {
+        fprintf(stderr, "FAIL: Register indices do not match the layout.\n");
+        return false;
+    }
+
+    // Everything but the vector registers fits in the first five cache lines.
+    //
+    if (BAL_GUEST_REGISTER_COUNT * sizeof(uint64_t) > 5 * 64
+        || offsetof(bal_guest_state_t, vectors) > 5 * 64)
+    {
+        fprintf(stderr, "FAIL: Scalar state spills past the fifth cache line.\n");
+        return false;
+    }
+
+    return true;
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(void);
+
+    const test_function_t tests[] = {
+        test_nzcv,
+        test_set_nzcv,
+        test_conditions,
+        test_layout,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        if (false == tests[i]())
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,213 @@
+#include "bal_engine.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include "bal_passes.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NONE BAL_SOURCE_NONE
+
+static uint32_t
+emit(bal_engine_t *engine,
+     bal_opcode_t  opcode,
+     uint32_t      source1,
+     uint32_t      source2,
+     uint32_t      source3)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, source3));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+static bool
+expect_opcode(const bal_engine_t *engine, uint32_t index, bal_opcode_t expected)
+{
+    bal_opcode_t actual = bal_ir_opcode(bal_ir_get(engine, index));
+
+    if (actual != expected)
+    {
+        fprintf(stderr, "FAIL: v%u has opcode %d, expected %d\n", index, actual, expected);
+        return false;
+    }
+
+    return true;
+}
+
+// x = (x < 0) ? 0 : x
+//
+static bool
+test_clamp(bal_engine_t *engine)
+{
+    uint32_t zero      = emit_constant(engine, 0);
+    uint32_t x         = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t condition = emit(engine, OPCODE_CMP, x, zero, NONE);
+    uint32_t if_index  = emit(engine, OPCODE_IF, condition, NONE, NONE);
+    uint32_t yield1    = emit(engine, OPCODE_YIELD, zero, NONE, NONE);
+    uint32_t else_     = emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    uint32_t yield2    = emit(engine, OPCODE_YIELD, x, NONE, NONE);
+    uint32_t merge     = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+
+    if (bal_pass_if_to_select(engine) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_pass_if_to_select() returned an error.\n");
+        return false;
+    }
+
+    if (!expect_opcode(engine, if_index, OPCODE_NOP) || !expect_opcode(engine, yield1, OPCODE_NOP)
+        || !expect_opcode(engine, else_, OPCODE_NOP) || !expect_opcode(engine, yield2, OPCODE_NOP)
+        || !expect_opcode(engine, merge, OPCODE_CONDITIONAL_SELECT))
+    {
+        return false;
+    }
+
+    bal_ir_instruction_t select = bal_ir_get(engine, merge);
+
+    if (bal_ir_source1(select) != condition || bal_ir_source2(select) != zero
+        || bal_ir_source3(select) != x)
+    {
+        fprintf(stderr, "FAIL: Select operands do not match the diamond.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// x = (x < 0) ? (0 - x) : x
+//
+static bool
+test_abs(bal_engine_t *engine)
+{
+    uint32_t zero      = emit_constant(engine, 0);
+    uint32_t x         = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t condition = emit(engine, OPCODE_CMP, x, zero, NONE);
+    emit(engine, OPCODE_IF, condition, NONE, NONE);
+    uint32_t negated = emit(engine, OPCODE_SUB, zero, x, NONE);
+    emit(engine, OPCODE_YIELD, negated, NONE, NONE);
+    emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    emit(engine, OPCODE_YIELD, x, NONE, NONE);
+    uint32_t merge = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+
+    (void)bal_pass_if_to_select(engine);
+
+    return expect_opcode(engine, negated, OPCODE_SUB)
+           && expect_opcode(engine, merge, OPCODE_CONDITIONAL_SELECT);
+}
+
+// min(max(x, 0), limit), where the inner diamond sits in the outer ELSE arm.
+//
+static bool
+test_nested(bal_engine_t *engine)
+{
+    uint32_t zero  = emit_constant(engine, 0);
+    uint32_t limit = emit_constant(engine, 255);
+    uint32_t x     = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t above    = emit(engine, OPCODE_CMP, x, limit, NONE);
+    uint32_t outer_if = emit(engine, OPCODE_IF, above, NONE, NONE);
+    emit(engine, OPCODE_YIELD, limit, NONE, NONE);
+    uint32_t outer_else = emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    uint32_t below      = emit(engine, OPCODE_CMP, x, zero, NONE);
+    uint32_t inner_if   = emit(engine, OPCODE_IF, below, NONE, NONE);
+    emit(engine, OPCODE_YIELD, zero, NONE, NONE);
+    uint32_t inner_else = emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    emit(engine, OPCODE_YIELD, x, NONE, NONE);
+    uint32_t inner        = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+    uint32_t inner_result = emit(engine, OPCODE_YIELD, inner, NONE, NONE);
+    uint32_t outer        = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+
+    (void)bal_pass_if_to_select(engine);
+
+    // The outer ELSE arm holds the inner CMP and the inner select.
+    //
+    if (!expect_opcode(engine, inner, OPCODE_CONDITIONAL_SELECT)
+        || !expect_opcode(engine, outer, OPCODE_CONDITIONAL_SELECT)
+        || !expect_opcode(engine, outer_if, OPCODE_NOP)
+        || !expect_opcode(engine, outer_else, OPCODE_NOP)
+        || !expect_opcode(engine, inner_if, OPCODE_NOP)
+        || !expect_opcode(engine, inner_else, OPCODE_NOP)
+        || !expect_opcode(engine, inner_result, OPCODE_NOP)
+        || !expect_opcode(engine, below, OPCODE_CMP))
+    {
+        return false;
+    }
+
+    bal_ir_instruction_t select = bal_ir_get(engine, outer);
+
+    if (bal_ir_source1(select) != above || bal_ir_source2(select) != limit
+        || bal_ir_source3(select) != inner)
+    {
+        fprintf(stderr, "FAIL: Outer select does not pick the inner select.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+test_side_effects(bal_engine_t *engine)
+{
+    uint32_t zero      = emit_constant(engine, 0);
+    uint32_t x         = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t condition = emit(engine, OPCODE_CMP, x, zero, NONE);
+    uint32_t if_index  = emit(engine, OPCODE_IF, condition, NONE, NONE);
+    emit(engine, OPCODE_STORE, x, zero, NONE);
+    emit(engine, OPCODE_YIELD, zero, NONE, NONE);
+    emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    emit(engine, OPCODE_YIELD, x, NONE, NONE);
+    uint32_t merge = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+
+    (void)bal_pass_if_to_select(engine);
+
+    return expect_opcode(engine, if_index, OPCODE_IF) && expect_opcode(engine, merge, OPCODE_MERGE);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_engine_t *);
+
+    const test_function_t tests[]     = { test_clamp, test_abs, test_nested, test_side_effects };
+    const size_t          tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    bal_engine_t    engine;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_engine_init(&allocator, &engine, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&engine);
+
+        if (false == tests[i](&engine))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    bal_engine_destroy(&allocator, &engine);
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,378 @@
+#include "bal_engine.h"
+#include "bal_interpreter.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE                 BAL_SOURCE_NONE
+#define INSTRUCTION_CAPACITY 32U
+#define THRESHOLD            4
+#define GUEST_MEMORY_SIZE    0x2000U
+
+typedef struct
+{
+    bal_engine_t      engine;
+    bal_interpreter_t interpreter;
+    bal_vcpu_t        vcpu;
+    uint64_t          values[INSTRUCTION_CAPACITY * 2];
+} test_fixture_t;
+
+static uint8_t guest_memory[GUEST_MEMORY_SIZE];
+
+static uint8_t *
+translate_write(void *context, bal_guest_address_t guest_address, size_t *max_writable_size)
+{
+    (void)context;
+
+    if (guest_address >= GUEST_MEMORY_SIZE)
+    {
+        return NULL;
+    }
+
+    *max_writable_size = GUEST_MEMORY_SIZE - guest_address;
+    return guest_memory + guest_address;
+}
+
+static const uint8_t *
+translate(void *context, bal_guest_address_t guest_address, size_t *max_readable_size)
+{
+    return translate_write(context, guest_address, max_readable_size);
+}
+
+static uint32_t
+emit(bal_engine_t *engine, bal_opcode_t opcode, uint32_t source1, uint32_t source2)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, NONE));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+/// Resets the engine for a unit of `guest_size` bytes at `guest_address`.
+static void
+begin_unit(test_fixture_t *fixture, bal_guest_address_t guest_address, size_t guest_size)
+{
+    (void)bal_engine_reset(&fixture->engine);
+    fixture->engine.guest_address        = guest_address;
+    fixture->engine.unit_exit.guest_size = guest_size;
+}
+
+static bool
+decode(test_fixture_t *fixture, bal_interpreter_unit_t **unit)
+{
+    bal_error_t error = bal_interpreter_decode(
+        &fixture->interpreter, &fixture->engine, THRESHOLD, unit);
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(
+            stderr, "FAIL: bal_interpreter_decode() returned %s.\n", bal_error_to_string(error));
+        return false;
+    }
+
+    return true;
+}
+
+static bal_guest_address_t
+run(test_fixture_t *fixture, const bal_interpreter_unit_t *unit)
+{
+    return bal_interpreter_run(&fixture->interpreter, unit, &fixture->vcpu, fixture->values);
+}
+
+static bool
+expect_value(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s is 0x%llx, expected 0x%llx.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+// X2 = ((X0 + X1) - 3) ^ (X0 & 0xF0)
+//
+static bool
+test_arithmetic(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+    begin_unit(fixture, 0x1000, 8);
+
+    uint32_t three  = emit_constant(engine, 3);
+    uint32_t mask   = emit_constant(engine, 0xF0);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t x1     = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    uint32_t sum    = emit(engine, OPCODE_ADD, x0, x1);
+    uint32_t less   = emit(engine, OPCODE_SUB, sum, three);
+    uint32_t masked = emit(engine, OPCODE_AND, x0, mask);
+    uint32_t result = emit(engine, OPCODE_XOR, less, masked);
+    (void)emit(engine, OPCODE_SET_REGISTER, 2, result);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bal_interpreter_unit_t *unit = NULL;
+
+    if (false == decode(fixture, &unit))
+    {
+        return false;
+    }
+
+    fixture->vcpu.state.registers[0] = 0x1234;
+    fixture->vcpu.state.registers[1] = 0x10;
+
+    bal_guest_address_t next = run(fixture, unit);
+    uint64_t            x2   = ((0x1234U + 0x10U) - 3U) ^ (0x1234U & 0xF0U);
+
+    return expect_value("target", next, 0x2000)
+           && expect_value("X2", fixture->vcpu.state.registers[2], x2)
+           && bal_interpreter_lookup(&fixture->interpreter, 0x1000) == unit
+           && expect_value("counter", (uint64_t)unit->counter, THRESHOLD);
+}
+
+// Values nobody reads are not decoded, but stores are.
+//
+static bool
+test_dead_values(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+    begin_unit(fixture, 0x1000, 4);
+
+    uint32_t one    = emit_constant(engine, 1);
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    (void)emit(engine, OPCODE_ADD, x0, one);
+    (void)emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    (void)emit(engine, OPCODE_NOP, NONE, NONE);
+    (void)emit(engine, OPCODE_SET_REGISTER, 3, one);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bal_interpreter_unit_t *unit = NULL;
+
+    if (false == decode(fixture, &unit))
+    {
+        return false;
+    }
+
+    bal_guest_address_t next = run(fixture, unit);
+
+    return expect_value("target", next, 0x2000)
+           && expect_value("X3", fixture->vcpu.state.registers[3], 1)
+           && expect_value("instructions", fixture->interpreter.instruction_count, 2);
+}
+
+// A call pushes its return address and a return pops it again.
+//
+static bool
+test_call_return(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+    begin_unit(fixture, 0x1000, 4);
+
+    uint32_t target         = emit_constant(engine, 0x3000);
+    uint32_t return_address = emit_constant(engine, 0x1004);
+    (void)emit(engine, OPCODE_SET_REGISTER, 30, return_address);
+    (void)emit(engine, OPCODE_CALL, target, return_address);
+
+    bal_interpreter_unit_t *call = NULL;
+
+    if (false == decode(fixture, &call))
+    {
+        return false;
+    }
+
+    begin_unit(fixture, 0x3000, 4);
+    uint32_t x30 = emit(engine, OPCODE_GET_REGISTER, 30, NONE);
+    (void)emit(engine, OPCODE_RETURN, x30, NONE);
+
+    bal_interpreter_unit_t *ret = NULL;
+
+    if (false == decode(fixture, &ret))
+    {
+        return false;
+    }
+
+    bal_return_stack_t *stack = &fixture->vcpu.return_stack;
+    bal_guest_address_t next  = run(fixture, call);
+    const bal_return_stack_entry_t *top = &stack->entries[stack->top / sizeof(*top)];
+
+    if (false == expect_value("call target", next, 0x3000)
+        || false == expect_value("pushed address", top->guest_address, 0x1004)
+        || top->host_code != NULL)
+    {
+        return false;
+    }
+
+    next = run(fixture, ret);
+
+    return expect_value("return target", next, 0x1004) && expect_value("top", stack->top, 0);
+}
+
+// X1 = [X0].h; [X0 + 2].w = X1; then a load past the end of guest memory
+// stops the unit before X2 is written.
+//
+static bool
+test_memory(test_fixture_t *fixture)
+{
+    bal_engine_t          *engine    = &fixture->engine;
+    bal_memory_interface_t interface = { NULL, translate, translate_write };
+    bal_tlb_init(&fixture->vcpu.tlb, &interface);
+    begin_unit(fixture, 0x1000, 8);
+
+    uint32_t two     = emit_constant(engine, 2);
+    uint32_t outside = emit_constant(engine, GUEST_MEMORY_SIZE);
+    uint32_t target  = emit_constant(engine, 0x2000);
+    uint32_t x0      = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t half    = emit(engine, OPCODE_LOAD, x0, 2);
+    uint32_t field   = emit(engine, OPCODE_ADD, x0, two);
+    bal_ir_set(engine, engine->instruction_count++, bal_ir_encode(OPCODE_STORE, field, half, 4));
+    (void)emit(engine, OPCODE_SET_REGISTER, 1, half);
+    uint32_t fault = emit(engine, OPCODE_LOAD, outside, 8);
+    (void)emit(engine, OPCODE_SET_REGISTER, 2, fault);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bal_interpreter_unit_t *unit = NULL;
+
+    if (false == decode(fixture, &unit))
+    {
+        return false;
+    }
+
+    (void)memset(guest_memory, 0xFF, sizeof(guest_memory));
+    guest_memory[0x100]              = 0x34;
+    guest_memory[0x101]              = 0x12;
+    fixture->vcpu.state.registers[0] = 0x100;
+    fixture->vcpu.state.registers[2] = 5;
+
+    bal_guest_address_t next = run(fixture, unit);
+    uint32_t            word = 0;
+    (void)memcpy(&word, guest_memory + 0x102, sizeof(word));
+
+    return expect_value("target", next, 0x1000)
+           && expect_value("X1", fixture->vcpu.state.registers[1], 0x1234)
+           && expect_value("X2", fixture->vcpu.state.registers[2], 5)
+           && expect_value("stored", word, 0x1234)
+           && expect_value("fault", fixture->vcpu.tlb.fault, 1);
+}
+
+static bool
+test_unsupported_opcode(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+    begin_unit(fixture, 0x1000, 4);
+
+    uint32_t target  = emit_constant(engine, 0x2000);
+    uint32_t x0      = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+    uint32_t product = emit(engine, OPCODE_MUL, x0, x0);
+    (void)emit(engine, OPCODE_SET_REGISTER, 0, product);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bal_interpreter_unit_t *unit  = NULL;
+    bal_error_t             error = bal_interpreter_decode(
+        &fixture->interpreter, &fixture->engine, THRESHOLD, &unit);
+
+    return expect_value("error", (uint64_t)error, (uint64_t)BAL_ERROR_UNSUPPORTED_OPCODE)
+           && expect_value("instructions", fixture->interpreter.instruction_count, 0);
+}
+
+// Decoding more units than the arena holds discards the old ones.
+//
+static bool
+test_flush(test_fixture_t *fixture)
+{
+    bal_engine_t *engine = &fixture->engine;
+
+    for (bal_guest_address_t address = 0x1000; address < 0x1000 + 4 * INSTRUCTION_CAPACITY;
+         address += 4)
+    {
+        begin_unit(fixture, address, 4);
+
+        uint32_t target = emit_constant(engine, address + 4);
+        uint32_t x0     = emit(engine, OPCODE_GET_REGISTER, 0, NONE);
+        uint32_t sum    = emit(engine, OPCODE_ADD, x0, target);
+        (void)emit(engine, OPCODE_SET_REGISTER, 0, sum);
+        (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+        bal_interpreter_unit_t *unit = NULL;
+
+        if (false == decode(fixture, &unit))
+        {
+            return false;
+        }
+    }
+
+    return fixture->interpreter.flushes != 0
+           && NULL == bal_interpreter_lookup(&fixture->interpreter, 0x1000)
+           && bal_interpreter_lookup(&fixture->interpreter, 0x1000 + 4 * INSTRUCTION_CAPACITY - 4)
+                  != NULL;
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *);
+
+    const test_function_t tests[] = {
+        test_arithmetic, test_dead_values,        test_call_return,
+        test_memory,     test_unsupported_opcode, test_flush,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    test_fixture_t  fixture;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_engine_init(&allocator, &fixture.engine, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)memset(&fixture.vcpu, 0, sizeof(fixture.vcpu));
+
+        if (bal_interpreter_init(&allocator, &fixture.interpreter, 16, INSTRUCTION_CAPACITY, logger)
+            != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_interpreter_init() failed.\n");
+            return_code = EXIT_FAILURE;
+            break;
+        }
+
+        if (false == tests[i](&fixture))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_interpreter_destroy(&allocator, &fixture.interpreter);
+    }
+
+    bal_engine_destroy(&allocator, &fixture.engine);
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,313 @@
+#include "bal_engine.h"
+#include "bal_ir.h"
+#include "bal_ir_file.h"
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE BAL_SOURCE_NONE
+#define PATH "test_ir_file.bin"
+
+/// Enough room for a wide unit whose indices run past 65536.
+#define WIDE_CAPACITY    (1U << 18U)
+#define WIDE_INSTRUCTION 70000U
+
+static uint32_t
+emit(bal_engine_t *engine, bal_opcode_t opcode, uint32_t source1, uint32_t source2)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, NONE));
+    engine->ssa_bit_widths[index] = (bal_bit_width_t)(32U << (index & 1U));
+    engine->instruction_count     = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static uint32_t
+emit_constant(bal_engine_t *engine, bal_constant_t value)
+{
+    uint32_t index           = engine->constant_count;
+    engine->constants[index] = value;
+    engine->constant_count   = (bal_constant_count_t)(index + 1);
+    return index | BAL_DECODED_CONSTANT_BIT;
+}
+
+/// X0 = X1; BL 0x2000
+///
+static void
+emit_unit(bal_engine_t *engine)
+{
+    uint32_t target         = emit_constant(engine, 0x2000);
+    uint32_t return_address = emit_constant(engine, 0x1008);
+    uint32_t x1             = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+    (void)emit(engine, OPCODE_SET_REGISTER, 0, x1);
+    (void)emit(engine, OPCODE_CALL, target, return_address);
+
+    engine->guest_address = 0x1000;
+    engine->unit_exit     = (bal_unit_exit_t) {
+            .kind           = BAL_UNIT_EXIT_CALL,
+            .target         = 0x2000,
+            .return_address = 0x1008,
+            .guest_size     = 8,
+    };
+}
+
+static bool
+expect_unit(const char              *name,
+            const bal_instruction_t *instructions,
+            const bal_constant_t    *constants,
+            const bal_bit_width_t   *ssa_bit_widths,
+            const bal_engine_t      *expected)
+{
+    size_t instruction_count = expected->instruction_count;
+
+    if (memcmp(instructions, expected->instructions, instruction_count * sizeof(*instructions))
+            != 0
+        || memcmp(constants, expected->constants, expected->constant_count * sizeof(*constants))
+               != 0
+        || memcmp(ssa_bit_widths, expected->ssa_bit_widths, instruction_count) != 0)
+    {
+        fprintf(stderr, "FAIL: %s does not match the written IR.\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+/// The mapped unit matches the engine it was written from, and loading it
+/// into a reset engine restores it.
+static bool
+test_round_trip(bal_engine_t *engine, bal_engine_t *copy)
+{
+    emit_unit(engine);
+
+    if (bal_ir_write(engine, PATH) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_ir_write() failed.\n");
+        return false;
+    }
+
+    bal_ir_mapping_t mapping;
+
+    if (bal_ir_map(&mapping, PATH, engine->logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_ir_map() failed.\n");
+        return false;
+    }
+
+    bool passed = mapping.instruction_count == engine->instruction_count
+                  && mapping.constant_count == engine->constant_count
+                  && 0x1000 == mapping.guest_address
+                  && BAL_UNIT_EXIT_CALL == mapping.unit_exit.kind
+                  && 0x2000 == mapping.unit_exit.target
+                  && 0x1008 == mapping.unit_exit.return_address
+                  && 8 == mapping.unit_exit.guest_size
+                  && expect_unit("Mapping",
+                                 mapping.instructions,
+                                 mapping.constants,
+                                 mapping.ssa_bit_widths,
+                                 engine);
+
+    passed = passed && BAL_SUCCESS == bal_ir_load(copy, &mapping)
+             && copy->instruction_count == engine->instruction_count
+             && copy->constant_count == engine->constant_count
+             && 0x1000 == copy->guest_address && 0x2000 == copy->unit_exit.target
+             && expect_unit("Loaded engine",
+                            copy->instructions,
+                            copy->constants,
+                            copy->ssa_bit_widths,
+                            engine);
+
+    bal_ir_unmap(&mapping);
+
+    if (false == passed)
+    {
+        fprintf(stderr, "FAIL: The unit was not restored.\n");
+    }
+
+    return passed;
+}
+
+/// A wide unit keeps its high source index bits through the file.
+static bool
+test_wide_round_trip(bal_engine_t *engine, bal_engine_t *copy)
+{
+    engine->is_wide = true;
+
+    // Push the pool past 65536 entries, skipping the index that spells
+    // BAL_SOURCE_NONE.
+    //
+    while (engine->constant_count < WIDE_INSTRUCTION)
+    {
+        engine->constant_count += (BAL_SOURCE_MASK == engine->constant_count) ? 1U : 0U;
+        (void)emit_constant(engine, engine->constant_count);
+    }
+
+    uint32_t target = emit_constant(engine, 0x2000);
+    uint32_t value  = emit(engine, OPCODE_GET_REGISTER, 1, NONE);
+
+    while (engine->instruction_count < WIDE_INSTRUCTION)
+    {
+        value = emit(engine, OPCODE_MOV, value, NONE);
+    }
+
+    uint32_t write = emit(engine, OPCODE_SET_REGISTER, 0, value);
+    (void)emit(engine, OPCODE_JUMP, target, NONE);
+
+    bal_ir_mapping_t mapping;
+
+    if (bal_ir_write(engine, PATH) != BAL_SUCCESS
+        || bal_ir_map(&mapping, PATH, engine->logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: The wide unit was not written.\n");
+        return false;
+    }
+
+    size_t extensions_size = engine->instruction_count * sizeof(uint64_t);
+
+    bool passed
+        = mapping.source_extensions != NULL
+          && 0 == memcmp(mapping.source_extensions, engine->source_extensions, extensions_size)
+          && BAL_SUCCESS == bal_ir_load(copy, &mapping) && copy->is_wide
+          && expect_unit("Loaded wide engine",
+                         copy->instructions,
+                         copy->constants,
+                         copy->ssa_bit_widths,
+                         engine)
+          && bal_ir_source2(bal_ir_get(copy, write)) == value
+          && bal_ir_source1(bal_ir_get(copy, write + 1U)) == target;
+
+    bal_ir_unmap(&mapping);
+
+    if (false == passed)
+    {
+        fprintf(stderr, "FAIL: The wide unit was not restored.\n");
+    }
+
+    return passed;
+}
+
+/// Missing, truncated and foreign files are rejected.
+static bool
+test_invalid(bal_engine_t *engine, bal_engine_t *copy)
+{
+    (void)copy;
+    emit_unit(engine);
+
+    bal_ir_mapping_t     mapping;
+    bal_ir_file_header_t header;
+    (void)remove(PATH);
+
+    if (bal_ir_map(&mapping, PATH, engine->logger) != BAL_ERROR_FILE_IO)
+    {
+        fprintf(stderr, "FAIL: A missing file was mapped.\n");
+        return false;
+    }
+
+    if (bal_ir_write(engine, PATH) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_ir_write() failed.\n");
+        return false;
+    }
+
+    FILE *file = fopen(PATH, "rb");
+
+    if (NULL == file || fread(&header, sizeof(header), 1, file) != 1)
+    {
+        fprintf(stderr, "FAIL: Could not read the header back.\n");
+
+        if (file != NULL)
+        {
+            (void)fclose(file);
+        }
+
+        return false;
+    }
+
+    (void)fclose(file);
+
+    // The header alone is too short for the arrays it describes.
+    //
+    file = fopen(PATH, "wb");
+    (void)fwrite(&header, sizeof(header), 1, file);
+    (void)fclose(file);
+
+    if (bal_ir_map(&mapping, PATH, engine->logger) != BAL_ERROR_INVALID_FILE)
+    {
+        fprintf(stderr, "FAIL: A truncated file was mapped.\n");
+        return false;
+    }
+
+    header.version           = BAL_IR_FILE_VERSION + 1U;
+    header.instruction_count = 0;
+    header.constant_count    = 0;
+    header.file_size         = sizeof(header);
+
+    file = fopen(PATH, "wb");
+    (void)fwrite(&header, sizeof(header), 1, file);
+    (void)fclose(file);
+
+    if (bal_ir_map(&mapping, PATH, engine->logger) != BAL_ERROR_INVALID_FILE)
+    {
+        fprintf(stderr, "FAIL: A file of another version was mapped.\n");
+        return false;
+    }
+
+    return true;
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_engine_t *, bal_engine_t *);
+
+    const test_function_t tests[] = {
+        test_round_trip,
+        test_wide_round_trip,
+        test_invalid,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    bal_engine_t    engine;
+    bal_engine_t    copy;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_engine_init_with_capacity(&allocator, &engine, logger, WIDE_CAPACITY) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init_with_capacity() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (bal_engine_init_with_capacity(&allocator, &copy, logger, WIDE_CAPACITY) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init_with_capacity() failed.\n");
+        bal_engine_destroy(&allocator, &engine);
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&engine);
+
+        if (false == tests[i](&engine, &copy))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    (void)remove(PATH);
+    bal_engine_destroy(&allocator, &copy);
+    bal_engine_destroy(&allocator, &engine);
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,301 @@
+#include "bal_memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_MEMORY_SIZE (16U * 0x10000U)
+
+typedef struct
+{
+    bal_allocator_t        allocator;
+    bal_logger_t           logger;
+    bal_memory_interface_t interface;
+    uint8_t               *host;
+} test_fixture_t;
+
+/// The bytes the paged interface holds, counted by the allocator of the
+/// fixture.
+static size_t allocated_bytes;
+
+static void *
+counting_allocate(bal_allocator_handle_t handle, size_t alignment, size_t size)
+{
+    (void)handle;
+    allocated_bytes += size;
+    return aligned_alloc(alignment, (size + alignment - 1U) & ~(alignment - 1U));
+}
+
+static void
+counting_free(bal_allocator_handle_t handle, void *pointer, size_t size)
+{
+    (void)handle;
+    allocated_bytes -= size;
+    free(pointer);
+}
+
+static bool
+expect_value(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s is 0x%llx, expected 0x%llx.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+expect_error(const char *name, bal_error_t actual, bal_error_t expected)
+{
+    return expect_value(name, (uint64_t)(int64_t)actual, (uint64_t)(int64_t)expected);
+}
+
+static bool
+expect_read(test_fixture_t     *fixture,
+            bal_guest_address_t guest_address,
+            const uint8_t      *host,
+            size_t              span)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    size_t                  available = 0;
+    const uint8_t          *actual    = interface->translate(interface, guest_address, &available);
+
+    return expect_value("host address", (uint64_t)(uintptr_t)actual, (uint64_t)(uintptr_t)host)
+           && (NULL == host || expect_value("readable span", available, span));
+}
+
+static bool
+expect_write(test_fixture_t     *fixture,
+             bal_guest_address_t guest_address,
+             const uint8_t      *host,
+             size_t              span)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    size_t                  available = 0;
+    uint8_t *actual = interface->translate_write(interface, guest_address, &available);
+
+    return expect_value("host address", (uint64_t)(uintptr_t)actual, (uint64_t)(uintptr_t)host)
+           && (NULL == host || expect_value("writable span", available, span));
+}
+
+// Pages mapped by separate calls to consecutive host memory form one span,
+// which ends at the first page that does not continue it.
+//
+static bool
+test_span(test_fixture_t *fixture)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    uint8_t                *host      = fixture->host;
+    uint32_t                rw = BAL_MEMORY_PERMISSION_READ | BAL_MEMORY_PERMISSION_WRITE;
+
+    bal_error_t first  = bal_memory_map_paged(interface, 0x10000, host, 0x2000, rw);
+    bal_error_t second = bal_memory_map_paged(interface, 0x12000, host + 0x2000, 0x1000, rw);
+    bal_error_t third  = bal_memory_map_paged(interface, 0x13000, host + 0x8000, 0x1000, rw);
+
+    return expect_error("first map", first, BAL_SUCCESS)
+           && expect_error("second map", second, BAL_SUCCESS)
+           && expect_error("third map", third, BAL_SUCCESS)
+           && expect_read(fixture, 0x10010, host + 0x10, 0x2FF0)
+           && expect_read(fixture, 0x12FFF, host + 0x2FFF, 1)
+           && expect_read(fixture, 0x13000, host + 0x8000, 0x1000)
+           && expect_read(fixture, 0x14000, NULL, 0) && expect_read(fixture, 0xF000, NULL, 0);
+}
+
+// A span goes on into the next last-level table, which covers 512 pages of
+// 4 KiB.
+//
+static bool
+test_table_boundary(test_fixture_t *fixture)
+{
+    bal_error_t error = bal_memory_map_paged(&fixture->interface,
+                                             0x1FE000,
+                                             fixture->host,
+                                             0x4000,
+                                             BAL_MEMORY_PERMISSION_READ);
+
+    return expect_error("map", error, BAL_SUCCESS)
+           && expect_read(fixture, 0x1FE000, fixture->host, 0x4000)
+           && expect_read(fixture, 0x200000, fixture->host + 0x2000, 0x2000);
+}
+
+// Stores need the write permission, loads read through pages of either
+// kind, and protecting an unmapped page changes nothing.
+//
+static bool
+test_protect(test_fixture_t *fixture)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    uint32_t                rw = BAL_MEMORY_PERMISSION_READ | BAL_MEMORY_PERMISSION_WRITE;
+
+    bal_error_t mapped = bal_memory_map_paged(interface, 0x40000, fixture->host, 0x4000, rw);
+
+    if (false == expect_error("map", mapped, BAL_SUCCESS))
+    {
+        return false;
+    }
+
+    bal_error_t error
+        = bal_memory_protect_paged(interface, 0x42000, 0x1000, BAL_MEMORY_PERMISSION_READ);
+    bal_error_t unmapped
+        = bal_memory_protect_paged(interface, 0x43000, 0x2000, BAL_MEMORY_PERMISSION_NONE);
+    bal_error_t none
+        = bal_memory_protect_paged(interface, 0x43000, 0x1000, BAL_MEMORY_PERMISSION_NONE);
+
+    return expect_error("protect", error, BAL_SUCCESS)
+           && expect_error("protect unmapped", unmapped, BAL_ERROR_GUEST_MEMORY_FAULT)
+           && expect_error("protect none", none, BAL_SUCCESS)
+           && expect_read(fixture, 0x40000, fixture->host, 0x3000)
+           && expect_write(fixture, 0x40000, fixture->host, 0x2000)
+           && expect_write(fixture, 0x42000, NULL, 0) && expect_read(fixture, 0x43000, NULL, 0);
+}
+
+// Unmapping frees every table it empties, and addresses far apart only
+// take the tables on their own paths.
+//
+static bool
+test_unmap(test_fixture_t *fixture)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    size_t                  empty     = allocated_bytes;
+    bal_guest_address_t     high      = 0xFFFFFFFF0000ULL;
+    uint32_t                read      = BAL_MEMORY_PERMISSION_READ;
+
+    bal_error_t low_error  = bal_memory_map_paged(interface, 0x1000, fixture->host, 0x1000, read);
+    bal_error_t high_error = bal_memory_map_paged(interface, high, fixture->host, 0x10000, read);
+
+    if (false == expect_error("map low", low_error, BAL_SUCCESS)
+        || false == expect_error("map high", high_error, BAL_SUCCESS)
+        || false == expect_read(fixture, high + 0xFFFF, fixture->host + 0xFFFF, 1))
+    {
+        return false;
+    }
+
+    // The low range covers an unmapped page too.
+    //
+    low_error  = bal_memory_unmap_paged(interface, 0, 0x2000);
+    high_error = bal_memory_unmap_paged(interface, high, 0x10000);
+
+    return expect_error("unmap low", low_error, BAL_SUCCESS)
+           && expect_error("unmap high", high_error, BAL_SUCCESS)
+           && expect_read(fixture, 0x1000, NULL, 0) && expect_read(fixture, high, NULL, 0)
+           && expect_value("allocated bytes", allocated_bytes, empty);
+}
+
+// Ranges must be aligned to pages and fit in the translated address bits.
+//
+static bool
+test_invalid_ranges(test_fixture_t *fixture)
+{
+    bal_memory_interface_t *interface = &fixture->interface;
+    uint32_t                read      = BAL_MEMORY_PERMISSION_READ;
+    bal_guest_address_t     limit     = 1ULL << BAL_MEMORY_PAGED_ADDRESS_BITS;
+
+    uint8_t                *buffer    = fixture->host;
+
+    bal_error_t guest  = bal_memory_map_paged(interface, 0x1800, buffer, 0x1000, read);
+    bal_error_t host   = bal_memory_map_paged(interface, 0x1000, buffer + 8, 0x1000, read);
+    bal_error_t size   = bal_memory_map_paged(interface, 0x1000, buffer, 0, read);
+    bal_error_t beyond = bal_memory_map_paged(interface, limit - 0x1000, buffer, 0x2000, read);
+    bal_error_t flags  = bal_memory_map_paged(interface, 0x1000, buffer, 0x1000, 4);
+
+    return expect_error("misaligned guest", guest, BAL_ERROR_MEMORY_ALIGNMENT)
+           && expect_error("misaligned host", host, BAL_ERROR_MEMORY_ALIGNMENT)
+           && expect_error("empty range", size, BAL_ERROR_INVALID_ARGUMENT)
+           && expect_error("range beyond the limit", beyond, BAL_ERROR_INVALID_ARGUMENT)
+           && expect_error("unknown permissions", flags, BAL_ERROR_INVALID_ARGUMENT)
+           && expect_read(fixture, 0x1000, NULL, 0) && expect_read(fixture, limit, NULL, 0);
+}
+
+// 64 KiB pages map and translate the same way.
+//
+static bool
+test_large_pages(test_fixture_t *fixture)
+{
+    bal_memory_destroy_paged(&fixture->allocator, &fixture->interface);
+
+    if (bal_memory_init_paged(&fixture->allocator, &fixture->interface, 0x10000, fixture->logger)
+        != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    bal_memory_interface_t *interface = &fixture->interface;
+    uint32_t                rw = BAL_MEMORY_PERMISSION_READ | BAL_MEMORY_PERMISSION_WRITE;
+
+    bal_error_t misaligned = bal_memory_map_paged(interface, 0x1000, fixture->host, 0x10000, rw);
+    bal_error_t error      = bal_memory_map_paged(interface, 0x30000, fixture->host, 0x20000, rw);
+
+    return expect_error("misaligned", misaligned, BAL_ERROR_MEMORY_ALIGNMENT)
+           && expect_error("map", error, BAL_SUCCESS)
+           && expect_write(fixture, 0x31234, fixture->host + 0x1234, 0x1EDCC)
+           && expect_read(fixture, 0x50000, NULL, 0);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *);
+
+    const test_function_t tests[] = {
+        test_span,  test_table_boundary, test_protect,
+        test_unmap, test_invalid_ranges, test_large_pages,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    test_fixture_t fixture;
+    fixture.allocator.handle   = NULL;
+    fixture.allocator.allocate = counting_allocate;
+    fixture.allocator.free     = counting_free;
+    bal_logger_init_default(&fixture.logger);
+    fixture.logger.min_level = BAL_LOG_LEVEL_ERROR;
+
+    fixture.host
+        = (uint8_t *)fixture.allocator.allocate(fixture.allocator.handle, 16, HOST_MEMORY_SIZE);
+
+    if (NULL == fixture.host)
+    {
+        fprintf(stderr, "FAIL: Failed to allocate host memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        size_t before = allocated_bytes;
+
+        if (bal_memory_init_paged(
+                &fixture.allocator, &fixture.interface, 0x1000, fixture.logger)
+            != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_memory_init_paged() failed.\n");
+            return_code = EXIT_FAILURE;
+            break;
+        }
+
+        if (false == tests[i](&fixture))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_memory_destroy_paged(&fixture.allocator, &fixture.interface);
+
+        if (allocated_bytes != before)
+        {
+            fprintf(stderr, "FAIL: Test case %zu leaked page tables.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    fixture.allocator.free(fixture.allocator.handle, fixture.host, HOST_MEMORY_SIZE);
+    return return_code;
+}
+
+/*** end of file ***/
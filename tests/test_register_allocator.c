@@ -0,0 +1,247 @@
+#include "bal_engine.h"
+#include "bal_ir.h"
+#include "bal_memory.h"
+#include "bal_register_allocator.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NONE BAL_SOURCE_NONE
+
+static uint32_t
+emit(bal_engine_t *engine,
+     bal_opcode_t  opcode,
+     uint32_t      source1,
+     uint32_t      source2,
+     uint32_t      source3)
+{
+    uint32_t index = engine->instruction_count;
+    bal_ir_set(engine, index, bal_ir_encode(opcode, source1, source2, source3));
+    engine->instruction_count = (bal_instruction_count_t)(index + 1);
+    return index;
+}
+
+static bool
+is_register(bal_value_location_t location)
+{
+    return location != BAL_LOCATION_NONE && 0 == (location & BAL_LOCATION_SPILLED);
+}
+
+// a = r0; b = r1; c = a + b; d = c + c; r0 = d
+//
+static bool
+test_chain(bal_engine_t *engine)
+{
+    bal_register_class_t      register_class;
+    bal_register_allocation_t allocation;
+    bal_register_class_init(&register_class, BAL_HOST_ARCHITECTURE_X86_64);
+
+    uint32_t a = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t b = emit(engine, OPCODE_GET_REGISTER, 1, NONE, NONE);
+    uint32_t c = emit(engine, OPCODE_ADD, a, b, NONE);
+    uint32_t d = emit(engine, OPCODE_ADD, c, c, NONE);
+    uint32_t s = emit(engine, OPCODE_STORE, d, NONE, NONE);
+
+    if (bal_register_allocate(engine, &register_class, &allocation) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_register_allocate() returned an error.\n");
+        return false;
+    }
+
+    const bal_value_location_t *locations = allocation.locations;
+
+    if (!is_register(locations[a]) || !is_register(locations[b]) || !is_register(locations[c])
+        || !is_register(locations[d]) || locations[s] != BAL_LOCATION_NONE)
+    {
+        fprintf(stderr, "FAIL: Expected every value in a register.\n");
+        return false;
+    }
+
+    // The result of an instruction never shares a register with its operands.
+    //
+    if (locations[a] == locations[b] || locations[c] == locations[a]
+        || locations[c] == locations[b] || locations[d] == locations[c])
+    {
+        fprintf(stderr, "FAIL: Overlapping live ranges share a register.\n");
+        return false;
+    }
+
+    // `a` and `b` are dead once `d` is defined, so their registers are reused.
+    //
+    if (locations[d] != locations[a] && locations[d] != locations[b])
+    {
+        fprintf(stderr, "FAIL: Register of an expired live range was not reused.\n");
+        return false;
+    }
+
+    if (allocation.live_range_ends[c] != d || allocation.spill_slot_count != 0)
+    {
+        fprintf(stderr, "FAIL: Unexpected live range end or spill slot count.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Four values live at the same time with two registers available.
+//
+static bool
+test_spill(bal_engine_t *engine)
+{
+    bal_register_class_t      register_class;
+    bal_register_allocation_t allocation;
+    bal_register_class_init(&register_class, BAL_HOST_ARCHITECTURE_X86_64);
+    register_class.registers_count = 2;
+
+    uint32_t values[4];
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        values[i] = emit(engine, OPCODE_GET_REGISTER, i, NONE, NONE);
+    }
+
+    uint32_t sum1 = emit(engine, OPCODE_ADD, values[3], values[2], NONE);
+    uint32_t sum2 = emit(engine, OPCODE_ADD, values[1], values[0], NONE);
+    emit(engine, OPCODE_STORE, sum1, sum2, NONE);
+
+    if (bal_register_allocate(engine, &register_class, &allocation) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_register_allocate() returned an error.\n");
+        return false;
+    }
+
+    const bal_value_location_t *locations = allocation.locations;
+
+    // The values read last are evicted first.
+    //
+    if (!is_register(locations[values[3]]) || !is_register(locations[values[2]])
+        || is_register(locations[values[1]]) || is_register(locations[values[0]]))
+    {
+        fprintf(stderr, "FAIL: Spilled the wrong live ranges.\n");
+        return false;
+    }
+
+    if (allocation.spill_slot_count < 2 || locations[values[0]] == locations[values[1]])
+    {
+        fprintf(stderr, "FAIL: Expected two distinct spill slots.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// x = (x < 0) ? (0 - x) : x
+//
+static bool
+test_merge(bal_engine_t *engine)
+{
+    bal_register_class_t      register_class;
+    bal_register_allocation_t allocation;
+    bal_register_class_init(&register_class, BAL_HOST_ARCHITECTURE_ARM64);
+
+    uint32_t zero      = emit(engine, OPCODE_CONST, NONE, NONE, NONE);
+    uint32_t x         = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t condition = emit(engine, OPCODE_CMP, x, zero, NONE);
+    emit(engine, OPCODE_IF, condition, NONE, NONE);
+    uint32_t negated = emit(engine, OPCODE_SUB, zero, x, NONE);
+    emit(engine, OPCODE_YIELD, negated, NONE, NONE);
+    emit(engine, OPCODE_ELSE, NONE, NONE, NONE);
+    emit(engine, OPCODE_YIELD, x, NONE, NONE);
+    uint32_t merge = emit(engine, OPCODE_MERGE, NONE, NONE, NONE);
+    emit(engine, OPCODE_STORE, merge, NONE, NONE);
+
+    if (bal_register_allocate(engine, &register_class, &allocation) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_register_allocate() returned an error.\n");
+        return false;
+    }
+
+    const bal_value_location_t *locations = allocation.locations;
+
+    // The merge is live from the first yield, so it can not share a register
+    // with anything either arm still reads.
+    //
+    if (!is_register(locations[merge]) || locations[merge] == locations[x]
+        || locations[merge] == locations[negated])
+    {
+        fprintf(stderr, "FAIL: Merge location overlaps a yielded value.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+test_pinned_register(bal_engine_t *engine)
+{
+    bal_register_class_t      register_class;
+    bal_register_allocation_t allocation;
+    bal_register_class_init(&register_class, BAL_HOST_ARCHITECTURE_X86_64);
+
+    uint8_t pinned = register_class.registers[0];
+    bal_register_class_pin(&register_class, pinned);
+
+    uint32_t a = emit(engine, OPCODE_GET_REGISTER, 0, NONE, NONE);
+    uint32_t b = emit(engine, OPCODE_GET_REGISTER, 1, NONE, NONE);
+    emit(engine, OPCODE_STORE, a, b, NONE);
+
+    if (bal_register_allocate(engine, &register_class, &allocation) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_register_allocate() returned an error.\n");
+        return false;
+    }
+
+    uint32_t reserved = (1U << pinned) | (1U << register_class.guest_state_register)
+                        | (1U << register_class.scratch_registers[0])
+                        | (1U << register_class.scratch_registers[1]);
+
+    if ((allocation.used_registers_mask & reserved) != 0)
+    {
+        fprintf(stderr, "FAIL: Handed out a reserved register.\n");
+        return false;
+    }
+
+    return true;
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(bal_engine_t *);
+
+    const test_function_t tests[]
+        = { test_chain, test_spill, test_merge, test_pinned_register };
+    const size_t          tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    bal_engine_t    engine;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    if (bal_engine_init(&allocator, &engine, logger) != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: bal_engine_init() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)bal_engine_reset(&engine);
+
+        if (false == tests[i](&engine))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    bal_engine_destroy(&allocator, &engine);
+    return return_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,1628 @@
+#include "bal_assembler.h"
+#include "bal_guest_state.h"
+#include "bal_memory.h"
+#include "bal_runtime.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GUEST_MEMORY_SIZE (64U * 1024U)
+#define HALT_ADDRESS      0x8000U
+
+typedef struct
+{
+    bal_allocator_t        allocator;
+    bal_logger_t           logger;
+    bal_memory_interface_t interface;
+    uint32_t              *memory;
+    bal_vcpu_t             vcpu;
+} test_fixture_t;
+
+static void
+assemble_at(test_fixture_t *fixture, bal_assembler_t *assembler, bal_guest_address_t address)
+{
+    size_t word = (size_t)address / sizeof(uint32_t);
+    (void)bal_assembler_init(assembler,
+                             fixture->memory + word,
+                             GUEST_MEMORY_SIZE / sizeof(uint32_t) - word,
+                             fixture->logger);
+}
+
+/// 0x1000: MOVZ X0, #1;      B 0x1010
+/// 0x1010: MOVZ X1, #2;      BL 0x1020
+/// 0x1018: B HALT_ADDRESS
+/// 0x1020: MOVZ X2, #3;      RET
+static void
+assemble_call_program(test_fixture_t *fixture)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x1000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X0, 1, 0);
+    bal_emit_b(&assembler, 0xC);
+
+    assemble_at(fixture, &assembler, 0x1010);
+    bal_emit_movz(&assembler, BAL_REGISTER_X1, 2, 0);
+    bal_emit_bl(&assembler, 0xC);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x1018));
+
+    assemble_at(fixture, &assembler, 0x1020);
+    bal_emit_movz(&assembler, BAL_REGISTER_X2, 3, 0);
+    bal_emit_ret(&assembler, BAL_REGISTER_X30);
+}
+
+static bool
+run(test_fixture_t *fixture, bal_runtime_t *runtime, bal_guest_address_t entry)
+{
+    // The return stack buffer is kept so later runs can hit on it.
+    //
+    (void)memset(&fixture->vcpu.state, 0, sizeof(fixture->vcpu.state));
+
+    bal_guest_address_t address = entry;
+    bal_error_t         error   = bal_runtime_run(runtime, &fixture->vcpu, &address, HALT_ADDRESS);
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr,
+                "FAIL: bal_runtime_run() returned %s at 0x%llx.\n",
+                bal_error_to_string(error),
+                (unsigned long long)address);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+expect_count(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s = %llu, expected %llu.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+expect_call_program_registers(const test_fixture_t *fixture)
+{
+    return expect_count("X0", fixture->vcpu.state.registers[0], 1)
+           && expect_count("X1", fixture->vcpu.state.registers[1], 2)
+           && expect_count("X2", fixture->vcpu.state.registers[2], 3)
+           && expect_count("X30", fixture->vcpu.state.registers[30], 0x1018);
+}
+
+static bool
+test_linking(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    assemble_call_program(fixture);
+
+    if (false == run(fixture, runtime, 0x1000) || false == expect_call_program_registers(fixture))
+    {
+        return false;
+    }
+
+    // The two direct branches and the return address of the call are
+    // linked. The final branch to the halt address never is. The return
+    // misses because 0x1018 did not exist when the call was made.
+    //
+    const bal_runtime_stats_t *stats = &runtime->stats;
+
+    if (false == expect_count("translations", stats->translations, 4)
+        || false == expect_count("links", stats->links, 3)
+        || false == expect_count("dispatches", stats->dispatches, 4))
+    {
+        return false;
+    }
+
+    // 0x1000 chains through 0x1010 into 0x1020, whose return is predicted
+    // and continues at 0x1018 without the dispatcher.
+    //
+    if (false == run(fixture, runtime, 0x1000) || false == expect_call_program_registers(fixture)
+        || false == expect_count("dispatches", stats->dispatches, 5))
+    {
+        return false;
+    }
+
+    bal_runtime_invalidate(runtime, 0x1010, sizeof(uint32_t));
+
+    if (false == expect_count("unlinks", stats->unlinks, 1)
+        || false == expect_count("invalidations", stats->invalidations, 1)
+        || false == expect_count("live units", runtime->cache.count, 3))
+    {
+        return false;
+    }
+
+    // 0x1000 returns to the dispatcher, 0x1010 is recompiled and all three
+    // of its links are restored. The stale return stack buffer is cleared.
+    //
+    return run(fixture, runtime, 0x1000) && expect_call_program_registers(fixture)
+           && expect_count("generation", fixture->vcpu.return_stack.generation, 1)
+           && expect_count("dispatches", stats->dispatches, 7)
+           && expect_count("translations", stats->translations, 5)
+           && expect_count("links", stats->links, 6);
+}
+
+static bool
+test_linking_disabled(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    runtime->config.enable_block_linking = false;
+    assemble_call_program(fixture);
+
+    return run(fixture, runtime, 0x1000) && run(fixture, runtime, 0x1000)
+           && expect_call_program_registers(fixture)
+           && expect_count("links", runtime->stats.links, 0)
+           && expect_count("dispatches", runtime->stats.dispatches, 8);
+}
+
+/// 0x3000: BL 0x3010
+/// 0x3004: B HALT_ADDRESS
+/// 0x3010: MOVZ X30, #0x3020; RET
+/// 0x3020: MOVZ X7, #9;       B HALT_ADDRESS
+static bool
+test_return_mismatch(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x3000);
+    bal_emit_bl(&assembler, 0x10);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x3004));
+
+    assemble_at(fixture, &assembler, 0x3010);
+    bal_emit_movz(&assembler, BAL_REGISTER_X30, 0x3020, 0);
+    bal_emit_ret(&assembler, BAL_REGISTER_X30);
+
+    assemble_at(fixture, &assembler, 0x3020);
+    bal_emit_movz(&assembler, BAL_REGISTER_X7, 9, 0);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x3024));
+
+    // Compile 0x3004 first so the call pushes a usable prediction, which the
+    // return must then reject.
+    //
+    return run(fixture, runtime, 0x3004) && run(fixture, runtime, 0x3000)
+           && expect_count("X7", fixture->vcpu.state.registers[7], 9)
+           && expect_count("X30", fixture->vcpu.state.registers[30], 0x3020)
+           && expect_count("dispatches", runtime->stats.dispatches, 4);
+}
+
+/// 0x2000: MOVZ X5, #0x2010; BLR X5
+/// 0x2010: MOVZ X6, #7;      BR X30
+static bool
+test_indirect(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x2000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X5, 0x2010, 0);
+    bal_emit_blr(&assembler, BAL_REGISTER_X5);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x2008));
+
+    assemble_at(fixture, &assembler, 0x2010);
+    bal_emit_movz(&assembler, BAL_REGISTER_X6, 7, 0);
+    bal_emit_br(&assembler, BAL_REGISTER_X30);
+
+    // Both indirect exits miss and fill an inline cache entry. The return
+    // address of the BLR is linked once 0x2008 exists.
+    //
+    const bal_vcpu_counters_t *counters = &fixture->vcpu.counters;
+
+    if (false == run(fixture, runtime, 0x2000)
+        || false == expect_count("X6", fixture->vcpu.state.registers[6], 7)
+        || false == expect_count("X30", fixture->vcpu.state.registers[30], 0x2008)
+        || false == expect_count("links", runtime->stats.links, 3)
+        || false == expect_count("misses", counters->inline_cache_misses, 2))
+    {
+        return false;
+    }
+
+    // Both inline caches hit, so only the first unit is dispatched.
+    //
+    return run(fixture, runtime, 0x2000) && expect_count("X6", fixture->vcpu.state.registers[6], 7)
+           && expect_count("hits", counters->inline_cache_hits, 2)
+           && expect_count("misses", counters->inline_cache_misses, 2)
+           && expect_count("dispatches", runtime->stats.dispatches, 4);
+}
+
+/// Runs `test_indirect` with slow paths in the cold region, then again with
+/// them emitted next to each unit.
+static bool
+test_cold_code(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    if (false == test_indirect(fixture, runtime))
+    {
+        return false;
+    }
+
+    uint32_t index = bal_translation_cache_lookup(&runtime->cache, 0x2000);
+
+    if (0 == runtime->cache.translations[index].cold_size)
+    {
+        fprintf(stderr, "FAIL: The inline cache miss path is not in the cold region.\n");
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.cold_code_size = 0;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+    (void)memset(&fixture->vcpu, 0, sizeof(fixture->vcpu));
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS || false == test_indirect(fixture, runtime))
+    {
+        return false;
+    }
+
+    index = bal_translation_cache_lookup(&runtime->cache, 0x2000);
+    return expect_count("cold size", runtime->cache.translations[index].cold_size, 0);
+}
+
+static bool
+run_branch_to(test_fixture_t *fixture, bal_runtime_t *runtime, bal_guest_address_t target)
+{
+    (void)memset(&fixture->vcpu.state, 0, sizeof(fixture->vcpu.state));
+    fixture->vcpu.state.registers[5] = target;
+
+    bal_guest_address_t address = 0x4000;
+
+    return bal_runtime_run(runtime, &fixture->vcpu, &address, HALT_ADDRESS) == BAL_SUCCESS
+           && expect_count("X7", fixture->vcpu.state.registers[7], target);
+}
+
+/// 0x4000: BR X5
+/// 0x4010, 0x4020, 0x4030: MOVZ X7, #address; B HALT_ADDRESS
+static bool
+test_inline_cache_replacement(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x4000);
+    bal_emit_br(&assembler, BAL_REGISTER_X5);
+
+    for (bal_guest_address_t target = 0x4010; target <= 0x4030; target += 0x10)
+    {
+        assemble_at(fixture, &assembler, target);
+        bal_emit_movz(&assembler, BAL_REGISTER_X7, (uint16_t)target, 0);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - (target + 4)));
+    }
+
+    // With two entries, the third target replaces the first and the first
+    // then replaces the second.
+    //
+    const bal_guest_address_t targets[] = { 0x4010, 0x4010, 0x4020, 0x4020,
+                                            0x4030, 0x4030, 0x4010 };
+
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); ++i)
+    {
+        if (false == run_branch_to(fixture, runtime, targets[i]))
+        {
+            return false;
+        }
+    }
+
+    const bal_vcpu_counters_t *counters = &fixture->vcpu.counters;
+
+    return expect_count("hits", counters->inline_cache_hits, 3)
+           && expect_count("misses", counters->inline_cache_misses, 4)
+           && expect_count("fills", runtime->stats.inline_cache_fills, 4)
+           && expect_count("unlinks", runtime->stats.unlinks, 2);
+}
+
+/// Loads the 64-bit `value` into `destination` with MOVZ and MOVK.
+static void
+emit_load_immediate(bal_assembler_t *assembler, bal_register_index_t destination, uint64_t value)
+{
+    bal_emit_movz(assembler, destination, (uint16_t)value, 0);
+
+    for (uint8_t shift = 16; shift < 64; shift += 16)
+    {
+        bal_emit_movk(assembler, destination, (uint16_t)(value >> shift), shift);
+    }
+}
+
+/// Runs every conditional branch case at its own address from 0x2000, twice
+/// so the second run goes through the linked exit, then checks which way it
+/// went.
+/// A case sets X0 to 2 if the branch is taken and to 1 otherwise.
+static bool
+run_conditional_branches(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    typedef struct
+    {
+        const char *name;
+        uint32_t    setup;
+        uint32_t    branch;
+        bool        taken;
+    } branch_case_t;
+
+    // X1 = 0x8000000000000005, X2 = 0xFFFFFF83. `CMP X1, X2` sets C and V,
+    // while flags left clear by the previous unit read as 0.
+    //
+    static const branch_case_t cases[] = {
+        { "B.VS after CMP X1, X2",        0xEB02003F, 0x54000066, true  },
+        { "B.EQ after CMP X1, X2",        0xEB02003F, 0x54000060, false },
+        { "B.HI after CMP X1, X2",        0xEB02003F, 0x54000068, true  },
+        { "B.GE after CMP X1, X2",        0xEB02003F, 0x5400006A, false },
+        { "B.LT after CMP X1, X2",        0xEB02003F, 0x5400006B, true  },
+        { "B.AL",                         0xD503201F, 0x5400006E, true  },
+        { "B.NE with clear flags",        0xD503201F, 0x54000061, true  },
+        { "B.EQ with clear flags",        0xD503201F, 0x54000060, false },
+        { "CBZ XZR",                      0xD503201F, 0xB400007F, true  },
+        { "CBZ X1",                       0xD503201F, 0xB4000061, false },
+        { "CBNZ X1",                      0xD503201F, 0xB5000061, true  },
+        { "CBZ W4 after MOVZ X4, #1, LSL #32", 0xD2C00024, 0x34000064, true  },
+        { "CBZ X4 after MOVZ X4, #1, LSL #32", 0xD2C00024, 0xB4000064, false },
+        { "TBNZ X1, #63",                 0xD503201F, 0xB7F80061, true  },
+        { "TBZ X1, #63",                  0xD503201F, 0xB6F80061, false },
+        { "TBZ W2, #2",                   0xD503201F, 0x36100062, true  },
+        { "TBNZ X2, #32",                 0xD503201F, 0xB7000062, false },
+    };
+    const size_t cases_count = sizeof(cases) / sizeof(cases[0]);
+
+    for (size_t i = 0; i < cases_count; ++i)
+    {
+        bal_assembler_t     assembler;
+        bal_guest_address_t address = 0x2000 + (bal_guest_address_t)i * 0x40;
+
+        assemble_at(fixture, &assembler, address);
+        emit_load_immediate(&assembler, BAL_REGISTER_X1, 0x8000000000000005ULL);
+        emit_load_immediate(&assembler, BAL_REGISTER_X2, 0xFFFFFF83ULL);
+        fixture->memory[(address + 0x20) / sizeof(uint32_t)] = cases[i].setup;
+        fixture->memory[(address + 0x24) / sizeof(uint32_t)] = cases[i].branch;
+
+        // Both branch to +0x30 when taken.
+        //
+        assemble_at(fixture, &assembler, address + 0x28);
+        bal_emit_movz(&assembler, BAL_REGISTER_X0, 1, 0);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - (address + 0x2C)));
+        bal_emit_movz(&assembler, BAL_REGISTER_X0, 2, 0);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - (address + 0x34)));
+
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            if (false == run(fixture, runtime, address))
+            {
+                fprintf(stderr, "FAIL: %s did not run.\n", cases[i].name);
+                return false;
+            }
+
+            uint64_t expected = cases[i].taken ? 2 : 1;
+
+            if (false == expect_count(cases[i].name, fixture->vcpu.state.registers[0], expected))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Conditional branches go the same way compiled and interpreted, and a
+/// loop closed by one links both of its exits.
+///
+/// 0x1000: MOVZ X0, #3
+/// 0x1004: SUBS X0, X0, #1; ADD X1, X1, #2; B.NE 0x1004
+/// 0x1010: B HALT_ADDRESS
+static bool
+test_conditional_branches(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x1000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X0, 3, 0);
+    fixture->memory[0x1004 / sizeof(uint32_t)] = 0xF1000400;
+    fixture->memory[0x1008 / sizeof(uint32_t)] = 0x91000821;
+    fixture->memory[0x100C / sizeof(uint32_t)] = 0x54FFFFC1;
+
+    assemble_at(fixture, &assembler, 0x1010);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x1010));
+
+    // The unit at 0x1000 runs the first iteration and the one at 0x1004 the
+    // rest. Both link their taken exit to 0x1004 and the other to 0x1010.
+    //
+    if (false == run(fixture, runtime, 0x1000)
+        || false == expect_count("X0", fixture->vcpu.state.registers[0], 0)
+        || false == expect_count("X1", fixture->vcpu.state.registers[1], 6)
+        || false == expect_count("NZCV", bal_guest_state_nzcv(&fixture->vcpu.state), 0x60000000U)
+        || false == expect_count("translations", runtime->stats.translations, 3)
+        || false == expect_count("links", runtime->stats.links, 4))
+    {
+        return false;
+    }
+
+    if (false == run_conditional_branches(fixture, runtime))
+    {
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    return run_conditional_branches(fixture, runtime)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+/// An instruction nothing translates ends the unit in front of it, and fails
+/// the run when it is reached.
+///
+/// 0x1000: MOVZ X0, #1; SVC #0
+static bool
+test_unsupported_instruction(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x1000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X0, 1, 0);
+    fixture->memory[0x1004 / sizeof(uint32_t)] = 0xD4000001;
+
+    (void)memset(&fixture->vcpu.state, 0, sizeof(fixture->vcpu.state));
+
+    bal_guest_address_t address = 0x1000;
+    bal_error_t         error   = bal_runtime_run(runtime, &fixture->vcpu, &address, HALT_ADDRESS);
+
+    return expect_count("error", (uint64_t)(int64_t)error, (uint64_t)BAL_ERROR_UNKNOWN_INSTRUCTION)
+           && expect_count("address", address, 0x1004)
+           && expect_count("X0", fixture->vcpu.state.registers[0], 1);
+}
+
+/// 0x3000: MOVZ X1, #1; MOVZ X4, #2, LSL #16; CMP X1, #2; B 0x3100
+/// 0x3100: LDR X3, [X4, #8] or NOP; CMP X0, X0; B HALT_ADDRESS
+static void
+assemble_flags_program(test_fixture_t *fixture, bool load)
+{
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x3000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X1, 1, 0);
+    bal_emit_movz(&assembler, BAL_REGISTER_X4, 2, 16);
+    fixture->memory[0x3008 / sizeof(uint32_t)] = 0xF100083F;
+
+    assemble_at(fixture, &assembler, 0x300C);
+    bal_emit_b(&assembler, 0xF4);
+
+    fixture->memory[0x3100 / sizeof(uint32_t)] = load ? 0xF9400483 : 0xD503201F;
+    fixture->memory[0x3104 / sizeof(uint32_t)] = 0xEB00001F;
+
+    assemble_at(fixture, &assembler, 0x3108);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x3108));
+}
+
+/// Compiles 0x3100 without the load, so it overwrites the flags first, then
+/// runs 0x3000 with the halt address at 0x3100. The exit of 0x3000 is never
+/// linked, so it writes the flags of its `CMP` back.
+static bool
+test_flags_on_halt(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_block_linking = false;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    assemble_flags_program(fixture, false);
+
+    if (false == run(fixture, runtime, 0x3100))
+    {
+        return false;
+    }
+
+    (void)memset(&fixture->vcpu.state, 0, sizeof(fixture->vcpu.state));
+
+    bal_guest_address_t address = 0x3000;
+    error = bal_runtime_run(runtime, &fixture->vcpu, &address, 0x3100);
+
+    return expect_count("error", (uint64_t)(int64_t)error, BAL_SUCCESS)
+           && expect_count("NZCV", bal_guest_state_nzcv(&fixture->vcpu.state), BAL_NZCV_N);
+}
+
+/// Compiles 0x3100, then runs 0x3000, which links to it. The load of 0x3100
+/// faults before its `CMP`, so the host sees the flags of 0x3000.
+static bool
+test_flags_on_fault(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    assemble_flags_program(fixture, true);
+
+    if (false == run(fixture, runtime, 0x3100))
+    {
+        return false;
+    }
+
+    (void)memset(&fixture->vcpu.state, 0, sizeof(fixture->vcpu.state));
+
+    bal_guest_address_t address = 0x3000;
+    bal_error_t         error   = bal_runtime_run(runtime, &fixture->vcpu, &address, HALT_ADDRESS);
+
+    return expect_count("error", (uint64_t)(int64_t)error, (uint64_t)BAL_ERROR_GUEST_MEMORY_FAULT)
+           && expect_count("address", address, 0x3100)
+           && expect_count("links", runtime->stats.links, 1)
+           && expect_count("NZCV", bal_guest_state_nzcv(&fixture->vcpu.state), BAL_NZCV_N);
+}
+
+/// 0x5000: B 0x5010
+/// 0x5010: MOVZ X1, #2; B HALT_ADDRESS
+static bool
+test_promotion(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_execution_counters = true;
+    config.promotion_threshold       = 2;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    bal_assembler_t assembler;
+
+    assemble_at(fixture, &assembler, 0x5000);
+    bal_emit_b(&assembler, 0x10);
+
+    assemble_at(fixture, &assembler, 0x5010);
+    bal_emit_movz(&assembler, BAL_REGISTER_X1, 2, 0);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - 0x5014));
+
+    // The second run trips both counters. 0x5000 is promoted first and its
+    // Tier 2 unit links into 0x5010, which is then promoted in turn and
+    // linked to again.
+    //
+    if (false == run(fixture, runtime, 0x5000) || false == run(fixture, runtime, 0x5000)
+        || false == expect_count("X1", fixture->vcpu.state.registers[1], 2)
+        || false == expect_count("promotions", runtime->stats.promotions, 2)
+        || false == expect_count("dispatches", runtime->stats.dispatches, 5)
+        || false == expect_count("links", runtime->stats.links, 3))
+    {
+        return false;
+    }
+
+    uint32_t first  = bal_translation_cache_lookup(&runtime->cache, 0x5000);
+    uint32_t second = bal_translation_cache_lookup(&runtime->cache, 0x5010);
+
+    if (false == expect_count("tier", runtime->cache.translations[first].tier, 2)
+        || false == expect_count("tier", runtime->cache.translations[second].tier, 2))
+    {
+        return false;
+    }
+
+    // Tier 2 units have no counters and stay linked.
+    //
+    return run(fixture, runtime, 0x5000) && run(fixture, runtime, 0x5000)
+           && expect_count("X1", fixture->vcpu.state.registers[1], 2)
+           && expect_count("promotions", runtime->stats.promotions, 2)
+           && expect_count("dispatches", runtime->stats.dispatches, 7);
+}
+
+/// Runs the call program twice in the interpreter, which compiles every unit
+/// on the second run, and a third time from compiled code.
+static bool
+test_interpreter(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 2;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    assemble_call_program(fixture);
+
+    if (false == run(fixture, runtime, 0x1000)
+        || false == expect_count("X2", fixture->vcpu.state.registers[2], 3)
+        || false == expect_count("interpretations", runtime->stats.interpretations, 4)
+        || false == expect_count("translations", runtime->stats.translations, 0))
+    {
+        return false;
+    }
+
+    if (false == run(fixture, runtime, 0x1000)
+        || false == expect_count("X30", fixture->vcpu.state.registers[30], 0x1018)
+        || false == expect_count("interpretations", runtime->stats.interpretations, 8)
+        || false == expect_count("translations", runtime->stats.translations, 4))
+    {
+        return false;
+    }
+
+    return run(fixture, runtime, 0x1000) && expect_count("X0", fixture->vcpu.state.registers[0], 1)
+           && expect_count("X1", fixture->vcpu.state.registers[1], 2)
+           && expect_count("interpretations", runtime->stats.interpretations, 8)
+           && expect_count("dispatches", runtime->stats.dispatches, 1);
+}
+
+/// 0x6000 + 8 * i: MOVZ X0, #i; B 0x6008 + 8 * i, for `count` units, the last
+/// of which branches to HALT_ADDRESS instead.
+static void
+assemble_chain_program(test_fixture_t *fixture, uint32_t count)
+{
+    bal_assembler_t assembler;
+    assemble_at(fixture, &assembler, 0x6000);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t address = 0x6000 + 8 * i;
+        bal_emit_movz(&assembler, BAL_REGISTER_X0, (uint16_t)i, 0);
+        bal_emit_b(&assembler, (i + 1 < count) ? 4 : (int32_t)(HALT_ADDRESS - address - 4));
+    }
+}
+
+/// Runs a chain of units that does not fit in the code memory twice. The
+/// oldest segments make room for the rest and are compiled again on the
+/// second run.
+static bool
+test_eviction(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.code_memory_size = 32U * 1024U;
+    config.cold_code_size   = 0;
+    config.code_segments    = 8;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    const uint32_t count = 1024;
+    assemble_chain_program(fixture, count);
+
+    if (false == run(fixture, runtime, 0x6000)
+        || false == expect_count("X0", fixture->vcpu.state.registers[0], count - 1)
+        || false == expect_count("translations", runtime->stats.translations, count)
+        || false == expect_count("retranslations", runtime->stats.retranslations, 0))
+    {
+        return false;
+    }
+
+    if (runtime->stats.evictions == 0 || runtime->stats.evicted_units == 0
+        || runtime->cache.count + runtime->stats.evicted_units != count)
+    {
+        fprintf(stderr, "FAIL: The chain did not evict any unit.\n");
+        return false;
+    }
+
+    return run(fixture, runtime, 0x6000)
+           && expect_count("X0", fixture->vcpu.state.registers[0], count - 1)
+           && expect_count("retranslations",
+                           runtime->stats.retranslations,
+                           runtime->stats.translations - count);
+}
+
+/// Runs a chain of more units than there are translation entries, so every
+/// segment is evicted until one frees an entry.
+static bool
+test_eviction_entries(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.max_translations = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    assemble_chain_program(fixture, 40);
+
+    return run(fixture, runtime, 0x6000)
+           && expect_count("X0", fixture->vcpu.state.registers[0], 39)
+           && expect_count("translations", runtime->stats.translations, 40)
+           && expect_count("evicted units", runtime->stats.evicted_units, 32)
+           && expect_count("live units", runtime->cache.count, 8);
+}
+
+#define THREADS_COUNT 4U
+
+typedef struct
+{
+    bal_runtime_t *runtime;
+    bal_vcpu_t     vcpu;
+    bal_error_t    error;
+    uint64_t       last_x0;
+} thread_context_t;
+
+static void *
+run_chain_thread(void *argument)
+{
+    thread_context_t *context = (thread_context_t *)argument;
+
+    for (uint32_t i = 0; i < 8U && BAL_SUCCESS == context->error; ++i)
+    {
+        bal_guest_address_t address = 0x6000;
+        context->error = bal_runtime_run(context->runtime, &context->vcpu, &address, HALT_ADDRESS);
+        context->last_x0 = context->vcpu.state.registers[0];
+    }
+
+    return NULL;
+}
+
+/// Runs a chain of units on several threads at once with `config`.
+static bool
+run_chain_threads(test_fixture_t             *fixture,
+                  bal_runtime_t              *runtime,
+                  const bal_runtime_config_t *config)
+{
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    const uint32_t count = 1024;
+    assemble_chain_program(fixture, count);
+
+    static thread_context_t contexts[THREADS_COUNT];
+    pthread_t               threads[THREADS_COUNT];
+    uint32_t                started = 0;
+
+    for (; started < THREADS_COUNT; ++started)
+    {
+        (void)memset(&contexts[started], 0, sizeof(contexts[started]));
+        contexts[started].runtime = runtime;
+
+        if (pthread_create(&threads[started], NULL, run_chain_thread, &contexts[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    bool passed = expect_count("threads started", started, THREADS_COUNT);
+
+    for (uint32_t i = 0; i < started; ++i)
+    {
+        (void)pthread_join(threads[i], NULL);
+        passed = passed && expect_count("error", (uint64_t)(int64_t)contexts[i].error, 0)
+                 && expect_count("X0", contexts[i].last_x0, count - 1);
+    }
+
+    return passed;
+}
+
+/// Runs a chain of units that does not fit in the code memory on several
+/// threads at once, so segments are evicted while other vCPUs run them.
+static bool
+test_threads(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.code_memory_size = 32U * 1024U;
+    config.cold_code_size   = 0;
+    config.code_segments    = 8;
+    config.max_vcpus        = THREADS_COUNT;
+
+    return run_chain_threads(fixture, runtime, &config)
+           && expect_count("evicted", runtime->stats.evictions != 0, true);
+}
+
+/// Interprets a chain of units that does not fit in the interpreter arenas
+/// on several threads at once, so they are emptied while other vCPUs run
+/// units from them.
+static bool
+test_threads_interpreted(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.max_vcpus             = THREADS_COUNT;
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = THREADS_COUNT + 1;
+    config.interpreter_capacity  = 64;
+
+    return run_chain_threads(fixture, runtime, &config)
+           && expect_count("flushes", runtime->interpreter.flushes != 0, true)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+/// Overwrites the MOVZ of the call program at 0x1020 through the TLB of the
+/// vCPU, like a guest store would, after every unit was compiled.
+static bool
+test_self_modifying_code(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    assemble_call_program(fixture);
+
+    if (false == run(fixture, runtime, 0x1000) || false == expect_call_program_registers(fixture))
+    {
+        return false;
+    }
+
+    uint32_t        instruction = 0;
+    bal_assembler_t assembler;
+    (void)bal_assembler_init(&assembler, &instruction, 1, fixture->logger);
+    bal_emit_movz(&assembler, BAL_REGISTER_X2, 7, 0);
+
+    // Data next to the code is on a code page too, but only the unit whose
+    // bytes were written is discarded.
+    //
+    bal_tlb_store(&fixture->vcpu.tlb, 0x1020, instruction, 4);
+    bal_tlb_store(&fixture->vcpu.tlb, 0x1800, 1, 8);
+    bal_tlb_store(&fixture->vcpu.tlb, 0x4000, 1, 8);
+
+    if (false == expect_count("code writes", runtime->stats.code_writes, 2)
+        || false == expect_count("invalidations", runtime->stats.invalidations, 1)
+        || BAL_TRANSLATION_NONE != bal_translation_cache_lookup(&runtime->cache, 0x1020))
+    {
+        return false;
+    }
+
+    return run(fixture, runtime, 0x1000) && expect_count("X2", fixture->vcpu.state.registers[2], 7)
+           && expect_count("X1", fixture->vcpu.state.registers[1], 2)
+           && expect_count("translations", runtime->stats.translations, 5);
+}
+
+/// Runs the call program from a fastmem region, where the page holding it is
+/// write protected once compiled. A store to it discards every unit on the
+/// page and lifts the protection.
+static bool
+test_fastmem_code(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_fastmem_t          fastmem;
+    bal_memory_interface_t interface;
+    bal_runtime_config_t   config;
+    bal_runtime_config_init_default(&config);
+    config.fastmem = &fastmem;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    if (bal_fastmem_init(&fixture->allocator, &fastmem, 16, 64, fixture->logger) != BAL_SUCCESS
+        || bal_fastmem_map(&fastmem, 0, GUEST_MEMORY_SIZE, true) != BAL_SUCCESS
+        || bal_memory_init_flat(
+               &fixture->allocator, &interface, fastmem.base, GUEST_MEMORY_SIZE, fixture->logger)
+               != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    bool passed = BAL_SUCCESS
+                  == bal_runtime_init(
+                      &fixture->allocator, runtime, &interface, &config, fixture->logger);
+
+    assemble_call_program(fixture);
+    (void)memcpy(fastmem.base, fixture->memory, GUEST_MEMORY_SIZE);
+
+    uint32_t        instruction = 0;
+    bal_assembler_t assembler;
+    (void)bal_assembler_init(&assembler, &instruction, 1, fixture->logger);
+    bal_emit_movz(&assembler, BAL_REGISTER_X2, 7, 0);
+
+    passed = passed && run(fixture, runtime, 0x1000) && expect_call_program_registers(fixture);
+
+    if (passed)
+    {
+        bal_tlb_store(&fixture->vcpu.tlb, 0x1020, instruction, 4);
+
+        // The page is writable again, so the host can write it directly.
+        //
+        fastmem.base[0x1800] = 1;
+
+        passed = expect_count("code writes", runtime->stats.code_writes, 1)
+                 && expect_count("invalidations", runtime->stats.invalidations, 4)
+                 && run(fixture, runtime, 0x1000)
+                 && expect_count("X2", fixture->vcpu.state.registers[2], 7);
+    }
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+    bal_memory_destroy_flat(&fixture->allocator, &interface);
+    bal_fastmem_destroy(&fixture->allocator, &fastmem);
+
+    // The caller destroys the runtime again.
+    //
+    (void)bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, NULL, fixture->logger);
+    return passed;
+}
+
+/// Replaces `runtime` with one using `config` and a fresh vCPU, then runs
+/// the indirect program of `test_indirect` and the call program twice.
+static bool
+run_cached(test_fixture_t *fixture, bal_runtime_t *runtime, const bal_runtime_config_t *config)
+{
+    bal_runtime_destroy(&fixture->allocator, runtime);
+    (void)memset(&fixture->vcpu, 0, sizeof(fixture->vcpu));
+
+    if (bal_runtime_init(&fixture->allocator, runtime, &fixture->interface, config, fixture->logger)
+        != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (false == run(fixture, runtime, 0x2000)
+            || false == expect_count("X6", fixture->vcpu.state.registers[6], 7)
+            || false == run(fixture, runtime, 0x1000))
+        {
+            return false;
+        }
+    }
+
+    return expect_count("hits", fixture->vcpu.counters.inline_cache_hits, 2);
+}
+
+/// Units saved by one runtime are loaded by the next instead of compiled,
+/// unless their guest code or the configuration changed.
+static bool
+test_persistent_cache(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    const char *path = "test_runtime_cache.bin";
+    (void)remove(path);
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_execution_counters = true;
+    config.persistent_cache_path     = path;
+
+    assemble_call_program(fixture);
+    (void)test_indirect(fixture, runtime);
+
+    bool passed = run_cached(fixture, runtime, &config)
+                  && expect_count("translations", runtime->stats.translations, 7)
+                  && expect_count("loads", runtime->stats.cache_loads, 0)
+                  && BAL_SUCCESS == bal_runtime_save_cache(runtime);
+
+    passed = passed && run_cached(fixture, runtime, &config)
+             && expect_call_program_registers(fixture)
+             && expect_count("translations", runtime->stats.translations, 0)
+             && expect_count("loads", runtime->stats.cache_loads, 7);
+
+    bal_assembler_t assembler;
+    assemble_at(fixture, &assembler, 0x1020);
+    bal_emit_movz(&assembler, BAL_REGISTER_X2, 9, 0);
+
+    passed = passed && run_cached(fixture, runtime, &config)
+             && expect_count("X2", fixture->vcpu.state.registers[2], 9)
+             && expect_count("translations", runtime->stats.translations, 1)
+             && expect_count("loads", runtime->stats.cache_loads, 6);
+
+    config.inline_cache_entries = 1;
+
+    passed = passed && run_cached(fixture, runtime, &config)
+             && expect_count("translations", runtime->stats.translations, 7)
+             && expect_count("loads", runtime->stats.cache_loads, 0);
+
+    (void)remove(path);
+    return passed;
+}
+
+/// Runs every data processing case at its own address, then checks the
+/// destination and NZCV. A destination of 31 is SP, or XZR for `CMP`.
+static bool
+run_data_processing(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    typedef struct
+    {
+        const char *name;
+        uint32_t    word;
+        uint32_t    destination;
+        uint64_t    expected;
+        uint32_t    nzcv;
+    } data_processing_case_t;
+
+    // X1 = 0x8000000000000005, X2 = 0xFFFFFF83.
+    //
+    static const data_processing_case_t cases[] = {
+        { "ADD X0, X1, #0x123",               0x91048C20, 0, 0x8000000000000128ULL, 0x00000000U },
+        { "ADD X0, X1, #0x5, LSL #12",        0x91401420, 0, 0x8000000000005005ULL, 0x00000000U },
+        { "SUB W0, W2, #0x84",                0x51021040, 0, 0x00000000FFFFFEFFULL, 0x00000000U },
+        { "ADDS X0, X1, #0x10",               0xB1004020, 0, 0x8000000000000015ULL, 0x80000000U },
+        { "SUBS X0, X1, #0x5",                0xF1001420, 0, 0x8000000000000000ULL, 0xA0000000U },
+        { "SUBS W0, W2, #0x84",               0x71021040, 0, 0x00000000FFFFFEFFULL, 0xA0000000U },
+        { "ADD X0, SP, #0x40",                0x910103E0, 0, 0x0000000000000040ULL, 0x00000000U },
+        { "ADD SP, X1, #0x10",                0x9100403F, 31, 0x8000000000000015ULL, 0x00000000U },
+        { "CMP X1, X2",                       0xEB02003F, 31, 0x0000000000000000ULL, 0x30000000U },
+        { "ADD X0, X1, X2, LSL #4",           0x8B021020, 0, 0x8000000FFFFFF835ULL, 0x00000000U },
+        { "ADD X0, X1, X2, LSR #3",           0x8B420C20, 0, 0x800000001FFFFFF5ULL, 0x00000000U },
+        { "SUB X0, X2, X1, ASR #60",          0xCB81F040, 0, 0x00000000FFFFFF8BULL, 0x00000000U },
+        { "ADD W0, W1, W2, ASR #4",           0x0B821020, 0, 0x00000000FFFFFFFDULL, 0x00000000U },
+        { "ADDS X0, X1, X1",                  0xAB010020, 0, 0x000000000000000AULL, 0x30000000U },
+        { "SUBS X0, X1, X2, LSL #63",         0xEB02FC20, 0, 0x0000000000000005ULL, 0x20000000U },
+        { "SUBS W0, W2, W2",                  0x6B020040, 0, 0x0000000000000000ULL, 0x60000000U },
+        { "NEG X0, X2",                       0xCB0203E0, 0, 0xFFFFFFFF0000007DULL, 0x00000000U },
+        { "ADD X0, X1, W2, UXTB",             0x8B220020, 0, 0x8000000000000088ULL, 0x00000000U },
+        { "ADD X0, X1, W2, SXTB #2",          0x8B228820, 0, 0x7FFFFFFFFFFFFE11ULL, 0x00000000U },
+        { "ADD X0, X1, W2, SXTH",             0x8B22A020, 0, 0x7FFFFFFFFFFFFF88ULL, 0x00000000U },
+        { "SUB X0, X1, W2, SXTW #4",          0xCB22D020, 0, 0x80000000000007D5ULL, 0x00000000U },
+        { "ADD X0, X1, X2, UXTX #1",          0x8B226420, 0, 0x80000001FFFFFF0BULL, 0x00000000U },
+        { "ADDS W0, W1, W2, UXTH #1",         0x2B222420, 0, 0x000000000001FF0BULL, 0x00000000U },
+        { "SUBS X0, X1, W2, SXTB",            0xEB228020, 0, 0x8000000000000082ULL, 0x80000000U },
+        { "AND X0, X1, X2, LSL #1",           0x8A020420, 0, 0x0000000000000004ULL, 0x00000000U },
+        { "ORR X0, X1, X2, ROR #8",           0xAAC22020, 0, 0x8300000000FFFFFFULL, 0x00000000U },
+        { "EOR W0, W1, W2, ROR #4",           0x4AC21020, 0, 0x000000003FFFFFFDULL, 0x00000000U },
+        { "BIC X0, X2, X1",                   0x8A210040, 0, 0x00000000FFFFFF82ULL, 0x00000000U },
+        { "ORN W0, W1, W2, LSR #1",           0x2A620420, 0, 0x000000008000003FULL, 0x00000000U },
+        { "EON X0, X1, X2, ASR #2",           0xCAA20820, 0, 0x7FFFFFFFC000001AULL, 0x00000000U },
+        { "ANDS X0, X1, X2",                  0xEA020020, 0, 0x0000000000000001ULL, 0x00000000U },
+        { "BICS W0, W2, W2",                  0x6A220040, 0, 0x0000000000000000ULL, 0x40000000U },
+        { "MOV X0, X2",                       0xAA0203E0, 0, 0x00000000FFFFFF83ULL, 0x00000000U },
+        { "AND X0, X1, #0xFF",                0x92401C20, 0, 0x0000000000000005ULL, 0x00000000U },
+        { "ORR X0, X1, #0x5555555555555555",  0xB200F020, 0, 0xD555555555555555ULL, 0x00000000U },
+        { "EOR W0, W2, #0xFF00FF00",          0x52089C40, 0, 0x0000000000FF0083ULL, 0x00000000U },
+        { "ANDS X0, X1, #0x8000000000000000", 0xF2410020, 0, 0x8000000000000000ULL, 0x80000000U },
+        { "ANDS W0, W2, #0x7C",               0x721E1040, 0, 0x0000000000000000ULL, 0x40000000U },
+    };
+    const size_t cases_count = sizeof(cases) / sizeof(cases[0]);
+
+    for (size_t i = 0; i < cases_count; ++i)
+    {
+        bal_assembler_t     assembler;
+        bal_guest_address_t address = 0x1000 + (bal_guest_address_t)i * 0x40;
+
+        assemble_at(fixture, &assembler, address);
+        emit_load_immediate(&assembler, BAL_REGISTER_X1, 0x8000000000000005ULL);
+        emit_load_immediate(&assembler, BAL_REGISTER_X2, 0xFFFFFF83ULL);
+        fixture->memory[(address + 0x20) / sizeof(uint32_t)] = cases[i].word;
+
+        assemble_at(fixture, &assembler, address + 0x24);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - (address + 0x24)));
+
+        if (false == run(fixture, runtime, address))
+        {
+            fprintf(stderr, "FAIL: %s did not run.\n", cases[i].name);
+            return false;
+        }
+
+        const bal_guest_state_t *state  = &fixture->vcpu.state;
+        uint64_t                 actual = 31 == cases[i].destination
+                                              ? state->sp
+                                              : state->registers[cases[i].destination];
+
+        if (false == expect_count(cases[i].name, actual, cases[i].expected)
+            || false == expect_count("NZCV", bal_guest_state_nzcv(state), cases[i].nzcv))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Data processing instructions give the same results compiled and
+/// interpreted.
+static bool
+test_data_processing(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    if (false == run_data_processing(fixture, runtime)
+        || false == expect_count("interpretations", runtime->stats.interpretations, 0))
+    {
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    return run_data_processing(fixture, runtime)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+/// 0x1000: Sets X1 = 0x4000, X2 and SP = 0x4100, then runs loads and stores
+/// in every addressing mode against data at 0x4020 and 0xBFE0.
+static bool
+run_memory_program(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    static const uint32_t words[] = {
+        0x9104003FU, // ADD SP, X1, #0x100
+        0xA9BF07E2U, // STP X2, X1, [SP, #-16]!
+        0xA8C113E3U, // LDP X3, X4, [SP], #16
+        0xB9000822U, // STR W2, [X1, #8]
+        0xF9400425U, // LDR X5, [X1, #8]
+        0x39808026U, // LDRSB X6, [X1, #0x20]
+        0x79C04427U, // LDRSH W7, [X1, #0x22]
+        0xD2800048U, // MOVZ X8, #2
+        0xB8687829U, // LDR W9, [X1, X8, LSL #2]
+        0xB980242AU, // LDRSW X10, [X1, #0x24]
+        0xF842102BU, // LDUR X11, [X1, #0x21]
+        0xF97FF033U, // LDR X19, [X1, #0x7FE0]
+        0xF8030C22U, // STR X2, [X1, #0x30]!
+        0xF85F042CU, // LDR X12, [X1], #-0x10
+        0x29403C2EU, // LDP W14, W15, [X1]
+        0x69404430U, // LDPSW X16, X17, [X1]
+        0x79008022U, // STRH W2, [X1, #0x40]
+        0x79408032U, // LDRH W18, [X1, #0x40]
+        0x5800004DU, // LDR X13, #8
+    };
+    const size_t words_count = sizeof(words) / sizeof(words[0]);
+    const uint64_t value     = 0x1122334455667788ULL;
+    const uint64_t literal   = 0xCAFEF00DDEADBEEFULL;
+
+    uint8_t *bytes = (uint8_t *)fixture->memory;
+    (void)memset(bytes + 0x4000, 0, 0x200);
+    (void)memcpy(bytes + 0x4020, &(uint64_t){ 0x8081828384858687ULL }, sizeof(uint64_t));
+    (void)memcpy(bytes + 0xBFE0, &(uint64_t){ 0x0123456789ABCDEFULL }, sizeof(uint64_t));
+
+    bal_assembler_t assembler;
+    assemble_at(fixture, &assembler, 0x1000);
+    bal_emit_movz(&assembler, BAL_REGISTER_X1, 0x4000, 0);
+    emit_load_immediate(&assembler, BAL_REGISTER_X2, value);
+
+    bal_guest_address_t address = 0x1000 + assembler.offset * sizeof(uint32_t);
+    (void)memcpy(bytes + address, words, sizeof(words));
+    address += words_count * sizeof(uint32_t);
+
+    assemble_at(fixture, &assembler, address);
+    bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - address));
+    (void)memcpy(bytes + address + 4, &literal, sizeof(literal));
+
+    if (false == run(fixture, runtime, 0x1000))
+    {
+        return false;
+    }
+
+    const uint64_t *registers = fixture->vcpu.state.registers;
+    uint64_t        stored[3];
+    uint16_t        halfword;
+    (void)memcpy(stored, bytes + 0x40F0, 2 * sizeof(uint64_t));
+    (void)memcpy(stored + 2, bytes + 0x4030, sizeof(uint64_t));
+    (void)memcpy(&halfword, bytes + 0x4060, sizeof(halfword));
+
+    return expect_count("SP", fixture->vcpu.state.sp, 0x4100)
+           && expect_count("X1", registers[1], 0x4020) && expect_count("X3", registers[3], value)
+           && expect_count("X4", registers[4], 0x4000)
+           && expect_count("X5", registers[5], 0x55667788)
+           && expect_count("X6", registers[6], 0xFFFFFFFFFFFFFF87ULL)
+           && expect_count("X7", registers[7], 0xFFFF8485)
+           && expect_count("X9", registers[9], 0x55667788)
+           && expect_count("X10", registers[10], 0xFFFFFFFF80818283ULL)
+           && expect_count("X11", registers[11], 0x0080818283848586ULL)
+           && expect_count("X12", registers[12], value)
+           && expect_count("X13", registers[13], literal)
+           && expect_count("X14", registers[14], 0x84858687)
+           && expect_count("X15", registers[15], 0x80818283)
+           && expect_count("X16", registers[16], 0xFFFFFFFF84858687ULL)
+           && expect_count("X17", registers[17], 0xFFFFFFFF80818283ULL)
+           && expect_count("X18", registers[18], 0x7788)
+           && expect_count("X19", registers[19], 0x0123456789ABCDEFULL)
+           && expect_count("[0x40F0]", stored[0], value)
+           && expect_count("[0x40F8]", stored[1], 0x4000)
+           && expect_count("[0x4030]", stored[2], value)
+           && expect_count("[0x4060]", halfword, 0x7788);
+}
+
+/// Loads and stores give the same results compiled and interpreted.
+static bool
+test_memory_access(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    if (false == run_memory_program(fixture, runtime))
+    {
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    return run_memory_program(fixture, runtime)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t    word;
+    uint64_t    low;
+    uint64_t    high;
+} vector_case_t;
+
+// V0 = 0xAA..., V1 = 0xFEDCBA9876543210_0123456789ABCDEF,
+// V2 = 0x8070605040302010_0123456700000080,
+// V3 = 0x80402010FF0A0504_1F0F0E0D03020100, X1 = 0x8899AABBCCDDEEFF.
+//
+static const vector_case_t vector_cases[] = {
+    { "ADD V0.16B, V1.16B, V2.16B",     0x4E228420, 0x02468ACE89ABCD6FULL, 0x7E4C1AE8B6845220ULL },
+    { "ADD V0.8H, V1.8H, V2.8H",        0x4E628420, 0x02468ACE89ABCE6FULL, 0x7F4C1AE8B6845220ULL },
+    { "ADD V0.2S, V1.2S, V2.2S",        0x0EA28420, 0x02468ACE89ABCE6FULL, 0x0000000000000000ULL },
+    { "ADD V0.2D, V1.2D, V2.2D",        0x4EE28420, 0x02468ACE89ABCE6FULL, 0x7F4D1AE8B6845220ULL },
+    { "SUB V0.4S, V1.4S, V2.4S",        0x6EA28420, 0x0000000089ABCD6FULL, 0x7E6C5A4836241200ULL },
+    { "SUB V0.8B, V1.8B, V2.8B",        0x2E228420, 0x0000000089ABCD6FULL, 0x0000000000000000ULL },
+    { "SUB V0.2D, V1.2D, V2.2D",        0x6EE28420, 0x0000000089ABCD6FULL, 0x7E6C5A4836241200ULL },
+    { "MUL V0.16B, V1.16B, V2.16B",     0x4E229C20, 0x01C9997100000080ULL, 0x0040C08080C04000ULL },
+    { "MUL V0.8H, V1.8H, V2.8H",        0x4E629C20, 0x4AC9AF710000F780ULL, 0x80404F802FC02100ULL },
+    { "MUL V0.4S, V1.4S, V2.4S",        0x4EA29C20, 0xDAFAAF71D5E6F780ULL, 0x0D734F804E852100ULL },
+    { "MUL V0.8B, V1.8B, V2.8B",        0x0E229C20, 0x01C9997100000080ULL, 0x0000000000000000ULL },
+    { "AND V0.16B, V1.16B, V2.16B",     0x4E221C20, 0x0123456700000080ULL, 0x8050201040102010ULL },
+    { "BIC V0.16B, V1.16B, V2.16B",     0x4E621C20, 0x0000000089ABCD6FULL, 0x7E8C9A8836441200ULL },
+    { "ORR V0.8B, V1.8B, V2.8B",        0x0EA21C20, 0x0123456789ABCDEFULL, 0x0000000000000000ULL },
+    { "ORN V0.16B, V1.16B, V2.16B",     0x4EE21C20, 0xFFFFFFFFFFFFFFFFULL, 0xFFDFBFBFFFDFFFFFULL },
+    { "EOR V0.16B, V0.16B, V1.16B",     0x6E211C00, 0xAB89EFCD23016745ULL, 0x54761032DCFE98BAULL },
+    { "CMEQ V0.4S, V1.4S, V2.4S",       0x6EA28C20, 0xFFFFFFFF00000000ULL, 0x0000000000000000ULL },
+    { "CMEQ V0.2D, V1.2D, V2.2D",       0x6EE28C20, 0x0000000000000000ULL, 0x0000000000000000ULL },
+    { "CMEQ V0.8B, V1.8B, V2.8B",       0x2E228C20, 0xFFFFFFFF00000000ULL, 0x0000000000000000ULL },
+    { "CMGT V0.16B, V1.16B, V2.16B",    0x4E223420, 0x00000000000000FFULL, 0xFF000000FFFFFF00ULL },
+    { "CMGT V0.4H, V1.4H, V2.4H",       0x0E623420, 0x0000000000000000ULL, 0x0000000000000000ULL },
+    { "CMGT V0.2D, V1.2D, V2.2D",       0x4EE23420, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "CMGE V0.8H, V1.8H, V2.8H",       0x4E623C20, 0xFFFFFFFF00000000ULL, 0xFFFF0000FFFFFFFFULL },
+    { "CMGE V0.4S, V1.4S, V2.4S",       0x4EA23C20, 0xFFFFFFFF00000000ULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "CMHI V0.16B, V1.16B, V2.16B",    0x6E223420, 0x00000000FFFFFFFFULL, 0xFFFFFFFFFFFFFF00ULL },
+    { "CMHI V0.2D, V1.2D, V2.2D",       0x6EE23420, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "CMHI V0.4S, V1.4S, V2.4S",       0x6EA23420, 0x00000000FFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "CMHS V0.8H, V1.8H, V2.8H",       0x6E623C20, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "CMHS V0.8B, V1.8B, V2.8B",       0x2E223C20, 0xFFFFFFFFFFFFFFFFULL, 0x0000000000000000ULL },
+    { "ZIP1 V0.16B, V1.16B, V2.16B",    0x4E023820, 0x008900AB00CD80EFULL, 0x0101232345456767ULL },
+    { "ZIP2 V0.8H, V1.8H, V2.8H",       0x4E427820, 0x4030765420103210ULL, 0x8070FEDC6050BA98ULL },
+    { "ZIP1 V0.2D, V1.2D, V2.2D",       0x4EC23820, 0x0123456789ABCDEFULL, 0x0123456700000080ULL },
+    { "ZIP2 V0.8B, V1.8B, V2.8B",       0x0E027820, 0x0101232345456767ULL, 0x0000000000000000ULL },
+    { "ZIP1 V0.2S, V1.2S, V2.2S",       0x0E823820, 0x0000008089ABCDEFULL, 0x0000000000000000ULL },
+    { "ZIP2 V0.4H, V1.4H, V2.4H",       0x0E427820, 0x0123012345674567ULL, 0x0000000000000000ULL },
+    { "EXT V0.16B, V1.16B, V2.16B, #3", 0x6E021820, 0x5432100123456789ULL, 0x000080FEDCBA9876ULL },
+    { "EXT V0.16B, V1.16B, V2.16B, #0", 0x6E020020, 0x0123456789ABCDEFULL, 0xFEDCBA9876543210ULL },
+    { "EXT V0.8B, V1.8B, V2.8B, #5",    0x2E022820, 0x6700000080012345ULL, 0x0000000000000000ULL },
+    { "TBL V0.16B, {V1.16B}, V3.16B",   0x4E030020, 0x00FEDCBA89ABCDEFULL, 0x0000000000544567ULL },
+    { "TBL V0.8B, {V1.16B}, V3.8B",     0x0E030020, 0x00FEDCBA89ABCDEFULL, 0x0000000000000000ULL },
+    { "DUP V0.16B, V1.B[13]",           0x4E1B0420, 0xBABABABABABABABAULL, 0xBABABABABABABABAULL },
+    { "DUP V0.4H, V1.H[6]",             0x0E1A0420, 0xBA98BA98BA98BA98ULL, 0x0000000000000000ULL },
+    { "DUP V0.4S, V2.S[1]",             0x4E0C0440, 0x0123456701234567ULL, 0x0123456701234567ULL },
+    { "DUP V0.2D, V1.D[1]",             0x4E180420, 0xFEDCBA9876543210ULL, 0xFEDCBA9876543210ULL },
+    { "DUP V0.16B, W1",                 0x4E010C20, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL },
+    { "DUP V0.8H, W1",                  0x4E020C20, 0xEEFFEEFFEEFFEEFFULL, 0xEEFFEEFFEEFFEEFFULL },
+    { "DUP V0.2S, W1",                  0x0E040C20, 0xCCDDEEFFCCDDEEFFULL, 0x0000000000000000ULL },
+    { "DUP V0.2D, X1",                  0x4E080C20, 0x8899AABBCCDDEEFFULL, 0x8899AABBCCDDEEFFULL },
+};
+
+/// Runs every vector case at its own address, then checks V0.
+static bool
+run_vector(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    const size_t cases_count = sizeof(vector_cases) / sizeof(vector_cases[0]);
+
+    for (size_t i = 0; i < cases_count; ++i)
+    {
+        bal_assembler_t      assembler;
+        bal_guest_address_t  address   = 0x1000 + (bal_guest_address_t)i * 0x10;
+        bal_guest_state_t   *state     = &fixture->vcpu.state;
+        const vector_case_t *test_case = &vector_cases[i];
+
+        fixture->memory[address / sizeof(uint32_t)] = test_case->word;
+        assemble_at(fixture, &assembler, address + 4);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - (address + 4)));
+
+        (void)memset(state, 0, sizeof(*state));
+        state->vectors[0] = (bal_guest_vector_register_t){ { 0xAAAAAAAAAAAAAAAAULL,
+                                                             0xAAAAAAAAAAAAAAAAULL } };
+        state->vectors[1] = (bal_guest_vector_register_t){ { 0x0123456789ABCDEFULL,
+                                                             0xFEDCBA9876543210ULL } };
+        state->vectors[2] = (bal_guest_vector_register_t){ { 0x0123456700000080ULL,
+                                                             0x8070605040302010ULL } };
+        state->vectors[3] = (bal_guest_vector_register_t){ { 0x1F0F0E0D03020100ULL,
+                                                             0x80402010FF0A0504ULL } };
+        state->registers[1] = 0x8899AABBCCDDEEFFULL;
+
+        bal_guest_address_t entry = address;
+        bal_error_t         error = bal_runtime_run(runtime, &fixture->vcpu, &entry, HALT_ADDRESS);
+
+        if (error != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: %s returned %s.\n", test_case->name, bal_error_to_string(error));
+            return false;
+        }
+
+        if (false == expect_count(test_case->name, state->vectors[0].lanes[0], test_case->low)
+            || false == expect_count(test_case->name, state->vectors[0].lanes[1], test_case->high))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Vector instructions give the same results compiled and interpreted.
+static bool
+test_vector(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    if (false == run_vector(fixture, runtime))
+    {
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    return run_vector(fixture, runtime)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t    words[4];
+    uint32_t    words_count;
+    uint32_t    result_register;
+    uint64_t    result;
+    uint64_t    memory;
+} atomic_case_t;
+
+// X0 = 0x10, X1 = 0xAABBCCDDEEFF0011, X2 = ATOMIC_ADDRESS, which holds
+// 0x1122334455667788. The single CAS compares against X0 and fails, the
+// STXR has no monitor to match and fails.
+//
+#define ATOMIC_ADDRESS 0x4000U
+
+static const atomic_case_t atomic_cases[] = {
+    { "LDADD X0, X1, [X2]",  { 0xF8200041 }, 1, 1, 0x1122334455667788ULL, 0x1122334455667798ULL },
+    { "LDADDH W0, W1, [X2]", { 0x78200041 }, 1, 1, 0x0000000000007788ULL, 0x1122334455667798ULL },
+    { "SWP X0, X1, [X2]",    { 0xF8208041 }, 1, 1, 0x1122334455667788ULL, 0x0000000000000010ULL },
+    { "SWPB W0, W1, [X2]",   { 0x38208041 }, 1, 1, 0x0000000000000088ULL, 0x1122334455667710ULL },
+    { "CAS X0, X1, [X2]",    { 0xC8A07C41 }, 1, 0, 0x1122334455667788ULL, 0x1122334455667788ULL },
+    { "CASB W0, W1, [X2]",   { 0x08A07C41 }, 1, 0, 0x0000000000000088ULL, 0x1122334455667788ULL },
+    { "STXR W4, X0, [X2]",   { 0xC8047C40 }, 1, 4, 0x0000000000000001ULL, 0x1122334455667788ULL },
+
+    // LDR X0, [X2]; CAS X0, X1, [X2]
+    //
+    { "LDR, CAS", { 0xF9400040, 0xC8A07C41 }, 2, 0, 0x1122334455667788ULL, 0xAABBCCDDEEFF0011ULL },
+
+    // LDAXR X3, [X2]; ADD X3, X3, #1; STLXR W4, X3, [X2]; CBNZ W4, .-12
+    //
+    { "LDAXR, ADD, STLXR, CBNZ",
+      { 0xC85FFC43, 0x91000463, 0xC804FC43, 0x35FFFFA4 },
+      4,
+      4,
+      0x0000000000000000ULL,
+      0x1122334455667789ULL },
+};
+
+/// Runs every atomic case at its own address, then checks the result
+/// register and the doubleword at `ATOMIC_ADDRESS`.
+static bool
+run_atomic(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    const size_t cases_count = sizeof(atomic_cases) / sizeof(atomic_cases[0]);
+
+    for (size_t i = 0; i < cases_count; ++i)
+    {
+        bal_assembler_t      assembler;
+        bal_guest_address_t  address   = 0x1000 + (bal_guest_address_t)i * 0x20;
+        bal_guest_state_t   *state     = &fixture->vcpu.state;
+        const atomic_case_t *test_case = &atomic_cases[i];
+        uint8_t             *bytes     = (uint8_t *)fixture->memory;
+        uint64_t             memory    = 0x1122334455667788ULL;
+
+        for (uint32_t j = 0; j < test_case->words_count; ++j)
+        {
+            fixture->memory[address / sizeof(uint32_t) + j] = test_case->words[j];
+        }
+
+        bal_guest_address_t end = address + test_case->words_count * 4;
+        assemble_at(fixture, &assembler, end);
+        bal_emit_b(&assembler, (int32_t)(HALT_ADDRESS - end));
+        (void)memcpy(bytes + ATOMIC_ADDRESS, &memory, sizeof(memory));
+
+        (void)memset(state, 0, sizeof(*state));
+        bal_vcpu_clear_exclusive_monitor(&fixture->vcpu);
+        state->registers[0] = 0x10;
+        state->registers[1] = 0xAABBCCDDEEFF0011ULL;
+        state->registers[2] = ATOMIC_ADDRESS;
+
+        bal_guest_address_t entry = address;
+        bal_error_t         error = bal_runtime_run(runtime, &fixture->vcpu, &entry, HALT_ADDRESS);
+
+        if (error != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: %s returned %s.\n", test_case->name, bal_error_to_string(error));
+            return false;
+        }
+
+        (void)memcpy(&memory, bytes + ATOMIC_ADDRESS, sizeof(memory));
+
+        if (false
+                == expect_count(test_case->name,
+                                state->registers[test_case->result_register],
+                                test_case->result)
+            || false == expect_count(test_case->name, memory, test_case->memory))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Atomic instructions give the same results compiled and interpreted.
+static bool
+test_atomic(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    if (false == run_atomic(fixture, runtime))
+    {
+        return false;
+    }
+
+    bal_runtime_config_t config;
+    bal_runtime_config_init_default(&config);
+    config.enable_interpreter    = true;
+    config.interpreter_threshold = 16;
+
+    bal_runtime_destroy(&fixture->allocator, runtime);
+
+    bal_error_t error = bal_runtime_init(
+        &fixture->allocator, runtime, &fixture->interface, &config, fixture->logger);
+
+    if (error != BAL_SUCCESS)
+    {
+        return false;
+    }
+
+    return run_atomic(fixture, runtime)
+           && expect_count("translations", runtime->stats.translations, 0);
+}
+
+static bool
+test_fetch_fault(test_fixture_t *fixture, bal_runtime_t *runtime)
+{
+    bal_guest_address_t address = GUEST_MEMORY_SIZE + 0x1000;
+    bal_error_t         error   = bal_runtime_run(runtime, &fixture->vcpu, &address, HALT_ADDRESS);
+
+    return expect_count("error", (uint64_t)(int64_t)error, (uint64_t)BAL_ERROR_GUEST_MEMORY_FAULT)
+           && expect_count("address", address, GUEST_MEMORY_SIZE + 0x1000);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *, bal_runtime_t *);
+
+    const test_function_t tests[]
+        = { test_linking,
+            test_linking_disabled,
+            test_return_mismatch,
+            test_indirect,
+            test_cold_code,
+            test_inline_cache_replacement,
+            test_promotion,
+            test_interpreter,
+            test_self_modifying_code,
+            test_fastmem_code,
+            test_eviction,
+            test_eviction_entries,
+            test_persistent_cache,
+            test_data_processing,
+            test_memory_access,
+            test_vector,
+            test_atomic,
+            test_threads,
+            test_threads_interpreted,
+            test_fetch_fault,
+            test_conditional_branches,
+            test_unsupported_instruction,
+            test_flags_on_halt,
+            test_flags_on_fault };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    test_fixture_t fixture;
+    bal_get_default_allocator(&fixture.allocator);
+    bal_logger_init_default(&fixture.logger);
+    fixture.logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    fixture.memory = (uint32_t *)fixture.allocator.allocate(
+        fixture.allocator.handle, 16, GUEST_MEMORY_SIZE);
+
+    if (NULL == fixture.memory
+        || bal_memory_init_flat(&fixture.allocator,
+                                &fixture.interface,
+                                fixture.memory,
+                                GUEST_MEMORY_SIZE,
+                                fixture.logger)
+               != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Failed to set up guest memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        bal_runtime_t runtime;
+        (void)memset(fixture.memory, 0, GUEST_MEMORY_SIZE);
+        (void)memset(&fixture.vcpu, 0, sizeof(fixture.vcpu));
+
+        if (bal_runtime_init(&fixture.allocator, &runtime, &fixture.interface, NULL, fixture.logger)
+            != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_runtime_init() failed.\n");
+            return EXIT_FAILURE;
+        }
+
+        if (false == tests[i](&fixture, &runtime))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_runtime_destroy(&fixture.allocator, &runtime);
+    }
+
+    bal_memory_destroy_flat(&fixture.allocator, &fixture.interface);
+    fixture.allocator.free(fixture.allocator.handle, fixture.memory, GUEST_MEMORY_SIZE);
+    return return_code;
+}
+
+/*** end of file ***/
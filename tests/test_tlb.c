@@ -0,0 +1,233 @@
+#include "bal_memory.h"
+#include "bal_tlb.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GUEST_MEMORY_SIZE (4U * BAL_TLB_PAGE_SIZE)
+
+typedef struct
+{
+    bal_memory_interface_t interface;
+    bal_tlb_t              tlb;
+    uint8_t               *memory;
+} test_fixture_t;
+
+static bool
+expect_value(const char *name, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        fprintf(stderr,
+                "FAIL: %s is 0x%llx, expected 0x%llx.\n",
+                name,
+                (unsigned long long)actual,
+                (unsigned long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+// The first access to a page misses and fills the entry, the next one hits.
+//
+static bool
+test_fill(test_fixture_t *fixture)
+{
+    const uint8_t bytes[] = { 0x11, 0x22, 0x33, 0x44 };
+    (void)memcpy(fixture->memory + 0x1010, bytes, sizeof(bytes));
+
+    uint64_t first  = bal_tlb_load(&fixture->tlb, 0x1010, 4);
+    uint64_t second = bal_tlb_load(&fixture->tlb, 0x1012, 2);
+
+    return expect_value("first load", first, 0x44332211)
+           && expect_value("second load", second, 0x4433)
+           && expect_value("misses", fixture->tlb.misses, 1)
+           && bal_tlb_probe(&fixture->tlb, 0x1FF8, 8, false) == fixture->memory + 0x1FF8
+           && NULL == bal_tlb_probe(&fixture->tlb, 0x1010, 4, true);
+}
+
+// Accesses crossing a page always take the slow path and are split.
+//
+static bool
+test_cross_page(test_fixture_t *fixture)
+{
+    bal_tlb_store(&fixture->tlb, 0x1FFC, 0x0807060504030201ULL, 8);
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        if (false == expect_value("byte", fixture->memory[0x1FFC + i], i + 1U))
+        {
+            return false;
+        }
+    }
+
+    uint64_t value = bal_tlb_load(&fixture->tlb, 0x1FFE, 4);
+
+    return expect_value("load", value, 0x06050403) && expect_value("misses", fixture->tlb.misses, 2)
+           && expect_value("fault", fixture->tlb.fault, 0);
+}
+
+static bool
+test_flush(test_fixture_t *fixture)
+{
+    (void)bal_tlb_load(&fixture->tlb, 0x1000, 8);
+    (void)bal_tlb_load(&fixture->tlb, 0x2000, 8);
+    bal_tlb_flush_range(&fixture->tlb, 0x1FFF, 1);
+
+    if (NULL != bal_tlb_probe(&fixture->tlb, 0x1000, 8, false)
+        || NULL == bal_tlb_probe(&fixture->tlb, 0x2000, 8, false))
+    {
+        fprintf(stderr, "FAIL: Range flush hit the wrong pages.\n");
+        return false;
+    }
+
+    bal_tlb_flush(&fixture->tlb);
+
+    if (NULL != bal_tlb_probe(&fixture->tlb, 0x2000, 8, false))
+    {
+        fprintf(stderr, "FAIL: Flush kept a mapping.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+test_fault(test_fixture_t *fixture)
+{
+    uint64_t value = bal_tlb_load(&fixture->tlb, GUEST_MEMORY_SIZE - 2U, 4);
+
+    if (false == expect_value("value", value, 0)
+        || false == expect_value("fault", fixture->tlb.fault, 1)
+        || false == expect_value("fault address", fixture->tlb.fault_address, GUEST_MEMORY_SIZE))
+    {
+        return false;
+    }
+
+    // Without a write callback guest memory is read only.
+    //
+    fixture->tlb.fault                 = 0;
+    fixture->interface.translate_write = NULL;
+    bal_tlb_store(&fixture->tlb, 0x1000, 1, 1);
+
+    return expect_value("fault", fixture->tlb.fault, 1)
+           && expect_value("byte", fixture->memory[0x1000], 0);
+}
+
+static uint64_t code_write_count;
+
+static void
+count_code_write(void *context, bal_tlb_t *tlb, bal_guest_address_t guest_address, uint64_t size)
+{
+    (void)context;
+    (void)tlb;
+    (void)guest_address;
+    (void)size;
+    code_write_count++;
+}
+
+// Stores to code pages are reported before they happen and never map the
+// page for writes. Pages turning into code pages drop their write mapping on
+// the next sync.
+//
+static bool
+test_code_pages(test_fixture_t *fixture)
+{
+    bal_code_pages_t code_pages;
+    bal_code_pages_init(&code_pages);
+    bal_code_pages_add(&code_pages, 0x1FF0, 0x20);
+    bal_tlb_watch_code(&fixture->tlb, &code_pages, count_code_write, NULL);
+    code_write_count = 0;
+
+    bal_tlb_store(&fixture->tlb, 0x2008, 0xAB, 1);
+    bal_tlb_store(&fixture->tlb, 0x2008, 0xCD, 1);
+    bal_tlb_store(&fixture->tlb, 0x3000, 0xEF, 1);
+
+    if (false == expect_value("code writes", code_write_count, 2)
+        || false == expect_value("byte", fixture->memory[0x2008], 0xCD)
+        || NULL != bal_tlb_probe(&fixture->tlb, 0x2008, 1, true)
+        || NULL == bal_tlb_probe(&fixture->tlb, 0x3000, 1, true))
+    {
+        return false;
+    }
+
+    bal_code_pages_add(&code_pages, 0x3000, 4);
+    bal_tlb_sync_code(&fixture->tlb);
+    bal_tlb_store(&fixture->tlb, 0x3000, 0x12, 1);
+
+    if (false == expect_value("code writes", code_write_count, 3))
+    {
+        return false;
+    }
+
+    bal_code_pages_remove(&code_pages, 0x1FF0, 0x20);
+    bal_code_pages_remove(&code_pages, 0x3000, 4);
+    bal_tlb_store(&fixture->tlb, 0x2008, 0x34, 1);
+
+    return expect_value("code writes", code_write_count, 3)
+           && NULL != bal_tlb_probe(&fixture->tlb, 0x2008, 1, true);
+}
+
+int
+main(void)
+{
+    typedef bool (*test_function_t)(test_fixture_t *);
+
+    const test_function_t tests[] = {
+        test_fill,
+        test_cross_page,
+        test_flush,
+        test_fault,
+        test_code_pages,
+    };
+    const size_t tests_count = sizeof(tests) / sizeof(tests[0]);
+
+    bal_allocator_t allocator;
+    bal_logger_t    logger;
+    test_fixture_t  fixture;
+    bal_get_default_allocator(&allocator);
+    bal_logger_init_default(&logger);
+    logger.min_level = BAL_LOG_LEVEL_WARN;
+
+    fixture.memory = (uint8_t *)allocator.allocate(allocator.handle, 16, GUEST_MEMORY_SIZE);
+
+    if (NULL == fixture.memory)
+    {
+        fprintf(stderr, "FAIL: Failed to allocate guest memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    int return_code = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < tests_count; ++i)
+    {
+        (void)memset(fixture.memory, 0, GUEST_MEMORY_SIZE);
+
+        if (bal_memory_init_flat(
+                &allocator, &fixture.interface, fixture.memory, GUEST_MEMORY_SIZE, logger)
+            != BAL_SUCCESS)
+        {
+            fprintf(stderr, "FAIL: bal_memory_init_flat() failed.\n");
+            return_code = EXIT_FAILURE;
+            break;
+        }
+
+        bal_tlb_init(&fixture.tlb, &fixture.interface);
+
+        if (false == tests[i](&fixture))
+        {
+            fprintf(stderr, "FAIL: Test case %zu failed.\n", i);
+            return_code = EXIT_FAILURE;
+        }
+
+        bal_memory_destroy_flat(&allocator, &fixture.interface);
+    }
+
+    allocator.free(allocator.handle, fixture.memory, GUEST_MEMORY_SIZE);
+    return return_code;
+}
+
+/*** end of file ***/
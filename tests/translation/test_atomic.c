@@ -0,0 +1,60 @@
+#include "setup.h"
+
+// A load exclusive is an ordinary load as far as replay goes, but the
+// store exclusive writes guest memory atomically, so the unit ends before
+// the load that follows it and never replays it when that load faults.
+//
+static int
+test_atomic(test_context_t *context)
+{
+    static const uint32_t code[] = {
+        0xC85FFC43U, // LDAXR X3, [X2]
+        0x91000463U, // ADD X3, X3, #1
+        0xC804FC43U, // STLXR W4, X3, [X2]
+        0xF9400040U, // LDR X0, [X2]
+    };
+
+    (void)memcpy(context->code_buffer, code, sizeof(code));
+
+    bal_error_t error = bal_engine_translate(
+        &context->engine, &context->interface, context->code_buffer, sizeof(code));
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Translation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t atomics = 0;
+    uint32_t loads   = 0;
+
+    for (uint32_t i = 0; i < context->engine.instruction_count; ++i)
+    {
+        bal_opcode_t opcode
+            = (bal_opcode_t)(context->engine.instructions[i] >> BAL_OPCODE_SHIFT_POSITION);
+
+        atomics += (opcode >= OPCODE_LOAD_EXCLUSIVE && opcode <= OPCODE_ATOMIC_COMPARE_SWAP) ? 1U
+                                                                                             : 0U;
+        loads += (OPCODE_LOAD == opcode) ? 1U : 0U;
+    }
+
+    if (atomics != 2 || loads != 0)
+    {
+        fprintf(stderr, "FAIL: %u atomics and %u loads, expected 2 and 0.\n", atomics, loads);
+        return EXIT_FAILURE;
+    }
+
+    const bal_unit_exit_t *unit_exit = &context->engine.unit_exit;
+
+    if (unit_exit->kind != BAL_UNIT_EXIT_FALLTHROUGH || unit_exit->guest_size != 12)
+    {
+        fprintf(stderr, "FAIL: The unit was not cut before the load.\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+BAL_TEST_MAIN(test_atomic)
+
+/*** end of file ***/
@@ -0,0 +1,56 @@
+#include "setup.h"
+
+// A typical prologue and epilogue. The accesses fold their offsets from SP,
+// so the only ADDs left are the two writebacks of SP.
+//
+static int
+test_load_store(test_context_t *context)
+{
+    static const uint32_t code[] = {
+        0xA9BE7BFDU, // STP X29, X30, [SP, #-32]!
+        0xA90153F3U, // STP X19, X20, [SP, #16]
+        0xA94153F3U, // LDP X19, X20, [SP, #16]
+        0xA8C27BFDU, // LDP X29, X30, [SP], #32
+    };
+
+    (void)memcpy(context->code_buffer, code, sizeof(code));
+
+    bal_error_t error = bal_engine_translate(
+        &context->engine, &context->interface, context->code_buffer, sizeof(code));
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Translation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t loads  = 0;
+    uint32_t stores = 0;
+    uint32_t adds   = 0;
+
+    for (uint32_t i = 0; i < context->engine.instruction_count; ++i)
+    {
+        bal_opcode_t opcode
+            = (bal_opcode_t)(context->engine.instructions[i] >> BAL_OPCODE_SHIFT_POSITION);
+
+        loads += (OPCODE_LOAD == opcode) ? 1U : 0U;
+        stores += (OPCODE_STORE == opcode) ? 1U : 0U;
+        adds += (OPCODE_ADD == opcode) ? 1U : 0U;
+    }
+
+    if (loads != 4 || stores != 4 || adds != 2)
+    {
+        fprintf(stderr,
+                "FAIL: %u loads, %u stores and %u adds, expected 4, 4 and 2.\n",
+                loads,
+                stores,
+                adds);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+BAL_TEST_MAIN(test_load_store)
+
+/*** end of file ***/
@@ -0,0 +1,164 @@
+#include "setup.h"
+
+/// More MOVZ instructions than a unit can hold. Each one emits a `CONST`
+/// and interns a constant.
+#define GUEST_INSTRUCTIONS 70000U
+
+/// Enough room for all of them in a wide unit.
+#define WIDE_CAPACITY (1U << 18U)
+
+static int
+translate(test_context_t *context, const uint32_t *code, size_t size, bal_guest_address_t address)
+{
+    (void)bal_engine_reset(&context->engine);
+    context->engine.guest_address = address;
+
+    bal_error_t error = bal_engine_translate(&context->engine, &context->interface, code, size);
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Translation at 0x%llx failed.\n", (unsigned long long)address);
+        return EXIT_FAILURE;
+    }
+
+    if (context->engine.instruction_count > BAL_UNIT_INSTRUCTION_LIMIT + 128U
+        || context->engine.constant_count > BAL_UNIT_INSTRUCTION_LIMIT + 128U)
+    {
+        fprintf(stderr,
+                "FAIL: Unit holds %u instructions and %u constants.\n",
+                context->engine.instruction_count,
+                context->engine.constant_count);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/// Returns the index held by the source bitfield `field` and its high bits
+/// `extension`, without the is constant flag.
+static uint32_t
+wide_index(uint64_t field, uint64_t extension)
+{
+    return (uint32_t)(field & BAL_SOURCE_MASK)
+           | ((uint32_t)(extension & BAL_SOURCE_EXTENSION_MASK) << 16U);
+}
+
+// A wide unit holds all of the code, and its writeback and exit address
+// indices past 65536.
+//
+static int
+translate_wide(test_context_t *context, const uint32_t *code, size_t size)
+{
+    int          return_code = EXIT_FAILURE;
+    bal_engine_t engine;
+
+    if (bal_engine_init_with_capacity(&context->allocator, &engine, context->logger, WIDE_CAPACITY)
+        != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Could not set up a wide engine.\n");
+        return EXIT_FAILURE;
+    }
+
+    engine.is_wide       = true;
+    engine.guest_address = 0x1000;
+
+    if (bal_engine_translate(&engine, &context->interface, code, size) != BAL_SUCCESS
+        || engine.unit_exit.guest_size != size)
+    {
+        fprintf(stderr, "FAIL: The wide unit was cut or failed.\n");
+        goto end;
+    }
+
+    // The writeback of X0 reads the last CONST, and the exit reads the
+    // constant interned last.
+    //
+    uint32_t count  = engine.instruction_count;
+    uint32_t value  = wide_index(engine.instructions[count - 2U] >> BAL_SOURCE2_SHIFT_POSITION,
+                                engine.source_extensions[count - 2U]
+                                    >> BAL_SOURCE2_EXTENSION_POSITION);
+    uint32_t target = wide_index(engine.instructions[count - 1U] >> BAL_SOURCE1_SHIFT_POSITION,
+                                 engine.source_extensions[count - 1U]
+                                     >> BAL_SOURCE1_EXTENSION_POSITION);
+
+    if (value != count - 3U || target != engine.constant_count - 1U
+        || engine.constants[target] != 0x1000 + size)
+    {
+        fprintf(stderr, "FAIL: The wide unit lost its high source index bits.\n");
+        goto end;
+    }
+
+    return_code = EXIT_SUCCESS;
+
+end:
+    bal_engine_destroy(&context->allocator, &engine);
+    return return_code;
+}
+
+// A unit reaching the IR limit ends early and falls through to the rest,
+// which translates as the next unit.
+//
+static int
+test_unit_limit(test_context_t *context)
+{
+    int             return_code = EXIT_FAILURE;
+    size_t          size        = GUEST_INSTRUCTIONS * sizeof(uint32_t);
+    uint32_t       *code = context->allocator.allocate(context->allocator.handle, 16U, size);
+    bal_assembler_t assembler;
+
+    if (NULL == code
+        || bal_assembler_init(&assembler, code, GUEST_INSTRUCTIONS, context->logger)
+               != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Could not set up the guest code.\n");
+        goto end;
+    }
+
+    for (uint32_t i = 0; i < GUEST_INSTRUCTIONS; ++i)
+    {
+        bal_emit_movz(&assembler, BAL_REGISTER_X0, (uint16_t)i, 0);
+    }
+
+    if (translate(context, code, size, 0x1000) != EXIT_SUCCESS)
+    {
+        goto end;
+    }
+
+    const bal_unit_exit_t *unit_exit = &context->engine.unit_exit;
+    size_t                 cut       = unit_exit->guest_size;
+
+    if (unit_exit->kind != BAL_UNIT_EXIT_FALLTHROUGH || 0 == cut || cut >= size
+        || unit_exit->target != 0x1000 + cut)
+    {
+        fprintf(stderr, "FAIL: The unit was not cut. Guest size: %zu.\n", cut);
+        goto end;
+    }
+
+    if (translate(context, code + cut / sizeof(uint32_t), size - cut, 0x1000 + cut)
+        != EXIT_SUCCESS)
+    {
+        goto end;
+    }
+
+    if (unit_exit->guest_size != size - cut)
+    {
+        fprintf(stderr, "FAIL: The rest of the code was cut again.\n");
+        goto end;
+    }
+
+    if (translate_wide(context, code, size) != EXIT_SUCCESS)
+    {
+        goto end;
+    }
+
+    return_code = EXIT_SUCCESS;
+
+end:
+    if (code != NULL)
+    {
+        context->allocator.free(context->allocator.handle, code, size);
+    }
+
+    return return_code;
+}
+
+BAL_TEST_MAIN(test_unit_limit)
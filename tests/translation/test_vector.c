@@ -0,0 +1,65 @@
+#include "setup.h"
+
+// Vector operations work on the guest register file directly, so the unit
+// ends before the store that follows them and never replays them when the
+// store faults.
+//
+static int
+test_vector(test_context_t *context)
+{
+    static const uint32_t code[] = {
+        0x4EA28420U, // ADD V0.4S, V1.4S, V2.4S
+        0x6E221C21U, // EOR V1.16B, V1.16B, V2.16B
+        0xF9000020U, // STR X0, [X1]
+        0x4EA28423U, // ADD V3.4S, V1.4S, V2.4S
+    };
+
+    (void)memcpy(context->code_buffer, code, sizeof(code));
+
+    bal_error_t error = bal_engine_translate(
+        &context->engine, &context->interface, context->code_buffer, sizeof(code));
+
+    if (error != BAL_SUCCESS)
+    {
+        fprintf(stderr, "FAIL: Translation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t adds   = 0;
+    uint32_t xors   = 0;
+    uint32_t stores = 0;
+
+    for (uint32_t i = 0; i < context->engine.instruction_count; ++i)
+    {
+        bal_opcode_t opcode
+            = (bal_opcode_t)(context->engine.instructions[i] >> BAL_OPCODE_SHIFT_POSITION);
+
+        adds += (OPCODE_VECTOR_ADD == opcode) ? 1U : 0U;
+        xors += (OPCODE_VECTOR_XOR == opcode) ? 1U : 0U;
+        stores += (OPCODE_STORE == opcode) ? 1U : 0U;
+    }
+
+    if (adds != 1 || xors != 1 || stores != 0)
+    {
+        fprintf(stderr,
+                "FAIL: %u vector adds, %u vector xors and %u stores, expected 1, 1 and 0.\n",
+                adds,
+                xors,
+                stores);
+        return EXIT_FAILURE;
+    }
+
+    const bal_unit_exit_t *unit_exit = &context->engine.unit_exit;
+
+    if (unit_exit->kind != BAL_UNIT_EXIT_FALLTHROUGH || unit_exit->guest_size != 8)
+    {
+        fprintf(stderr, "FAIL: The unit was not cut before the store.\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+BAL_TEST_MAIN(test_vector)
+
+/*** end of file ***/